@@ -0,0 +1,369 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef METER_PORT_H
+#define METER_PORT_H
+
+#include "mbed.h"
+#include "rtos.h"
+
+#include "MeterProtocol.h"
+#include "SeoulFrameDecoder.h"
+#include "PstecFrameDecoder.h"
+#include "ModbusRtuDecoder.h"
+#include "ModbusMaster.h"
+#include "UartRxChunker.h"
+#include "SpscByteRing.h"
+#include "UartTxQueue.h"
+#include "PortCounters.h"
+
+// Event flags raised by the UART receive interrupts
+#define UART_FLAG_RX_DATA         (1UL << 0)    // a full chunk was received
+#define UART_FLAG_RX_FRAME_END    (1UL << 1)    // protocol end byte received
+#define UART_FLAG_RX_IDLE         (1UL << 2)    // line went quiet
+#define UART_FLAG_RX_ANY          (UART_FLAG_RX_DATA | UART_FLAG_RX_FRAME_END | UART_FLAG_RX_IDLE)
+
+// Bytes collected in interrupt context before the parser thread is woken
+#define UART_RX_CHUNK_SIZE        32
+// Bytes read from the UART per receive interrupt at most
+#define UART_RX_FIFO_READ         16
+
+// A burst is over when the line stays quiet this many characters,
+// unless the protocol defines its own silence
+#define UART_RX_IDLE_CHARS        20
+#define UART_RX_IDLE_US(baud)     ((UART_RX_IDLE_CHARS * 11 * 1000000UL) / (baud))
+
+/*
+ * Protocol traits of a MeterPort:
+ *   Decoder     a FrameDecoder, or a class with the same interface
+ *   end_byte    byte that wakes the parser thread right away, -1 for none
+ *   idle_us()   silence after which a burst is over
+ *
+ * A gap on the line drops the partial frame the decoder holds. The echo of
+ * a request is a frame of its own, so the time a meter takes to answer is
+ * never a gap inside a frame.
+ */
+struct SeoulProtocol {
+    typedef SeoulFrameDecoder Decoder;
+    static const int end_byte = SEOUL_RESPONSE_ETX;
+
+    static uint32_t idle_us(int baud)
+    {
+        return UART_RX_IDLE_US(baud);
+    }
+};
+
+struct PstecProtocol {
+    typedef PstecFrameDecoder Decoder;
+    static const int end_byte = PSTEC_RESPONSE_ETX;
+
+    static uint32_t idle_us(int baud)
+    {
+        return UART_RX_IDLE_US(baud);
+    }
+};
+
+// Modbus RTU frames end in 3.5 characters of silence, which also wakes the thread
+struct ModbusProtocol {
+    typedef ModbusRtuDecoder<MODBUS_MAX_RESPONSE_LENGTH> Decoder;
+    static const int end_byte = -1;
+
+    static uint32_t idle_us(int baud)
+    {
+        return modbus_t35_us(baud);
+    }
+};
+
+/** What every port has regardless of its protocol and sizes. */
+class MeterPortBase {
+public:
+    explicit MeterPortBase(const char *name) : _name(name) {}
+
+    const char *name() const
+    {
+        return _name;
+    }
+
+    const PortCounters &counters() const
+    {
+        return _counters;
+    }
+
+protected:
+    const char *_name;
+    PortCounters _counters;
+};
+
+/**
+ * One meter UART with its whole receive and transmit path: the serial
+ * driver, the interrupt-side chunker and idle timer, the receive ring, the
+ * transmit queue, the frame decoder and the parser thread with its stack.
+ *
+ * Everything lives inside the object, so a port is one block of known size
+ * that can be placed in a StaticArena; nothing comes from the heap.
+ * Frames go to @p handler on the port's thread, transmit completions to
+ * the event queue.
+ *
+ * With METER_PORT_REACTOR the port has neither thread nor stack. The
+ * receive interrupt collects its reasons in the port's EventFlags and posts
+ * one parser call to the event queue, which is not posted again until that
+ * call ran, so a port never holds more than one event. All ports then parse
+ * on the event queue thread, next to the scheduling and publishing, and
+ * wait behind its flash writes: the receive ring has to cover them.
+ *
+ * @tparam Protocol Traits as SeoulProtocol
+ * @tparam RxSize Receive ring size, a power of two
+ * @tparam TxSize Transmit queue size
+ * @tparam StackSize Parser thread stack size, unused with METER_PORT_REACTOR
+ */
+template <typename Protocol, size_t RxSize, size_t TxSize, size_t StackSize>
+class MeterPort : public MeterPortBase {
+public:
+    typedef typename Protocol::Decoder Decoder;
+
+    /**
+     * @param handler Called with every decoded frame, on the port's thread or
+     *                with METER_PORT_REACTOR on the event queue
+     * @param context Passed back to @p handler
+     * @param events Queue the transmit completions are posted to, and the
+     *               parser calls with METER_PORT_REACTOR
+     * @param activity LED toggled on every received chunk, may be NULL
+     */
+    MeterPort(const char *name, PinName tx, PinName rx, int baud, MeterFrameHandler handler, void *context,
+              EventQueue &events, DigitalOut *activity = NULL)
+        : MeterPortBase(name),
+          _uart(tx, rx, baud),
+          _chunker(&MeterPort::on_chunk, this, Protocol::end_byte, Protocol::idle_us(baud)),
+          _decoder(handler, context),
+          _events(events),
+          _activity(activity)
+#if METER_PORT_REACTOR == 1
+          , _scheduled(false)
+#else
+          , _thread(osPriorityNormal, StackSize, _stack, name)
+#endif
+    {
+    }
+
+    /** Start the parser thread, if any, and the receive interrupt. Call once. */
+    void start()
+    {
+        _decoder.reset();
+        _rx.reset();
+        _tx.reset();
+#if METER_PORT_REACTOR == 1
+#if EVENT_DRIVEN_RX != 1
+        _events.call_every(1000, callback(this, &MeterPort::drain));
+#endif
+#else
+        _thread.start(callback(this, &MeterPort::run));
+#endif
+        _uart.attach(callback(this, &MeterPort::rx_irq), SerialBase::RxIrq);
+    }
+
+    /**
+     * Queue a binary frame and enable the transmit interrupt. Never blocks.
+     * @param done Called on the event queue once the frame was handed to the UART, may be NULL
+     * @return false if the transmit queue is full
+     */
+    bool write(const uint8_t *data, size_t size, UartTxDoneFn done = NULL, void *context = NULL)
+    {
+        if (!_tx.write(data, size, done, context)) {
+            return false;
+        }
+        _uart.attach(callback(this, &MeterPort::tx_irq), SerialBase::TxIrq);
+        return true;
+    }
+
+private:
+    // Runs the received bytes through the decoder, straight out of the ring
+    void drain()
+    {
+        const uint8_t *first;
+        const uint8_t *second;
+        size_t firstSize;
+        size_t secondSize;
+
+        size_t nCount = _rx.peek(first, firstSize, second, secondSize);
+        if (0 == nCount) {
+            return;
+        }
+
+        uint32_t start = us_ticker_read();
+        if (0 < firstSize) {
+            _decoder.feed(first, firstSize);
+        }
+        if (0 < secondSize) {
+            _decoder.feed(second, secondSize);
+        }
+        _rx.commit(nCount);
+
+        _counters.count_parse(us_ticker_read() - start);
+        _counters.update(_decoder.stats());
+    }
+
+    // Parses what was received and ends a frame the line gave up on
+    void process(uint32_t events)
+    {
+        drain();
+        if ((events & UART_FLAG_RX_IDLE) && (0 < _decoder.pending())) {
+            printf("# %s- inter-byte gap, frame dropped\n", _name);
+            _decoder.resync();
+            _counters.update(_decoder.stats());
+        }
+    }
+
+#if METER_PORT_REACTOR == 1
+    // Parser call of the reactor, runs on the event queue
+    void service()
+    {
+        // Reasons raised from here on post the next call
+        _scheduled = false;
+        process(_flags.clear(UART_FLAG_RX_ANY));
+    }
+
+    // Posts the parser call unless one is pending (interrupt context)
+    void schedule()
+    {
+        core_util_critical_section_enter();
+        bool post = !_scheduled;
+        _scheduled = true;
+        core_util_critical_section_exit();
+
+        // A full queue leaves the bytes in the ring for the next chunk
+        if (post && (0 == _events.call(callback(this, &MeterPort::service)))) {
+            _scheduled = false;
+        }
+    }
+#else
+    void run()
+    {
+        while (true) {
+#if EVENT_DRIVEN_RX == 1
+            process(_flags.wait_any(UART_FLAG_RX_ANY));
+#else
+            drain();
+            Thread::wait(1000);
+#endif
+        }
+    }
+#endif
+
+    // Hands a received chunk to the parser (interrupt context)
+    static void on_chunk(void *context, const uint8_t *data, size_t size, RxChunkReason reason)
+    {
+        MeterPort *port = static_cast<MeterPort *>(context);
+
+        size_t queued = port->_rx.push(data, size);
+        port->_counters.count_rx(size, size - queued);
+        port->toggle_activity();
+
+        if (RX_CHUNK_END_BYTE == reason) {
+            port->_flags.set(UART_FLAG_RX_FRAME_END);
+        }
+        else if (RX_CHUNK_IDLE == reason) {
+            port->_flags.set(UART_FLAG_RX_IDLE);
+        }
+        else {
+            port->_flags.set(UART_FLAG_RX_DATA);
+        }
+#if METER_PORT_REACTOR == 1
+        port->schedule();
+#endif
+    }
+
+    void toggle_activity()
+    {
+        if (NULL != _activity) {
+            *_activity = !*_activity;
+        }
+    }
+
+    // Reads everything the UART holds in one receive interrupt
+    void rx_irq()
+    {
+#if EVENT_DRIVEN_RX == 1
+        uint8_t fifo[UART_RX_FIFO_READ];
+        size_t nCount = 0;
+        while ((nCount < sizeof(fifo)) && _uart.readable()) {
+            fifo[nCount++] = (uint8_t)_uart.getc();
+        }
+        if (_chunker.receive(fifo, nCount, us_ticker_read())) {
+            _idle.attach_us(callback(this, &MeterPort::idle_irq), _chunker.idle_time());
+        }
+#else
+        uint8_t ch = (uint8_t)_uart.getc();
+        _counters.count_rx(1, _rx.push(ch) ? 0 : 1);
+        toggle_activity();
+#endif
+    }
+
+    // Idle timer expiry of the receive path
+    void idle_irq()
+    {
+        // Must not interleave with the receive interrupt
+        core_util_critical_section_enter();
+        uint32_t next = _chunker.poll(us_ticker_read());
+        core_util_critical_section_exit();
+
+        if (0 < next) {
+            _idle.attach_us(callback(this, &MeterPort::idle_irq), next);
+        }
+    }
+
+    // Feeds the UART from the transmit queue, completions go to the event queue
+    void tx_irq()
+    {
+        while (_uart.writeable()) {
+            uint8_t ch;
+            UartTxCompletion completion;
+
+            if (!_tx.next(ch, completion)) {
+                _uart.attach(NULL, SerialBase::TxIrq);
+                return;
+            }
+            _uart.putc(ch);
+
+            if (NULL != completion.done) {
+                _events.call(completion.done, completion.context);
+            }
+        }
+    }
+
+    RawSerial _uart;
+    Timeout _idle;
+    EventFlags _flags;
+
+    // Filled by the receive interrupt, drained by the parser thread
+    UartRxChunker<UART_RX_CHUNK_SIZE> _chunker;
+    SpscByteRing<RxSize> _rx;
+
+    // Filled by the event queue thread, drained by the transmit interrupt
+    UartTxQueue<TxSize> _tx;
+
+    Decoder _decoder;
+    EventQueue &_events;
+    DigitalOut *_activity;
+
+#if METER_PORT_REACTOR == 1
+    volatile bool _scheduled;   // a service() call is queued
+#else
+    // The stack comes before the thread that is constructed on it
+    alignas(8) unsigned char _stack[StackSize];
+    Thread _thread;
+#endif
+};
+
+#endif /* METER_PORT_H */
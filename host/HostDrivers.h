@@ -0,0 +1,420 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_DRIVERS_H
+#define HOST_DRIVERS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "HostPlatform.h"
+
+/** Pins used by the application; they only name things on the host. */
+enum PinName {
+    PA_2, PA_3, PC_0, PC_1, PC_4, PC_5,
+    LED1, LED2, BUTTON1, A1, D7, D9,
+    NC = -1
+};
+
+namespace mbed {
+
+class SerialBase {
+public:
+    enum IrqType {
+        RxIrq = 0,
+        TxIrq,
+        IrqCnt
+    };
+};
+
+class Serial : public SerialBase {
+};
+
+/**
+ * RawSerial on a pseudo-terminal.
+ *
+ * The n-th port created gets the symlink "uart<n>" in the working
+ * directory, so uart1 is the Seoul water meter bus, uart2 the PSTEC bus and
+ * uart3 the power meter, in the order main.cpp declares them. A meter
+ * emulator opens the link like a serial port and sets the line timing.
+ *
+ * A reader thread stands in for the receive interrupt: it calls the RxIrq
+ * handler while bytes are waiting. The TxIrq handler is called on a second
+ * thread as long as it stays attached; the line never stalls, so it always
+ * finds the port writeable. Both hold host_irq_lock().
+ */
+class RawSerial : public SerialBase {
+public:
+    RawSerial(PinName tx, PinName rx, int baud = 9600) : _baud(baud), _master(-1), _slave(-1), _tx_pending(false)
+    {
+        static int ports = 0;
+        char link[16];
+
+        (void)tx;
+        (void)rx;
+        snprintf(link, sizeof(link), "uart%d", ++ports);
+
+        _master = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((0 > _master) || (0 != grantpt(_master)) || (0 != unlockpt(_master))) {
+            printf("[host] %s: no pseudo-terminal (%d)\n", link, errno);
+            return;
+        }
+
+        // Holding the slave open keeps reads from failing while no emulator is attached
+        _slave = open(ptsname(_master), O_RDWR | O_NOCTTY);
+        if (0 <= _slave) {
+            struct termios tio;
+            tcgetattr(_slave, &tio);
+            cfmakeraw(&tio);
+            tcsetattr(_slave, TCSANOW, &tio);
+        }
+
+        unlink(link);
+        if (0 != symlink(ptsname(_master), link)) {
+            printf("[host] %s: cannot link %s (%d)\n", link, ptsname(_master), errno);
+        }
+
+        std::thread(&RawSerial::receive, this).detach();
+        std::thread(&RawSerial::transmit, this).detach();
+    }
+
+    void baud(int baudrate)
+    {
+        _baud = baudrate;
+    }
+
+    void attach(Callback<void()> func, IrqType type = RxIrq)
+    {
+        std::lock_guard<std::recursive_mutex> irq(host_irq_lock());
+
+        _irq[type] = func;
+        if ((TxIrq == type) && func) {
+            std::lock_guard<std::mutex> lock(_tx_mutex);
+            _tx_pending = true;
+            _tx_ready.notify_one();
+        }
+    }
+
+    bool readable()
+    {
+        std::lock_guard<std::recursive_mutex> irq(host_irq_lock());
+        return !_rx.empty();
+    }
+
+    bool writeable()
+    {
+        return true;
+    }
+
+    int getc()
+    {
+        std::lock_guard<std::recursive_mutex> irq(host_irq_lock());
+
+        if (_rx.empty()) {
+            return -1;
+        }
+        int ch = _rx.front();
+        _rx.pop_front();
+        return ch;
+    }
+
+    int putc(int c)
+    {
+        uint8_t ch = (uint8_t)c;
+        return (1 == write(_master, &ch, 1)) ? c : -1;
+    }
+
+private:
+    void receive()
+    {
+        uint8_t data[64];
+
+        while (true) {
+            ssize_t n = read(_master, data, sizeof(data));
+            if (0 >= n) {
+                wait_ms(10);
+                continue;
+            }
+
+            std::lock_guard<std::recursive_mutex> irq(host_irq_lock());
+            _rx.insert(_rx.end(), data, data + n);
+
+            // Like a level-triggered interrupt: fire until the FIFO is drained
+            while (!_rx.empty() && _irq[RxIrq]) {
+                size_t before = _rx.size();
+                _irq[RxIrq]();
+                if (before == _rx.size()) {
+                    break;
+                }
+            }
+        }
+    }
+
+    void transmit()
+    {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(_tx_mutex);
+                _tx_ready.wait(lock, [this]() { return _tx_pending; });
+                _tx_pending = false;
+            }
+
+            std::lock_guard<std::recursive_mutex> irq(host_irq_lock());
+            while (_irq[TxIrq]) {
+                _irq[TxIrq]();
+            }
+        }
+    }
+
+    int _baud;
+    int _master;
+    int _slave;
+
+    Callback<void()> _irq[IrqCnt];
+    std::deque<uint8_t> _rx;
+
+    std::mutex _tx_mutex;
+    std::condition_variable _tx_ready;
+    bool _tx_pending;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin, int value = 0) : _value(value)
+    {
+        (void)pin;
+    }
+
+    void write(int value)
+    {
+        _value = value;
+    }
+
+    int read()
+    {
+        return _value;
+    }
+
+    DigitalOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    volatile int _value;
+};
+
+/** A button that is never pressed. */
+class InterruptIn {
+public:
+    InterruptIn(PinName pin)
+    {
+        (void)pin;
+    }
+
+    int read()
+    {
+#ifdef MBED_CONF_APP_BUTTON_PRESSED_STATE
+        return !MBED_CONF_APP_BUTTON_PRESSED_STATE;
+#else
+        return 1;
+#endif
+    }
+
+    void fall(Callback<void()> func)
+    {
+        _fall = func;
+    }
+
+    void rise(Callback<void()> func)
+    {
+        _rise = func;
+    }
+
+private:
+    Callback<void()> _fall;
+    Callback<void()> _rise;
+};
+
+/**
+ * Ticker on its own thread. The handler runs holding host_irq_lock(), like
+ * a timer interrupt; attaching again from inside the handler re-arms it.
+ */
+class Ticker {
+public:
+    Ticker() : _one_shot(false), _armed(false), _stop(false), _due_us(0), _period_us(0)
+    {
+        _thread = std::thread(&Ticker::run, this);
+    }
+
+    virtual ~Ticker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+            _changed.notify_all();
+        }
+        _thread.join();
+    }
+
+    void attach(Callback<void()> func, float t)
+    {
+        attach_us(func, (uint64_t)(t * 1000000.0f));
+    }
+
+    void attach_us(Callback<void()> func, uint64_t t)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _func = func;
+        _period_us = t;
+        _due_us = host_time_us() + t;
+        _armed = true;
+        _changed.notify_all();
+    }
+
+    void detach()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _armed = false;
+        _changed.notify_all();
+    }
+
+protected:
+    explicit Ticker(bool oneShot) : _one_shot(oneShot), _armed(false), _stop(false), _due_us(0), _period_us(0)
+    {
+        _thread = std::thread(&Ticker::run, this);
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (!_stop) {
+            uint64_t now = host_time_us();
+            if (!_armed) {
+                _changed.wait(lock);
+                continue;
+            }
+            if (now < _due_us) {
+                _changed.wait_for(lock, std::chrono::microseconds(_due_us - now));
+                continue;
+            }
+
+            // Lock order as in the handlers: interrupt lock first
+            lock.unlock();
+            std::lock_guard<std::recursive_mutex> irq(host_irq_lock());
+            lock.lock();
+            if (!_armed || (host_time_us() < _due_us)) {
+                continue;   // detached or re-armed meanwhile
+            }
+
+            Callback<void()> func = _func;
+            if (_one_shot) {
+                _armed = false;
+            }
+            else {
+                _due_us += _period_us;
+            }
+
+            lock.unlock();
+            func();
+            lock.lock();
+        }
+    }
+
+    bool _one_shot;
+    bool _armed;
+    bool _stop;
+    uint64_t _due_us;
+    uint64_t _period_us;
+    Callback<void()> _func;
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::thread _thread;
+};
+
+class Timeout : public Ticker {
+public:
+    Timeout() : Ticker(true) {}
+};
+
+class Timer {
+public:
+    Timer() : _running(false), _start_us(0), _elapsed_us(0) {}
+
+    void start()
+    {
+        if (!_running) {
+            _start_us = host_time_us();
+            _running = true;
+        }
+    }
+
+    void stop()
+    {
+        _elapsed_us = read_high_resolution_us();
+        _running = false;
+    }
+
+    void reset()
+    {
+        _start_us = host_time_us();
+        _elapsed_us = 0;
+    }
+
+    uint64_t read_high_resolution_us()
+    {
+        return _elapsed_us + (_running ? (host_time_us() - _start_us) : 0);
+    }
+
+    int read_us()
+    {
+        return (int)read_high_resolution_us();
+    }
+
+    int read_ms()
+    {
+        return (int)(read_high_resolution_us() / 1000);
+    }
+
+    float read()
+    {
+        return read_high_resolution_us() / 1000000.0f;
+    }
+
+private:
+    bool _running;
+    uint64_t _start_us;
+    uint64_t _elapsed_us;
+};
+
+} // namespace mbed
+
+#endif /* HOST_DRIVERS_H */
@@ -0,0 +1,163 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_EVENTS_H
+#define HOST_EVENTS_H
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include "HostPlatform.h"
+
+namespace events {
+
+/**
+ * Host stand-in for events::EventQueue.
+ *
+ * Events are kept in a map ordered by due time and run by the thread that
+ * dispatches the queue, one at a time. Posting is thread safe and never
+ * fails; the size given to the constructor is ignored.
+ */
+class EventQueue {
+public:
+    EventQueue(unsigned size = 0, unsigned char *buffer = NULL) : _next_id(1), _running_id(0), _break(false)
+    {
+        (void)size;
+        (void)buffer;
+    }
+
+    template <typename F, typename... A>
+    int call(F func, A... args)
+    {
+        return post(0, 0, std::bind(func, args...));
+    }
+
+    template <typename F, typename... A>
+    int call_in(int ms, F func, A... args)
+    {
+        return post(ms, 0, std::bind(func, args...));
+    }
+
+    template <typename F, typename... A>
+    int call_every(int ms, F func, A... args)
+    {
+        return post(ms, ms, std::bind(func, args...));
+    }
+
+    /** A callback that posts @p func to this queue, for interrupt handlers. */
+    template <typename F>
+    mbed::Callback<void()> event(F func)
+    {
+        return mbed::Callback<void()>([this, func]() { call(func); });
+    }
+
+    void cancel(int id)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (id == _running_id) {
+            _running_id = 0;
+        }
+        for (auto it = _events.begin(); it != _events.end(); ++it) {
+            if (id == it->second.id) {
+                _events.erase(it);
+                break;
+            }
+        }
+    }
+
+    void dispatch_forever()
+    {
+        dispatch(-1);
+    }
+
+    /** Run events for @p ms milliseconds, or until break_dispatch() if negative. */
+    void dispatch(int ms = -1)
+    {
+        uint64_t until = host_time_us() + (uint64_t)ms * 1000;
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _break = false;
+        while (!_break) {
+            uint64_t now = host_time_us();
+            if ((0 <= ms) && (now >= until)) {
+                break;
+            }
+            if (_events.empty() || (_events.begin()->first > now)) {
+                uint64_t wake = _events.empty() ? until : _events.begin()->first;
+                if ((0 > ms) && _events.empty()) {
+                    _changed.wait(lock);
+                }
+                else {
+                    _changed.wait_for(lock, std::chrono::microseconds(wake - now));
+                }
+                continue;
+            }
+
+            Event event = _events.begin()->second;
+            _events.erase(_events.begin());
+            _running_id = event.id;
+
+            lock.unlock();
+            event.func();
+            lock.lock();
+
+            // Periodic events stay on the queue unless cancelled meanwhile
+            if ((0 < event.period_ms) && (event.id == _running_id)) {
+                _events.insert(std::make_pair(now + event.period_ms * 1000ULL, event));
+            }
+            _running_id = 0;
+        }
+    }
+
+    void break_dispatch()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _break = true;
+        _changed.notify_all();
+    }
+
+private:
+    struct Event {
+        int id;
+        uint32_t period_ms;
+        std::function<void()> func;
+    };
+
+    int post(int delayMs, int periodMs, std::function<void()> func)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Event event = { _next_id, (uint32_t)periodMs, func };
+
+        // Ids are never 0, callers use 0 for "no event"
+        _next_id = (0x7FFFFFFF == _next_id) ? 1 : (_next_id + 1);
+        _events.insert(std::make_pair(host_time_us() + (uint64_t)delayMs * 1000, event));
+        _changed.notify_all();
+        return event.id;
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::multimap<uint64_t, Event> _events;
+    int _next_id;
+    int _running_id;
+    bool _break;
+};
+
+} // namespace events
+
+#endif /* HOST_EVENTS_H */
@@ -0,0 +1,200 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_NETWORK_H
+#define HOST_NETWORK_H
+
+#include <netdb.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+typedef int nsapi_error_t;
+typedef int nsapi_size_or_error_t;
+typedef unsigned int nsapi_size_t;
+
+#define NSAPI_ERROR_OK              0
+#define NSAPI_ERROR_WOULD_BLOCK     -3001
+#define NSAPI_ERROR_NO_SOCKET       -3005
+#define NSAPI_ERROR_NO_CONNECTION   -3004
+#define NSAPI_ERROR_DNS_FAILURE     -3009
+#define NSAPI_ERROR_DEVICE_ERROR    -3012
+
+enum nsapi_connection_status_t {
+    NSAPI_STATUS_LOCAL_UP = 0,
+    NSAPI_STATUS_GLOBAL_UP = 1,
+    NSAPI_STATUS_DISCONNECTED = 2,
+    NSAPI_STATUS_CONNECTING = 3,
+    NSAPI_STATUS_ERROR_UNSUPPORTED = -3002
+};
+
+/** IPv4 address and port, as the socket calls take it. */
+class SocketAddress {
+public:
+    SocketAddress() : _port(0)
+    {
+        memset(&_address, 0, sizeof(_address));
+    }
+
+    void set_port(uint16_t port)
+    {
+        _port = port;
+    }
+
+    uint16_t get_port() const
+    {
+        return _port;
+    }
+
+    sockaddr_in sockaddr() const
+    {
+        sockaddr_in address = _address;
+        address.sin_port = htons(_port);
+        return address;
+    }
+
+    void set_sockaddr(const sockaddr_in &address)
+    {
+        _address = address;
+        _port = ntohs(address.sin_port);
+    }
+
+private:
+    sockaddr_in _address;
+    uint16_t _port;
+};
+
+/** A network that is always there once connected, on the host's own sockets. */
+class NetworkInterface {
+public:
+    NetworkInterface() : _status(NSAPI_STATUS_DISCONNECTED) {}
+    virtual ~NetworkInterface() {}
+
+    static NetworkInterface *get_default_instance()
+    {
+        static NetworkInterface loopback;
+        return &loopback;
+    }
+
+    virtual nsapi_error_t connect()
+    {
+        _status = NSAPI_STATUS_GLOBAL_UP;
+        return NSAPI_ERROR_OK;
+    }
+
+    virtual nsapi_error_t disconnect()
+    {
+        _status = NSAPI_STATUS_DISCONNECTED;
+        return NSAPI_ERROR_OK;
+    }
+
+    virtual const char *get_ip_address()
+    {
+        return "127.0.0.1";
+    }
+
+    virtual nsapi_connection_status_t get_connection_status() const
+    {
+        return _status;
+    }
+
+    virtual nsapi_error_t gethostbyname(const char *host, SocketAddress *address)
+    {
+        addrinfo hints;
+        addrinfo *found = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if ((0 != getaddrinfo(host, NULL, &hints, &found)) || (NULL == found)) {
+            return NSAPI_ERROR_DNS_FAILURE;
+        }
+        uint16_t port = address->get_port();
+        address->set_sockaddr(*(const sockaddr_in *)found->ai_addr);
+        address->set_port(port);
+        freeaddrinfo(found);
+        return NSAPI_ERROR_OK;
+    }
+
+private:
+    volatile nsapi_connection_status_t _status;
+};
+
+/** Blocking UDP socket with a receive timeout. */
+class UDPSocket {
+public:
+    UDPSocket() : _fd(-1), _timeout_ms(-1) {}
+
+    ~UDPSocket()
+    {
+        close();
+    }
+
+    nsapi_error_t open(NetworkInterface *)
+    {
+        _fd = socket(AF_INET, SOCK_DGRAM, 0);
+        return (0 > _fd) ? NSAPI_ERROR_NO_SOCKET : NSAPI_ERROR_OK;
+    }
+
+    nsapi_error_t close()
+    {
+        if (0 <= _fd) {
+            ::close(_fd);
+            _fd = -1;
+        }
+        return NSAPI_ERROR_OK;
+    }
+
+    void set_timeout(int timeout_ms)
+    {
+        _timeout_ms = timeout_ms;
+    }
+
+    nsapi_size_or_error_t sendto(const SocketAddress &address, const void *data, nsapi_size_t size)
+    {
+        sockaddr_in to = address.sockaddr();
+        ssize_t sent = ::sendto(_fd, data, size, 0, (const sockaddr *)&to, sizeof(to));
+        return (0 > sent) ? NSAPI_ERROR_DEVICE_ERROR : (nsapi_size_or_error_t)sent;
+    }
+
+    nsapi_size_or_error_t recvfrom(SocketAddress *address, void *data, nsapi_size_t size)
+    {
+        timeval timeout = { 0, 0 };
+        if (0 <= _timeout_ms) {
+            timeout.tv_sec = _timeout_ms / 1000;
+            timeout.tv_usec = (_timeout_ms % 1000) * 1000;
+        }
+        setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        sockaddr_in from;
+        socklen_t length = sizeof(from);
+        ssize_t received = ::recvfrom(_fd, data, size, 0, (sockaddr *)&from, &length);
+        if (0 > received) {
+            return NSAPI_ERROR_WOULD_BLOCK;
+        }
+        if (NULL != address) {
+            address->set_sockaddr(from);
+        }
+        return (nsapi_size_or_error_t)received;
+    }
+
+private:
+    int _fd;
+    int _timeout_ms;
+};
+
+#endif /* HOST_NETWORK_H */
@@ -0,0 +1,147 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_PLATFORM_H
+#define HOST_PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+/*
+ * Host stand-ins for the Mbed OS platform layer: Callback, the critical
+ * section and the microsecond ticker.
+ *
+ * Interrupt handlers of the host drivers run on their own threads while
+ * holding the one recursive "interrupt" lock that the critical section
+ * takes, so handlers never interleave with each other or with code that
+ * disables interrupts, as on the target.
+ */
+
+#define MBED_ASSERT(expr)               ((expr) ? (void)0 : abort())
+#define MBED_STATIC_ASSERT(expr, msg)   static_assert(expr, msg)
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+/** Function, member function or functor, like mbed::Callback. */
+template <typename R, typename... A>
+class Callback<R(A...)> {
+public:
+    Callback() {}
+
+    Callback(R (*func)(A...))
+    {
+        if (NULL != func) {
+            _func = func;
+        }
+    }
+
+    template <typename T, typename M>
+    Callback(T *obj, M method) : _func([obj, method](A... args) { return (obj->*method)(args...); }) {}
+
+    template <typename F, typename std::enable_if<std::is_class<F>::value, int>::type = 0>
+    Callback(F func) : _func(func) {}
+
+    R operator()(A... args) const
+    {
+        return _func(args...);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+private:
+    std::function<R(A...)> _func;
+};
+
+template <typename R, typename... A>
+Callback<R(A...)> callback(R (*func)(A...))
+{
+    return Callback<R(A...)>(func);
+}
+
+template <typename T, typename R, typename... A>
+Callback<R(A...)> callback(T *obj, R (T::*method)(A...))
+{
+    return Callback<R(A...)>(obj, method);
+}
+
+} // namespace mbed
+
+/** The lock held by every simulated interrupt handler. */
+inline std::recursive_mutex &host_irq_lock()
+{
+    static std::recursive_mutex lock;
+    return lock;
+}
+
+inline void core_util_critical_section_enter()
+{
+    host_irq_lock().lock();
+}
+
+inline void core_util_critical_section_exit()
+{
+    host_irq_lock().unlock();
+}
+
+/** Microseconds since the program started. */
+inline uint64_t host_time_us()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline uint32_t us_ticker_read()
+{
+    return (uint32_t)host_time_us();
+}
+
+/** The PC clock is the real-time clock; it is already set. */
+inline void set_time(time_t t)
+{
+    printf("[host] set_time(%ld), %ld s from the PC clock\n", (long)t, (long)(t - time(NULL)));
+}
+
+inline void wait_us(int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+inline void wait_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void wait(float s)
+{
+    wait_us((int)(s * 1000000.0f));
+}
+
+#endif /* HOST_PLATFORM_H */
@@ -0,0 +1,166 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_RTOS_H
+#define HOST_RTOS_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "HostPlatform.h"
+
+/*
+ * Host stand-ins for the Mbed OS RTOS API on std::thread. Priorities and
+ * stack sizes are accepted and ignored.
+ */
+
+#define osWaitForever           0xFFFFFFFFU
+#define osFlagsError            0x80000000U
+#define osFlagsErrorTimeout     0xFFFFFFFEU
+#define osOK                    0
+
+typedef int32_t osStatus;
+
+enum osPriority {
+    osPriorityIdle,
+    osPriorityLow,
+    osPriorityBelowNormal,
+    osPriorityNormal,
+    osPriorityAboveNormal,
+    osPriorityHigh,
+    osPriorityRealtime
+};
+
+namespace rtos {
+
+class Kernel {
+public:
+    static uint64_t get_ms_count()
+    {
+        return host_time_us() / 1000;
+    }
+};
+
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stackSize = 0, unsigned char *stackMem = NULL,
+           const char *name = NULL)
+    {
+        (void)priority;
+        (void)stackSize;
+        (void)stackMem;
+        (void)name;
+    }
+
+    /** Runs @p task on a detached std::thread; threads live until exit. */
+    osStatus start(mbed::Callback<void()> task)
+    {
+        std::thread(task).detach();
+        return osOK;
+    }
+
+    static osStatus wait(uint32_t millisec)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(millisec));
+        return osOK;
+    }
+};
+
+class EventFlags {
+public:
+    EventFlags() : _flags(0) {}
+
+    uint32_t set(uint32_t flags)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flags |= flags;
+        _changed.notify_all();
+        return _flags;
+    }
+
+    uint32_t clear(uint32_t flags = 0x7FFFFFFF)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint32_t previous = _flags;
+        _flags &= ~flags;
+        return previous;
+    }
+
+    uint32_t get() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _flags;
+    }
+
+    uint32_t wait_any(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true)
+    {
+        return wait_for(flags, millisec, clear, false);
+    }
+
+    uint32_t wait_all(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true)
+    {
+        return wait_for(flags, millisec, clear, true);
+    }
+
+private:
+    uint32_t wait_for(uint32_t flags, uint32_t millisec, bool clear, bool all)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto ready = [&]() { return all ? ((_flags & flags) == flags) : (0 != (_flags & flags)); };
+
+        if (osWaitForever == millisec) {
+            _changed.wait(lock, ready);
+        }
+        else if (!_changed.wait_for(lock, std::chrono::milliseconds(millisec), ready)) {
+            return osFlagsErrorTimeout;
+        }
+
+        uint32_t result = _flags;
+        if (clear) {
+            _flags &= ~flags;
+        }
+        return result;
+    }
+
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    uint32_t _flags;
+};
+
+class Mutex {
+public:
+    void lock()
+    {
+        _mutex.lock();
+    }
+
+    bool trylock()
+    {
+        return _mutex.try_lock();
+    }
+
+    void unlock()
+    {
+        _mutex.unlock();
+    }
+
+private:
+    std::recursive_mutex _mutex;
+};
+
+} // namespace rtos
+
+#endif /* HOST_RTOS_H */
@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_STORAGE_H
+#define HOST_STORAGE_H
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+// Directory that holds the mounted file systems of the host build
+#ifndef HOST_FS_ROOT
+#define HOST_FS_ROOT "host-fs"
+#endif
+
+namespace mbed {
+
+/** Stands for the flash of the board; the host file systems do not use it. */
+class BlockDevice {
+public:
+    virtual ~BlockDevice() {}
+
+    static BlockDevice *get_default_instance()
+    {
+        static BlockDevice flash;
+        return &flash;
+    }
+};
+
+class SlicingBlockDevice : public BlockDevice {
+public:
+    SlicingBlockDevice(BlockDevice *bd, uint64_t start, uint64_t end)
+    {
+        (void)bd;
+        (void)start;
+        (void)end;
+    }
+};
+
+/**
+ * A file system mounted as the host directory HOST_FS_ROOT/<name>.
+ *
+ * The application reaches its files through stdio, so a plain directory
+ * behaves like the mounted partition. reformat() empties the directory.
+ */
+class FileSystem {
+public:
+    explicit FileSystem(const char *name)
+    {
+        snprintf(_path, sizeof(_path), "%s/%s", HOST_FS_ROOT, name);
+    }
+
+    virtual ~FileSystem() {}
+
+    virtual int mount(BlockDevice *bd)
+    {
+        (void)bd;
+        mkdir(HOST_FS_ROOT, 0777);
+        if ((0 != mkdir(_path, 0777)) && (EEXIST != errno)) {
+            return -errno;
+        }
+        return 0;
+    }
+
+    virtual int unmount()
+    {
+        return 0;
+    }
+
+    virtual int reformat(BlockDevice *bd)
+    {
+        nftw(_path, &remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return mount(bd);
+    }
+
+    const char *getName() const
+    {
+        return _path;
+    }
+
+private:
+    static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+    {
+        (void)sb;
+        (void)flag;
+        (void)ftw;
+        return remove(path);
+    }
+
+    char _path[128];
+};
+
+} // namespace mbed
+
+#endif /* HOST_STORAGE_H */
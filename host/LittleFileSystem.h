@@ -0,0 +1,32 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef LITTLE_FILE_SYSTEM_H
+#define LITTLE_FILE_SYSTEM_H
+
+#include "mbed.h"
+
+/** Host stand-in, see mbed::FileSystem in HostStorage.h. */
+class LittleFileSystem : public mbed::FileSystem {
+public:
+    LittleFileSystem(const char *name = NULL, mbed::BlockDevice *bd = NULL) : mbed::FileSystem(name ? name : "fs")
+    {
+        if (NULL != bd) {
+            mount(bd);
+        }
+    }
+};
+
+#endif /* LITTLE_FILE_SYSTEM_H */
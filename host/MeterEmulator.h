@@ -0,0 +1,585 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef METER_EMULATOR_H
+#define METER_EMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "MeterProtocol.h"
+
+#define METER_EMULATOR_MAX_SCHEDULE     512
+#define METER_EMULATOR_MAX_REQUEST      8
+#define METER_EMULATOR_MAX_RESPONSE     32
+#define METER_EMULATOR_MAX_METERS       4
+
+/** What goes wrong on the line, as probabilities per response. */
+struct LineFaults {
+    float no_answer;            // the meter stays silent
+    float truncate;             // the response stops early
+    float bad_checksum;         // checksum byte wrong
+    float noise;                // per byte: one bit flipped
+    float garbage;              // 1-8 random bytes before the response
+    float delay;                // the response comes delay_ms late
+    uint32_t delay_ms;
+    uint32_t gap_us;            // extra inter-byte time, uniform 0..gap_us
+    uint32_t seed;
+};
+
+/** Counters of an emulator. */
+struct MeterEmulatorStats {
+    uint32_t requests;          // valid requests received
+    uint32_t bad_requests;      // framing or checksum wrong
+    uint32_t answered;          // complete, undamaged responses
+    uint32_t silent;
+    uint32_t truncated;
+    uint32_t bad_checksums;
+    uint32_t noisy;             // responses with at least one flipped bit
+    uint32_t garbage;
+    uint32_t delayed;
+};
+
+/**
+ * Byte-accurate emulator of a meter bus.
+ *
+ * Request bytes are fed in as the gateway sends them. When a request is
+ * complete, the response is scheduled byte by byte on a microsecond clock:
+ * it starts after the meter's turnaround time and every byte takes one
+ * character time at the bus speed (11 bits, 8E1) plus the configured
+ * inter-byte jitter. Faults from LineFaults are drawn per response from a
+ * seeded generator, so a run can be repeated exactly.
+ *
+ * The receiving side pulls the bytes with next() once their time has come.
+ */
+class MeterEmulator {
+public:
+    MeterEmulator(uint32_t baud, uint32_t turnaroundUs, const LineFaults &faults)
+        : _char_us((11 * 1000000UL) / baud), _turnaround_us(turnaroundUs), _faults(faults),
+          _random(faults.seed ? faults.seed : 1), _request_length(0), _head(0), _count(0), _last_us(0)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    virtual ~MeterEmulator() {}
+
+    /** Take bytes sent by the gateway; the last one is on the line at @p nowUs. */
+    void receive(const uint8_t *data, size_t size, uint64_t nowUs)
+    {
+        for (size_t i = 0; i < size; i++) {
+            if (_request_length >= sizeof(_request)) {
+                _request_length = 0;
+            }
+            _request[_request_length++] = data[i];
+
+            size_t used = 0;
+            if (request(_request, _request_length, nowUs, used)) {
+                _request_length = 0;
+            }
+            else if (0 < used) {
+                memmove(_request, _request + used, _request_length - used);
+                _request_length -= used;
+            }
+        }
+    }
+
+    /** true if a byte is scheduled; @p atUs is when it is completely received. */
+    bool peek(uint64_t &atUs) const
+    {
+        if (0 == _count) {
+            return false;
+        }
+        atUs = _schedule[_head].at_us;
+        return true;
+    }
+
+    /** Take the next byte if it has been received by @p nowUs. */
+    bool next(uint64_t nowUs, uint8_t &byte, uint64_t &atUs)
+    {
+        if ((0 == _count) || (_schedule[_head].at_us > nowUs)) {
+            return false;
+        }
+        byte = _schedule[_head].byte;
+        atUs = _schedule[_head].at_us;
+        _head = (_head + 1) % METER_EMULATOR_MAX_SCHEDULE;
+        _count--;
+        return true;
+    }
+
+    uint32_t char_time() const
+    {
+        return _char_us;
+    }
+
+    const MeterEmulatorStats &stats() const
+    {
+        return _stats;
+    }
+
+protected:
+    /**
+     * Check the request bytes collected so far.
+     * @param used Set to the number of leading bytes to drop when not complete
+     * @return true if a complete request was handled
+     */
+    virtual bool request(const uint8_t *data, size_t length, uint64_t nowUs, size_t &used) = 0;
+
+    /** Put bytes on the line right away, like the echo of a request. */
+    void echo(const uint8_t *data, size_t length, uint64_t nowUs)
+    {
+        uint64_t at = nowUs;
+        for (size_t i = 0; i < length; i++) {
+            at += (0 == i) ? 0 : _char_us;
+            push(data[i], at);
+        }
+    }
+
+    /** Schedule a response frame and apply the faults. */
+    void respond(uint8_t *frame, size_t length, size_t checksumIndex, uint64_t nowUs)
+    {
+        if (chance(_faults.no_answer)) {
+            _stats.silent++;
+            return;
+        }
+
+        bool damaged = false;
+        uint64_t at = ((_last_us > nowUs) ? _last_us : nowUs) + _turnaround_us;
+
+        if (chance(_faults.delay)) {
+            _stats.delayed++;
+            at += (uint64_t)_faults.delay_ms * 1000;
+        }
+        if (chance(_faults.garbage)) {
+            _stats.garbage++;
+            for (uint32_t n = 1 + (random() % 8); 0 < n; n--) {
+                at += _char_us;
+                push((uint8_t)random(), at);
+            }
+        }
+        if (chance(_faults.bad_checksum)) {
+            _stats.bad_checksums++;
+            frame[checksumIndex] ^= 0x01;
+            damaged = true;
+        }
+        if (chance(_faults.truncate)) {
+            _stats.truncated++;
+            length = 1 + (random() % (length - 1));
+            damaged = true;
+        }
+
+        bool noisy = false;
+        for (size_t i = 0; i < length; i++) {
+            uint8_t byte = frame[i];
+            if (chance(_faults.noise)) {
+                byte ^= (uint8_t)(1 << (random() % 8));
+                noisy = true;
+            }
+            at += _char_us + ((0 < _faults.gap_us) ? (random() % (_faults.gap_us + 1)) : 0);
+            push(byte, at);
+        }
+
+        if (noisy) {
+            _stats.noisy++;
+        }
+        else if (!damaged) {
+            _stats.answered++;
+        }
+    }
+
+    uint32_t random()
+    {
+        // xorshift32
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        return _random;
+    }
+
+    bool chance(float probability)
+    {
+        return (0.0f < probability) && ((random() % 1000000) < (uint32_t)(probability * 1000000.0f));
+    }
+
+    MeterEmulatorStats _stats;
+
+private:
+    struct Scheduled {
+        uint64_t at_us;
+        uint8_t byte;
+    };
+
+    void push(uint8_t byte, uint64_t atUs)
+    {
+        if (METER_EMULATOR_MAX_SCHEDULE <= _count) {
+            return;
+        }
+        _schedule[(_head + _count) % METER_EMULATOR_MAX_SCHEDULE] = Scheduled { atUs, byte };
+        _count++;
+        _last_us = atUs;
+    }
+
+    uint32_t _char_us;
+    uint32_t _turnaround_us;
+    LineFaults _faults;
+    uint32_t _random;
+
+    uint8_t _request[METER_EMULATOR_MAX_REQUEST];
+    size_t _request_length;
+
+    Scheduled _schedule[METER_EMULATOR_MAX_SCHEDULE];
+    size_t _head;
+    size_t _count;
+    uint64_t _last_us;
+};
+
+/**
+ * Seoul water meter: answers 0x10 0x5B 0x01 CS 0x16 with an M-Bus long
+ * frame, CI 0x78, that carries these records:
+ *   0C 78  fabrication number, 8 BCD digits
+ *   0C 13  volume in litres, 8 BCD digits; byte 15 of the frame
+ *   4C 13  volume at the last due date, storage 1
+ *   42 6C  that due date, type G
+ *   02 FD 17  error flags
+ * Every answered request adds @p litresPerRead.
+ */
+class SeoulMeterEmulator : public MeterEmulator {
+public:
+    SeoulMeterEmulator(const LineFaults &faults, uint32_t litres = 123456, uint32_t litresPerRead = 7,
+                       uint32_t baud = 1200, uint32_t turnaroundUs = 50000)
+        : MeterEmulator(baud, turnaroundUs, faults), _litres(litres), _litres_per_read(litresPerRead) {}
+
+    uint32_t litres() const
+    {
+        return _litres;
+    }
+
+protected:
+    virtual bool request(const uint8_t *data, size_t length, uint64_t nowUs, size_t &used)
+    {
+        if (SEOUL_REQUEST_STX != data[0]) {
+            used = 1;
+            return false;
+        }
+        if (SEOUL_REQUEST_PACKET_LENGTH > length) {
+            return false;
+        }
+        if ((0x5B != data[1]) || (0x01 != data[2]) || ((uint8_t)(data[1] + data[2]) != data[3]) ||
+            (SEOUL_REQUEST_ETX != data[4])) {
+            _stats.bad_requests++;
+            used = 1;
+            return false;
+        }
+
+        _stats.requests++;
+        _litres += _litres_per_read;
+
+        // 0x68 L L 0x68, C A CI, 27 bytes of records, CS 0x16
+        uint8_t frame[4 + 3 + 27 + 2];
+        size_t n = 0;
+        frame[n++] = SEOUL_RESPONSE_STX;
+        frame[n++] = 3 + 27;
+        frame[n++] = 3 + 27;
+        frame[n++] = SEOUL_RESPONSE_STX;
+        frame[n++] = 0x08;
+        frame[n++] = 0x01;
+        frame[n++] = 0x78;
+        n = bcd_record(frame, n, 0x0C, 0x78, 12345678);
+        n = bcd_record(frame, n, 0x0C, 0x13, _litres);
+        n = bcd_record(frame, n, 0x4C, 0x13, _litres - _litres % 1000);
+        frame[n++] = 0x42;
+        frame[n++] = 0x6C;
+        frame[n++] = 0x3F;      // 31.12.2025
+        frame[n++] = 0x3C;
+        frame[n++] = 0x02;
+        frame[n++] = 0xFD;
+        frame[n++] = 0x17;
+        frame[n++] = 0x00;
+        frame[n++] = 0x00;
+        uint8_t checksum = 0;
+        for (size_t i = 4; i < n; i++) {
+            checksum += frame[i];
+        }
+        frame[n++] = checksum;
+        frame[n++] = SEOUL_RESPONSE_ETX;
+
+        respond(frame, n, n - 2, nowUs);
+        return true;
+    }
+
+private:
+    // Record of 8 BCD digits, least significant byte first
+    static size_t bcd_record(uint8_t *frame, size_t n, uint8_t dif, uint8_t vif, uint32_t value)
+    {
+        frame[n++] = dif;
+        frame[n++] = vif;
+        for (int i = 0; i < 4; i++) {
+            frame[n++] = (uint8_t)((((value / 10) % 10) << 4) | (value % 10));
+            value /= 100;
+        }
+        return n;
+    }
+
+    uint32_t _litres;
+    uint32_t _litres_per_read;
+};
+
+/**
+ * PSTEC bus with up to METER_EMULATOR_MAX_METERS meters. A request
+ * 0xC0 type BCC 0xD0 is echoed by the line as it is sent; the meter of that
+ * type answers 0xC0 type, 5 BCD bytes of the reading (4 decimals, most
+ * significant first), 5 more data bytes, BCC 0xD0. Requests for a type
+ * nobody has go unanswered.
+ */
+class PstecMeterEmulator : public MeterEmulator {
+public:
+    PstecMeterEmulator(const LineFaults &faults, uint32_t baud = 4800, uint32_t turnaroundUs = 20000)
+        : MeterEmulator(baud, turnaroundUs, faults), _meters(0) {}
+
+    /** Add a meter; every answered request adds @p perRead to its register. */
+    bool add_meter(uint8_t type, uint64_t value, uint32_t perRead)
+    {
+        if (METER_EMULATOR_MAX_METERS <= _meters) {
+            return false;
+        }
+        _types[_meters] = type;
+        _values[_meters] = value;
+        _per_read[_meters] = perRead;
+        _meters++;
+        return true;
+    }
+
+    uint64_t value(uint8_t type) const
+    {
+        for (size_t i = 0; i < _meters; i++) {
+            if (type == _types[i]) {
+                return _values[i];
+            }
+        }
+        return 0;
+    }
+
+protected:
+    virtual bool request(const uint8_t *data, size_t length, uint64_t nowUs, size_t &used)
+    {
+        if (PSTEC_REQUEST_STX != data[0]) {
+            used = 1;
+            return false;
+        }
+        if (PSTEC_REQUEST_PACKET_LENGTH > length) {
+            return false;
+        }
+
+        // The half-duplex line echoes whatever the gateway sends
+        echo(data, PSTEC_REQUEST_PACKET_LENGTH, nowUs);
+
+        if ((((data[0] + data[1]) & 0x7F) != data[2]) || (PSTEC_REQUEST_ETX != data[3])) {
+            _stats.bad_requests++;
+            return true;
+        }
+        _stats.requests++;
+
+        for (size_t m = 0; m < _meters; m++) {
+            if (data[1] != _types[m]) {
+                continue;
+            }
+            _values[m] += _per_read[m];
+
+            uint8_t frame[PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT];
+            uint64_t value = _values[m];
+            memset(frame, 0, sizeof(frame));
+            frame[0] = PSTEC_RESPONSE_STX;
+            frame[1] = _types[m];
+            for (int i = 6; i >= 2; i--) {
+                frame[i] = (uint8_t)((((value / 10) % 10) << 4) | (value % 10));
+                value /= 100;
+            }
+            uint8_t bcc = 0;
+            for (size_t i = 0; i < 12; i++) {
+                bcc += frame[i];
+            }
+            frame[12] = bcc & 0x7F;
+            frame[13] = PSTEC_RESPONSE_ETX;
+
+            respond(frame, sizeof(frame), 12, nowUs);
+            return true;
+        }
+
+        _stats.silent++;
+        return true;
+    }
+
+private:
+    uint8_t _types[METER_EMULATOR_MAX_METERS];
+    uint64_t _values[METER_EMULATOR_MAX_METERS];
+    uint32_t _per_read[METER_EMULATOR_MAX_METERS];
+    size_t _meters;
+};
+
+/**
+ * Modbus RTU energy meters on one bus, at addresses 1 to @p slaves. Each
+ * answers function 0x04 reads of 1 to 125 input registers out of a map
+ * laid out like the common DIN rail meters: IEEE 754 floats, high word
+ * first, voltage at 0x0000, current at 0x0006, power at 0x000C and energy
+ * at 0x0156. Registers in between read as 0. The load wanders around
+ * @p watts and the energy counts it up in kWh over the emulator's clock.
+ * Other functions get exception 0x01, reads beyond the map 0x02 and bad
+ * counts 0x03. Requests for other slaves go unanswered.
+ */
+class ModbusMeterEmulator : public MeterEmulator {
+public:
+    ModbusMeterEmulator(const LineFaults &faults, size_t slaves = 1, float watts = 1500.0f, uint32_t baud = 9600,
+                        uint32_t turnaroundUs = 5000)
+        : MeterEmulator(baud, turnaroundUs, faults), _slaves(0)
+    {
+        while ((_slaves < slaves) && (_slaves < METER_EMULATOR_MAX_METERS)) {
+            Slave &slave = _slave[_slaves++];
+            slave.base_watts = watts * _slaves;
+            slave.watts = slave.base_watts;
+            slave.kwh = 1234.5 * _slaves;
+            slave.sampled_us = 0;
+        }
+    }
+
+    // Input register map
+    static const uint16_t VOLTAGE_REGISTER = 0x0000;
+    static const uint16_t CURRENT_REGISTER = 0x0006;
+    static const uint16_t POWER_REGISTER   = 0x000C;
+    static const uint16_t ENERGY_REGISTER  = 0x0156;
+    static const uint16_t REGISTERS        = 0x0200;
+
+protected:
+    virtual bool request(const uint8_t *data, size_t length, uint64_t nowUs, size_t &used)
+    {
+        if (MODBUS_READ_REQUEST_LENGTH > length) {
+            return false;
+        }
+        if (crc(data, 6) != (uint16_t)(data[6] | (data[7] << 8))) {
+            _stats.bad_requests++;
+            used = 1;
+            return false;
+        }
+        if ((0 == data[0]) || (_slaves < data[0])) {
+            return true;
+        }
+        _stats.requests++;
+
+        Slave &slave = _slave[data[0] - 1];
+        advance(slave, nowUs);
+
+        uint16_t reg = (uint16_t)((data[2] << 8) | data[3]);
+        uint16_t count = (uint16_t)((data[4] << 8) | data[5]);
+        uint8_t frame[MODBUS_MAX_FRAME_LENGTH];
+        size_t n = 0;
+        uint8_t exception = 0;
+
+        if (MODBUS_READ_INPUT_REGISTERS != data[1]) {
+            exception = 0x01;
+        }
+        else if ((0 == count) || (MODBUS_MAX_READ_REGISTERS < count)) {
+            exception = 0x03;
+        }
+        else if (REGISTERS < (uint32_t)reg + count) {
+            exception = 0x02;
+        }
+
+        frame[n++] = data[0];
+        if (0 != exception) {
+            frame[n++] = data[1] | MODBUS_EXCEPTION;
+            frame[n++] = exception;
+        }
+        else {
+            frame[n++] = MODBUS_READ_INPUT_REGISTERS;
+            frame[n++] = (uint8_t)(2 * count);
+            for (uint16_t i = 0; i < count; i++) {
+                uint16_t word = value(slave, reg + i);
+                frame[n++] = (uint8_t)(word >> 8);
+                frame[n++] = (uint8_t)word;
+            }
+        }
+        uint16_t sum = crc(frame, n);
+        frame[n++] = (uint8_t)sum;
+        frame[n++] = (uint8_t)(sum >> 8);
+
+        respond(frame, n, n - 2, nowUs);
+        return true;
+    }
+
+private:
+    struct Slave {
+        float base_watts;
+        float watts;
+        double kwh;
+        uint64_t sampled_us;
+    };
+
+    // Bit by bit, to check the gateway's table against
+    static uint16_t crc(const uint8_t *data, size_t length)
+    {
+        uint16_t value = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            value ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? ((value >> 1) ^ 0xA001) : (value >> 1);
+            }
+        }
+        return value;
+    }
+
+    // One word of the register map
+    static uint16_t value(const Slave &slave, uint16_t reg)
+    {
+        float number;
+        uint16_t base = reg & ~1;
+
+        if (VOLTAGE_REGISTER == base) {
+            number = 230.0f;
+        }
+        else if (CURRENT_REGISTER == base) {
+            number = slave.watts / 230.0f;
+        }
+        else if (POWER_REGISTER == base) {
+            number = slave.watts;
+        }
+        else if (ENERGY_REGISTER == base) {
+            number = (float)slave.kwh;
+        }
+        else {
+            return 0;
+        }
+
+        uint32_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return (reg & 1) ? (uint16_t)bits : (uint16_t)(bits >> 16);
+    }
+
+    // Count the energy of the time since the last request, then let the load move
+    void advance(Slave &slave, uint64_t nowUs)
+    {
+        if (0 != slave.sampled_us) {
+            slave.kwh += (double)slave.watts * (double)(nowUs - slave.sampled_us) / 3.6e12;
+        }
+        slave.sampled_us = nowUs;
+        slave.watts += slave.base_watts * ((float)(random() % 201) - 100.0f) / 1000.0f;
+        if (slave.watts < 0.0f) {
+            slave.watts = 0.0f;
+        }
+    }
+
+    Slave _slave[METER_EMULATOR_MAX_METERS];
+    size_t _slaves;
+};
+
+#endif /* METER_EMULATOR_H */
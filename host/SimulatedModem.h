@@ -0,0 +1,117 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SIMULATED_MODEM_H
+#define SIMULATED_MODEM_H
+
+#include <stdint.h>
+
+/** Timing of a cellular modem, see SimulatedModem. */
+struct SimulatedModemProfile {
+    uint32_t setup_ms;          // RRC connection setup from idle
+    uint32_t resume_ms;         // leaving PSM, setup included
+    uint32_t message_ms;        // airtime of one uplink message
+    uint32_t inactivity_ms;     // RRC release after the last message
+    uint32_t active_ms;         // T3324: idle time with paging before PSM
+    uint32_t edrx_cycle_ms;     // paging cycle while idle, 0 = no paging
+    uint32_t paging_ms;         // receiver on per paging occasion
+};
+
+/**
+ * Host-side stand-in for an NB-IoT or Cat.M1 modem, for radio-on time.
+ *
+ * After a transmission the modem stays connected until the inactivity
+ * timer runs out, then listens for paging every eDRX cycle until T3324
+ * expires and it enters PSM. Time is a simulated millisecond clock that
+ * only moves forward; connected time and paging listens count as radio on.
+ */
+class SimulatedModem {
+public:
+    explicit SimulatedModem(const SimulatedModemProfile &profile)
+        : _profile(profile), _now(0), _connected_until(0), _idle_until(0), _next_paging(0),
+          _radio_on_ms(0), _connections(0), _resumes(0), _messages(0)
+    {
+    }
+
+    /** Send @p messages back to back at time @p nowMs. */
+    void send(uint32_t nowMs, uint32_t messages)
+    {
+        advance(nowMs);
+
+        uint32_t busy = messages * _profile.message_ms;
+        if (_now >= _connected_until) {
+            busy += (_now >= _idle_until) ? _profile.resume_ms : _profile.setup_ms;
+            _resumes += (_now >= _idle_until) ? 1 : 0;
+            _connections++;
+        }
+        else {
+            _radio_on_ms -= _connected_until - _now;    // re-counted below
+        }
+
+        _connected_until = _now + busy + _profile.inactivity_ms;
+        _radio_on_ms += _connected_until - _now;
+        _idle_until = _connected_until + _profile.active_ms;
+        _next_paging = _connected_until + _profile.edrx_cycle_ms;
+        _messages += messages;
+    }
+
+    /** Let the clock run to @p nowMs. */
+    void advance(uint32_t nowMs)
+    {
+        if (0 < _profile.edrx_cycle_ms) {
+            while ((_next_paging <= nowMs) && (_next_paging < _idle_until)) {
+                _radio_on_ms += _profile.paging_ms;
+                _next_paging += _profile.edrx_cycle_ms;
+            }
+        }
+        if (nowMs > _now) {
+            _now = nowMs;
+        }
+    }
+
+    uint64_t radio_on_ms() const
+    {
+        return _radio_on_ms;
+    }
+
+    uint32_t connections() const
+    {
+        return _connections;
+    }
+
+    uint32_t resumes() const
+    {
+        return _resumes;
+    }
+
+    uint32_t messages() const
+    {
+        return _messages;
+    }
+
+private:
+    SimulatedModemProfile _profile;
+    uint64_t _now;
+    uint64_t _connected_until;
+    uint64_t _idle_until;
+    uint64_t _next_paging;
+
+    uint64_t _radio_on_ms;
+    uint32_t _connections;
+    uint32_t _resumes;
+    uint32_t _messages;
+};
+
+#endif /* SIMULATED_MODEM_H */
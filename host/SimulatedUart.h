@@ -0,0 +1,151 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SIMULATED_UART_H
+#define SIMULATED_UART_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "UartRxChunker.h"
+
+/**
+ * Host-side stand-in for a UART receiver and its idle Timeout.
+ *
+ * Bytes are clocked in at the configured baud rate against a simulated
+ * microsecond clock. The receive interrupt fires when the FIFO reaches its
+ * threshold or, like the hardware receiver timeout, one character time after
+ * the last byte. The idle timer is driven exactly as main.cpp drives its
+ * Timeout, so chunk boundaries and interrupt counts match the target.
+ */
+template <size_t ChunkSize>
+class SimulatedUart {
+public:
+    /**
+     * @param chunker Receive path under test
+     * @param baud Line speed, 11 bits per character (8E1)
+     * @param fifoThreshold Bytes per receive interrupt, 1 for a FIFO-less UART
+     */
+    SimulatedUart(UartRxChunker<ChunkSize> &chunker, uint32_t baud, size_t fifoThreshold)
+        : _chunker(chunker), _char_us((11 * 1000000UL) / baud), _threshold(fifoThreshold),
+          _now(0), _deadline(0), _timer_armed(false), _fifo_length(0),
+          _rx_interrupts(0), _timer_interrupts(0)
+    {
+        if (_threshold > sizeof(_fifo)) {
+            _threshold = sizeof(_fifo);
+        }
+    }
+
+    /** Put bytes on the line back to back. */
+    void transmit(const uint8_t *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++) {
+            receive(data[i], _now + _char_us);
+        }
+        flush();
+    }
+
+    /**
+     * Clock in one byte that is completely received at @p atUs, for senders
+     * with their own timing. Call flush() when the sender goes quiet.
+     */
+    void receive(uint8_t byte, uint32_t atUs)
+    {
+        // A gap longer than a character lets the receiver timeout fire
+        if ((0 < _fifo_length) && ((int32_t)(atUs - (_now + 2 * _char_us)) >= 0)) {
+            advance(_now + _char_us);
+            interrupt();
+        }
+        advance(((int32_t)(atUs - _now) > 0) ? atUs : _now);
+        _fifo[_fifo_length++] = byte;
+        if (_fifo_length >= _threshold) {
+            interrupt();
+        }
+    }
+
+    /** Receiver timeout after the last byte: hand over what is in the FIFO. */
+    void flush()
+    {
+        if (0 < _fifo_length) {
+            advance(_now + _char_us);
+            interrupt();
+        }
+    }
+
+    /** Leave the line quiet for @p us microseconds. */
+    void idle(uint32_t us)
+    {
+        advance(_now + us);
+    }
+
+    uint32_t now() const
+    {
+        return _now;
+    }
+
+    uint32_t rx_interrupts() const
+    {
+        return _rx_interrupts;
+    }
+
+    uint32_t timer_interrupts() const
+    {
+        return _timer_interrupts;
+    }
+
+private:
+    void advance(uint32_t until)
+    {
+        while (_timer_armed && ((int32_t)(_deadline - until) <= 0)) {
+            _now = _deadline;
+            _timer_interrupts++;
+
+            uint32_t next = _chunker.poll(_now);
+            if (0 < next) {
+                _deadline = _now + next;
+            }
+            else {
+                _timer_armed = false;
+            }
+        }
+        _now = until;
+    }
+
+    void interrupt()
+    {
+        _rx_interrupts++;
+        if (_chunker.receive(_fifo, _fifo_length, _now)) {
+            _timer_armed = true;
+            _deadline = _now + _chunker.idle_time();
+        }
+        _fifo_length = 0;
+    }
+
+    UartRxChunker<ChunkSize> &_chunker;
+    uint32_t _char_us;
+    size_t _threshold;
+
+    uint32_t _now;
+    uint32_t _deadline;
+    bool _timer_armed;
+
+    uint8_t _fifo[32];
+    size_t _fifo_length;
+
+    uint32_t _rx_interrupts;
+    uint32_t _timer_interrupts;
+};
+
+#endif /* SIMULATED_UART_H */
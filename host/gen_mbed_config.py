@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+# ----------------------------------------------------------------------------
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ----------------------------------------------------------------------------
+"""Writes the application settings of an mbed_app.json as mbed_config.h,
+the way mbed-cli does, for the host build.
+
+usage: gen_mbed_config.py [mbed_app.json [TARGET]] > mbed_config.h
+"""
+import json
+import sys
+
+
+def macro_value(value):
+    if isinstance(value, bool):
+        return '1' if value else '0'
+    return str(value)
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else 'mbed_app.json'
+    target = sys.argv[2] if len(sys.argv) > 2 else None
+
+    with open(path) as f:
+        app = json.load(f)
+
+    macros = {}
+    names = {}
+    for name, entry in app.get('config', {}).items():
+        if not isinstance(entry, dict):
+            entry = {'value': entry}
+        names[name] = entry.get('macro_name', 'MBED_CONF_APP_' + name.upper().replace('-', '_'))
+        macros[name] = entry.get('value')
+
+    overrides = app.get('target_overrides', {})
+    for scope in ['*', target]:
+        for key, value in overrides.get(scope, {}).items():
+            if key.startswith('app.') and key[4:] in names:
+                macros[key[4:]] = value
+
+    print('// Generated from %s by host/gen_mbed_config.py' % path)
+    print('#ifndef MBED_CONFIG_H')
+    print('#define MBED_CONFIG_H')
+    print('')
+    for name in sorted(macros):
+        if macros[name] is not None:
+            print('#define %-50s %s' % (names[name], macro_value(macros[name])))
+    print('')
+    print('#endif /* MBED_CONFIG_H */')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,38 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef MBED_H
+#define MBED_H
+
+/*
+ * Host build of the application: this directory stands in for mbed-os.
+ * It is listed in .mbedignore, so target builds never see it.
+ */
+
+#include "HostPlatform.h"
+#include "HostRtos.h"
+#include "HostEvents.h"
+#include "HostDrivers.h"
+#include "HostStorage.h"
+#include "HostNetwork.h"
+
+using namespace mbed;
+using namespace events;
+using namespace rtos;
+
+// The target console is unbuffered; keep the log complete when the process is killed
+static const int host_stdout_mode = setvbuf(stdout, NULL, _IOLBF, 0);
+
+#endif /* MBED_H */
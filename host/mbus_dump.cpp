@@ -0,0 +1,237 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * Decodes M-Bus long frames given in hex with the gateway's record
+ * iterator, and times it.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Imeter host/mbus_dump.cpp meter/MbusRecords.cpp meter/SeoulFrameDecoder.cpp \
+ *       meter/MeterReading.cpp meter/Bcd.cpp -o host-build/mbus_dump
+ *   host-build/mbus_dump host/mbus_telegrams.txt
+ *   host-build/mbus_dump bench=100000 host/mbus_telegrams.txt
+ *
+ * Without a file the telegrams are read from stdin, one per line; '#'
+ * starts a comment. bench=N decodes every telegram N times and prints the
+ * time per telegram instead of the records.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MbusRecords.h"
+#include "SeoulFrameDecoder.h"
+
+#define MAX_LINE    1024
+
+static const char *const functions[] = { "", " max", " min", " error" };
+
+static const char *const errors[] = {
+    "ok", "not a long frame", "unknown CI", "truncated record", "too many DIFEs", "too many VIFEs",
+    "reserved DIF", "reserved variable length"
+};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Hex digits of a line up to a comment, spaces anywhere
+static size_t parse_hex(const char *line, uint8_t *frame, size_t size)
+{
+    size_t length = 0;
+    int high = -1;
+
+    for (const char *p = line; ('\0' != *p) && ('#' != *p); p++) {
+        if (!isxdigit((unsigned char)*p)) {
+            continue;
+        }
+        int digit = isdigit((unsigned char)*p) ? (*p - '0') : (tolower((unsigned char)*p) - 'a' + 10);
+        if (0 > high) {
+            high = digit;
+        }
+        else if (length < size) {
+            frame[length++] = (uint8_t)((high << 4) | digit);
+            high = -1;
+        }
+    }
+    return length;
+}
+
+static void print_value(const MbusRecord &record)
+{
+    MeterReading reading;
+    MbusDateTime date;
+    char text[MAX_LINE];
+
+    if ((MBUS_QUANTITY_DATE == record.quantity) || (MBUS_QUANTITY_DATE_TIME == record.quantity) ||
+        (MBUS_QUANTITY_TARIFF_START == record.quantity) || (MBUS_QUANTITY_BATTERY_CHANGE == record.quantity)) {
+        if (mbus_record_date(record, date)) {
+            printf("%04u-%02u-%02u %02u:%02u:%02u%s%s", date.year, date.month, date.day, date.hour, date.minute,
+                   date.second, date.summer_time ? " summer" : "", date.valid ? "" : " invalid");
+            return;
+        }
+    }
+    if (0 < mbus_record_text(record, text, sizeof(text))) {
+        printf("\"%s\"", text);
+        return;
+    }
+    if (mbus_record_value(record, reading) && (0 < meter_reading_format(reading, text, sizeof(text)))) {
+        const char *unit = (METER_UNIT_NONE != reading.unit) ? meter_unit_name(reading.unit) : mbus_unit_name(record.unit);
+        printf("%s%s%s", text, ('\0' != *unit) ? " " : "", unit);
+        return;
+    }
+    printf("%u bytes:", record.length);
+    for (size_t i = 0; i < record.length; i++) {
+        printf(" %02X", record.data[i]);
+    }
+}
+
+static void print_unit_text(const MbusRecord &record)
+{
+    if (NULL != record.unit_text) {
+        printf(" [");
+        for (size_t i = record.unit_text_length; 0 < i; i--) {
+            putchar(record.unit_text[i - 1]);
+        }
+        printf("]");
+    }
+}
+
+static void dump(const uint8_t *frame, size_t length)
+{
+    MbusRecordIterator records(frame, length);
+    const MbusHeader &header = records.header();
+    MbusRecord record;
+    char code[4];
+
+    mbus_manufacturer_code(header.manufacturer, code);
+    printf("%u bytes, CI %02X", (unsigned)length, header.ci);
+    if (MBUS_CI_RESPONSE_LONG_HEADER == header.ci) {
+        printf(", id %08lX, %s version %u, medium %02X", (unsigned long)header.id, code, header.version, header.medium);
+    }
+    if (MBUS_CI_RESPONSE_NO_HEADER != header.ci) {
+        printf(", access %u, status %02X", header.access, header.status);
+    }
+    printf("\n");
+
+    while (records.next(record)) {
+        if (MBUS_CODING_MANUFACTURER == record.coding) {
+            printf("  manufacturer data, %u bytes%s\n", record.length,
+                   records.more_follows() ? ", more records follow" : "");
+            continue;
+        }
+        printf("  %-24s", mbus_quantity_name(record.quantity));
+        print_value(record);
+        print_unit_text(record);
+        if ((0 != record.storage) || (0 != record.tariff) || (0 != record.subunit)) {
+            printf("  (storage %llu, tariff %lu, subunit %u)", (unsigned long long)record.storage,
+                   (unsigned long)record.tariff, record.subunit);
+        }
+        printf("%s", functions[record.function]);
+        if (0 != record.error) {
+            printf(" record error %02X", record.error);
+        }
+        printf("\n");
+    }
+    if (MBUS_RECORD_OK != records.error()) {
+        printf("  error: %s\n", errors[records.error()]);
+    }
+
+    MeterReading reading;
+    char text[METER_READING_TEXT_SIZE];
+    if (seoul_decode_reading(frame, length, reading) && (0 < meter_reading_format(reading, text, sizeof(text)))) {
+        printf("  as a Seoul water meter: %s %s\n", text, meter_unit_name(reading.unit));
+    }
+}
+
+// Walks all records and decodes their values, as the gateway would
+static size_t decode_all(const uint8_t *frame, size_t length)
+{
+    MbusRecordIterator records(frame, length);
+    MbusRecord record;
+    MeterReading reading;
+    size_t count = 0;
+
+    while (records.next(record)) {
+        count += mbus_record_value(record, reading) ? 1 : 0;
+    }
+    return count;
+}
+
+static void bench(const uint8_t *frame, size_t length, unsigned long rounds)
+{
+    volatile size_t sink = 0;
+    MbusRecordIterator records(frame, length);
+    MbusRecord record;
+    size_t count = 0;
+
+    while (records.next(record)) {
+        count++;
+    }
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < rounds; i++) {
+        sink += decode_all(frame, length);
+    }
+    double all = (double)(now_ns() - start) / rounds;
+
+    start = now_ns();
+    for (unsigned long i = 0; i < rounds; i++) {
+        MeterReading reading;
+        sink += seoul_decode_reading(frame, length, reading) ? 1 : 0;
+    }
+    double seoul = (double)(now_ns() - start) / rounds;
+
+    printf("%3u bytes, %2u records: %7.1f ns all values, %5.1f ns per record, %6.1f ns Seoul reading\n",
+           (unsigned)length, (unsigned)count, all, (0 < count) ? all / count : 0.0, seoul);
+    (void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long rounds = 0;
+    FILE *input = stdin;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strncmp(argv[i], "bench=", 6)) {
+            rounds = strtoul(argv[i] + 6, NULL, 0);
+        }
+        else if (NULL == (input = fopen(argv[i], "r"))) {
+            printf("%s: cannot open\n", argv[i]);
+            return 1;
+        }
+    }
+
+    char line[MAX_LINE];
+    uint8_t frame[SEOUL_RESPONSE_MAX_LENGTH];
+
+    while (NULL != fgets(line, sizeof(line), input)) {
+        size_t length = parse_hex(line, frame, sizeof(frame));
+        if (0 == length) {
+            continue;
+        }
+        if (0 < rounds) {
+            bench(frame, length, rounds);
+        }
+        else {
+            dump(frame, length);
+        }
+    }
+    return 0;
+}
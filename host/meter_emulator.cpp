@@ -0,0 +1,210 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * Meter emulators on the pseudo-terminals of the host build.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Imeter host/meter_emulator.cpp -o host-build/meter_emulator
+ *   cd host-build && ./meter_emulator noise=0.001 truncate=0.02 seoul=uart1 pstec=uart2 power=uart3
+ *
+ * Options apply to the ports named after them.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MeterEmulator.h"
+
+#define MAX_PORTS   4
+
+struct Port {
+    const char *path;
+    int fd;
+    MeterEmulator *emulator;
+};
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool is_option(const char *arg, size_t length, const char *name)
+{
+    return (strlen(name) == length) && (0 == strncmp(arg, name, length));
+}
+
+static bool parse_option(const char *arg, LineFaults &faults, uint32_t &baud)
+{
+    const char *value = strchr(arg, '=');
+    if (NULL == value) {
+        return false;
+    }
+    size_t name = value++ - arg;
+
+    if (is_option(arg, name, "baud"))            { baud = strtoul(value, NULL, 0); }
+    else if (is_option(arg, name, "silent"))     { faults.no_answer = strtof(value, NULL); }
+    else if (is_option(arg, name, "truncate"))   { faults.truncate = strtof(value, NULL); }
+    else if (is_option(arg, name, "checksum"))   { faults.bad_checksum = strtof(value, NULL); }
+    else if (is_option(arg, name, "noise"))      { faults.noise = strtof(value, NULL); }
+    else if (is_option(arg, name, "garbage"))    { faults.garbage = strtof(value, NULL); }
+    else if (is_option(arg, name, "delay"))      { faults.delay = strtof(value, NULL); }
+    else if (is_option(arg, name, "delay-ms"))   { faults.delay_ms = strtoul(value, NULL, 0); }
+    else if (is_option(arg, name, "gap-us"))     { faults.gap_us = strtoul(value, NULL, 0); }
+    else if (is_option(arg, name, "seed"))       { faults.seed = strtoul(value, NULL, 0); }
+    else {
+        return false;
+    }
+    return true;
+}
+
+static int open_port(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        printf("%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct termios tio;
+    if (0 == tcgetattr(fd, &tio)) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static void print_stats(const Port &port)
+{
+    const MeterEmulatorStats &s = port.emulator->stats();
+    printf("%s: %u requests (%u bad), %u answered, %u silent, %u truncated, %u bad checksum, %u noisy, %u garbage, %u delayed\n",
+           port.path, s.requests, s.bad_requests, s.answered, s.silent, s.truncated, s.bad_checksums, s.noisy,
+           s.garbage, s.delayed);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    LineFaults faults;
+    uint32_t baud = 0;
+    size_t slaves = 1;
+    Port ports[MAX_PORTS];
+    size_t count = 0;
+
+    memset(&faults, 0, sizeof(faults));
+    faults.delay_ms = 1500;
+    faults.seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *path = strchr(argv[i], '=');
+        bool seoul = (0 == strncmp(argv[i], "seoul=", 6));
+        bool pstec = (0 == strncmp(argv[i], "pstec=", 6));
+        bool power = (0 == strncmp(argv[i], "power=", 6));
+
+        if ((seoul || pstec || power) && (count < MAX_PORTS)) {
+            Port &port = ports[count];
+            port.path = path + 1;
+            port.fd = open_port(port.path);
+            if (port.fd < 0) {
+                return 1;
+            }
+            if (seoul) {
+                port.emulator = new SeoulMeterEmulator(faults, 123456, 7, baud ? baud : 1200);
+            }
+            else if (power) {
+                port.emulator = new ModbusMeterEmulator(faults, slaves, 1500.0f, baud ? baud : 9600);
+            }
+            else {
+                PstecMeterEmulator *emulator = new PstecMeterEmulator(faults, baud ? baud : 4800);
+                emulator->add_meter(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER, 10000000, 13);
+                emulator->add_meter(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER, 20000000, 11);
+                emulator->add_meter(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS, 30000000, 17);
+                emulator->add_meter(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT, 40000000, 19);
+                port.emulator = emulator;
+            }
+            count++;
+        }
+        else if (0 == strncmp(argv[i], "slaves=", 7)) {
+            slaves = strtoul(path + 1, NULL, 0);
+        }
+        else if (!parse_option(argv[i], faults, baud)) {
+            printf("usage: %s [baud=N silent=P truncate=P checksum=P noise=P garbage=P delay=P delay-ms=N gap-us=N seed=N "
+                   "slaves=N] "
+                   "seoul=PORT pstec=PORT power=PORT\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 == count) {
+        printf("no port given\n");
+        return 1;
+    }
+
+    uint64_t statsDue = now_us() + 10 * 1000000ULL;
+
+    while (true) {
+        struct pollfd fds[MAX_PORTS];
+        uint64_t now = now_us();
+        uint64_t wake = statsDue;
+
+        for (size_t i = 0; i < count; i++) {
+            uint64_t at;
+            if (ports[i].emulator->peek(at) && (at < wake)) {
+                wake = at;
+            }
+            fds[i].fd = ports[i].fd;
+            fds[i].events = POLLIN;
+        }
+
+        int timeout = (wake > now) ? (int)((wake - now + 999) / 1000) : 0;
+        poll(fds, count, timeout);
+        now = now_us();
+
+        for (size_t i = 0; i < count; i++) {
+            Port &port = ports[i];
+
+            if (fds[i].revents & POLLIN) {
+                uint8_t data[64];
+                ssize_t n = read(port.fd, data, sizeof(data));
+                if (0 < n) {
+                    port.emulator->receive(data, n, now);
+                }
+            }
+
+            // A pty has no baud rate, so pace the bytes by their schedule
+            uint8_t byte;
+            uint64_t at;
+            while (port.emulator->next(now, byte, at)) {
+                if (write(port.fd, &byte, 1) < 0) {
+                    printf("%s: %s\n", port.path, strerror(errno));
+                }
+            }
+        }
+
+        if (now >= statsDue) {
+            statsDue = now + 10 * 1000000ULL;
+            for (size_t i = 0; i < count; i++) {
+                print_stats(ports[i]);
+            }
+        }
+    }
+}
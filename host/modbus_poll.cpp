@@ -0,0 +1,256 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * Modbus RTU poller for the host, to try the master and its block
+ * planning against the meter emulator or a real bus.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Imeter host/modbus_poll.cpp meter/ModbusMaster.cpp meter/Crc16.cpp \
+ *       -o host-build/modbus_poll
+ *   cd host-build && ./modbus_poll link=bus 1:4:12:2 1:4:342:2 2:4:0:2 2:4:6:2
+ *   ./meter_emulator slaves=2 power=bus
+ *
+ * link=NAME creates a pseudo-terminal and links it as NAME, port=PATH
+ * opens an existing one or a serial adapter, 8E1. Every
+ * SLAVE:FUNCTION:REGISTER:COUNT is a point; a point of two registers is
+ * also shown as a float.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ModbusMaster.h"
+#include "ModbusRtuDecoder.h"
+
+struct Point {
+    int handle;
+    uint8_t slave;
+    uint16_t reg;
+    uint8_t count;
+};
+
+static int bus = -1;
+static ModbusMaster *master = NULL;
+static Point points[MODBUS_MAX_POINTS];
+static size_t pointCount = 0;
+
+static uint32_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static int open_port(const char *path, uint32_t baud)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        printf("%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct termios tio;
+    if (0 == tcgetattr(fd, &tio)) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= PARENB;
+        cfsetspeed(&tio, (19200 == baud) ? B19200 : (38400 == baud) ? B38400 : (4800 == baud) ? B4800 : B9600);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// A pseudo-terminal the emulator opens through the link
+static int open_link(const char *link)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if ((fd < 0) || (0 != grantpt(fd)) || (0 != unlockpt(fd))) {
+        printf("%s: no pseudo-terminal (%d)\n", link, errno);
+        return -1;
+    }
+
+    // Holding the slave open keeps reads from failing while no emulator is attached
+    int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    if (0 <= slave) {
+        struct termios tio;
+        tcgetattr(slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+
+    unlink(link);
+    if (0 != symlink(ptsname(fd), link)) {
+        printf("%s: cannot link %s (%d)\n", link, ptsname(fd), errno);
+        return -1;
+    }
+    return fd;
+}
+
+static void send_request(void *, const uint8_t *data, size_t size)
+{
+    if (write(bus, data, size) != (ssize_t)size) {
+        printf("write: %s\n", strerror(errno));
+    }
+}
+
+static void on_frame(void *, const uint8_t *frame, size_t length)
+{
+    if (!master->on_frame(frame, length, now_ms())) {
+        printf("slave %u: unexpected frame, function 0x%02X\n", frame[0], frame[1]);
+    }
+}
+
+static void on_done(const ModbusPoll &poll, bool ok)
+{
+    printf("slave %u: %s in %lu ms\n", poll.slave, ok ? "read" : "not all read",
+           (unsigned long)(now_ms() - poll.sent_ms));
+
+    for (size_t i = 0; i < pointCount; i++) {
+        const Point &point = points[i];
+        const uint16_t *words = master->registers(point.handle);
+        if ((poll.slave != point.slave) || (NULL == words)) {
+            continue;
+        }
+
+        printf("  %5u:", point.reg);
+        for (uint8_t n = 0; n < point.count; n++) {
+            printf(" %04X", words[n]);
+        }
+        MeterReading reading;
+        if ((MODBUS_FLOAT_REGISTERS == point.count) && modbus_decode_float(words, -3, METER_UNIT_NONE, reading)) {
+            printf("  %.3f", (double)reading.value / 1000.0);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+static bool parse_point(const char *arg)
+{
+    unsigned slave, function, reg, count;
+
+    if ((4 != sscanf(arg, "%u:%u:%u:%u", &slave, &function, &reg, &count)) || (MODBUS_MAX_POINTS <= pointCount)) {
+        return false;
+    }
+    int handle = master->add_point((uint8_t)slave, (uint8_t)function, (uint16_t)reg, (uint8_t)count);
+    if (0 > handle) {
+        printf("%s: not a valid point\n", arg);
+        return false;
+    }
+    points[pointCount++] = Point { handle, (uint8_t)slave, (uint16_t)reg, (uint8_t)count };
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t baud = 9600;
+    uint32_t intervalMs = 1000;
+    uint32_t timeoutMs = 200;
+    uint16_t maxGap = 8;
+    const char *link = NULL;
+    const char *port = NULL;
+
+    // Options first, the guard time depends on the baud rate
+    for (int i = 1; i < argc; i++) {
+        if (0 == strncmp(argv[i], "baud=", 5))          { baud = strtoul(argv[i] + 5, NULL, 0); }
+        else if (0 == strncmp(argv[i], "interval=", 9)) { intervalMs = strtoul(argv[i] + 9, NULL, 0); }
+        else if (0 == strncmp(argv[i], "timeout=", 8))  { timeoutMs = strtoul(argv[i] + 8, NULL, 0); }
+        else if (0 == strncmp(argv[i], "gap=", 4))      { maxGap = (uint16_t)strtoul(argv[i] + 4, NULL, 0); }
+        else if (0 == strncmp(argv[i], "link=", 5))     { link = argv[i] + 5; }
+        else if (0 == strncmp(argv[i], "port=", 5))     { port = argv[i] + 5; }
+    }
+
+    static ModbusMaster modbus(&send_request, NULL, modbus_t35_us(baud) / 1000 + 1);
+    master = &modbus;
+
+    for (int i = 1; i < argc; i++) {
+        if ((NULL == strchr(argv[i], '=')) && !parse_point(argv[i])) {
+            printf("usage: %s [baud=N interval=MS timeout=MS gap=N] link=NAME|port=PATH SLAVE:FUNCTION:REGISTER:COUNT...\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+    if ((0 == pointCount) || ((NULL == link) == (NULL == port))) {
+        printf("need points and one of link= or port=\n");
+        return 1;
+    }
+
+    size_t blocks = modbus.plan(maxGap);
+    if (0 == blocks) {
+        printf("too many blocks\n");
+        return 1;
+    }
+    printf("%u points in %u requests per round\n", (unsigned)pointCount, (unsigned)blocks);
+
+    bus = (NULL != link) ? open_link(link) : open_port(port, baud);
+    if (bus < 0) {
+        return 1;
+    }
+
+    ModbusRtuDecoder<> decoder(&on_frame, NULL);
+    uint32_t t35Ms = modbus_t35_us(baud) / 1000 + 1;
+    uint32_t roundDue = now_ms();
+    uint32_t statsDue = roundDue + 10000;
+
+    while (true) {
+        uint32_t now = now_ms();
+
+        if ((int32_t)(now - roundDue) >= 0) {
+            roundDue += intervalMs;
+            for (size_t i = 0; i < pointCount; i++) {
+                // Once per slave, the master turns away a slave already queued
+                modbus.submit(points[i].slave, timeoutMs, &on_done, NULL, now);
+            }
+        }
+        if ((int32_t)(now - statsDue) >= 0) {
+            statsDue += 10000;
+            const ModbusStats &s = modbus.stats();
+            const DecoderStats &d = decoder.stats();
+            printf("polls %lu, requests %lu, responses %lu, exceptions %lu, timeouts %lu, unmatched %lu, "
+                   "CRC errors %lu, length errors %lu\n",
+                   (unsigned long)s.polls, (unsigned long)s.requests, (unsigned long)s.responses,
+                   (unsigned long)s.exceptions, (unsigned long)s.timeouts, (unsigned long)s.unmatched,
+                   (unsigned long)d.checksum_errors, (unsigned long)d.length_errors);
+            fflush(stdout);
+        }
+
+        uint32_t wait = modbus.run(now);
+        uint32_t untilRound = roundDue - now;
+        if ((0 == wait) || (untilRound < wait)) {
+            wait = untilRound;
+        }
+
+        // The decoder waits for a frame's end only as long as the line is busy
+        struct pollfd fd = { bus, POLLIN, 0 };
+        if (0 < decoder.pending()) {
+            wait = t35Ms;
+        }
+        if (0 == poll(&fd, 1, (int)wait)) {
+            decoder.resync();
+            continue;
+        }
+
+        uint8_t data[64];
+        ssize_t n = read(bus, data, sizeof(data));
+        if (0 < n) {
+            decoder.feed(data, (size_t)n);
+        }
+    }
+}
@@ -0,0 +1,396 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SIMPLE_MBED_CLOUD_CLIENT_H
+#define SIMPLE_MBED_CLOUD_CLIENT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+
+/*
+ * Host stand-in for SimpleMbedCloudClient that records instead of
+ * connecting.
+ *
+ * Every value set on a resource is appended to HOST_CLOUD_LOG as
+ * "<ms> <path> <value>", binary values in hex. Notifications of observable
+ * resources are reported delivered HOST_CLOUD_RTT_MS later, and
+ * registration completes after the same delay; callbacks run on a cloud
+ * thread like the real client's. Lines on stdin such as
+ * "PUT 4100/0/5752 *,0,0,60,3600" or "POST 4100/0/5753 1,0,4294967295"
+ * act as requests from the server; "DOWN" drops the registration and "UP"
+ * registers again, for outages.
+ */
+
+#ifndef HOST_CLOUD_LOG
+#define HOST_CLOUD_LOG      HOST_FS_ROOT "/cloud.log"
+#endif
+
+#ifndef HOST_CLOUD_RTT_MS
+#define HOST_CLOUD_RTT_MS   100
+#endif
+
+namespace m2m {
+typedef std::string String;
+}
+
+typedef enum {
+    NOTIFICATION_STATUS_INIT = 0,
+    NOTIFICATION_STATUS_BUILD_ERROR,
+    NOTIFICATION_STATUS_RESEND_QUEUE_FULL,
+    NOTIFICATION_STATUS_SENT,
+    NOTIFICATION_STATUS_DELIVERED,
+    NOTIFICATION_STATUS_SEND_FAILED,
+    NOTIFICATION_STATUS_SUBSCRIBED,
+    NOTIFICATION_STATUS_UNSUBSCRIBED
+} NoticationDeliveryStatus;
+
+class M2MMethod {
+public:
+    enum M2MMethodType {
+        GET    = 0x01,
+        PUT    = 0x02,
+        POST   = 0x04,
+        DELETE = 0x08
+    };
+};
+
+struct ConnectorClientEndpointInfo {
+    m2m::String internal_endpoint_name;
+    m2m::String endpoint_name;
+};
+
+class MbedCloudClientResource;
+
+/** Thread that runs the callbacks of the recording cloud. */
+inline events::EventQueue &host_cloud_queue()
+{
+    static events::EventQueue *queue = []() {
+        events::EventQueue *created = new events::EventQueue();
+        std::thread([created]() { created->dispatch_forever(); }).detach();
+        return created;
+    }();
+    return *queue;
+}
+
+/** Appends one published value to the log. */
+inline void host_cloud_record(const char *path, const char *value)
+{
+    static std::mutex lock;
+    static FILE *log = NULL;
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (NULL == log) {
+        mkdir(HOST_FS_ROOT, 0777);
+        log = fopen(HOST_CLOUD_LOG, "a");
+    }
+    if (NULL != log) {
+        // One line per value
+        fprintf(log, "%llu %s ", (unsigned long long)(host_time_us() / 1000), path);
+        for (const char *p = value; '\0' != *p; p++) {
+            if ('\n' == *p) {
+                fputs((('\0' == p[1]) ? "" : "\\n"), log);
+            }
+            else {
+                fputc(*p, log);
+            }
+        }
+        fputc('\n', log);
+        fflush(log);
+    }
+}
+
+class M2MResource {
+public:
+    explicit M2MResource(MbedCloudClientResource *owner) : _owner(owner) {}
+
+    bool set_value(const uint8_t *value, uint32_t length);
+
+private:
+    MbedCloudClientResource *_owner;
+};
+
+class MbedCloudClientResource {
+public:
+    typedef void (*NotificationCallback)(MbedCloudClientResource *resource, const NoticationDeliveryStatus status);
+    typedef void (*PutCallback)(MbedCloudClientResource *resource, m2m::String newValue);
+    typedef void (*PostCallback)(MbedCloudClientResource *resource, const uint8_t *buffer, uint16_t size);
+
+    MbedCloudClientResource(const char *path, const char *name)
+        : _path(path), _name(name), _methods(0), _observable(false),
+          _notification(NULL), _put(NULL), _post(NULL), _m2m(this) {}
+
+    void set_value(int value)
+    {
+        set_value(std::to_string(value).c_str());
+    }
+
+    void set_value(float value)
+    {
+        set_value(std::to_string(value).c_str());
+    }
+
+    void set_value(const char *value)
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _value = value;
+        }
+        published(value);
+    }
+
+    m2m::String get_value()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _value;
+    }
+
+    int get_value_int()
+    {
+        return atoi(get_value().c_str());
+    }
+
+    float get_value_float()
+    {
+        return (float)atof(get_value().c_str());
+    }
+
+    void methods(unsigned int methods)
+    {
+        _methods = methods;
+    }
+
+    void observable(bool observable)
+    {
+        _observable = observable;
+    }
+
+    void attach_notification_callback(NotificationCallback callback)
+    {
+        _notification = callback;
+    }
+
+    void attach_put_callback(PutCallback callback)
+    {
+        _put = callback;
+    }
+
+    void attach_post_callback(PostCallback callback)
+    {
+        _post = callback;
+    }
+
+    M2MResource *get_m2m_resource()
+    {
+        return &_m2m;
+    }
+
+    const char *path() const
+    {
+        return _path.c_str();
+    }
+
+    static const char *delivery_status_to_string(const NoticationDeliveryStatus status)
+    {
+        switch (status) {
+            case NOTIFICATION_STATUS_INIT:              return "Init";
+            case NOTIFICATION_STATUS_BUILD_ERROR:       return "Build error";
+            case NOTIFICATION_STATUS_RESEND_QUEUE_FULL: return "Resend queue full";
+            case NOTIFICATION_STATUS_SENT:              return "Sent";
+            case NOTIFICATION_STATUS_DELIVERED:         return "Delivered";
+            case NOTIFICATION_STATUS_SEND_FAILED:       return "Send failed";
+            case NOTIFICATION_STATUS_SUBSCRIBED:        return "Subscribed";
+            case NOTIFICATION_STATUS_UNSUBSCRIBED:      return "Unsubscribed";
+            default:                                    return "Unknown";
+        }
+    }
+
+    /** A request from the server, on the cloud thread. */
+    void request(const char *method, const char *body)
+    {
+        if ((0 == strcmp(method, "PUT")) && (_methods & M2MMethod::PUT)) {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                _value = body;
+            }
+            if (NULL != _put) {
+                _put(this, m2m::String(body));
+            }
+        }
+        else if ((0 == strcmp(method, "POST")) && (_methods & M2MMethod::POST) && (NULL != _post)) {
+            _post(this, (const uint8_t *)body, (uint16_t)strlen(body));
+        }
+        else {
+            printf("[host] %s %s: method not allowed\n", method, path());
+        }
+    }
+
+private:
+    friend class M2MResource;
+
+    void published(const char *text)
+    {
+        host_cloud_record(path(), text);
+        if (_observable && (NULL != _notification)) {
+            host_cloud_queue().call_in(HOST_CLOUD_RTT_MS, _notification, this, NOTIFICATION_STATUS_DELIVERED);
+        }
+    }
+
+    std::string _path;
+    std::string _name;
+    std::mutex _lock;
+    std::string _value;
+    unsigned int _methods;
+    bool _observable;
+    NotificationCallback _notification;
+    PutCallback _put;
+    PostCallback _post;
+    M2MResource _m2m;
+};
+
+inline bool M2MResource::set_value(const uint8_t *value, uint32_t length)
+{
+    std::string hex;
+    char digits[3];
+
+    for (uint32_t i = 0; i < length; i++) {
+        snprintf(digits, sizeof(digits), "%02x", value[i]);
+        hex += digits;
+    }
+    {
+        std::lock_guard<std::mutex> guard(_owner->_lock);
+        _owner->_value.assign((const char *)value, length);
+    }
+    _owner->published(hex.c_str());
+    return true;
+}
+
+class SimpleMbedCloudClient {
+public:
+    SimpleMbedCloudClient(NetworkInterface *net, BlockDevice *bd, FileSystem *fs)
+        : _registered(false), _reading(false), _on_registered(NULL), _on_unregistered(NULL)
+    {
+        (void)net;
+        (void)bd;
+        (void)fs;
+        _endpoint.internal_endpoint_name = "host-simulation";
+        _endpoint.endpoint_name = "host-simulation";
+    }
+
+    int init()
+    {
+        return 0;
+    }
+
+    MbedCloudClientResource *create_resource(const char *path, const char *name)
+    {
+        _resources.push_back(std::unique_ptr<MbedCloudClientResource>(new MbedCloudClientResource(path, name)));
+        return _resources.back().get();
+    }
+
+    void on_registered(void (*callback)(const ConnectorClientEndpointInfo *endpoint))
+    {
+        _on_registered = callback;
+    }
+
+    void on_unregistered(void (*callback)())
+    {
+        _on_unregistered = callback;
+    }
+
+    bool register_and_connect()
+    {
+        // Requests find the resources created before registering
+        if (!_reading) {
+            _reading = true;
+            std::thread(&SimpleMbedCloudClient::read_requests, this).detach();
+        }
+        host_cloud_queue().call_in(HOST_CLOUD_RTT_MS, &SimpleMbedCloudClient::registration_done, this);
+        return true;
+    }
+
+    bool is_client_registered()
+    {
+        return _registered;
+    }
+
+private:
+    static void registration_done(SimpleMbedCloudClient *client)
+    {
+        client->_registered = true;
+        if (NULL != client->_on_registered) {
+            client->_on_registered(&client->_endpoint);
+        }
+    }
+
+    static void unregistration_done(SimpleMbedCloudClient *client)
+    {
+        client->_registered = false;
+        if (NULL != client->_on_unregistered) {
+            client->_on_unregistered();
+        }
+    }
+
+    void read_requests()
+    {
+        char line[256];
+
+        while (NULL != fgets(line, sizeof(line), stdin)) {
+            char method[8];
+            char path[32];
+            char body[200] = "";
+            int fields = sscanf(line, "%7s %31s %199[^\n]", method, path, body);
+
+            if ((1 == fields) && (0 == strcmp(method, "DOWN"))) {
+                host_cloud_queue().call(&SimpleMbedCloudClient::unregistration_done, this);
+                continue;
+            }
+            if ((1 == fields) && (0 == strcmp(method, "UP"))) {
+                register_and_connect();
+                continue;
+            }
+            if (2 > fields) {
+                continue;
+            }
+            for (size_t i = 0; i < _resources.size(); i++) {
+                if (0 == strcmp(_resources[i]->path(), path)) {
+                    std::string text(body);
+                    MbedCloudClientResource *resource = _resources[i].get();
+                    std::string verb(method);
+                    host_cloud_queue().call([resource, verb, text]() { resource->request(verb.c_str(), text.c_str()); });
+                }
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<MbedCloudClientResource> > _resources;
+    ConnectorClientEndpointInfo _endpoint;
+    volatile bool _registered;
+    bool _reading;
+    void (*_on_registered)(const ConnectorClientEndpointInfo *endpoint);
+    void (*_on_unregistered)();
+};
+
+class StorageHelper {
+public:
+    static int format(FileSystem *fs, BlockDevice *bd)
+    {
+        return fs->reformat(bd);
+    }
+};
+
+#endif /* SIMPLE_MBED_CLOUD_CLIENT_H */
@@ -0,0 +1,115 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Checks and timing for the host tests.
+ *
+ * Every test is one program. It runs its checks, prints one summary line
+ * and exits with 1 if a check failed. Tests that also measure do so when
+ * given "bench", or "bench=N" to set the size of the run; the numbers are
+ * printed, never checked.
+ */
+
+#define CHECK(expr)                 host_test_check((expr), #expr, __FILE__, __LINE__)
+#define CHECK_EQUAL(expected, actual) \
+    host_test_equal((long long)(expected), (long long)(actual), #actual, __FILE__, __LINE__)
+
+static unsigned host_test_checks = 0;
+static unsigned host_test_failures = 0;
+
+static bool host_test_check(bool ok, const char *expr, const char *file, int line)
+{
+    host_test_checks++;
+    if (!ok) {
+        host_test_failures++;
+        printf("%s:%d: CHECK(%s) failed\n", file, line, expr);
+    }
+    return ok;
+}
+
+static bool host_test_equal(long long expected, long long actual, const char *expr, const char *file, int line)
+{
+    host_test_checks++;
+    if (expected != actual) {
+        host_test_failures++;
+        printf("%s:%d: %s is %lld, expected %lld\n", file, line, expr, actual, expected);
+        return false;
+    }
+    return true;
+}
+
+/** Print the summary. @return Exit code of the test */
+static int host_test_done(const char *name)
+{
+    printf("%s: %u checks, %u failed\n", name, host_test_checks, host_test_failures);
+    return (0 == host_test_failures) ? 0 : 1;
+}
+
+/**
+ * Value of the argument @p name, given as "name" or "name=N".
+ * @return @p absent if not given, @p bare if given without a value
+ */
+static unsigned long host_test_arg(int argc, char **argv, const char *name, unsigned long absent, unsigned long bare)
+{
+    size_t length = strlen(name);
+
+    for (int i = 1; i < argc; i++) {
+        if (0 != strncmp(argv[i], name, length)) {
+            continue;
+        }
+        if ('\0' == argv[i][length]) {
+            return bare;
+        }
+        if ('=' == argv[i][length]) {
+            return strtoul(argv[i] + length + 1, NULL, 0);
+        }
+    }
+    return absent;
+}
+
+static uint64_t host_test_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Shortest time of @p runs calls of @p body, in nanoseconds. */
+template <typename F>
+uint64_t host_test_time(unsigned runs, F body)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (unsigned i = 0; i < runs; i++) {
+        uint64_t start = host_test_ns();
+        body();
+        uint64_t elapsed = host_test_ns() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+#endif /* HOST_TEST_H */
@@ -0,0 +1,239 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * The generated Seoul and PSTEC decoders against the hand-written ones
+ * they replaced, kept in host/tests/reference: the same frames out of
+ * the same streams, and with bench the time of both.
+ *
+ *   g++ -std=gnu++14 -Os -Ihost -Ihost/tests -Imeter host/tests/decoder_reference_test.cpp \
+ *       host/tests/reference/ReferenceSeoulFrameDecoder.cpp host/tests/reference/ReferencePstecFrameDecoder.cpp \
+ *       meter/PstecFrameDecoder.cpp meter/SeoulFrameDecoder.cpp meter/MbusRecords.cpp meter/MeterReading.cpp \
+ *       meter/Bcd.cpp -o host-build/decoder_reference_test
+ *   host-build/decoder_reference_test bench=2000
+ *
+ * Seoul frames and counters match in every case. PSTEC frames match on
+ * clean and noisy lines; after a bad frame the generated decoder scans for
+ * the next STX where the old one waited for an ETX, so under truncated
+ * and garbled responses it finds at least as many. bench=N times N
+ * responses per protocol in ns per byte, old and new, per chunk size;
+ * build with -Os, as the target is, and with -O2 to compare.
+ */
+#include <vector>
+
+#include "HostTest.h"
+#include "MeterEmulator.h"
+#include "PstecFrameDecoder.h"
+#include "SeoulFrameDecoder.h"
+#include "reference/ReferencePstecFrameDecoder.h"
+#include "reference/ReferenceSeoulFrameDecoder.h"
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<Bytes> Frames;
+
+static const size_t chunkSizes[] = { 1, 2, 3, 7, 16, 32, 64, 4096 };
+
+static void on_frame(void *context, const uint8_t *frame, size_t length)
+{
+    static_cast<Frames *>(context)->push_back(Bytes(frame, frame + length));
+}
+
+static void count_frame(void *context, const uint8_t *frame, size_t length)
+{
+    (void)frame;
+    (void)length;
+    (*static_cast<size_t *>(context))++;
+}
+
+static void collect(MeterEmulator &meter, Bytes &bytes, uint64_t &nowUs)
+{
+    uint8_t byte;
+    uint64_t at;
+
+    while (meter.next(UINT64_MAX, byte, at)) {
+        bytes.push_back(byte);
+        nowUs = at;
+    }
+}
+
+static Bytes seoul_stream(size_t reads, const LineFaults &faults)
+{
+    static const uint8_t request[] = { SEOUL_REQUEST_STX, 0x5B, 0x01, 0x5C, SEOUL_REQUEST_ETX };
+    SeoulMeterEmulator meter(faults);
+    Bytes bytes;
+    uint64_t now = 0;
+
+    for (size_t i = 0; i < reads; i++) {
+        meter.receive(request, sizeof(request), now);
+        collect(meter, bytes, now);
+        now += 500000;
+    }
+    return bytes;
+}
+
+static const uint8_t pstecTypes[] = {
+    PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER, PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER,
+    PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS, PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT
+};
+
+static Bytes pstec_stream(size_t reads, const LineFaults &faults)
+{
+    PstecMeterEmulator meter(faults);
+    Bytes bytes;
+    uint64_t now = 0;
+
+    for (size_t m = 0; m < sizeof(pstecTypes); m++) {
+        meter.add_meter(pstecTypes[m], 12345670000ULL * (m + 1) % 9999999999ULL, 13 + (uint32_t)m);
+    }
+    for (size_t i = 0; i < reads; i++) {
+        uint8_t type = pstecTypes[i % sizeof(pstecTypes)];
+        uint8_t request[] = { PSTEC_REQUEST_STX, type, (uint8_t)((PSTEC_REQUEST_STX + type) & 0x7F), PSTEC_REQUEST_ETX };
+
+        meter.receive(request, sizeof(request), now);
+        collect(meter, bytes, now);
+        now += 100000;
+    }
+    return bytes;
+}
+
+template <typename Decoder>
+static Frames decode(const Bytes &bytes, size_t chunk, DecoderStats &stats)
+{
+    Frames frames;
+    Decoder decoder(&on_frame, &frames);
+
+    for (size_t i = 0; i < bytes.size(); i += chunk) {
+        decoder.feed(&bytes[i], (chunk < bytes.size() - i) ? chunk : (bytes.size() - i));
+    }
+    stats = decoder.stats();
+    return frames;
+}
+
+static bool same_stats(const DecoderStats &a, const DecoderStats &b)
+{
+    return (a.frames == b.frames) && (a.checksum_errors == b.checksum_errors) &&
+           (a.length_errors == b.length_errors) && (a.resets == b.resets) && (a.skipped == b.skipped);
+}
+
+static size_t responses(const Frames &frames)
+{
+    size_t count = 0;
+    for (const Bytes &frame : frames) {
+        count += (PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT == frame.size()) ? 1 : 0;
+    }
+    return count;
+}
+
+static LineFaults line(float noise, float truncate, float garbage, uint32_t seed)
+{
+    LineFaults faults = LineFaults();
+    faults.noise = noise;
+    faults.truncate = truncate;
+    faults.bad_checksum = (0 < truncate) ? 0.05f : 0.0f;
+    faults.garbage = garbage;
+    faults.no_answer = (0 < truncate) ? 0.05f : 0.0f;
+    faults.seed = seed;
+    return faults;
+}
+
+static void check_seoul(const char *name, const Bytes &stream)
+{
+    for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++) {
+        DecoderStats generated;
+        DecoderStats reference;
+        Frames got = decode<SeoulFrameDecoder>(stream, chunkSizes[c], generated);
+        Frames want = decode<ReferenceSeoulFrameDecoder>(stream, chunkSizes[c], reference);
+
+        if (!CHECK(got == want) || !CHECK(same_stats(generated, reference))) {
+            printf("  %s, chunks of %u bytes: %u frames, reference %u\n", name, (unsigned)chunkSizes[c],
+                   (unsigned)got.size(), (unsigned)want.size());
+        }
+    }
+}
+
+static void check_pstec(const char *name, const Bytes &stream, bool same)
+{
+    for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++) {
+        DecoderStats generated;
+        DecoderStats reference;
+        Frames got = decode<PstecFrameDecoder>(stream, chunkSizes[c], generated);
+        Frames want = decode<ReferencePstecFrameDecoder>(stream, chunkSizes[c], reference);
+
+        bool ok = same ? CHECK(got == want) : CHECK(responses(got) >= responses(want));
+        if (!ok) {
+            printf("  %s, chunks of %u bytes: %u responses, reference %u\n", name, (unsigned)chunkSizes[c],
+                   (unsigned)responses(got), (unsigned)responses(want));
+        }
+    }
+}
+
+template <typename Decoder>
+static double ns_per_byte(const Bytes &stream, size_t chunk)
+{
+    size_t frames = 0;
+
+    uint64_t ns = host_test_time(31, [&]() {
+        Decoder decoder(&count_frame, &frames);
+        frames = 0;
+        for (size_t i = 0; i < stream.size(); i += chunk) {
+            decoder.feed(&stream[i], (chunk < stream.size() - i) ? chunk : (stream.size() - i));
+        }
+    });
+    return (double)ns / stream.size();
+}
+
+template <typename Generated, typename Reference>
+static void bench_pair(const char *name, const Bytes &stream)
+{
+    for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++) {
+        double reference = ns_per_byte<Reference>(stream, chunkSizes[c]);
+        double generated = ns_per_byte<Generated>(stream, chunkSizes[c]);
+        printf("  %-6s chunk %4u  %6.2f -> %6.2f ns/byte  %5.2fx\n", name, (unsigned)chunkSizes[c], reference,
+               generated, reference / generated);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Bytes clean = seoul_stream(300, LineFaults());
+    Bytes noisy = seoul_stream(1000, line(0.002f, 0.0f, 0.0f, 3));
+    Bytes faulty = seoul_stream(1000, line(0.002f, 0.05f, 0.1f, 7));
+    check_seoul("Seoul clean", clean);
+    check_seoul("Seoul noisy", noisy);
+    check_seoul("Seoul faults", faulty);
+
+    // No bit noise for PSTEC: its 7-bit BCC misses a flipped top bit
+    Bytes pstecClean = pstec_stream(300, LineFaults());
+    Bytes pstecGarbled = pstec_stream(1000, line(0.0f, 0.0f, 0.1f, 5));
+    Bytes pstecFaulty = pstec_stream(1000, line(0.0f, 0.05f, 0.1f, 7));
+    check_pstec("PSTEC clean", pstecClean, true);
+    check_pstec("PSTEC garbage", pstecGarbled, false);
+    check_pstec("PSTEC faults", pstecFaulty, false);
+
+    DecoderStats stats;
+    CHECK_EQUAL(300, decode<SeoulFrameDecoder>(clean, 32, stats).size());
+    CHECK_EQUAL(600, decode<PstecFrameDecoder>(pstecClean, 32, stats).size());
+
+    unsigned long reads = host_test_arg(argc, argv, "bench", 0, 2000);
+    if (0 < reads) {
+        Bytes seoul = seoul_stream(reads, LineFaults());
+        Bytes pstec = pstec_stream(reads, LineFaults());
+        printf("Clean streams, %lu responses, reference -> generated:\n", reads);
+        bench_pair<SeoulFrameDecoder, ReferenceSeoulFrameDecoder>("Seoul", seoul);
+        bench_pair<PstecFrameDecoder, ReferencePstecFrameDecoder>("PSTEC", pstec);
+    }
+
+    return host_test_done("decoder_reference_test");
+}
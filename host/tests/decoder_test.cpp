@@ -0,0 +1,405 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * Seoul and PSTEC frame decoders and the receive path in front of them,
+ * fed with the byte streams of the meter emulators.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/decoder_test.cpp meter/SeoulFrameDecoder.cpp \
+ *       meter/PstecFrameDecoder.cpp meter/MbusRecords.cpp meter/MeterReading.cpp meter/Bcd.cpp \
+ *       -o host-build/decoder_test
+ *   host-build/decoder_test bench=2000
+ *
+ * The checks decode clean streams in every chunk size, noisy streams,
+ * and the path UART -> chunker -> ring -> decoder as MeterPort runs it.
+ * bench=N times N responses per protocol in bytes/s and frames/s.
+ */
+#include <algorithm>
+#include <vector>
+
+#include "HostTest.h"
+#include "MeterEmulator.h"
+#include "SimulatedUart.h"
+#include "SeoulFrameDecoder.h"
+#include "PstecFrameDecoder.h"
+#include "SpscByteRing.h"
+#include "UartRxChunker.h"
+
+// Sizes of the receive path in MeterPort.h and main.cpp
+#define RX_CHUNK_SIZE       32
+#define RX_FIFO_READ        16
+#define RX_RING_SIZE        512
+
+typedef std::vector<uint8_t> Bytes;
+
+/** A recorded byte stream and the values the meters sent in it. */
+struct Stream {
+    Bytes bytes;
+    std::vector<uint64_t> sent;     // register of every answered request
+    std::vector<uint64_t> at_us;    // when each byte is completely received
+    MeterEmulatorStats stats;
+};
+
+/** Frames handed over by a decoder. */
+struct Frames {
+    std::vector<Bytes> frames;
+};
+
+static void on_frame(void *context, const uint8_t *frame, size_t length)
+{
+    static_cast<Frames *>(context)->frames.push_back(Bytes(frame, frame + length));
+}
+
+static void count_frame(void *context, const uint8_t *frame, size_t length)
+{
+    (void)frame;
+    (void)length;
+    (*static_cast<size_t *>(context))++;
+}
+
+static void collect(MeterEmulator &meter, Stream &stream, uint64_t &nowUs)
+{
+    uint8_t byte;
+    uint64_t at;
+
+    while (meter.next(UINT64_MAX, byte, at)) {
+        stream.bytes.push_back(byte);
+        stream.at_us.push_back(at);
+        nowUs = at;
+    }
+}
+
+static void seoul_stream(size_t reads, const LineFaults &faults, Stream &stream)
+{
+    static const uint8_t request[] = { SEOUL_REQUEST_STX, 0x5B, 0x01, 0x5C, SEOUL_REQUEST_ETX };
+    SeoulMeterEmulator meter(faults);
+    uint64_t now = 0;
+
+    for (size_t i = 0; i < reads; i++) {
+        meter.receive(request, sizeof(request), now);
+        stream.sent.push_back(meter.litres());
+        collect(meter, stream, now);
+        now += 500000;
+    }
+    stream.stats = meter.stats();
+}
+
+static const uint8_t pstecTypes[] = {
+    PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER, PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER,
+    PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS, PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT
+};
+
+static void pstec_stream(size_t reads, const LineFaults &faults, Stream &stream)
+{
+    PstecMeterEmulator meter(faults);
+    uint64_t now = 0;
+
+    for (size_t m = 0; m < sizeof(pstecTypes); m++) {
+        meter.add_meter(pstecTypes[m], 12345670000ULL * (m + 1) % 9999999999ULL, 13 + (uint32_t)m);
+    }
+    for (size_t i = 0; i < reads; i++) {
+        uint8_t type = pstecTypes[i % sizeof(pstecTypes)];
+        uint8_t request[] = { PSTEC_REQUEST_STX, type, (uint8_t)((PSTEC_REQUEST_STX + type) & 0x7F), PSTEC_REQUEST_ETX };
+
+        meter.receive(request, sizeof(request), now);
+        stream.sent.push_back(meter.value(type));
+        collect(meter, stream, now);
+        now += 100000;
+    }
+    stream.stats = meter.stats();
+}
+
+template <typename Decoder>
+static void decode(const Bytes &bytes, size_t chunk, Frames &frames, DecoderStats &stats)
+{
+    Decoder decoder(&on_frame, &frames);
+
+    for (size_t i = 0; i < bytes.size(); i += chunk) {
+        decoder.feed(&bytes[i], (chunk < bytes.size() - i) ? chunk : (bytes.size() - i));
+    }
+    decoder.resync();
+    stats = decoder.stats();
+}
+
+static bool same_stats(const DecoderStats &a, const DecoderStats &b)
+{
+    return (a.frames == b.frames) && (a.checksum_errors == b.checksum_errors) &&
+           (a.length_errors == b.length_errors) && (a.resets == b.resets) && (a.skipped == b.skipped);
+}
+
+static const size_t chunkSizes[] = { 1, 2, 3, 5, 7, 16, 32, 64, 4096 };
+
+/** Every chunk size finds the same frames as one feed of the whole stream. */
+template <typename Decoder>
+static void check_chunking(const char *name, const Stream &stream)
+{
+    Frames whole;
+    DecoderStats wholeStats;
+    decode<Decoder>(stream.bytes, stream.bytes.size(), whole, wholeStats);
+
+    for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++) {
+        Frames frames;
+        DecoderStats stats;
+        decode<Decoder>(stream.bytes, chunkSizes[c], frames, stats);
+        if (!CHECK(whole.frames == frames.frames) || !CHECK(same_stats(wholeStats, stats))) {
+            printf("  %s, chunks of %u bytes\n", name, (unsigned)chunkSizes[c]);
+        }
+    }
+}
+
+static void check_seoul_clean()
+{
+    LineFaults faults = LineFaults();
+    Stream stream;
+    seoul_stream(200, faults, stream);
+
+    Frames frames;
+    DecoderStats stats;
+    decode<SeoulFrameDecoder>(stream.bytes, 32, frames, stats);
+
+    CHECK_EQUAL(200, frames.frames.size());
+    CHECK_EQUAL(0, stats.checksum_errors + stats.length_errors + stats.resets + stats.skipped);
+    for (size_t i = 0; (i < frames.frames.size()) && (i < stream.sent.size()); i++) {
+        MeterReading reading;
+        CHECK(seoul_decode_reading(frames.frames[i].data(), frames.frames[i].size(), reading));
+        CHECK_EQUAL(-3, reading.exponent);
+        CHECK_EQUAL(METER_UNIT_CUBIC_METRE, reading.unit);
+        CHECK_EQUAL(stream.sent[i], reading.value);
+    }
+    check_chunking<SeoulFrameDecoder>("Seoul clean", stream);
+}
+
+static void check_pstec_clean()
+{
+    LineFaults faults = LineFaults();
+    Stream stream;
+    pstec_stream(200, faults, stream);
+
+    Frames frames;
+    DecoderStats stats;
+    decode<PstecFrameDecoder>(stream.bytes, 32, frames, stats);
+
+    // Every request comes back as its echo, then the response
+    CHECK_EQUAL(400, frames.frames.size());
+    CHECK_EQUAL(0, stats.checksum_errors + stats.length_errors + stats.resets + stats.skipped);
+    for (size_t i = 0; (2 * i + 1 < frames.frames.size()) && (i < stream.sent.size()); i++) {
+        const Bytes &echo = frames.frames[2 * i];
+        const Bytes &response = frames.frames[2 * i + 1];
+        uint8_t type = pstecTypes[i % sizeof(pstecTypes)];
+        MeterReading reading;
+
+        CHECK_EQUAL(PSTEC_REQUEST_PACKET_LENGTH, echo.size());
+        CHECK_EQUAL(type, response[1]);
+        CHECK(pstec_decode_reading(response.data(), response.size(), reading));
+        CHECK_EQUAL(-4, reading.exponent);
+        CHECK_EQUAL(stream.sent[i], reading.value);
+    }
+    check_chunking<PstecFrameDecoder>("PSTEC clean", stream);
+}
+
+/**
+ * Under line faults every intact response is found, and whatever is
+ * found is a value a meter really sent.
+ */
+static void check_faults()
+{
+    LineFaults faults = LineFaults();
+    faults.noise = 0.002f;
+    faults.truncate = 0.05f;
+    faults.bad_checksum = 0.05f;
+    faults.garbage = 0.1f;
+    faults.no_answer = 0.05f;
+    faults.seed = 7;
+
+    Stream seoul;
+    seoul_stream(1000, faults, seoul);
+    Frames frames;
+    DecoderStats stats;
+    decode<SeoulFrameDecoder>(seoul.bytes, 32, frames, stats);
+
+    size_t valid = 0;
+    for (size_t i = 0; i < frames.frames.size(); i++) {
+        MeterReading reading;
+        if (seoul_decode_reading(frames.frames[i].data(), frames.frames[i].size(), reading)) {
+            CHECK(std::find(seoul.sent.begin(), seoul.sent.end(), (uint64_t)reading.value) != seoul.sent.end());
+            valid++;
+        }
+    }
+    CHECK(seoul.stats.answered <= valid);
+    CHECK(0 < stats.checksum_errors);
+    check_chunking<SeoulFrameDecoder>("Seoul faults", seoul);
+
+    // The 7-bit BCC cannot see a flipped top bit, and a BCD byte with its
+    // top bit flipped can still be BCD, so noise would let wrong values by
+    Stream pstec;
+    faults.noise = 0.0f;
+    pstec_stream(1000, faults, pstec);
+    frames.frames.clear();
+    decode<PstecFrameDecoder>(pstec.bytes, 32, frames, stats);
+
+    size_t responses = 0;
+    for (size_t i = 0; i < frames.frames.size(); i++) {
+        MeterReading reading;
+        if (pstec_decode_reading(frames.frames[i].data(), frames.frames[i].size(), reading)) {
+            CHECK(std::find(pstec.sent.begin(), pstec.sent.end(), (uint64_t)reading.value) != pstec.sent.end());
+            responses++;
+        }
+    }
+    CHECK(pstec.stats.answered <= responses);
+    check_chunking<PstecFrameDecoder>("PSTEC faults", pstec);
+}
+
+/** The receive path of a MeterPort without the hop to its thread. */
+template <typename Decoder>
+class ReceivePath {
+public:
+    ReceivePath(int endByte, uint32_t baud, MeterFrameHandler handler, void *context)
+        : _chunker(&ReceivePath::on_chunk, this, endByte, (20 * 11 * 1000000UL) / baud),
+          _uart(_chunker, baud, RX_FIFO_READ), _decoder(handler, context) {}
+
+    void receive(const Stream &stream)
+    {
+        for (size_t i = 0; i < stream.bytes.size(); i++) {
+            _uart.receive(stream.bytes[i], (uint32_t)stream.at_us[i]);
+        }
+        _uart.flush();
+        _uart.idle(1000000);
+    }
+
+    const DecoderStats &stats() const
+    {
+        return _decoder.stats();
+    }
+
+    uint32_t overflows() const
+    {
+        return _ring.overflows();
+    }
+
+private:
+    static void on_chunk(void *context, const uint8_t *data, size_t size, RxChunkReason reason)
+    {
+        ReceivePath *path = static_cast<ReceivePath *>(context);
+        const uint8_t *first;
+        const uint8_t *second;
+        size_t firstSize;
+        size_t secondSize;
+
+        path->_ring.push(data, size);
+        size_t count = path->_ring.peek(first, firstSize, second, secondSize);
+        path->_decoder.feed(first, firstSize);
+        path->_decoder.feed(second, secondSize);
+        path->_ring.commit(count);
+
+        if ((RX_CHUNK_IDLE == reason) && (0 < path->_decoder.pending())) {
+            path->_decoder.resync();
+        }
+    }
+
+    UartRxChunker<RX_CHUNK_SIZE> _chunker;
+    SimulatedUart<RX_CHUNK_SIZE> _uart;
+    SpscByteRing<RX_RING_SIZE> _ring;
+    Decoder _decoder;
+};
+
+static void check_receive_path()
+{
+    LineFaults faults = LineFaults();
+    Stream seoul;
+    Stream pstec;
+    seoul_stream(100, faults, seoul);
+    pstec_stream(100, faults, pstec);
+
+    Frames expected;
+    DecoderStats stats;
+    Frames frames;
+    decode<SeoulFrameDecoder>(seoul.bytes, seoul.bytes.size(), expected, stats);
+    ReceivePath<SeoulFrameDecoder> seoulPath(SEOUL_RESPONSE_ETX, 1200, &on_frame, &frames);
+    seoulPath.receive(seoul);
+    CHECK(expected.frames == frames.frames);
+    CHECK_EQUAL(0, seoulPath.overflows());
+
+    expected.frames.clear();
+    frames.frames.clear();
+    decode<PstecFrameDecoder>(pstec.bytes, pstec.bytes.size(), expected, stats);
+    ReceivePath<PstecFrameDecoder> pstecPath(PSTEC_RESPONSE_ETX, 4800, &on_frame, &frames);
+    pstecPath.receive(pstec);
+    CHECK(expected.frames == frames.frames);
+    CHECK_EQUAL(0, pstecPath.overflows());
+}
+
+template <typename Decoder>
+static void bench_decoder(const char *name, const Stream &stream)
+{
+    for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++) {
+        size_t chunk = chunkSizes[c];
+        size_t frames = 0;
+
+        uint64_t ns = host_test_time(15, [&]() {
+            Decoder decoder(&count_frame, &frames);
+            frames = 0;
+            for (size_t i = 0; i < stream.bytes.size(); i += chunk) {
+                decoder.feed(&stream.bytes[i], (chunk < stream.bytes.size() - i) ? chunk : (stream.bytes.size() - i));
+            }
+        });
+        double seconds = ns / 1e9;
+        printf("  %-6s chunk %4u  %6.2f ns/byte  %8.1f MB/s  %10.0f frames/s\n", name, (unsigned)chunk,
+               (double)ns / stream.bytes.size(), stream.bytes.size() / seconds / 1e6, frames / seconds);
+    }
+}
+
+template <typename Decoder>
+static void bench_path(const char *name, const Stream &stream, int endByte, uint32_t baud)
+{
+    size_t frames = 0;
+    uint64_t ns = host_test_time(15, [&]() {
+        ReceivePath<Decoder> path(endByte, baud, &count_frame, &frames);
+        frames = 0;
+        path.receive(stream);
+    });
+    double seconds = ns / 1e9;
+    printf("  %-6s path        %6.2f ns/byte  %8.1f MB/s  %10.0f frames/s\n", name,
+           (double)ns / stream.bytes.size(), stream.bytes.size() / seconds / 1e6, frames / seconds);
+}
+
+static void bench(size_t reads)
+{
+    LineFaults faults = LineFaults();
+    Stream seoul;
+    Stream pstec;
+    seoul_stream(reads, faults, seoul);
+    pstec_stream(reads, faults, pstec);
+
+    printf("Decoder throughput, %u responses per protocol, best of 15 runs:\n", (unsigned)reads);
+    bench_decoder<SeoulFrameDecoder>("Seoul", seoul);
+    bench_decoder<PstecFrameDecoder>("PSTEC", pstec);
+    printf("Receive path, UART FIFO of %u -> chunker -> ring -> decoder:\n", RX_FIFO_READ);
+    bench_path<SeoulFrameDecoder>("Seoul", seoul, SEOUL_RESPONSE_ETX, 1200);
+    bench_path<PstecFrameDecoder>("PSTEC", pstec, PSTEC_RESPONSE_ETX, 4800);
+}
+
+int main(int argc, char **argv)
+{
+    check_seoul_clean();
+    check_pstec_clean();
+    check_faults();
+    check_receive_path();
+
+    unsigned long reads = host_test_arg(argc, argv, "bench", 0, 2000);
+    if (0 < reads) {
+        bench(reads);
+    }
+    return host_test_done("decoder_test");
+}
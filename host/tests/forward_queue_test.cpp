@@ -0,0 +1,536 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * ForwardQueue on a temporary directory: draining in order, acknowledged by
+ * delivery status or by the receiver, retries and giving up, a link that
+ * flaps while a receiver loses and duplicates batches, reopening, a torn
+ * record and a full queue. Files must only grow, and the file writes are
+ * counted.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter -Istorage host/tests/forward_queue_test.cpp \
+ *       storage/ForwardQueue.cpp -o host-build/forward_queue_test
+ *   host-build/forward_queue_test bench
+ *
+ * bench=N queues N readings with the link down and drains them, and prints
+ * the time and the file writes per reading.
+ */
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "HostTest.h"
+#include "ForwardQueue.h"
+
+static char directory[] = "/tmp/forward_queue_XXXXXX";
+
+/** Batches as the link gets them. */
+struct Link {
+    bool accept;
+    std::vector<ForwardEntry> sent;
+    size_t batches;
+    size_t last_count;
+};
+
+static bool send(void *context, const ForwardEntry *entries, size_t count)
+{
+    Link &link = *static_cast<Link *>(context);
+
+    if (!link.accept) {
+        return false;
+    }
+    link.sent.insert(link.sent.end(), entries, entries + count);
+    link.batches++;
+    link.last_count = count;
+    return true;
+}
+
+static MeterReading reading_of(int64_t value)
+{
+    MeterReading reading = { value, -3, METER_UNIT_CUBIC_METRE };
+    return reading;
+}
+
+static void clear_directory()
+{
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    char name[300];
+
+    while ((NULL != dir) && (NULL != (entry = readdir(dir)))) {
+        if ('.' != entry->d_name[0]) {
+            snprintf(name, sizeof(name), "%s/%s", directory, entry->d_name);
+            remove(name);
+        }
+    }
+    if (NULL != dir) {
+        closedir(dir);
+    }
+}
+
+/** Size of every segment file. */
+static std::map<std::string, long> segment_sizes()
+{
+    std::map<std::string, long> sizes;
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    struct stat info;
+    char name[300];
+
+    while ((NULL != dir) && (NULL != (entry = readdir(dir)))) {
+        snprintf(name, sizeof(name), "%s/%s", directory, entry->d_name);
+        if ((NULL != strstr(entry->d_name, ".fwd")) && (0 == stat(name, &info))) {
+            sizes[entry->d_name] = info.st_size;
+        }
+    }
+    if (NULL != dir) {
+        closedir(dir);
+    }
+    return sizes;
+}
+
+/** Files that stay must only have grown, by whole records. */
+static void check_append_only(const std::map<std::string, long> &before, const std::map<std::string, long> &after)
+{
+    for (const auto &file : after) {
+        auto old = before.find(file.first);
+        if (before.end() != old) {
+            CHECK(old->second <= file.second);
+        }
+        CHECK_EQUAL(0, file.second % (long)sizeof(ForwardEntry));
+    }
+}
+
+/** Run the queue every 100 ms for @p ms, acknowledging each batch by delivery status. */
+static uint32_t drain(ForwardQueue &queue, Link &link, uint32_t now, uint32_t ms)
+{
+    for (uint32_t end = now + ms; (int32_t)(end - now) > 0; now += 100) {
+        size_t batches = link.batches;
+        queue.run(now);
+        if (batches != link.batches) {
+            queue.delivered(true, now);
+        }
+    }
+    return now;
+}
+
+static void test_drain()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    ForwardQueue queue(directory, 1024, &send, &link);
+    queue.configure(8, 2000, 30000, 0);
+    CHECK_EQUAL(0, queue.open());
+
+    // Link down: queued in the write buffer, then one append per 8 readings
+    for (int i = 0; i < 20; i++) {
+        CHECK_EQUAL(0, queue.push((uint8_t)(i % 3), 1000 + i, reading_of(i)));
+    }
+    CHECK_EQUAL(20, queue.backlog());
+    CHECK_EQUAL(2, queue.stats().writes);
+    CHECK_EQUAL(0, queue.run(0));
+    CHECK_EQUAL(0, link.batches);
+    CHECK_EQUAL(16 * (long)sizeof(ForwardEntry), segment_sizes()["00000000.fwd"]);
+
+    // Link up: batches of 8 at least 2 s apart, each waiting for its acknowledgement
+    queue.set_link(true, 0);
+    CHECK_EQUAL(30000, queue.run(0));
+    CHECK_EQUAL(1, link.batches);
+    CHECK_EQUAL(8, link.last_count);
+    CHECK_EQUAL(3, queue.stats().writes);
+    CHECK_EQUAL(29000, queue.run(1000));
+    CHECK_EQUAL(1, link.batches);
+    queue.delivered(true, 1000);
+    CHECK_EQUAL(12, queue.backlog());
+    CHECK_EQUAL(1000, queue.run(1000));
+    queue.run(2000);
+    CHECK_EQUAL(2, link.batches);
+    queue.delivered(true, 2000);
+
+    drain(queue, link, 2100, 10000);
+    CHECK_EQUAL(0, queue.backlog());
+    CHECK_EQUAL(3, link.batches);
+    CHECK_EQUAL(20, link.sent.size());
+    for (size_t i = 0; i < link.sent.size(); i++) {
+        CHECK_EQUAL(i + 1, link.sent[i].seq);
+        CHECK_EQUAL(i, link.sent[i].reading.value);
+        CHECK_EQUAL(1000 + i, link.sent[i].reading.timestamp);
+        CHECK_EQUAL(i % 3, link.sent[i].reading.meter);
+    }
+    CHECK_EQUAL(20, queue.stats().delivered);
+
+    // Less than FORWARD_QUEUE_CURSOR_INTERVAL acknowledged: no cursor write
+    CHECK_EQUAL(3, queue.stats().writes);
+}
+
+static void test_receiver_ack()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    ForwardQueue queue(directory, 1024, &send, &link);
+    queue.configure(8, 2000, 30000, 0);
+    CHECK_EQUAL(0, queue.open());
+
+    for (int i = 0; i < 20; i++) {
+        queue.push(0, 1000 + i, reading_of(i));
+    }
+    queue.set_link(true, 0);
+    queue.run(0);
+    CHECK_EQUAL(1, link.batches);
+
+    // No observer, so no delivery status: the receiver reports what it has
+    CHECK(!queue.acknowledge(21));
+    CHECK(queue.acknowledge(8));
+    CHECK_EQUAL(12, queue.backlog());
+    CHECK_EQUAL(0, queue.run(2000) - 30000);
+    CHECK_EQUAL(2, link.batches);
+    CHECK_EQUAL(9, link.sent[8].seq);
+
+    // It may be ahead of the batch in flight, or behind it
+    CHECK(queue.acknowledge(18));
+    CHECK_EQUAL(2, queue.backlog());
+    CHECK(queue.acknowledge(5));
+    CHECK_EQUAL(2, queue.backlog());
+    queue.run(4000);
+    CHECK_EQUAL(3, link.batches);
+    CHECK_EQUAL(19, link.sent.back().seq - 1);
+    CHECK(queue.acknowledge(20));
+    CHECK_EQUAL(0, queue.backlog());
+    CHECK_EQUAL(20, queue.stats().delivered);
+}
+
+static void test_give_up()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    ForwardQueue queue(directory, 1024, &send, &link);
+    queue.configure(8, 2000, 30000, 3);
+    CHECK_EQUAL(0, queue.open());
+
+    for (int i = 0; i < 10; i++) {
+        queue.push(0, 1000 + i, reading_of(i));
+    }
+    queue.set_link(true, 0);
+
+    // Nobody acknowledges: sent 3 times with a growing wait, then given up
+    uint32_t now = 0;
+    for (int i = 0; i < 200; i++, now += 1000) {
+        queue.run(now);
+    }
+    CHECK_EQUAL(6, link.batches);
+    CHECK_EQUAL(10, queue.stats().abandoned);
+    CHECK_EQUAL(0, queue.backlog());
+    CHECK_EQUAL(6, queue.stats().failures);
+
+    // Retries of the first batch: at 0, 32 s, 66 s
+    CHECK_EQUAL(1, link.sent[0].seq);
+    CHECK_EQUAL(1, link.sent[8].seq);
+    CHECK_EQUAL(1, link.sent[16].seq);
+    CHECK_EQUAL(9, link.sent[24].seq);
+
+    // A link refusing the batch counts as an attempt too
+    link.accept = false;
+    queue.push(0, 2000, reading_of(100));
+    for (int i = 0; i < 400; i++, now += 1000) {
+        queue.run(now);
+    }
+    CHECK_EQUAL(11, queue.stats().abandoned);
+    CHECK_EQUAL(0, queue.backlog());
+}
+
+static void test_flapping_link()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    ForwardQueue queue(directory, 1024, &send, &link);
+    queue.configure(8, 2000, 30000, 0);
+    CHECK_EQUAL(0, queue.open());
+
+    srand(7);
+    std::map<std::string, long> sizes = segment_sizes();
+    std::set<uint32_t> received;
+    std::vector<int64_t> values;
+    size_t duplicates = 0;
+    size_t pushed = 0;
+    size_t pushed_up = 0;
+    size_t pending_ack = 0;     // batch delivered but the status not reported yet
+    uint32_t status_at = 0;
+    bool up = false;
+
+    // 6 hours in 100 ms steps: a reading every 10 s, the link changes every few minutes
+    for (uint32_t now = 0; now < 6 * 3600 * 1000; now += 100) {
+        if (0 == now % 10000) {
+            CHECK_EQUAL(0, queue.push((uint8_t)(pushed % 5), 1000 + now / 1000, reading_of(pushed)));
+            pushed++;
+            pushed_up += up ? 1 : 0;
+        }
+        if (0 == rand() % 1500) {
+            up = !up;
+            queue.set_link(up, now);
+            pending_ack = 0;
+        }
+
+        size_t before = link.sent.size();
+        queue.run(now);
+        if (before != link.sent.size()) {
+            // Lost on the way 1 time in 10, the status lost 1 time in 10 more
+            int fate = rand() % 10;
+            if (0 == fate) {
+                link.sent.resize(before);
+                status_at = now + 500;
+                pending_ack = 1;
+            } else {
+                for (size_t i = before; i < link.sent.size(); i++) {
+                    if (!received.insert(link.sent[i].seq).second) {
+                        duplicates++;
+                    } else {
+                        values.push_back(link.sent[i].reading.value);
+                    }
+                }
+                status_at = now + 300;
+                pending_ack = (1 == fate) ? 0 : 2;
+            }
+        }
+        if ((0 != pending_ack) && (now == status_at)) {
+            queue.delivered(2 == pending_ack, now);
+            pending_ack = 0;
+        }
+
+        if (0 == now % 60000) {
+            std::map<std::string, long> after = segment_sizes();
+            check_append_only(sizes, after);
+            sizes = after;
+        }
+    }
+
+    // Up for good until drained
+    size_t seen = link.sent.size();
+    queue.set_link(true, 6 * 3600 * 1000);
+    drain(queue, link, 6 * 3600 * 1000, 10 * 60 * 1000);
+    for (size_t i = seen; i < link.sent.size(); i++) {
+        if (received.insert(link.sent[i].seq).second) {
+            values.push_back(link.sent[i].reading.value);
+        }
+    }
+
+    CHECK_EQUAL(0, queue.backlog());
+    CHECK_EQUAL(pushed, received.size());
+    CHECK_EQUAL(pushed, *received.rbegin());
+    CHECK_EQUAL(0, queue.stats().dropped);
+    bool in_order = true;
+    for (size_t i = 0; i < values.size(); i++) {
+        in_order &= ((int64_t)i == values[i]);
+    }
+    CHECK(in_order);
+
+    // Appends of 8 readings while the link is down, at most one per reading
+    // while it is up and batches go out, and a cursor write per 32 acknowledged
+    CHECK(queue.stats().writes <= (pushed - pushed_up) / 8 + pushed_up + pushed / FORWARD_QUEUE_CURSOR_INTERVAL + 2);
+    CHECK(0 < duplicates);
+    CHECK(0 < queue.stats().failures);
+}
+
+static void test_reopen()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    uint32_t now = 0;
+    {
+        ForwardQueue queue(directory, 1024, &send, &link);
+        queue.configure(8, 2000, 30000, 0);
+        CHECK_EQUAL(0, queue.open());
+        for (int i = 0; i < 300; i++) {
+            queue.push(0, 1000 + i, reading_of(i));
+        }
+        queue.set_link(true, now);
+        // 5 batches acknowledged, the cursor written at 32
+        for (int i = 0; i < 5; i++, now += 2000) {
+            queue.run(now);
+            queue.delivered(true, now);
+        }
+        CHECK_EQUAL(260, queue.backlog());
+        // The first batch wrote the buffered readings, the power goes
+    }
+
+    ForwardQueue queue(directory, 1024, &send, &link);
+    queue.configure(8, 2000, 30000, 0);
+    CHECK_EQUAL(0, queue.open());
+    CHECK_EQUAL(300 - 32, queue.backlog());
+    CHECK_EQUAL(1, segment_sizes().count("00000000.fwd"));
+
+    // Numbers go on after the last one on file, never reused
+    queue.push(0, 5000, reading_of(5000));
+    link.sent.clear();
+    queue.set_link(true, now);
+    drain(queue, link, now, 20 * 60 * 1000);
+    CHECK_EQUAL(300 - 32 + 1, link.sent.size());
+    CHECK_EQUAL(33, link.sent.front().seq);
+    CHECK_EQUAL(301, link.sent.back().seq);
+    CHECK_EQUAL(5000, link.sent.back().reading.value);
+
+    // Acknowledged segments are gone, the newest stays to carry on from
+    std::map<std::string, long> sizes = segment_sizes();
+    CHECK_EQUAL(1, sizes.size());
+    CHECK_EQUAL(1, sizes.count("00000002.fwd"));
+
+    // Readings acknowledged since the last cursor write are sent again
+    ForwardQueue again(directory, 1024, &send, &link);
+    CHECK_EQUAL(0, again.open());
+    CHECK_EQUAL(301 % FORWARD_QUEUE_CURSOR_INTERVAL, again.backlog());
+}
+
+static void test_torn()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    {
+        ForwardQueue queue(directory, 1024, &send, &link);
+        CHECK_EQUAL(0, queue.open());
+        for (int i = 0; i < 16; i++) {
+            queue.push(0, 1000 + i, reading_of(i));
+        }
+    }
+
+    // The last record half written, another one garbled
+    char name[300];
+    snprintf(name, sizeof(name), "%s/00000000.fwd", directory);
+    FILE *file = fopen(name, "r+b");
+    CHECK(NULL != file);
+    if (NULL != file) {
+        fseek(file, 3 * sizeof(ForwardEntry) + 10, SEEK_SET);
+        fputc(0x55, file);
+        fseek(file, 15 * sizeof(ForwardEntry) + 12, SEEK_SET);
+        ftruncate(fileno(file), 15 * sizeof(ForwardEntry) + 12);
+        fclose(file);
+    }
+
+    ForwardQueue queue(directory, 1024, &send, &link);
+    queue.configure(8, 2000, 30000, 0);
+    CHECK_EQUAL(0, queue.open());
+    CHECK_EQUAL(15, queue.backlog());
+    for (int i = 0; i < 4; i++) {
+        queue.push(0, 2000 + i, reading_of(100 + i));
+    }
+    CHECK_EQUAL(0, queue.flush());
+
+    // After the torn record, appending goes on in the next segment
+    CHECK_EQUAL(4 * (long)sizeof(ForwardEntry), segment_sizes()["00000001.fwd"]);
+
+    queue.set_link(true, 0);
+    drain(queue, link, 0, 10 * 60 * 1000);
+    CHECK_EQUAL(0, queue.backlog());
+    CHECK_EQUAL(14 + 4, link.sent.size());
+    CHECK_EQUAL(1, queue.stats().dropped);
+    bool garbled_sent = false;
+    for (const ForwardEntry &entry : link.sent) {
+        garbled_sent |= (4 == entry.seq);
+    }
+    CHECK(!garbled_sent);
+    CHECK_EQUAL(FORWARD_QUEUE_SEGMENT_ENTRIES + 1, link.sent[14].seq);
+}
+
+static void test_full()
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    ForwardQueue queue(directory, 2 * FORWARD_QUEUE_SEGMENT_ENTRIES, &send, &link);
+    queue.configure(8, 2000, 30000, 0);
+    CHECK_EQUAL(0, queue.open());
+
+    std::map<std::string, long> sizes = segment_sizes();
+    for (int i = 0; i < 3 * FORWARD_QUEUE_SEGMENT_ENTRIES + 40; i++) {
+        CHECK_EQUAL(0, queue.push(0, 1000 + i, reading_of(i)));
+        std::map<std::string, long> after = segment_sizes();
+        check_append_only(sizes, after);
+        sizes = after;
+    }
+    CHECK_EQUAL(0, queue.flush());
+
+    // The oldest segments went whole, with their readings
+    CHECK_EQUAL(2 * FORWARD_QUEUE_SEGMENT_ENTRIES, queue.stats().dropped);
+    CHECK_EQUAL(FORWARD_QUEUE_SEGMENT_ENTRIES + 40, queue.backlog());
+    CHECK_EQUAL(2, segment_sizes().size());
+
+    queue.set_link(true, 0);
+    drain(queue, link, 0, 30 * 60 * 1000);
+    CHECK_EQUAL(FORWARD_QUEUE_SEGMENT_ENTRIES + 40, link.sent.size());
+    CHECK_EQUAL(2 * FORWARD_QUEUE_SEGMENT_ENTRIES + 1, link.sent.front().seq);
+    CHECK_EQUAL(2 * FORWARD_QUEUE_SEGMENT_ENTRIES, link.sent.front().reading.value);
+}
+
+static void bench(unsigned long readings)
+{
+    clear_directory();
+    Link link = { true, {}, 0, 0 };
+    ForwardQueue queue(directory, FORWARD_QUEUE_MAX_SEGMENTS * FORWARD_QUEUE_SEGMENT_ENTRIES, &send, &link);
+    queue.configure(FORWARD_QUEUE_MAX_BATCH, 0, 30000, 0);
+    queue.open();
+    link.sent.reserve(readings);
+
+    uint64_t start = host_test_ns();
+    for (unsigned long i = 0; i < readings; i++) {
+        queue.push((uint8_t)(i % 5), 1000 + (uint32_t)i, reading_of(i));
+    }
+    queue.flush();
+    uint64_t pushed = host_test_ns() - start;
+    uint32_t push_writes = queue.stats().writes;
+
+    start = host_test_ns();
+    queue.set_link(true, 0);
+    while (0 < queue.backlog()) {
+        size_t batches = link.batches;
+        queue.run(0);
+        if (batches == link.batches) {
+            break;
+        }
+        queue.delivered(true, 0);
+    }
+    uint64_t drained = host_test_ns() - start;
+
+    printf("push: %lu readings, %lu dropped, %.0f ns/reading, %lu file writes\n", readings,
+           (unsigned long)queue.stats().dropped, (double)pushed / readings, (unsigned long)push_writes);
+    printf("drain: %lu readings in %lu batches, %.0f ns/reading, %lu file writes\n", (unsigned long)link.sent.size(),
+           (unsigned long)link.batches, (double)drained / link.sent.size(), (unsigned long)(queue.stats().writes - push_writes));
+}
+
+int main(int argc, char **argv)
+{
+    if (NULL == mkdtemp(directory)) {
+        printf("no temporary directory\n");
+        return 1;
+    }
+
+    test_drain();
+    test_receiver_ack();
+    test_give_up();
+    test_flapping_link();
+    test_reopen();
+    test_torn();
+    test_full();
+
+    unsigned long readings = host_test_arg(argc, argv, "bench", 0, FORWARD_QUEUE_MAX_SEGMENTS * FORWARD_QUEUE_SEGMENT_ENTRIES);
+    if (0 < readings) {
+        bench(readings);
+    }
+
+    clear_directory();
+    rmdir(directory);
+    return host_test_done("forward_queue_test");
+}
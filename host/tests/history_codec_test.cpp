@@ -0,0 +1,415 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * History codec: every trace decoded back exactly, the block size of a
+ * steady trace to the byte, full buffers, scale changes, extreme values
+ * and cut or corrupt blocks. The recorded traces are meter responses built
+ * byte by byte and run through the frame decoders, as the gateway stores them.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/history_codec_test.cpp meter/HistoryCodec.cpp \
+ *       meter/SeoulFrameDecoder.cpp meter/PstecFrameDecoder.cpp meter/MbusRecords.cpp meter/MeterReading.cpp \
+ *       meter/Bcd.cpp -o host-build/history_codec_test
+ *   host-build/history_codec_test bench
+ *
+ * bench prints bytes per sample, the ratio to the 16 byte StoredReading
+ * and the encode and decode time per sample of every trace.
+ */
+#include <string.h>
+
+#include <vector>
+
+#include "HostTest.h"
+#include "HistoryCodec.h"
+#include "PstecFrameDecoder.h"
+#include "SeoulFrameDecoder.h"
+
+// Record size in ReadingStore.h, what a sample costs uncompressed
+#define STORED_READING_SIZE     16
+
+// Samples per trace
+#define TRACE_LENGTH            1000
+
+struct Sample {
+    uint32_t timestamp;
+    MeterReading reading;
+};
+
+typedef std::vector<Sample> Trace;
+
+/** Seeded generator, so every run sees the same traces. */
+static uint32_t next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/** Polls every @p interval seconds, off by up to @p jitter, the value moving by 0 to @p step. */
+static Trace synthetic(uint32_t interval, uint32_t jitter, uint32_t step, uint32_t seed)
+{
+    Trace trace;
+    Sample sample = { 1700000000, { 123456789, -3, METER_UNIT_CUBIC_METRE } };
+
+    for (size_t i = 0; i < TRACE_LENGTH; i++) {
+        uint32_t t = 1700000000 + (uint32_t)i * interval;
+        sample.timestamp = jitter ? (t - jitter + next_random(seed) % (2 * jitter + 1)) : t;
+        trace.push_back(sample);
+        sample.reading.value += step ? (next_random(seed) % (step + 1)) : 0;
+    }
+    return trace;
+}
+
+/** Any value at any time, the worst case of the codec. */
+static Trace random_trace(uint32_t seed)
+{
+    Trace trace;
+    Sample sample = { 0, { 0, -4, METER_UNIT_KILOWATT_HOUR } };
+
+    for (size_t i = 0; i < TRACE_LENGTH; i++) {
+        sample.timestamp = next_random(seed);
+        sample.reading.value = ((int64_t)next_random(seed) << 32) | next_random(seed);
+        trace.push_back(sample);
+    }
+    return trace;
+}
+
+struct Recorder {
+    bool (*decode)(const uint8_t *frame, size_t length, MeterReading &reading);
+    uint32_t timestamp;
+    Trace trace;
+};
+
+static void on_frame(void *context, const uint8_t *frame, size_t length)
+{
+    Recorder *recorder = static_cast<Recorder *>(context);
+    Sample sample;
+
+    sample.timestamp = recorder->timestamp;
+    if (recorder->decode(frame, length, sample.reading)) {
+        recorder->trace.push_back(sample);
+    }
+}
+
+/** An M-Bus long frame as the Seoul meter sends it, the volume in litres at byte 15. */
+static size_t seoul_frame(uint8_t *frame, uint32_t litres)
+{
+    static const uint8_t header[] = {
+        SEOUL_RESPONSE_STX, 0x0F, 0x0F, SEOUL_RESPONSE_STX, 0x08, 0x01, 0x78,
+        0x0C, 0x78, 0x78, 0x56, 0x34, 0x12,     // fabrication number 12345678
+        0x0C, 0x13                              // volume, 8 BCD digits in litres
+    };
+    size_t n = sizeof(header);
+
+    memcpy(frame, header, n);
+    for (int i = 0; i < 4; i++, litres /= 100) {
+        frame[n++] = (uint8_t)((((litres / 10) % 10) << 4) | (litres % 10));
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 4; i < n; i++) {
+        checksum += frame[i];
+    }
+    frame[n++] = checksum;
+    frame[n++] = SEOUL_RESPONSE_ETX;
+    return n;
+}
+
+/**
+ * The PSTEC line as the gateway hears it: the echo of its request, then
+ * the response with the 5 BCD byte reading, most significant first.
+ */
+static size_t pstec_frames(uint8_t *frame, uint8_t type, uint64_t value)
+{
+    size_t n = 0;
+
+    frame[n++] = PSTEC_REQUEST_STX;
+    frame[n++] = type;
+    frame[n++] = (uint8_t)((PSTEC_REQUEST_STX + type) & 0x7F);
+    frame[n++] = PSTEC_REQUEST_ETX;
+
+    uint8_t *response = frame + n;
+    memset(response, 0, PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT);
+    response[0] = PSTEC_RESPONSE_STX;
+    response[1] = type;
+    for (int i = 6; i >= 2; i--, value /= 100) {
+        response[i] = (uint8_t)((((value / 10) % 10) << 4) | (value % 10));
+    }
+    uint8_t bcc = 0;
+    for (size_t i = 0; i < 12; i++) {
+        bcc += response[i];
+    }
+    response[12] = bcc & 0x7F;
+    response[13] = PSTEC_RESPONSE_ETX;
+    return n + PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT;
+}
+
+/** Seoul water meter polled every 60 s, its responses decoded. */
+static Trace seoul_trace(uint32_t seed)
+{
+    Recorder recorder = { &seoul_decode_reading, 0, Trace() };
+    SeoulFrameDecoder decoder(&on_frame, &recorder);
+    uint8_t frame[32];
+    uint32_t litres = 123456;
+
+    for (size_t i = 0; i < TRACE_LENGTH; i++) {
+        recorder.timestamp = 1700000000 + (uint32_t)i * 60 + next_random(seed) % 2;
+        litres += 7;
+        decoder.feed(frame, seoul_frame(frame, litres));
+    }
+    return recorder.trace;
+}
+
+/** One PSTEC meter polled every @p interval seconds, its responses decoded. */
+static Trace pstec_trace(uint8_t type, uint64_t value, uint32_t perRead, uint32_t interval)
+{
+    Recorder recorder = { &pstec_decode_reading, 0, Trace() };
+    PstecFrameDecoder decoder(&on_frame, &recorder);
+    uint8_t frame[32];
+
+    for (size_t i = 0; i < TRACE_LENGTH; i++) {
+        recorder.timestamp = 1700000000 + (uint32_t)i * interval;
+        value += perRead;
+        decoder.feed(frame, pstec_frames(frame, type, value));
+    }
+    return recorder.trace;
+}
+
+/** Encode the whole trace into one block. @return Samples taken */
+static size_t encode(const Trace &trace, std::vector<uint8_t> &block)
+{
+    HistoryEncoder encoder(block.data(), block.size());
+    size_t count = 0;
+
+    while ((count < trace.size()) && encoder.add(trace[count].timestamp, trace[count].reading)) {
+        count++;
+    }
+    block.resize(encoder.length());
+    return count;
+}
+
+/** Decode @p block and compare it with the start of @p trace. @return Samples read */
+static size_t check_decode(const Trace &trace, const std::vector<uint8_t> &block)
+{
+    HistoryDecoder decoder(block.data(), block.size());
+    uint32_t timestamp;
+    MeterReading reading;
+    size_t count = 0;
+    size_t wrong = 0;
+
+    while (decoder.next(timestamp, reading)) {
+        if ((count >= trace.size()) || (timestamp != trace[count].timestamp) ||
+            (reading.value != trace[count].reading.value) || (reading.exponent != trace[count].reading.exponent) ||
+            (reading.unit != trace[count].reading.unit)) {
+            wrong++;
+        }
+        count++;
+    }
+    CHECK_EQUAL(0, wrong);
+    return count;
+}
+
+struct NamedTrace {
+    const char *name;
+    Trace trace;
+    double max_bytes;       // per sample, the bound the checks hold the codec to
+};
+
+static void test_round_trip(const NamedTrace &named)
+{
+    const Trace &trace = named.trace;
+    std::vector<uint8_t> block(trace.size() * (HISTORY_CODEC_HEADER_SIZE + HISTORY_CODEC_MAX_SAMPLE));
+
+    CHECK_EQUAL(TRACE_LENGTH, trace.size());
+    CHECK_EQUAL(trace.size(), encode(trace, block));
+    CHECK_EQUAL(trace.size(), check_decode(trace, block));
+    if (!CHECK(block.size() <= named.max_bytes * trace.size())) {
+        printf("  %s: %.2f bytes/sample\n", named.name, (double)block.size() / trace.size());
+    }
+}
+
+static size_t varint_size(uint64_t value)
+{
+    size_t n = 1;
+    while (0x80 <= value) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static void test_steady_size()
+{
+    // Steady interval, small increments: one byte of time and one of value per sample
+    Trace trace = synthetic(60, 0, 20, 7);
+    std::vector<uint8_t> block(4096);
+
+    CHECK_EQUAL(trace.size(), encode(trace, block));
+    size_t expected = HISTORY_CODEC_HEADER_SIZE + varint_size(trace[0].timestamp) +
+                      varint_size(2 * (uint64_t)trace[0].reading.value) + 2 * (trace.size() - 1);
+    CHECK_EQUAL(expected, block.size());
+
+    // The same time and value twice still costs two bytes
+    uint8_t buffer[2 * (HISTORY_CODEC_HEADER_SIZE + HISTORY_CODEC_MAX_SAMPLE)];
+    HistoryEncoder encoder(buffer, sizeof(buffer));
+    MeterReading reading = { 5, 0, METER_UNIT_WATT };
+    CHECK(encoder.add(100, reading));
+    size_t first = encoder.length();
+    CHECK(encoder.add(100, reading));
+    CHECK_EQUAL(first + 2, encoder.length());
+    CHECK_EQUAL(2, encoder.count());
+}
+
+static void test_full_and_scale()
+{
+    Trace trace = synthetic(60, 1, 1000, 11);
+    std::vector<uint8_t> full(HISTORY_CODEC_HEADER_SIZE + HISTORY_CODEC_MAX_SAMPLE);
+
+    // Every buffer size: whole samples only, and what fits decodes
+    for (size_t size = 0; size < 64; size++) {
+        std::vector<uint8_t> block(size);
+        size_t count = encode(trace, block);
+        CHECK(block.size() <= size);
+        CHECK_EQUAL(count, check_decode(trace, block));
+    }
+
+    // A full encoder keeps refusing, and its length stays put
+    std::vector<uint8_t> block(20);
+    HistoryEncoder encoder(block.data(), block.size());
+    size_t count = 0;
+    while (encoder.add(trace[count].timestamp, trace[count].reading)) {
+        count++;
+    }
+    size_t length = encoder.length();
+    CHECK(!encoder.add(trace[count].timestamp, trace[count].reading));
+    CHECK_EQUAL(length, encoder.length());
+    CHECK_EQUAL(count, encoder.count());
+
+    // Another exponent or unit needs a new block
+    encoder.reset();
+    CHECK_EQUAL(0, encoder.length());
+    MeterReading reading = { 1, -3, METER_UNIT_CUBIC_METRE };
+    CHECK(encoder.add(1, reading));
+    reading.exponent = -4;
+    CHECK(!encoder.add(2, reading));
+    reading.exponent = -3;
+    reading.unit = METER_UNIT_KILOWATT_HOUR;
+    CHECK(!encoder.add(2, reading));
+    reading.unit = METER_UNIT_CUBIC_METRE;
+    CHECK(encoder.add(2, reading));
+    CHECK_EQUAL(2, encoder.count());
+}
+
+static void test_extremes()
+{
+    Trace trace;
+    const uint32_t times[] = { 0, UINT32_MAX, 0, 1, UINT32_MAX - 1, 1700000000, 1700000000 };
+    const int64_t values[] = { INT64_MIN, INT64_MAX, INT64_MIN, 0, -1, INT64_MAX, 1 };
+
+    for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+        Sample sample = { times[i], { values[i], -128, 0xFF } };
+        trace.push_back(sample);
+    }
+    std::vector<uint8_t> block(trace.size() * (HISTORY_CODEC_HEADER_SIZE + HISTORY_CODEC_MAX_SAMPLE));
+    CHECK_EQUAL(trace.size(), encode(trace, block));
+    CHECK_EQUAL(trace.size(), check_decode(trace, block));
+}
+
+static void test_corrupt()
+{
+    Trace trace = synthetic(300, 0, 100000, 3);
+    std::vector<uint8_t> block(4096);
+    size_t count = encode(trace, block);
+    uint32_t timestamp;
+    MeterReading reading;
+
+    // Empty and header only blocks hold nothing
+    HistoryDecoder empty(block.data(), 0);
+    CHECK(!empty.next(timestamp, reading));
+    HistoryDecoder header(block.data(), HISTORY_CODEC_HEADER_SIZE);
+    CHECK(!header.next(timestamp, reading));
+
+    // A cut block decodes up to the cut, never past it
+    for (size_t cut = 0; cut < 64; cut++) {
+        std::vector<uint8_t> part(block.begin(), block.begin() + cut);
+        size_t read = check_decode(trace, part);
+        CHECK(read <= count);
+    }
+
+    // A varint that never ends is refused
+    std::vector<uint8_t> endless(HISTORY_CODEC_HEADER_SIZE + 12, 0xFF);
+    HistoryDecoder decoder(endless.data(), endless.size());
+    CHECK(!decoder.next(timestamp, reading));
+}
+
+static void bench(const std::vector<NamedTrace> &traces, unsigned runs)
+{
+    printf("%-28s %8s %8s %9s %9s\n", "trace", "B/sample", "vs 16 B", "encode", "decode");
+    for (const NamedTrace &named : traces) {
+        const Trace &trace = named.trace;
+        std::vector<uint8_t> block(trace.size() * (HISTORY_CODEC_HEADER_SIZE + HISTORY_CODEC_MAX_SAMPLE));
+        HistoryEncoder encoder(block.data(), block.size());
+        volatile uint64_t sink = 0;
+
+        uint64_t encodeNs = host_test_time(runs, [&]() {
+            encoder.reset();
+            for (const Sample &sample : trace) {
+                encoder.add(sample.timestamp, sample.reading);
+            }
+        });
+        size_t length = encoder.length();
+
+        uint64_t decodeNs = host_test_time(runs, [&]() {
+            HistoryDecoder decoder(block.data(), length);
+            uint32_t timestamp;
+            MeterReading reading;
+            while (decoder.next(timestamp, reading)) {
+                sink += timestamp;
+            }
+        });
+
+        double perSample = (double)length / trace.size();
+        printf("%-28s %8.2f %7.1fx %6.1f ns %6.1f ns\n", named.name, perSample, STORED_READING_SIZE / perSample,
+               (double)encodeNs / trace.size(), (double)decodeNs / trace.size());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<NamedTrace> traces = {
+        { "steady 60 s", synthetic(60, 0, 20, 1), 2.1 },
+        { "water 60 s +-1 s", synthetic(60, 1, 20, 2), 2.1 },
+        { "gas 300 s", synthetic(300, 0, 500, 3), 3.1 },
+        { "Seoul 60 s, recorded", seoul_trace(4), 2.1 },
+        { "PSTEC gas 300 s, recorded", pstec_trace(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS, 123456789, 57, 300), 2.1 },
+        { "PSTEC heat 60 s, recorded", pstec_trace(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT, 9999000000ULL, 1337, 60), 3.1 },
+        { "random values and times", random_trace(5), 16.0 },
+    };
+
+    for (const NamedTrace &named : traces) {
+        test_round_trip(named);
+    }
+    test_steady_size();
+    test_full_and_scale();
+    test_extremes();
+    test_corrupt();
+
+    unsigned long runs = host_test_arg(argc, argv, "bench", 0, 50);
+    if (0 < runs) {
+        bench(traces, (unsigned)runs);
+    }
+
+    return host_test_done("history_codec_test");
+}
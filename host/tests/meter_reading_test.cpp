@@ -0,0 +1,158 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * MeterReading text both ways and comparison: numbers parsed with and
+ * without sign and point, the 18 digits a value may have, text that is
+ * not a number, formats parsed back, and comparing and subtracting
+ * across exponents. bench times a format and a parse of a reading.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/meter_reading_test.cpp meter/MeterReading.cpp \
+ *       -o host-build/meter_reading_test
+ *   host-build/meter_reading_test bench
+ */
+#include <string.h>
+
+#include "HostTest.h"
+#include "MeterReading.h"
+
+static bool parses(const char *text, int64_t value, int exponent)
+{
+    MeterReading reading = { 1, 1, METER_UNIT_WATT };
+
+    return CHECK(meter_reading_parse(text, reading)) && CHECK_EQUAL(value, reading.value) &&
+           CHECK_EQUAL(exponent, reading.exponent) && CHECK_EQUAL(METER_UNIT_NONE, reading.unit);
+}
+
+static void test_parse()
+{
+    MeterReading reading;
+
+    parses("0", 0, 0);
+    parses("12.5", 125, -1);
+    parses("-0.001", -1, -3);
+    parses("+7", 7, 0);
+    parses("3.", 3, 0);
+    parses(".25", 25, -2);
+    parses("007", 7, 0);
+
+    // 18 digits always fit, a 19th may not; leading zeros count
+    parses("999999999999999999", 999999999999999999LL, 0);
+    parses("-999999999999999999", -999999999999999999LL, 0);
+    parses(".000000000000000001", 1, -18);
+    parses("12345678.9012345678", 123456789012345678LL, -10);
+    CHECK(!meter_reading_parse("1000000000000000000", reading));
+    CHECK(!meter_reading_parse("-1000000000000000000", reading));
+    CHECK(!meter_reading_parse("1.000000000000000000", reading));
+    CHECK(!meter_reading_parse("0.000000000000000001", reading));
+
+    CHECK(!meter_reading_parse("", reading));
+    CHECK(!meter_reading_parse("-", reading));
+    CHECK(!meter_reading_parse(".", reading));
+    CHECK(!meter_reading_parse("1.2.3", reading));
+    CHECK(!meter_reading_parse("1e3", reading));
+    CHECK(!meter_reading_parse(" 1", reading));
+    CHECK(!meter_reading_parse("1 ", reading));
+    CHECK(!meter_reading_parse("--1", reading));
+}
+
+static void test_format()
+{
+    static const MeterReading readings[] = {
+        { 0, 0, 0 }, { 1234567890, -4, 0 }, { -5, -3, 0 }, { 42, 2, 0 }, { 999999999999999999LL, -17, 0 },
+        { INT64_MIN, 0, 0 }
+    };
+    static const char *texts[] = {
+        "0", "123456.7890", "-0.005", "4200", "9.99999999999999999", "-9223372036854775808"
+    };
+    char text[METER_READING_TEXT_SIZE];
+
+    for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+        CHECK_EQUAL(strlen(texts[i]), meter_reading_format(readings[i], text, sizeof(text)));
+        CHECK(0 == strcmp(texts[i], text));
+    }
+
+    // Too small a buffer, counting the terminator
+    CHECK_EQUAL(0, meter_reading_format(readings[1], text, strlen(texts[1])));
+    CHECK_EQUAL(strlen(texts[1]), meter_reading_format(readings[1], text, strlen(texts[1]) + 1));
+
+    // Back to the same value; a positive exponent comes back as zeros
+    for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]) - 1; i++) {
+        MeterReading parsed;
+        meter_reading_format(readings[i], text, sizeof(text));
+        CHECK(meter_reading_parse(text, parsed));
+        CHECK_EQUAL(0, meter_reading_compare(readings[i], parsed));
+    }
+}
+
+static void test_compare()
+{
+    MeterReading a = { 125, -1, 0 };        // 12.5
+    MeterReading b = { 12500, -3, 0 };      // 12.500
+    MeterReading c = { 13, 0, 0 };
+    MeterReading big = { 999999999999999999LL, 2, 0 };
+    MeterReading result;
+
+    CHECK_EQUAL(0, meter_reading_compare(a, b));
+    CHECK(meter_reading_compare(a, c) < 0);
+    CHECK(meter_reading_compare(c, b) > 0);
+    CHECK(meter_reading_compare(big, b) > 0);
+    CHECK(meter_reading_compare(b, big) < 0);
+
+    CHECK(meter_reading_subtract(c, a, result));
+    CHECK_EQUAL(5, result.value);
+    CHECK_EQUAL(-1, result.exponent);
+
+    // Scaling the larger exponent down overflows
+    CHECK(!meter_reading_subtract(big, b, result));
+}
+
+static void bench(unsigned long count)
+{
+    char text[METER_READING_TEXT_SIZE];
+    MeterReading reading = { 0, -4, 0 };
+    MeterReading parsed;
+
+    uint64_t best = host_test_time(10, [&]() {
+        for (unsigned long i = 0; i < count; i++) {
+            reading.value = 1234567890 + (int64_t)i;
+            meter_reading_format(reading, text, sizeof(text));
+        }
+    });
+    printf("format: %lu readings, %.1f ns/reading\n", count, (double)best / count);
+
+    best = host_test_time(10, [&]() {
+        for (unsigned long i = 0; i < count; i++) {
+            text[0] = (char)('1' + i % 9);
+            meter_reading_parse(text, parsed);
+        }
+    });
+    printf("parse: %lu readings of %u characters, %.1f ns/reading\n", count, (unsigned)strlen(text),
+           (double)best / count);
+}
+
+int main(int argc, char **argv)
+{
+    test_parse();
+    test_format();
+    test_compare();
+
+    unsigned long count = host_test_arg(argc, argv, "bench", 0, 1000000);
+    if (0 < count) {
+        bench(count);
+    }
+
+    return host_test_done("meter_reading_test");
+}
@@ -0,0 +1,396 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * MeterHealth and PollScheduler, then 24 simulated hours of one bus with
+ * four meters polled every 10 s: a fast one, a slow one, a dead one and
+ * one that loses 30% of its answers. The day runs once with the adaptive
+ * policy and once with a fixed 1.5 s timeout and no retries.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/poll_scheduler_test.cpp meter/PollScheduler.cpp \
+ *       meter/MeterHealth.cpp -o host-build/poll_scheduler_test
+ *   host-build/poll_scheduler_test bench
+ *
+ * bench prints the bus time, requests, reads and timeouts of both days.
+ */
+#include "HostTest.h"
+#include "PollScheduler.h"
+
+#define DAY_MS          86400000UL
+#define INTERVAL_MS     10000UL
+#define POLLS_PER_DAY   (DAY_MS / INTERVAL_MS)
+
+static MeterHealthPolicy default_policy()
+{
+    MeterHealthPolicy policy = {
+        METER_HEALTH_MIN_TIMEOUT_MS, METER_HEALTH_TIMEOUT_FACTOR, METER_HEALTH_RETRIES, METER_HEALTH_BACKOFF_MS,
+        METER_HEALTH_DEGRADED_AFTER, METER_HEALTH_OFFLINE_AFTER, METER_HEALTH_PROBE_INTERVAL_MS
+    };
+    return policy;
+}
+
+static void test_histogram()
+{
+    LatencyHistogram histogram;
+
+    CHECK_EQUAL(0, histogram.percentile(500));
+    for (int i = 0; i < 98; i++) {
+        histogram.add(30);
+    }
+    histogram.add(700);
+    histogram.add(9000);
+    CHECK_EQUAL(100, histogram.samples());
+    CHECK_EQUAL(50, histogram.percentile(500));
+    CHECK_EQUAL(800, histogram.percentile(990));
+    CHECK_EQUAL(UINT32_MAX, histogram.percentile(1000));
+    CHECK_EQUAL(98, histogram.count(1));
+    CHECK_EQUAL(1, histogram.count(LATENCY_BUCKETS - 1));
+    CHECK_EQUAL(25, LatencyHistogram::edge(0));
+
+    // Old samples fade: halved once the history is full
+    for (int i = 0; i < LATENCY_HISTORY - 100; i++) {
+        histogram.add(3000);
+    }
+    CHECK_EQUAL(LATENCY_HISTORY, histogram.samples());
+    histogram.add(3000);
+    CHECK_EQUAL(49 + 0 + 0 + (LATENCY_HISTORY - 100) / 2 + 1, histogram.samples());
+    CHECK_EQUAL(49, histogram.count(1));
+}
+
+static void test_health()
+{
+    MeterHealthPolicy policy = default_policy();
+    MeterHealth health;
+
+    health.configure(&policy, 1500, 5000);
+    CHECK_EQUAL(1500, health.timeout_ms());
+
+    // Initial timeout until enough samples, then the 99th percentile doubled
+    for (int i = 0; i < METER_HEALTH_MIN_SAMPLES - 1; i++) {
+        health.on_response(60);
+    }
+    CHECK_EQUAL(1500, health.timeout_ms());
+    health.on_response(60);
+    CHECK_EQUAL(150, health.timeout_ms());
+
+    // The floor, then the ceiling
+    MeterHealth fast;
+    fast.configure(&policy, 1500, 5000);
+    for (int i = 0; i < METER_HEALTH_MIN_SAMPLES; i++) {
+        fast.on_response(5);
+    }
+    CHECK_EQUAL(METER_HEALTH_MIN_TIMEOUT_MS, fast.timeout_ms());
+    MeterHealth slow;
+    slow.configure(&policy, 1500, 5000);
+    for (int i = 0; i < METER_HEALTH_MIN_SAMPLES; i++) {
+        slow.on_response(3000);
+    }
+    CHECK_EQUAL(5000, slow.timeout_ms());
+
+    // Backoff doubles, then no more retries for this poll
+    CHECK_EQUAL(500, health.on_failure());
+    CHECK_EQUAL(1000, health.on_failure());
+    CHECK_EQUAL(0, health.on_failure());
+    CHECK_EQUAL(METER_DEGRADED, health.state());
+    CHECK_EQUAL(0, health.on_failure());
+    CHECK_EQUAL(0, health.on_failure());
+    CHECK_EQUAL(METER_DEGRADED, health.state());
+    CHECK_EQUAL(0, health.on_failure());
+    CHECK_EQUAL(METER_OFFLINE, health.state());
+    CHECK_EQUAL(6, health.failures());
+
+    // One answer and it is back, with its retries
+    health.on_response(60);
+    CHECK_EQUAL(METER_ONLINE, health.state());
+    CHECK_EQUAL(0, health.failures());
+    CHECK_EQUAL(500, health.on_failure());
+
+    CHECK(0 == strcmp("offline", meter_state_name(METER_OFFLINE)));
+}
+
+static unsigned requests[3];
+
+static void count_request(void *context)
+{
+    requests[(intptr_t)context]++;
+}
+
+static void test_scheduler()
+{
+    PollScheduler scheduler;
+    PollMeterConfig config = { 0, 0, INTERVAL_MS, 1000, 5000, &count_request, (void *)0 };
+
+    memset(requests, 0, sizeof(requests));
+    CHECK_EQUAL(-1, scheduler.add_meter(PollMeterConfig(), 0));
+    int low = scheduler.add_meter(config, 0);
+    config.priority = 1;
+    config.context = (void *)1;
+    int high = scheduler.add_meter(config, 0);
+    CHECK_EQUAL(0, low);
+    CHECK_EQUAL(1, high);
+
+    // One bus: the higher priority goes first, the other waits for it
+    CHECK_EQUAL(1000, scheduler.run(0));
+    CHECK_EQUAL(1, requests[1]);
+    CHECK_EQUAL(0, requests[0]);
+    CHECK_EQUAL(1, scheduler.busy(0));
+    CHECK(scheduler.complete(high, 100));
+    CHECK(!scheduler.complete(high, 100));
+    scheduler.run(100);
+    CHECK_EQUAL(1, requests[0]);
+    CHECK_EQUAL(100, scheduler.stats(low)->max_slip_ms);
+
+    // No answer: retried after the backoff, between the regular polls
+    CHECK_EQUAL(500, scheduler.run(1100));
+    CHECK_EQUAL(1, scheduler.stats(low)->timeouts);
+    scheduler.run(1600);
+    CHECK_EQUAL(2, requests[0]);
+    CHECK_EQUAL(1, scheduler.stats(low)->retries);
+    CHECK(scheduler.complete(low, 1700));
+
+    // The regular polls kept their phase
+    scheduler.run(INTERVAL_MS);
+    CHECK_EQUAL(2, requests[1]);
+    CHECK(scheduler.complete(high, INTERVAL_MS + 50));
+    scheduler.run(INTERVAL_MS + 50);
+    CHECK_EQUAL(3, requests[0]);
+    CHECK_EQUAL(2, scheduler.stats(low)->polls);
+
+    // A queued bus only expires a transaction after depth x deadline
+    PollScheduler queued;
+    PollMeterConfig pstec = { 1, 0, INTERVAL_MS, 1000, 3000, &count_request, (void *)2 };
+    queued.set_bus_depth(1, 4);
+    int meter = queued.add_meter(pstec, 0);
+    queued.run(0);
+    CHECK_EQUAL(1, queued.busy(1));
+    queued.run(11999);
+    CHECK_EQUAL(1, queued.busy(1));
+    queued.run(12000);
+    CHECK_EQUAL(1, queued.stats(meter)->timeouts);
+    CHECK_EQUAL(2, requests[2]);
+
+    // The latency the queue measured, not the time since the scheduler started it
+    CHECK(queued.complete(meter, 14000, true, 40));
+    CHECK_EQUAL(1, queued.health(meter)->latency().count(1));
+}
+
+/** Response of one simulated meter. */
+typedef enum {
+    FAST,       // 40 to 60 ms
+    SLOW,       // 650 to 1000 ms
+    DEAD,       // never
+    LOSSY       // 60 to 140 ms, 30% lost
+} Behaviour;
+
+struct Bus;
+
+struct SimMeter {
+    Bus *bus;
+    Behaviour behaviour;
+    int handle;
+    uint32_t seq;           // request the answer in flight belongs to
+    uint32_t started_ms;
+    bool answering;
+    uint32_t answer_ms;
+    uint32_t answer_seq;
+
+    uint32_t requests;
+    uint32_t reads;
+};
+
+struct Bus {
+    PollScheduler scheduler;
+    SimMeter meters[4];
+    uint32_t now;
+    uint32_t random;
+
+    uint64_t busy_ms;
+    uint64_t answering_ms;
+};
+
+struct DayResult {
+    uint64_t busy_ms;
+    uint64_t silence_ms;
+    uint32_t requests[4];
+    uint32_t reads[4];
+    uint32_t timeouts[4];
+};
+
+static uint32_t next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void sim_request(void *context)
+{
+    SimMeter *meter = static_cast<SimMeter *>(context);
+    Bus *bus = meter->bus;
+    uint32_t random = next_random(bus->random);
+
+    meter->requests++;
+    meter->seq++;
+    meter->started_ms = bus->now;
+
+    uint32_t latency = 0;
+    switch (meter->behaviour) {
+        case FAST:
+            latency = 40 + random % 21;
+            break;
+        case SLOW:
+            latency = 650 + random % 351;
+            break;
+        case DEAD:
+            return;
+        case LOSSY:
+            if (30 > (random >> 8) % 100) {
+                return;
+            }
+            latency = 60 + random % 81;
+            break;
+    }
+    meter->answering = true;
+    meter->answer_ms = bus->now + latency;
+    meter->answer_seq = meter->seq;
+}
+
+/** One day of the bus, event by event, as the eventQueue of main.cpp runs it. */
+static DayResult simulate(const MeterHealthPolicy &policy, uint32_t timeoutMs, uint32_t deadlineMs)
+{
+    static const Behaviour behaviours[4] = { FAST, SLOW, DEAD, LOSSY };
+    static Bus bus;
+
+    bus.scheduler = PollScheduler();
+    bus.scheduler.set_health_policy(policy);
+    bus.now = 0;
+    bus.random = 42;
+    bus.busy_ms = 0;
+    bus.answering_ms = 0;
+
+    for (int m = 0; m < 4; m++) {
+        SimMeter &meter = bus.meters[m];
+        meter = SimMeter();
+        meter.bus = &bus;
+        meter.behaviour = behaviours[m];
+        PollMeterConfig config = { 0, 0, INTERVAL_MS, timeoutMs, deadlineMs, &sim_request, &meter };
+        meter.handle = bus.scheduler.add_meter(config, 0);
+    }
+
+    uint32_t next_run = 0;
+    while (bus.now < DAY_MS) {
+        bool run = (0 <= (int32_t)(bus.now - next_run));
+
+        // Answers; one of a request given up on meets no open transaction
+        for (int m = 0; m < 4; m++) {
+            SimMeter &meter = bus.meters[m];
+            if (meter.answering && (0 <= (int32_t)(bus.now - meter.answer_ms))) {
+                meter.answering = false;
+                if ((meter.answer_seq == meter.seq) && bus.scheduler.complete(meter.handle, bus.now)) {
+                    meter.reads++;
+                    bus.answering_ms += bus.now - meter.started_ms;
+                    run = true;
+                }
+            }
+        }
+        if (run) {
+            uint32_t wait = bus.scheduler.run(bus.now);
+            next_run = bus.now + ((0 < wait) ? wait : 1);
+        }
+
+        uint32_t next = next_run;
+        for (int m = 0; m < 4; m++) {
+            if (bus.meters[m].answering && ((int32_t)(bus.meters[m].answer_ms - next) < 0)) {
+                next = bus.meters[m].answer_ms;
+            }
+        }
+        if (0 < bus.scheduler.busy(0)) {
+            bus.busy_ms += next - bus.now;
+        }
+        bus.now = next;
+    }
+
+    DayResult result;
+    result.busy_ms = bus.busy_ms;
+    result.silence_ms = bus.busy_ms - bus.answering_ms;
+    for (int m = 0; m < 4; m++) {
+        result.requests[m] = bus.meters[m].requests;
+        result.reads[m] = bus.meters[m].reads;
+        result.timeouts[m] = bus.scheduler.timeout_ms(bus.meters[m].handle);
+
+        const PollMeterStats *stats = bus.scheduler.stats(bus.meters[m].handle);
+        uint32_t reads = bus.meters[m].reads;
+        CHECK_EQUAL(stats->polls + stats->retries, result.requests[m]);
+        CHECK_EQUAL(stats->responses, reads);
+    }
+    CHECK_EQUAL(METER_OFFLINE, bus.scheduler.health(bus.meters[DEAD].handle)->state());
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    test_histogram();
+    test_health();
+    test_scheduler();
+
+    DayResult adaptive = simulate(default_policy(), 1500, 5000);
+
+    // Fixed 1.5 s for every meter, no retries, never offline
+    MeterHealthPolicy fixed_policy = { 1500, 1, 0, 0, 255, 255, 0 };
+    DayResult fixed = simulate(fixed_policy, 1500, 1500);
+
+    // The live meters keep their poll times: one regular poll per interval
+    static const Behaviour live[] = { FAST, SLOW, LOSSY };
+    for (Behaviour m : live) {
+        CHECK(POLLS_PER_DAY <= adaptive.requests[m]);
+        CHECK_EQUAL(POLLS_PER_DAY, fixed.requests[m]);
+    }
+    CHECK_EQUAL(POLLS_PER_DAY, adaptive.reads[FAST]);
+    CHECK_EQUAL(POLLS_PER_DAY, adaptive.reads[SLOW]);
+
+    // Timeouts follow each meter
+    CHECK_EQUAL(150, adaptive.timeouts[FAST]);
+    CHECK_EQUAL(2400, adaptive.timeouts[SLOW]);
+    CHECK(adaptive.timeouts[LOSSY] <= 300);
+
+    // The dead meter only probed, then every 15 minutes
+    CHECK_EQUAL(POLLS_PER_DAY, fixed.requests[DEAD]);
+    CHECK(adaptive.requests[DEAD] <= METER_HEALTH_OFFLINE_AFTER + METER_HEALTH_RETRIES + DAY_MS / METER_HEALTH_PROBE_INTERVAL_MS + 1);
+    CHECK_EQUAL(0, adaptive.reads[DEAD]);
+
+    // Retries recover most of the lost answers
+    CHECK(adaptive.reads[LOSSY] > fixed.reads[LOSSY]);
+    CHECK(adaptive.reads[LOSSY] * 100 >= POLLS_PER_DAY * 85);
+
+    // The bus spends far less time listening to silence
+    CHECK(adaptive.busy_ms * 2 < fixed.busy_ms);
+    CHECK(adaptive.silence_ms * 10 < fixed.silence_ms);
+
+    if (0 < host_test_arg(argc, argv, "bench", 0, 1)) {
+        printf("%-26s %14s %14s\n", "", "fixed 1.5 s", "adaptive");
+        printf("%-26s %13.1f%% %13.1f%%\n", "bus busy", 100.0 * fixed.busy_ms / DAY_MS, 100.0 * adaptive.busy_ms / DAY_MS);
+        printf("%-26s %13.1f%% %13.1f%%\n", "bus waiting on silence", 100.0 * fixed.silence_ms / DAY_MS,
+               100.0 * adaptive.silence_ms / DAY_MS);
+        printf("%-26s %14lu %14lu\n", "dead meter requests", (unsigned long)fixed.requests[DEAD],
+               (unsigned long)adaptive.requests[DEAD]);
+        printf("%-26s %8lu / %lu %8lu / %lu\n", "30%-loss meter reads", (unsigned long)fixed.reads[LOSSY],
+               (unsigned long)POLLS_PER_DAY, (unsigned long)adaptive.reads[LOSSY], (unsigned long)POLLS_PER_DAY);
+        printf("%-26s %14s %4lu/%lu/%lu ms\n", "timeouts fast/slow/lossy", "1500 ms", (unsigned long)adaptive.timeouts[FAST],
+               (unsigned long)adaptive.timeouts[SLOW], (unsigned long)adaptive.timeouts[LOSSY]);
+    }
+
+    return host_test_done("poll_scheduler_test");
+}
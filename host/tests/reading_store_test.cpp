@@ -0,0 +1,402 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * ReadingStore on a temporary directory: what queries return, what is left
+ * after a reopen, a torn record, the segment limit and expiry, and the
+ * refusal of a timestamp that goes back. UnstampedReadings, which feeds the
+ * store readings taken before the clock was set, is checked with it.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter -Istorage host/tests/reading_store_test.cpp \
+ *       storage/ReadingStore.cpp storage/UnstampedReadings.cpp -o host-build/reading_store_test
+ *   host-build/reading_store_test bench
+ *
+ * bench=N appends N readings of 5 meters, one a minute each, by default as
+ * many as the store holds, then times queries of one meter over the last
+ * hour, day and everything.
+ */
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HostTest.h"
+#include "ReadingStore.h"
+#include "UnstampedReadings.h"
+
+#define START_TIME          1600000000UL
+
+static char directory[] = "/tmp/reading_store_XXXXXX";
+
+static MeterReading reading_of(int64_t value)
+{
+    MeterReading reading = { value, -3, METER_UNIT_CUBIC_METRE };
+    return reading;
+}
+
+/** Remove the segment files, leave the directory. */
+static void clear_directory()
+{
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    char name[300];
+
+    while ((NULL != dir) && (NULL != (entry = readdir(dir)))) {
+        if ('.' != entry->d_name[0]) {
+            snprintf(name, sizeof(name), "%s/%s", directory, entry->d_name);
+            remove(name);
+        }
+    }
+    if (NULL != dir) {
+        closedir(dir);
+    }
+}
+
+/** Bytes of all segment files. */
+static long directory_bytes()
+{
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    struct stat info;
+    char name[300];
+    long total = 0;
+
+    while ((NULL != dir) && (NULL != (entry = readdir(dir)))) {
+        snprintf(name, sizeof(name), "%s/%s", directory, entry->d_name);
+        if (('.' != entry->d_name[0]) && (0 == stat(name, &info))) {
+            total += info.st_size;
+        }
+    }
+    if (NULL != dir) {
+        closedir(dir);
+    }
+    return total;
+}
+
+/** What a query visited, and whether it came in order. */
+struct Visited {
+    size_t count;
+    uint32_t first_ts;
+    uint32_t last_ts;
+    int64_t value_sum;
+    bool sorted;
+    bool meters_match;
+    uint8_t meter;
+    size_t stop_after;
+};
+
+static bool visit(void *context, const StoredReading &stored)
+{
+    Visited &visited = *static_cast<Visited *>(context);
+
+    if (0 == visited.count) {
+        visited.first_ts = stored.timestamp;
+    } else if (stored.timestamp < visited.last_ts) {
+        visited.sorted = false;
+    }
+    if ((READING_STORE_ALL_METERS != visited.meter) && (stored.meter != visited.meter)) {
+        visited.meters_match = false;
+    }
+    visited.last_ts = stored.timestamp;
+    visited.value_sum += stored.value;
+    visited.count++;
+    return (0 == visited.stop_after) || (visited.count < visited.stop_after);
+}
+
+static Visited query(ReadingStore &store, uint8_t meter, uint32_t from, uint32_t to, size_t stop_after = 0)
+{
+    Visited visited = { 0, 0, 0, 0, true, true, meter, stop_after };
+    size_t count = store.query(meter, from, to, &visit, &visited);
+    CHECK_EQUAL(count, visited.count);
+    return visited;
+}
+
+/**
+ * 3 meters read every 10 s. Reading i of meter m has the value
+ * 1000 * m + i, so a sum tells which readings came back.
+ */
+static void fill(ReadingStore &store, uint32_t readings)
+{
+    for (uint32_t i = 0; i < readings; i++) {
+        for (uint8_t meter = 0; meter < 3; meter++) {
+            CHECK_EQUAL(0, store.append(meter, START_TIME + i * 10, reading_of(1000 * meter + i)));
+        }
+    }
+}
+
+static int64_t sum_of(uint8_t meter, uint32_t first, uint32_t last)
+{
+    int64_t sum = 0;
+    for (uint32_t i = first; i <= last; i++) {
+        sum += 1000 * meter + i;
+    }
+    return sum;
+}
+
+static void test_query()
+{
+    clear_directory();
+    ReadingStore store(directory);
+    CHECK_EQUAL(0, store.open());
+    CHECK_EQUAL(0, store.records());
+
+    // 900 records over 4 segments, the last one partly filled
+    fill(store, 300);
+    CHECK_EQUAL(900, store.records());
+
+    Visited all = query(store, READING_STORE_ALL_METERS, 0, UINT32_MAX);
+    CHECK_EQUAL(900, all.count);
+    CHECK(all.sorted);
+    CHECK_EQUAL(START_TIME, all.first_ts);
+    CHECK_EQUAL(START_TIME + 2990, all.last_ts);
+    CHECK_EQUAL(sum_of(0, 0, 299) + sum_of(1, 0, 299) + sum_of(2, 0, 299), all.value_sum);
+    CHECK_EQUAL(4, store.segments());
+    CHECK_EQUAL(900 * (long)sizeof(StoredReading), directory_bytes());
+
+    // One meter, bounds included, across the first segment boundary at record 256
+    Visited range = query(store, 1, START_TIME + 500, START_TIME + 1500);
+    CHECK_EQUAL(101, range.count);
+    CHECK(range.meters_match);
+    CHECK_EQUAL(START_TIME + 500, range.first_ts);
+    CHECK_EQUAL(START_TIME + 1500, range.last_ts);
+    CHECK_EQUAL(sum_of(1, 50, 150), range.value_sum);
+
+    // Between two readings, before the first, after the last
+    CHECK_EQUAL(0, query(store, 2, START_TIME + 501, START_TIME + 509).count);
+    CHECK_EQUAL(0, query(store, READING_STORE_ALL_METERS, 0, START_TIME - 1).count);
+    CHECK_EQUAL(0, query(store, READING_STORE_ALL_METERS, START_TIME + 2991, UINT32_MAX).count);
+    CHECK_EQUAL(0, query(store, 7, 0, UINT32_MAX).count);
+
+    // The visitor stops it
+    Visited stopped = query(store, 0, START_TIME, UINT32_MAX, 20);
+    CHECK_EQUAL(20, stopped.count);
+    CHECK_EQUAL(START_TIME + 190, stopped.last_ts);
+}
+
+static void test_backwards()
+{
+    clear_directory();
+    ReadingStore store(directory);
+    CHECK_EQUAL(0, store.open());
+
+    CHECK_EQUAL(0, store.append(0, START_TIME + 100, reading_of(1)));
+    CHECK_EQUAL(-EINVAL, store.append(0, START_TIME + 99, reading_of(2)));
+    CHECK_EQUAL(0, store.append(0, START_TIME + 100, reading_of(3)));
+    CHECK_EQUAL(2, store.records());
+
+    Visited visited = query(store, 0, 0, UINT32_MAX);
+    CHECK_EQUAL(2, visited.count);
+    CHECK_EQUAL(4, visited.value_sum);
+
+    // The last time survives a reopen
+    ReadingStore reopened(directory);
+    CHECK_EQUAL(0, reopened.open());
+    CHECK_EQUAL(-EINVAL, reopened.append(0, START_TIME + 50, reading_of(4)));
+    CHECK_EQUAL(0, reopened.append(0, START_TIME + 101, reading_of(5)));
+    CHECK_EQUAL(3, reopened.records());
+}
+
+static void test_reopen()
+{
+    clear_directory();
+    {
+        ReadingStore store(directory);
+        CHECK_EQUAL(0, store.open());
+        fill(store, 100);
+        // 300 records, the last 4 only in the write buffer
+        CHECK_EQUAL(300, store.records());
+    }
+
+    ReadingStore store(directory);
+    CHECK_EQUAL(0, store.open());
+    CHECK_EQUAL(296, store.records());
+    CHECK_EQUAL(2, store.segments());
+
+    // A record cut short by a power loss
+    char name[128];
+    snprintf(name, sizeof(name), "%s/00000001.seg", directory);
+    FILE *file = fopen(name, "ab");
+    CHECK(NULL != file);
+    if (NULL != file) {
+        fwrite("torn", 1, 4, file);
+        fclose(file);
+    }
+    CHECK_EQUAL(0, store.open());
+    CHECK_EQUAL(296, store.records());
+
+    // Appending goes to a new segment, never after the torn tail
+    CHECK_EQUAL(0, store.append(0, START_TIME + 1000, reading_of(5000)));
+    CHECK_EQUAL(0, store.flush());
+    CHECK_EQUAL(3, store.segments());
+
+    Visited visited = query(store, 0, START_TIME + 980, UINT32_MAX);
+    CHECK_EQUAL(2, visited.count);
+    CHECK_EQUAL(98 + 5000, visited.value_sum);
+}
+
+static void test_limits()
+{
+    clear_directory();
+    ReadingStore store(directory, 3);
+    CHECK_EQUAL(0, store.open());
+
+    // 6 segments written, the first 3 deleted
+    fill(store, 5 * READING_STORE_SEGMENT_RECORDS / 3 + 1);
+    CHECK_EQUAL(0, store.flush());
+    CHECK_EQUAL(3, store.segments());
+    CHECK_EQUAL(2 * READING_STORE_SEGMENT_RECORDS + 1, store.records());
+    CHECK_EQUAL(store.records() * (long)sizeof(StoredReading), directory_bytes());
+
+    Visited all = query(store, READING_STORE_ALL_METERS, 0, UINT32_MAX);
+    CHECK_EQUAL(store.records(), all.count);
+    CHECK(all.sorted);
+
+    // Segments that end before the time go, the one holding it stays
+    uint32_t second = query(store, READING_STORE_ALL_METERS, 0, UINT32_MAX, READING_STORE_SEGMENT_RECORDS + 3).last_ts;
+    CHECK_EQUAL(1, store.expire(second));
+    CHECK_EQUAL(2, store.segments());
+    CHECK(query(store, READING_STORE_ALL_METERS, 0, UINT32_MAX).first_ts <= second);
+    CHECK_EQUAL(0, store.expire(0));
+    CHECK_EQUAL(2, store.expire(UINT32_MAX));
+    CHECK_EQUAL(0, store.records());
+    CHECK_EQUAL(0, directory_bytes());
+}
+
+struct Stamped {
+    size_t count;
+    uint8_t meter[UNSTAMPED_READINGS_SIZE];
+    uint32_t timestamp[UNSTAMPED_READINGS_SIZE];
+    int64_t value[UNSTAMPED_READINGS_SIZE];
+};
+
+static void stamped(void *context, uint8_t meter, uint32_t timestamp, const MeterReading &reading)
+{
+    Stamped &out = *static_cast<Stamped *>(context);
+    if (out.count < UNSTAMPED_READINGS_SIZE) {
+        out.meter[out.count] = meter;
+        out.timestamp[out.count] = timestamp;
+        out.value[out.count] = reading.value;
+    }
+    out.count++;
+}
+
+static void test_unstamped()
+{
+    UnstampedReadings held;
+    Stamped out;
+
+    // Taken 60 s, 30.5 s and 0.2 s before the clock is set at uptime 100 s
+    held.add(0, 40000, reading_of(10));
+    held.add(1, 69500, reading_of(11));
+    held.add(2, 99800, reading_of(12));
+    CHECK_EQUAL(3, held.count());
+
+    memset(&out, 0, sizeof(out));
+    CHECK_EQUAL(3, held.stamp(START_TIME, 100000, &stamped, &out));
+    CHECK_EQUAL(3, out.count);
+    CHECK_EQUAL(START_TIME - 60, out.timestamp[0]);
+    CHECK_EQUAL(START_TIME - 30, out.timestamp[1]);
+    CHECK_EQUAL(START_TIME, out.timestamp[2]);
+    CHECK_EQUAL(1, out.meter[1]);
+    CHECK_EQUAL(12, out.value[2]);
+    CHECK_EQUAL(0, held.count());
+    CHECK_EQUAL(0, held.stamp(START_TIME, 100000, &stamped, &out));
+
+    // Full: the oldest go, the rest keep their order, across the wrap of uptime
+    for (uint32_t i = 0; i < UNSTAMPED_READINGS_SIZE + 5; i++) {
+        held.add(0, (uint32_t)(0xFFFFF000UL + i * 1000), reading_of(i));
+    }
+    CHECK_EQUAL(UNSTAMPED_READINGS_SIZE, held.count());
+    CHECK_EQUAL(5, held.dropped());
+
+    uint32_t now = (uint32_t)(0xFFFFF000UL + (UNSTAMPED_READINGS_SIZE + 4) * 1000);
+    memset(&out, 0, sizeof(out));
+    CHECK_EQUAL(UNSTAMPED_READINGS_SIZE, held.stamp(START_TIME, now, &stamped, &out));
+    CHECK_EQUAL(5, out.value[0]);
+    CHECK_EQUAL(START_TIME - (UNSTAMPED_READINGS_SIZE - 1), out.timestamp[0]);
+    CHECK_EQUAL(UNSTAMPED_READINGS_SIZE + 4, out.value[UNSTAMPED_READINGS_SIZE - 1]);
+    CHECK_EQUAL(START_TIME, out.timestamp[UNSTAMPED_READINGS_SIZE - 1]);
+
+    // Stamped readings go to the store in order
+    clear_directory();
+    ReadingStore store(directory);
+    CHECK_EQUAL(0, store.open());
+    held.add(0, 1000, reading_of(1));
+    held.add(0, 2000, reading_of(2));
+    held.stamp(START_TIME, 3000, [](void *context, uint8_t meter, uint32_t timestamp, const MeterReading &reading) {
+        CHECK_EQUAL(0, static_cast<ReadingStore *>(context)->append(meter, timestamp, reading));
+    }, &store);
+    Visited visited = query(store, 0, 0, UINT32_MAX);
+    CHECK_EQUAL(2, visited.count);
+    CHECK_EQUAL(START_TIME - 2, visited.first_ts);
+    CHECK_EQUAL(START_TIME - 1, visited.last_ts);
+}
+
+static void bench(unsigned long readings)
+{
+    clear_directory();
+    ReadingStore store(directory);
+    store.open();
+
+    uint64_t start = host_test_ns();
+    for (unsigned long i = 0; i < readings; i++) {
+        store.append((uint8_t)(i % 5), START_TIME + (uint32_t)(i / 5) * 60, reading_of(i));
+    }
+    store.flush();
+    uint64_t elapsed = host_test_ns() - start;
+    printf("append: %lu readings kept of %lu, %u segments, %.0f ns/reading, %.1f bytes written/reading\n",
+           (unsigned long)store.records(), readings, (unsigned)store.segments(), (double)elapsed / readings,
+           (double)directory_bytes() / store.records());
+
+    uint32_t last = START_TIME + (uint32_t)((readings - 1) / 5) * 60;
+    const struct {
+        const char *name;
+        uint32_t span;
+    } spans[] = { { "last hour", 3600 }, { "last day", 86400 }, { "all", UINT32_MAX } };
+
+    for (size_t i = 0; i < sizeof(spans) / sizeof(spans[0]); i++) {
+        uint32_t from = (spans[i].span < last) ? last - spans[i].span : 0;
+        Visited visited = { 0, 0, 0, 0, true, true, 2, 0 };
+        uint64_t best = host_test_time(10, [&]() {
+            visited.count = 0;
+            store.query(2, from, last, &visit, &visited);
+        });
+        printf("query meter 2, %s: %lu readings in %.1f us, %.0f ns/reading\n", spans[i].name,
+               (unsigned long)visited.count, best / 1000.0, (0 < visited.count) ? (double)best / visited.count : 0.0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (NULL == mkdtemp(directory)) {
+        printf("no temporary directory\n");
+        return 1;
+    }
+
+    test_query();
+    test_backwards();
+    test_reopen();
+    test_limits();
+    test_unstamped();
+
+    unsigned long readings = host_test_arg(argc, argv, "bench", 0, READING_STORE_MAX_SEGMENTS * READING_STORE_SEGMENT_RECORDS);
+    if (0 < readings) {
+        bench(readings);
+    }
+
+    clear_directory();
+    rmdir(directory);
+    return host_test_done("reading_store_test");
+}
@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef REFERENCE_FRAME_BUFFER_H
+#define REFERENCE_FRAME_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Holds the bytes of the frame a decoder is currently assembling.
+ *
+ * While a frame lies entirely inside the span passed to feed(), it is only
+ * referenced, never copied. Only a frame that straddles two feed() calls is
+ * spilled into the internal storage, so most frames reach the handler as a
+ * pointer into the caller's receive buffer.
+ */
+template <size_t Capacity>
+class FrameBuffer {
+public:
+    FrameBuffer() : _start(NULL), _length(0), _spilled(false) {}
+
+    /** Start a new frame at @p p (a byte of the current span). */
+    void begin(const uint8_t *p)
+    {
+        _start   = p;
+        _length  = 1;
+        _spilled = false;
+    }
+
+    /**
+     * Add the next byte of the frame.
+     * @return false if the frame would exceed Capacity
+     */
+    bool add(const uint8_t *p)
+    {
+        if (_length >= Capacity) {
+            return false;
+        }
+        if (_spilled) {
+            _storage[_length] = *p;
+        }
+        _length++;
+        return true;
+    }
+
+    /** Drop the current frame. */
+    void clear()
+    {
+        _start   = NULL;
+        _length  = 0;
+        _spilled = false;
+    }
+
+    /** Called at the end of a span: keep a partial frame alive past it. */
+    void spill()
+    {
+        if ((0 < _length) && !_spilled) {
+            memmove(_storage, _start, _length);
+            _spilled = true;
+        }
+    }
+
+    const uint8_t *data() const
+    {
+        return _spilled ? _storage : _start;
+    }
+
+    size_t length() const
+    {
+        return _length;
+    }
+
+private:
+    const uint8_t *_start;
+    size_t _length;
+    bool _spilled;
+    uint8_t _storage[Capacity];
+};
+
+#endif /* REFERENCE_FRAME_BUFFER_H */
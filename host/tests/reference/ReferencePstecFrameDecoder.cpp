@@ -0,0 +1,129 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "ReferencePstecFrameDecoder.h"
+
+ReferencePstecFrameDecoder::ReferencePstecFrameDecoder(MeterFrameHandler handler, void *context)
+    : _handler(handler), _context(context)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    reset();
+}
+
+void ReferencePstecFrameDecoder::reset()
+{
+    _state       = RX_STX;
+    _apdu_length = 0;
+    _checksum    = 0;
+    _echo        = false;
+    _frame.clear();
+}
+
+size_t ReferencePstecFrameDecoder::feed(const uint8_t *data, size_t size)
+{
+    size_t frames = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        const uint8_t *p = data + i;
+        uint8_t ch = *p;
+
+        switch (_state) {
+            case RX_STX:
+                if (ch == PSTEC_RESPONSE_STX) {
+                    _state    = RX_ID;
+                    _checksum = ch;
+                    _frame.begin(p);
+                }
+                else {
+                    _stats.skipped++;
+                }
+                break;
+
+            case RX_ID:
+                _state     = RX_DATA;
+                _checksum += ch;
+                _frame.add(p);
+                break;
+
+            case RX_DATA:
+                _frame.add(p);
+
+                // STX type BCC ETX: the echo of a request
+                if (0 == _apdu_length) {
+                    _echo = (ch == (_checksum & 0x7F));
+                }
+                else if ((1 == _apdu_length) && _echo && (ch == PSTEC_REQUEST_ETX)) {
+                    _stats.frames++;
+                    _handler(_context, _frame.data(), _frame.length());
+                    frames++;
+                    reset();
+                    break;
+                }
+
+                _apdu_length++;
+                _checksum += ch;
+
+                if (_apdu_length == PSTEC_RESPONSE_PACKET_APDU_LENGTH_PRECISE_ACCUM_INSTANT) {
+                    _state = RX_BCC;
+                }
+                break;
+
+            case RX_BCC:
+                _checksum &= 0x7F;  // trim to 7-bit BCC
+
+                if (ch == _checksum) {
+                    _state = RX_ETX;
+                    _frame.add(p);
+                }
+                else {
+                    _stats.checksum_errors++;
+                    _stats.resets++;
+                    reset();
+                }
+                break;
+
+            case RX_ETX:
+                if (ch == PSTEC_RESPONSE_ETX) {
+                    _frame.add(p);
+                    _stats.frames++;
+                    _handler(_context, _frame.data(), _frame.length());
+                    frames++;
+                }
+                else {
+                    _stats.length_errors++;
+                    _stats.resets++;
+                }
+                reset();
+                break;
+
+            default:
+                reset();
+                break;
+        }
+    }
+
+    _frame.spill();
+
+    return frames;
+}
+
+size_t ReferencePstecFrameDecoder::resync()
+{
+    _stats.resets++;
+    reset();
+    return 0;
+}
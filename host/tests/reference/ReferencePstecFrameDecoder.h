@@ -0,0 +1,93 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef REFERENCE_PSTEC_FRAME_DECODER_H
+#define REFERENCE_PSTEC_FRAME_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterProtocol.h"
+#include "ReferenceFrameBuffer.h"
+#include "FrameDecoder.h"
+
+/**
+ * The hand-written PSTEC decoder that PstecFrameDecoder replaced, kept as
+ * the reference the generated one is compared and timed against.
+ *
+ * Decoder for the PSTEC meter bus.
+ *
+ * The bus is half duplex, so every 4-byte request (STX type BCC ETX) is read
+ * back as an echo, and 14-byte responses (STX type data[10] BCC ETX) follow.
+ * Both are passed to the handler; the length tells them apart.
+ *
+ * The decoder does not need to know which request was sent: a frame whose
+ * third byte is the BCC of the first two and whose fourth byte is ETX is an
+ * echo. Response data is BCD, so ETX (0xD0) cannot appear there. Matching
+ * responses to requests is left to the caller, by the ID field.
+ */
+class ReferencePstecFrameDecoder {
+public:
+    /**
+     * @param handler Called for every complete echo and response frame
+     * @param context Passed back to @p handler
+     */
+    ReferencePstecFrameDecoder(MeterFrameHandler handler, void *context);
+
+    /** Drop any partial frame. */
+    void reset();
+
+    /**
+     * Run the state machine over a span of received bytes.
+     * @param data Received bytes
+     * @param size Number of bytes in @p data
+     * @return Number of frames passed to the handler
+     */
+    size_t feed(const uint8_t *data, size_t size);
+
+    /**
+     * Drop a partial frame cut off by a gap on the line, counted as a reset.
+     * @return Number of frames passed to the handler, always 0
+     */
+    size_t resync();
+
+    const DecoderStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    typedef enum {
+        RX_STX,
+        RX_ID,
+        RX_DATA,
+        RX_BCC,
+        RX_ETX
+    } State;
+
+    MeterFrameHandler _handler;
+    void *_context;
+
+    State _state;
+    uint8_t _apdu_length;
+    uint8_t _checksum;
+    bool _echo;
+
+    DecoderStats _stats;
+
+    FrameBuffer<PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT> _frame;
+};
+
+#endif /* REFERENCE_PSTEC_FRAME_DECODER_H */
@@ -0,0 +1,192 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "ReferenceSeoulFrameDecoder.h"
+
+// 0x68 L L 0x68 + L bytes (C, A, CI, user data) + checksum + 0x16
+#define SEOUL_FRAME_OVERHEAD    (SEOUL_RESPONSE_HEADER_LENGTH + 2)
+
+// C, A and CI fields come before the user data
+#define SEOUL_MIN_L_FIELD       3
+
+ReferenceSeoulFrameDecoder::ReferenceSeoulFrameDecoder(MeterFrameHandler handler, void *context)
+    : _handler(handler), _context(context)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    reset();
+}
+
+void ReferenceSeoulFrameDecoder::reset()
+{
+    _window_length = 0;
+}
+
+int ReferenceSeoulFrameDecoder::check(const uint8_t *p, size_t length, size_t &total)
+{
+    // Header bytes are checked as soon as they arrive
+    if (((2 <= length) && (SEOUL_MIN_L_FIELD > p[1])) || ((3 <= length) && (p[2] != p[1]))) {
+        _stats.length_errors++;
+        return -1;
+    }
+    if ((4 <= length) && (SEOUL_RESPONSE_STX != p[3])) {
+        return -1;
+    }
+    if ((5 <= length) && (0x80 <= p[4])) {     // C field
+        return -1;
+    }
+    if (SEOUL_RESPONSE_HEADER_LENGTH > length) {
+        return 0;
+    }
+
+    total = p[1] + SEOUL_FRAME_OVERHEAD;
+    if (total > length) {
+        return 0;
+    }
+
+    if (SEOUL_RESPONSE_ETX != p[total - 1]) {
+        _stats.length_errors++;
+        return -1;
+    }
+
+    // Arithmetic sum of C, A, CI and user data, modulo 256
+    const uint8_t *data = p + SEOUL_RESPONSE_HEADER_LENGTH;
+    size_t count = p[1];
+    uint32_t sum = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        sum += data[i] + data[i + 1] + data[i + 2] + data[i + 3];
+    }
+    for (; i < count; i++) {
+        sum += data[i];
+    }
+
+    if ((uint8_t)sum != data[count]) {
+        _stats.checksum_errors++;
+        return -1;
+    }
+    return 1;
+}
+
+void ReferenceSeoulFrameDecoder::drop(size_t count)
+{
+    _window_length -= count;
+    memmove(_window, _window + count, _window_length);
+}
+
+size_t ReferenceSeoulFrameDecoder::scan_window()
+{
+    size_t frames = 0;
+
+    while (0 < _window_length) {
+        if (SEOUL_RESPONSE_STX != _window[0]) {
+            const uint8_t *next = (const uint8_t *)memchr(_window, SEOUL_RESPONSE_STX, _window_length);
+            size_t skip = (NULL != next) ? (size_t)(next - _window) : _window_length;
+            _stats.skipped += skip;
+            drop(skip);
+            continue;
+        }
+
+        size_t total = 0;
+        int result = check(_window, _window_length, total);
+        if (0 == result) {
+            break;
+        }
+        if (0 < result) {
+            _stats.frames++;
+            _handler(_context, _window, total);
+            frames++;
+            drop(total);
+        }
+        else {
+            _stats.resets++;
+            _stats.skipped++;
+            drop(1);
+        }
+    }
+
+    return frames;
+}
+
+size_t ReferenceSeoulFrameDecoder::feed(const uint8_t *data, size_t size)
+{
+    size_t frames = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        // A frame is pending from an earlier span: complete it in the window
+        if (0 < _window_length) {
+            size_t want = SEOUL_RESPONSE_HEADER_LENGTH - _window_length;
+            if (SEOUL_RESPONSE_HEADER_LENGTH <= _window_length) {
+                want = _window[1] + SEOUL_FRAME_OVERHEAD - _window_length;
+            }
+            if (want > size - i) {
+                want = size - i;
+            }
+            memcpy(_window + _window_length, data + i, want);
+            _window_length += want;
+            i += want;
+            frames += scan_window();
+            continue;
+        }
+
+        const uint8_t *p = (const uint8_t *)memchr(data + i, SEOUL_RESPONSE_STX, size - i);
+        if (NULL == p) {
+            _stats.skipped += size - i;
+            break;
+        }
+        _stats.skipped += p - (data + i);
+        i = p - data;
+
+        // Fast path: check the frame where it lies
+        size_t total = 0;
+        int result = check(p, size - i, total);
+        if (0 < result) {
+            _stats.frames++;
+            _handler(_context, p, total);
+            frames++;
+            i += total;
+        }
+        else if (0 == result) {
+            memcpy(_window, p, size - i);
+            _window_length = size - i;
+            i = size;
+        }
+        else {
+            _stats.resets++;
+            _stats.skipped++;
+            i++;
+        }
+    }
+
+    return frames;
+}
+
+size_t ReferenceSeoulFrameDecoder::resync()
+{
+    size_t frames = 0;
+
+    if (0 < _window_length) {
+        _stats.resets++;
+    }
+    while (0 < _window_length) {
+        _stats.skipped++;
+        drop(1);
+        frames += scan_window();
+    }
+
+    return frames;
+}
@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef REFERENCE_SEOUL_FRAME_DECODER_H
+#define REFERENCE_SEOUL_FRAME_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterProtocol.h"
+#include "FrameDecoder.h"
+
+/**
+ * The hand-written Seoul decoder that SeoulFrameDecoder replaced, kept as
+ * the reference the generated one is compared and timed against.
+ *
+ * Decoder for the M-Bus long frames returned by the Seoul water meter
+ * (0x68 L L 0x68 C A CI data... CS 0x16), of any L field length.
+ *
+ * The decoder scans for a header instead of stepping through a state
+ * machine. A frame is only accepted when its checksum and end byte are
+ * right, and a candidate that turns out to be wrong only costs its first
+ * byte: scanning goes on from the byte after it, so a real frame hidden
+ * behind line noise is still found.
+ *
+ * A frame that lies entirely inside the span passed to feed() is checked
+ * and handed over in place. Only a frame that straddles two feed() calls
+ * is collected in the internal window.
+ *
+ * One instance holds the whole parse state of one port, so bytes can be
+ * fed in arbitrary chunks as they come off the UART.
+ */
+class ReferenceSeoulFrameDecoder {
+public:
+    /**
+     * @param handler Called for every complete frame
+     * @param context Passed back to @p handler
+     */
+    ReferenceSeoulFrameDecoder(MeterFrameHandler handler, void *context);
+
+    /** Drop any partial frame and wait for the next start byte. */
+    void reset();
+
+    /**
+     * The line went quiet, so the partial frame will not complete. Scan the
+     * bytes held after its first byte for frames, instead of dropping them.
+     * @return Number of frames passed to the handler
+     */
+    size_t resync();
+
+    /**
+     * Run the state machine over a span of received bytes.
+     * @param data Received bytes
+     * @param size Number of bytes in @p data
+     * @return Number of frames passed to the handler
+     */
+    size_t feed(const uint8_t *data, size_t size);
+
+    const DecoderStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    /**
+     * Check a candidate frame.
+     * @param total Set to the frame length once the header is known
+     * @return 1 if valid, 0 if more bytes are needed, -1 if not a frame
+     */
+    int check(const uint8_t *p, size_t length, size_t &total);
+
+    /** Hand over the frames in the window and drop what cannot start one. */
+    size_t scan_window();
+
+    void drop(size_t count);
+
+    MeterFrameHandler _handler;
+    void *_context;
+
+    uint8_t _window[SEOUL_RESPONSE_MAX_LENGTH];
+    size_t _window_length;
+
+    DecoderStats _stats;
+};
+
+#endif /* REFERENCE_SEOUL_FRAME_DECODER_H */
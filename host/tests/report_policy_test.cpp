@@ -0,0 +1,200 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * ReportPolicy decisions and policy text: the first reading, changes held
+ * back by the minimum interval, the absolute and relative deadbands, the
+ * heartbeat after the maximum interval; policy updates parsed, rejected,
+ * formatted and parsed back as the Report-Policy resource shows them.
+ * bench times a decision.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/report_policy_test.cpp meter/ReportPolicy.cpp \
+ *       meter/MeterReading.cpp -o host-build/report_policy_test
+ *   host-build/report_policy_test bench
+ */
+#include <limits.h>
+#include <string.h>
+
+#include "HostTest.h"
+#include "ReportPolicy.h"
+
+static MeterReading reading(int64_t value, int exponent)
+{
+    MeterReading r = { value, (int8_t)exponent, METER_UNIT_NONE };
+    return r;
+}
+
+static ReportPolicyConfig policy(const char *text)
+{
+    ReportPolicyConfig config;
+    int meter;
+
+    memset(&config, 0, sizeof(config));
+    CHECK(report_policy_parse(text, meter, config));
+    return config;
+}
+
+static void test_any_change()
+{
+    ReportPolicy p;
+
+    p.configure(policy("0,0,0,0,0"));
+    CHECK(p.evaluate(reading(100, 0), 0));
+    CHECK(!p.evaluate(reading(100, 0), 1000));
+    CHECK(!p.evaluate(reading(1000, -1), 2000));    // same value, other scale
+    CHECK(p.evaluate(reading(1001, -1), 3000));
+    CHECK_EQUAL(2, p.suppressed());
+}
+
+static void test_min_interval()
+{
+    ReportPolicy p;
+
+    p.configure(policy("0,0,0,60,0"));
+    CHECK(p.evaluate(reading(1, 0), 0));
+    CHECK(!p.evaluate(reading(2, 0), 59999));
+    // The change held back goes out with the first reading after it
+    CHECK(p.evaluate(reading(2, 0), 60000));
+    CHECK(!p.evaluate(reading(2, 0), 200000));
+}
+
+static void test_deadbands()
+{
+    ReportPolicy abs;
+    ReportPolicy rel;
+
+    abs.configure(policy("0,0.5,0,0,0"));
+    CHECK(abs.evaluate(reading(100, 0), 0));
+    CHECK(!abs.evaluate(reading(1004, -1), 1000));
+    CHECK(abs.evaluate(reading(1005, -1), 2000));
+    CHECK(!abs.evaluate(reading(1001, -1), 3000));  // 0.4 from the last report
+    CHECK(abs.evaluate(reading(99, 0), 4000));      // either direction
+
+    rel.configure(policy("0,0,1,0,0"));
+    CHECK(rel.evaluate(reading(-200, 0), 0));
+    CHECK(!rel.evaluate(reading(-1981, -1), 1000));
+    CHECK(rel.evaluate(reading(-198, 0), 2000));    // 1 % of |-200|
+}
+
+static void test_heartbeat()
+{
+    ReportPolicy p;
+
+    p.configure(policy("0,10,0,0,3600"));
+    CHECK(p.evaluate(reading(5, 0), 0));
+    CHECK(!p.evaluate(reading(5, 0), 3599999));
+    CHECK(p.evaluate(reading(5, 0), 3600000));
+    // Measured from the heartbeat, across the wrap of the ms clock
+    CHECK(!p.evaluate(reading(5, 0), 3600000 + 3599999));
+
+    ReportPolicy wrapped;
+    wrapped.configure(policy("0,10,0,0,3600"));
+    CHECK(wrapped.evaluate(reading(5, 0), UINT32_MAX - 999));
+    CHECK(!wrapped.evaluate(reading(5, 0), 3598000));
+    CHECK(wrapped.evaluate(reading(5, 0), 3599000));
+}
+
+static void test_parse()
+{
+    ReportPolicyConfig config;
+    int meter = 7;
+
+    CHECK(report_policy_parse("2,0.01,0.5,60,3600", meter, config));
+    CHECK_EQUAL(2, meter);
+    CHECK_EQUAL(1, config.abs_deadband.value);
+    CHECK_EQUAL(-2, config.abs_deadband.exponent);
+    CHECK_EQUAL(5, config.rel_deadband.value);
+    CHECK_EQUAL(-1, config.rel_deadband.exponent);
+    CHECK_EQUAL(60, config.min_interval_s);
+    CHECK_EQUAL(3600, config.max_interval_s);
+
+    CHECK(report_policy_parse("*,0,0,60,3600", meter, config));
+    CHECK_EQUAL(-1, meter);
+
+    CHECK(!report_policy_parse("", meter, config));
+    CHECK(!report_policy_parse("-1,0,0,60,3600", meter, config));
+    CHECK(!report_policy_parse("x,0,0,60,3600", meter, config));
+    CHECK(!report_policy_parse("0,-1,0,60,3600", meter, config));
+    CHECK(!report_policy_parse("0,0,-1,60,3600", meter, config));
+    CHECK(!report_policy_parse("0,0,0,-60,3600", meter, config));
+    CHECK(!report_policy_parse("0,0,0,60", meter, config));
+    CHECK(!report_policy_parse("0,0,0,60,", meter, config));
+    CHECK(!report_policy_parse("0,0,0,60,3600,1", meter, config));
+    CHECK(!report_policy_parse("0,,0,60,3600", meter, config));
+}
+
+static void test_format()
+{
+    char text[REPORT_POLICY_TEXT_SIZE];
+    ReportPolicyConfig config = policy("2,0.01,0.5,60,3600");
+    ReportPolicyConfig parsed;
+    int meter;
+
+    CHECK_EQUAL(strlen("2,0.01,0.5,60,3600"), report_policy_format(2, config, text, sizeof(text)));
+    CHECK(0 == strcmp("2,0.01,0.5,60,3600", text));
+    CHECK_EQUAL(strlen("*,0.01,0.5,60,3600"), report_policy_format(-1, config, text, sizeof(text)));
+    CHECK(0 == strcmp("*,0.01,0.5,60,3600", text));
+
+    // Too small a buffer, counting the terminator
+    CHECK_EQUAL(0, report_policy_format(2, config, text, strlen("2,0.01,0.5,60,3600")));
+
+    // The longest policy fits
+    config.abs_deadband = reading(INT64_MAX, -18);
+    config.rel_deadband = reading(INT64_MAX, -18);
+    config.min_interval_s = UINT32_MAX;
+    config.max_interval_s = UINT32_MAX;
+    CHECK(0 < report_policy_format(INT_MAX, config, text, sizeof(text)));
+    CHECK(0 < report_policy_format(-1, config, text, sizeof(text)));
+
+    config = policy("0,12.5,0.001,0,86400");
+    CHECK(0 < report_policy_format(4, config, text, sizeof(text)));
+    CHECK(report_policy_parse(text, meter, parsed));
+    CHECK_EQUAL(4, meter);
+    CHECK_EQUAL(0, meter_reading_compare(config.abs_deadband, parsed.abs_deadband));
+    CHECK_EQUAL(0, meter_reading_compare(config.rel_deadband, parsed.rel_deadband));
+    CHECK_EQUAL(config.min_interval_s, parsed.min_interval_s);
+    CHECK_EQUAL(config.max_interval_s, parsed.max_interval_s);
+}
+
+static void bench(unsigned long count)
+{
+    ReportPolicy p;
+    unsigned long reported = 0;
+
+    p.configure(policy("0,0.5,1,0,3600"));
+    uint64_t best = host_test_time(10, [&]() {
+        for (unsigned long i = 0; i < count; i++) {
+            reported += p.evaluate(reading(1000000 + (int64_t)(i % 64), -2), (uint32_t)i);
+        }
+    });
+    printf("evaluate: %lu readings, %.1f ns/reading, %lu reported\n", count, (double)best / count, reported);
+}
+
+int main(int argc, char **argv)
+{
+    test_any_change();
+    test_min_interval();
+    test_deadbands();
+    test_heartbeat();
+    test_parse();
+    test_format();
+
+    unsigned long count = host_test_arg(argc, argv, "bench", 0, 1000000);
+    if (0 < count) {
+        bench(count);
+    }
+
+    return host_test_done("report_policy_test");
+}
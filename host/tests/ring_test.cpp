@@ -0,0 +1,347 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * SpscByteRing: wraparound of the storage and of the 32-bit indices,
+ * overflow counting, and one producer and one consumer thread at full
+ * speed.
+ *
+ *   g++ -std=gnu++14 -O2 -pthread -Ihost -Ihost/tests -Imeter host/tests/ring_test.cpp -o host-build/ring_test
+ *   host-build/ring_test stress=200 bench
+ *
+ * stress=N moves N MB between the threads, 16 by default. bench times the
+ * ring against CircularBuffer<char, 512> as the receive path used it: one
+ * push per received byte in the interrupt, one pop per byte in the thread,
+ * each in a critical section.
+ */
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "HostTest.h"
+#include "SpscByteRing.h"
+
+/** Sequence the stress test sends, checkable at any offset. */
+static uint8_t pattern(uint64_t offset)
+{
+    uint64_t x = offset * 0x9E3779B97F4A7C15ULL;
+    return (uint8_t)(x >> 56);
+}
+
+/** Every peek, commit and pop against a byte-by-byte model, across the end of the storage. */
+static void check_wraparound()
+{
+    SpscByteRing<16> ring;
+    std::deque<uint8_t> model;
+    uint64_t sent = 0;
+    uint32_t random = 1;
+
+    for (int step = 0; step < 20000; step++) {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+
+        if (random & 1) {
+            uint8_t block[24];
+            size_t size = (random >> 1) % sizeof(block);
+            for (size_t i = 0; i < size; i++) {
+                block[i] = pattern(sent + i);
+            }
+            size_t space = 16 - model.size();
+            size_t queued = ring.push(block, size);
+            CHECK_EQUAL((size < space) ? size : space, queued);
+            for (size_t i = 0; i < queued; i++) {
+                model.push_back(block[i]);
+            }
+            // Dropped bytes are sent again, like a sender that retries
+            sent += queued;
+        }
+        else {
+            const uint8_t *first;
+            const uint8_t *second;
+            size_t firstSize;
+            size_t secondSize;
+            size_t count = ring.peek(first, firstSize, second, secondSize);
+
+            CHECK_EQUAL(model.size(), count);
+            CHECK_EQUAL(count, firstSize + secondSize);
+            size_t take = (random >> 1) % (count + 1);
+            for (size_t i = 0; i < take; i++) {
+                uint8_t byte = (i < firstSize) ? first[i] : second[i - firstSize];
+                if (!CHECK_EQUAL(model.front(), byte)) {
+                    return;
+                }
+                model.pop_front();
+            }
+            ring.commit(take);
+        }
+        CHECK_EQUAL(model.size(), ring.size());
+    }
+}
+
+/** Blocks around the point where the free-running indices wrap. */
+static void check_index_wraparound()
+{
+    static SpscByteRing<4096> ring;
+    static uint8_t block[4096];
+
+    // 2^32 - 4096 bytes through the ring leaves both indices one push short of wrapping
+    for (uint32_t i = 0; i < (0x100000000ULL / sizeof(block)) - 1; i++) {
+        ring.push(block, sizeof(block));
+        ring.commit(sizeof(block));
+    }
+    CHECK(ring.empty());
+
+    uint8_t data[3000];
+    uint8_t out[3000];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = pattern(i);
+    }
+    for (int round = 0; round < 4; round++) {
+        CHECK_EQUAL(sizeof(data), ring.push(data, sizeof(data)));
+        CHECK_EQUAL(sizeof(data), ring.size());
+        CHECK_EQUAL(4096 - sizeof(data), ring.push(data, sizeof(data)));
+        CHECK_EQUAL(4096, ring.size());
+        CHECK_EQUAL(sizeof(out), ring.pop(out, sizeof(out)));
+        CHECK(0 == memcmp(data, out, sizeof(out)));
+        CHECK_EQUAL(4096 - sizeof(data), ring.pop(out, sizeof(out)));
+        CHECK(0 == memcmp(data, out, 4096 - sizeof(data)));
+        CHECK(ring.empty());
+    }
+}
+
+static void check_overflow()
+{
+    SpscByteRing<8> ring;
+    uint8_t data[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    uint8_t out[12];
+
+    CHECK_EQUAL(8, ring.push(data, sizeof(data)));
+    CHECK_EQUAL(4, ring.overflows());
+    CHECK(!ring.push(13));
+    CHECK_EQUAL(5, ring.overflows());
+
+    // Queued bytes are never overwritten
+    CHECK_EQUAL(8, ring.pop(out, sizeof(out)));
+    CHECK(0 == memcmp(data, out, 8));
+
+    ring.reset();
+    CHECK(ring.empty());
+    CHECK_EQUAL(0, ring.overflows());
+}
+
+/** One producer and one consumer thread, random block sizes, every byte checked. */
+static void check_threads(uint64_t total)
+{
+    static SpscByteRing<512> ring;
+    std::atomic<bool> failed(false);
+
+    ring.reset();
+    uint64_t start = host_test_ns();
+
+    std::thread producer([&]() {
+        uint8_t block[64];
+        uint32_t random = 7;
+        uint64_t sent = 0;
+
+        while ((sent < total) && !failed.load(std::memory_order_relaxed)) {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            size_t size = 1 + random % sizeof(block);
+            if (size > total - sent) {
+                size = (size_t)(total - sent);
+            }
+            for (size_t i = 0; i < size; i++) {
+                block[i] = pattern(sent + i);
+            }
+            size_t queued = ring.push(block, size);
+            if (0 == queued) {
+                // On a single core the consumer has to get a turn
+                std::this_thread::yield();
+            }
+            sent += queued;
+        }
+    });
+
+    uint64_t received = 0;
+    uint32_t random = 11;
+    while ((received < total) && !failed.load(std::memory_order_relaxed)) {
+        const uint8_t *first;
+        const uint8_t *second;
+        size_t firstSize;
+        size_t secondSize;
+        size_t count = ring.peek(first, firstSize, second, secondSize);
+        if (0 == count) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        size_t take = (random & 1) ? count : (count / 2);
+        for (size_t i = 0; i < take; i++) {
+            uint8_t byte = (i < firstSize) ? first[i] : second[i - firstSize];
+            if (pattern(received + i) != byte) {
+                printf("byte %llu is %02X, expected %02X\n", (unsigned long long)(received + i), byte,
+                       pattern(received + i));
+                failed = true;
+                break;
+            }
+        }
+        ring.commit(take);
+        received += take;
+    }
+    producer.join();
+
+    uint64_t ns = host_test_ns() - start;
+    CHECK(!failed);
+    CHECK_EQUAL(total, received);
+    CHECK(ring.empty());
+    printf("  %llu MB between two threads in %.2f s, %u bytes refused while full\n", (unsigned long long)(total >> 20),
+           ns / 1e9, (unsigned)ring.overflows());
+}
+
+/**
+ * CircularBuffer<T, Size> as in Mbed OS 5.13, the buffer the ring replaced:
+ * every push and pop takes the critical section, and a push into a full
+ * buffer overwrites the oldest element.
+ */
+template <typename T, uint32_t Size, bool Locked>
+class ReferenceCircularBuffer {
+public:
+    ReferenceCircularBuffer() : _head(0), _tail(0), _full(false) {}
+
+    void push(const T &data)
+    {
+        enter();
+        if (_full) {
+            _tail = (_tail + 1) % Size;
+        }
+        _pool[_head] = data;
+        _head = (_head + 1) % Size;
+        _full = (_head == _tail);
+        leave();
+    }
+
+    bool pop(T &data)
+    {
+        bool ok = false;
+        enter();
+        if ((_head != _tail) || _full) {
+            data = _pool[_tail];
+            _tail = (_tail + 1) % Size;
+            _full = false;
+            ok = true;
+        }
+        leave();
+        return ok;
+    }
+
+private:
+    void enter()
+    {
+        if (Locked) {
+            _lock.lock();
+        }
+    }
+
+    void leave()
+    {
+        if (Locked) {
+            _lock.unlock();
+        }
+    }
+
+    T _pool[Size];
+    uint32_t _head;
+    uint32_t _tail;
+    bool _full;
+    std::mutex _lock;
+};
+
+template <bool Locked>
+static uint64_t bench_circular(const uint8_t *data, size_t size, uint8_t &sum)
+{
+    static ReferenceCircularBuffer<char, 512, Locked> buffer;
+
+    return host_test_time(9, [&]() {
+        char ch;
+        for (size_t i = 0; i < size; i += 32) {
+            for (size_t j = 0; j < 32; j++) {
+                buffer.push((char)data[i + j]);
+            }
+            while (buffer.pop(ch)) {
+                sum += (uint8_t)ch;
+            }
+        }
+    });
+}
+
+static void bench(size_t size)
+{
+    static SpscByteRing<512> ring;
+    uint8_t *data = (uint8_t *)malloc(size);
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        data[i] = pattern(i);
+    }
+
+    // Chunks of 32 as the receive interrupt hands them over
+    uint64_t ringNs = host_test_time(9, [&]() {
+        for (size_t i = 0; i < size; i += 32) {
+            ring.push(data + i, 32);
+
+            const uint8_t *first;
+            const uint8_t *second;
+            size_t firstSize;
+            size_t secondSize;
+            size_t count = ring.peek(first, firstSize, second, secondSize);
+            for (size_t j = 0; j < firstSize; j++) {
+                sum += first[j];
+            }
+            for (size_t j = 0; j < secondSize; j++) {
+                sum += second[j];
+            }
+            ring.commit(count);
+        }
+    });
+    uint64_t lockedNs = bench_circular<true>(data, size, sum);
+    uint64_t bareNs = bench_circular<false>(data, size, sum);
+
+    printf("Ring against CircularBuffer<char, 512>, %u KB in chunks of 32, best of 9 runs (checksum %02X):\n",
+           (unsigned)(size >> 10), sum);
+    printf("  SpscByteRing push + peek/commit    %6.2f ns/byte\n", (double)ringNs / size);
+    printf("  CircularBuffer, locked per byte    %6.2f ns/byte\n", (double)lockedNs / size);
+    printf("  CircularBuffer, lock left out      %6.2f ns/byte\n", (double)bareNs / size);
+    free(data);
+}
+
+int main(int argc, char **argv)
+{
+    check_wraparound();
+    check_index_wraparound();
+    check_overflow();
+    check_threads(host_test_arg(argc, argv, "stress", 16, 16) << 20);
+
+    unsigned long size = host_test_arg(argc, argv, "bench", 0, 4096);
+    if (0 < size) {
+        bench((size_t)size << 10);
+    }
+    return host_test_done("ring_test");
+}
@@ -0,0 +1,378 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * SenML-CBOR encoder and batch: the bytes of a known pack, packs decoded
+ * back record by record, buffers too small, and the batch window. With
+ * bench, the encoding time and the uplink bytes of one polling cycle as
+ * one pack against one notification per meter.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/senml_test.cpp meter/SenmlCbor.cpp \
+ *       meter/SenmlBatch.cpp meter/MeterReading.cpp -o host-build/senml_test
+ *   host-build/senml_test bench
+ */
+#include <string>
+
+#include "HostTest.h"
+#include "MeterReading.h"
+#include "SenmlBatch.h"
+#include "SenmlCbor.h"
+
+// Size of the pack buffer in main.cpp
+#define SENML_PACK_SIZE     256
+
+/*
+ * Per message overhead of a notification, for the size comparison: IPv4
+ * and UDP headers, a DTLS 1.2 record with AES-128-CCM-8 (header, explicit
+ * nonce, tag) and a CoAP header with a 4 byte token, Observe and
+ * Content-Format options and the payload marker.
+ */
+#define IP_UDP_OVERHEAD     28
+#define DTLS_OVERHEAD       29
+#define COAP_OVERHEAD       13
+
+/** Reads back what the encoder writes: heads, integers, text. */
+class CborReader {
+public:
+    CborReader(const uint8_t *data, size_t length) : _data(data), _length(length), _offset(0), _error(false) {}
+
+    /** @return The argument of the next head, of @p major type */
+    uint64_t head(uint8_t major)
+    {
+        if (_offset >= _length) {
+            _error = true;
+            return 0;
+        }
+        uint8_t initial = _data[_offset++];
+        if ((initial >> 5) != major) {
+            _error = true;
+            return 0;
+        }
+        uint8_t info = initial & 0x1F;
+        if (info < 24) {
+            return info;
+        }
+        size_t count = (size_t)1 << (info - 24);
+        if ((27 < info) || (_length - _offset < count)) {
+            _error = true;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < count; i++) {
+            value = (value << 8) | _data[_offset++];
+        }
+        return value;
+    }
+
+    int64_t integer()
+    {
+        if ((_offset < _length) && (1 == (_data[_offset] >> 5))) {
+            return -1 - (int64_t)head(1);
+        }
+        return (int64_t)head(0);
+    }
+
+    std::string text()
+    {
+        size_t length = (size_t)head(3);
+        if (_length - _offset < length) {
+            _error = true;
+            return "";
+        }
+        std::string value((const char *)_data + _offset, length);
+        _offset += length;
+        return value;
+    }
+
+    uint8_t peek_major() const
+    {
+        return (_offset < _length) ? (_data[_offset] >> 5) : 0xFF;
+    }
+
+    bool done() const
+    {
+        return !_error && (_offset == _length);
+    }
+
+    bool error() const
+    {
+        return _error;
+    }
+
+private:
+    const uint8_t *_data;
+    size_t _length;
+    size_t _offset;
+    bool _error;
+};
+
+struct Decoded {
+    std::string base_name;
+    std::string name;
+    std::string unit;
+    int64_t mantissa;
+    int8_t exponent;
+    uint32_t time;
+};
+
+/** Decode a pack, resolving base name and base time. @return Records, -1 if malformed */
+static int decode(const uint8_t *data, size_t length, Decoded *records, size_t max)
+{
+    CborReader cbor(data, length);
+    size_t count = (size_t)cbor.head(4);
+    std::string base_name;
+    int64_t base_time = 0;
+
+    for (size_t i = 0; (i < count) && (i < max) && !cbor.error(); i++) {
+        Decoded &record = records[i];
+        record = Decoded();
+        int64_t time = 0;
+        size_t pairs = (size_t)cbor.head(5);
+
+        for (size_t p = 0; (p < pairs) && !cbor.error(); p++) {
+            switch (cbor.integer()) {
+                case -2:
+                    base_name = cbor.text();
+                    break;
+                case -3:
+                    base_time = cbor.integer();
+                    break;
+                case 0:
+                    record.name = cbor.text();
+                    break;
+                case 1:
+                    record.unit = cbor.text();
+                    break;
+                case 2:
+                    if (6 == cbor.peek_major()) {
+                        CHECK_EQUAL(4, cbor.head(6));
+                        CHECK_EQUAL(2, cbor.head(4));
+                        record.exponent = (int8_t)cbor.integer();
+                        record.mantissa = cbor.integer();
+                    } else {
+                        record.exponent = 0;
+                        record.mantissa = cbor.integer();
+                    }
+                    break;
+                case 6:
+                    time = cbor.integer();
+                    break;
+                default:
+                    return -1;
+            }
+        }
+        record.base_name = base_name;
+        record.time = (uint32_t)(base_time + time);
+    }
+    return cbor.done() ? (int)count : -1;
+}
+
+static const char *names[] = { "Seoul-Water", "Water", "Hot-Water", "Gas", "Heat" };
+
+/** One polling cycle of the five meters, a few seconds apart. */
+static void cycle(SenmlRecord *records, uint32_t time, int64_t step)
+{
+    const MeterReading readings[5] = {
+        { 123463 + step, -3, METER_UNIT_CUBIC_METRE },
+        { 10000026 + step, -4, METER_UNIT_CUBIC_METRE },
+        { 20000022 + step, -4, METER_UNIT_CUBIC_METRE },
+        { 30000034 + step, -4, METER_UNIT_CUBIC_METRE },
+        { 40000019 + step, -4, METER_UNIT_NONE },
+    };
+    for (int i = 0; i < 5; i++) {
+        records[i].name = names[i];
+        records[i].reading = readings[i];
+        records[i].time = time + 2 * i;
+    }
+}
+
+static void test_known_bytes()
+{
+    // [{-3: 1600000000, 0: "Gas", 1: "m3", 2: 4([-3, 3000123])}, {0: "Heat", 2: 7, 6: 5}]
+    static const uint8_t expected[] = {
+        0x82,
+        0xA4, 0x22, 0x1A, 0x5F, 0x5E, 0x10, 0x00, 0x00, 0x63, 'G', 'a', 's', 0x01, 0x62, 'm', '3',
+        0x02, 0xC4, 0x82, 0x22, 0x1A, 0x00, 0x2D, 0xC7, 0x3B,
+        0xA3, 0x00, 0x64, 'H', 'e', 'a', 't', 0x02, 0x07, 0x06, 0x05,
+    };
+    SenmlRecord records[2] = {
+        { "Gas", { 3000123, -3, METER_UNIT_CUBIC_METRE }, 1600000000 },
+        { "Heat", { 7, 0, METER_UNIT_NONE }, 1600000005 },
+    };
+    uint8_t buffer[64];
+
+    size_t length = senml_cbor_encode(records, 2, NULL, buffer, sizeof(buffer));
+    CHECK_EQUAL(sizeof(expected), length);
+    CHECK(0 == memcmp(expected, buffer, sizeof(expected)));
+
+    // Every shorter buffer fails whole, and writes nothing past its end
+    for (size_t size = 0; size < sizeof(expected); size++) {
+        memset(buffer, 0xEE, sizeof(buffer));
+        CHECK_EQUAL(0, senml_cbor_encode(records, 2, NULL, buffer, size));
+        CHECK_EQUAL(0xEE, buffer[size]);
+    }
+}
+
+static void test_round_trip()
+{
+    SenmlRecord records[SENML_BATCH_MAX_RECORDS];
+    Decoded decoded[SENML_BATCH_MAX_RECORDS];
+    uint8_t buffer[SENML_PACK_SIZE];
+
+    cycle(records, 1700000000, 0);
+    // Negative, large and time going back within a pack
+    records[3].reading.value = -5;
+    records[4].reading.value = INT64_C(123456789012345);
+    records[2].time = 1699999990;
+
+    size_t length = senml_cbor_encode(records, 5, "urn:dev:host-simulation:", buffer, sizeof(buffer));
+    CHECK(0 < length);
+    CHECK_EQUAL(5, decode(buffer, length, decoded, 5));
+    for (int i = 0; i < 5; i++) {
+        CHECK(decoded[i].base_name == "urn:dev:host-simulation:");
+        CHECK(decoded[i].name == names[i]);
+        CHECK(decoded[i].unit == meter_unit_name(records[i].reading.unit));
+        CHECK_EQUAL(records[i].reading.value, decoded[i].mantissa);
+        CHECK_EQUAL(records[i].reading.exponent, decoded[i].exponent);
+        CHECK_EQUAL(records[i].time, decoded[i].time);
+    }
+
+    // The clock not set yet: time 0 is "now" to SenML, sent as such
+    for (int i = 0; i < 5; i++) {
+        records[i].time = 0;
+    }
+    length = senml_cbor_encode(records, 5, NULL, buffer, sizeof(buffer));
+    CHECK_EQUAL(5, decode(buffer, length, decoded, 5));
+    CHECK_EQUAL(0, decoded[4].time);
+
+    // A cycle of the five meters fits the pack buffer of main.cpp at the widest values
+    for (int i = 0; i < 5; i++) {
+        records[i].reading.value = INT64_MIN + i;
+        records[i].reading.exponent = -4;
+        records[i].reading.unit = METER_UNIT_KILOWATT_HOUR;
+        records[i].time = 4000000000UL + 3600 * i;
+    }
+    length = senml_cbor_encode(records, 5, "urn:dev:host-simulation:", buffer, sizeof(buffer));
+    CHECK(0 < length);
+    CHECK_EQUAL(5, decode(buffer, length, decoded, 5));
+    CHECK_EQUAL(INT64_MIN + 4, decoded[4].mantissa);
+    CHECK_EQUAL(4000000000UL + 3600 * 4, decoded[4].time);
+}
+
+static void test_batch()
+{
+    SenmlBatch batch(5000, 3);
+    MeterReading reading = { 1, -3, METER_UNIT_CUBIC_METRE };
+    uint8_t buffer[SENML_PACK_SIZE];
+    Decoded decoded[SENML_BATCH_MAX_RECORDS];
+
+    CHECK(!batch.due(0));
+    CHECK(batch.add("Water", reading, 100, 1000));
+    CHECK(!batch.add("Gas", reading, 101, 1500));
+    CHECK(!batch.due(5999));
+
+    // A second reading of a meter replaces the first
+    reading.value = 2;
+    CHECK(!batch.add("Water", reading, 102, 2000));
+    CHECK_EQUAL(2, batch.count());
+    CHECK(!batch.due(2000));
+
+    // Due when every meter is in, or when the window closes
+    CHECK(!batch.add("Heat", reading, 103, 2500));
+    CHECK(batch.due(2500));
+    size_t length = batch.flush(NULL, buffer, sizeof(buffer));
+    CHECK_EQUAL(3, decode(buffer, length, decoded, 3));
+    CHECK(decoded[0].name == "Water");
+    CHECK_EQUAL(2, decoded[0].mantissa);
+    CHECK_EQUAL(102, decoded[0].time);
+    CHECK_EQUAL(0, batch.count());
+    CHECK(!batch.due(100000));
+
+    CHECK(batch.add("Gas", reading, 200, 10000));
+    CHECK(!batch.due(14999));
+    CHECK(batch.due(15000));
+
+    // Too small a buffer empties the batch all the same
+    CHECK_EQUAL(0, batch.flush(NULL, buffer, 4));
+    CHECK_EQUAL(0, batch.count());
+}
+
+static void bench(unsigned long cycles)
+{
+    SenmlRecord records[5];
+    uint8_t buffer[SENML_PACK_SIZE];
+    size_t pack = 0;
+    size_t text = 0;
+    char value[METER_READING_TEXT_SIZE];
+
+    cycle(records, 1700000000, 0);
+    uint64_t best = host_test_time(10, [&]() {
+        for (unsigned long i = 0; i < cycles; i++) {
+            records[0].reading.value = (int64_t)i;
+            pack = senml_cbor_encode(records, 5, NULL, buffer, sizeof(buffer));
+        }
+    });
+    printf("encode: %lu packs of 5 readings, %.0f ns/pack, %.0f ns/reading\n", cycles,
+           (double)best / cycles, (double)best / cycles / 5);
+
+    best = host_test_time(10, [&]() {
+        for (unsigned long i = 0; i < cycles; i++) {
+            records[0].reading.value = (int64_t)i;
+            for (int m = 0; m < 5; m++) {
+                meter_reading_format(records[m].reading, value, sizeof(value));
+            }
+        }
+    });
+    printf("text: %lu cycles of 5 readings, %.0f ns/cycle\n", cycles, (double)best / cycles);
+
+    cycle(records, 1700000000, 0);
+    pack = senml_cbor_encode(records, 5, NULL, buffer, sizeof(buffer));
+    for (int m = 0; m < 5; m++) {
+        text += meter_reading_format(records[m].reading, value, sizeof(value));
+    }
+    size_t overhead = IP_UDP_OVERHEAD + DTLS_OVERHEAD + COAP_OVERHEAD;
+    printf("one cycle: pack %u bytes in 1 message, %u bytes on air; "
+           "text %u bytes in 5 messages, %u bytes on air\n",
+           (unsigned)pack, (unsigned)(pack + overhead), (unsigned)text, (unsigned)(text + 5 * overhead));
+}
+
+int main(int argc, char **argv)
+{
+    test_known_bytes();
+    test_round_trip();
+    test_batch();
+
+    // One pack of a cycle costs less on air than a notification per meter,
+    // counting the per message overhead
+    SenmlRecord records[5];
+    uint8_t buffer[SENML_PACK_SIZE];
+    char value[METER_READING_TEXT_SIZE];
+    size_t text = 0;
+    size_t overhead = IP_UDP_OVERHEAD + DTLS_OVERHEAD + COAP_OVERHEAD;
+    cycle(records, 1700000000, 0);
+    size_t pack = senml_cbor_encode(records, 5, NULL, buffer, sizeof(buffer));
+    for (int m = 0; m < 5; m++) {
+        text += meter_reading_format(records[m].reading, value, sizeof(value));
+    }
+    CHECK(0 < pack);
+    CHECK(pack + overhead < text + 5 * overhead);
+
+    unsigned long cycles = host_test_arg(argc, argv, "bench", 0, 100000);
+    if (0 < cycles) {
+        bench(cycles);
+    }
+
+    return host_test_done("senml_test");
+}
@@ -0,0 +1,409 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+/*
+ * UplinkScheduler against its rules, then a simulated day of the gateway
+ * driving it, with the bursts sent through SimulatedModem.
+ *
+ *   g++ -std=gnu++14 -O2 -Ihost -Ihost/tests -Imeter host/tests/uplink_test.cpp meter/UplinkScheduler.cpp \
+ *       -o host-build/uplink_test
+ *   host-build/uplink_test bench
+ *
+ * The day: 5 meters polled every 60 s, about a third of the readings
+ * passing the report policy, and no button, as on a target without one,
+ * or 2 urgent presses. Every notification must go out once, only while
+ * the radio is up or with an urgent one, and within a window period of
+ * its submit. bench prints the radio-on time of the scheduler's estimate
+ * and of the simulated modem per profile, window and button.
+ *
+ * A third day presses every 5 s without urgency, as the ticker main.cpp
+ * once ran on targets without a button: each press lands in the tail of
+ * the last and the radio never goes back to sleep.
+ */
+#include "HostTest.h"
+#include "SimulatedModem.h"
+#include "UplinkScheduler.h"
+
+#define DAY_MS              86400000UL
+#define POLL_INTERVAL_MS    60000UL
+#define METERS              5
+#define TICKER_INTERVAL_MS  5000UL
+
+enum Button {
+    BUTTON_NONE = 0,
+    BUTTON_PRESSES,         // 2 a day, urgent
+    BUTTON_TICKER,          // every TICKER_INTERVAL_MS, not urgent
+    BUTTON_COUNT
+};
+
+static const char *buttonNames[BUTTON_COUNT] = { "no button", "2 presses", "5 s ticker" };
+
+static unsigned sent[UPLINK_MAX_PENDING + 2];
+
+static void count_send(void *context)
+{
+    sent[(intptr_t)context]++;
+}
+
+static UplinkScheduler *resubmitTo;
+
+static void resubmit(void *context)
+{
+    resubmitTo->submit(&count_send, context, false, 0);
+}
+
+static const RadioProfile nbiotRadio = { 2000, 200, 20000 };
+
+static void test_rules()
+{
+    UplinkScheduler uplink;
+    UplinkWindow immediate = { 0, 0 };
+    UplinkWindow window = { 900000, 30000 };
+
+    // No window: sent on the next run
+    memset(sent, 0, sizeof(sent));
+    uplink.configure(immediate, nbiotRadio, 0);
+    CHECK(uplink.submit(&count_send, (void *)1, false, 0));
+    CHECK_EQUAL(0, uplink.run(0));
+    CHECK_EQUAL(1, sent[1]);
+    CHECK_EQUAL(0, uplink.pending());
+
+    // Waits for the window, and run() says how long
+    uplink.configure(window, nbiotRadio, 1000);
+    CHECK(uplink.submit(&count_send, (void *)2, false, 100000));
+    CHECK(uplink.submit(&count_send, (void *)2, false, 200000));
+    CHECK(uplink.submit(&count_send, (void *)3, false, 200000));
+    CHECK_EQUAL(901000 - 200000, uplink.run(200000));
+    CHECK_EQUAL(0, sent[2]);
+    CHECK(!uplink.awake(900999));
+    CHECK(uplink.awake(901000));
+    CHECK_EQUAL(0, uplink.run(901000));
+    CHECK_EQUAL(1, sent[2]);
+    CHECK_EQUAL(1, sent[3]);
+    CHECK_EQUAL(1, uplink.stats().coalesced);
+    CHECK_EQUAL(1, uplink.stats().bursts);
+    CHECK_EQUAL(2, uplink.stats().messages);
+
+    // Still connected after the window: sent at once until the tail ends
+    uint32_t off = 901000 + 2000 + 2 * 200 + 20000;
+    CHECK(uplink.submit(&count_send, (void *)4, false, off - 1));
+    CHECK_EQUAL(0, uplink.run(off - 1));
+    CHECK_EQUAL(1, sent[4]);
+    uint32_t extended = (off - 1) + 200 + 20000;
+    CHECK(uplink.awake(extended - 1));
+    CHECK(!uplink.awake(extended));
+
+    // Urgent: out of the window, taking the waiting ones along
+    CHECK(uplink.submit(&count_send, (void *)5, false, 1200000));
+    CHECK(0 < uplink.run(1200000));
+    CHECK(uplink.submit(&count_send, (void *)6, true, 1200000));
+    CHECK_EQUAL(0, uplink.run(1200000));
+    CHECK_EQUAL(1, sent[5]);
+    CHECK_EQUAL(1, sent[6]);
+    CHECK_EQUAL(1, uplink.stats().urgent);
+
+    // A pending one submitted again as urgent makes the queue urgent
+    CHECK(uplink.submit(&count_send, (void *)7, false, 1500000));
+    CHECK(uplink.submit(&count_send, (void *)7, true, 1500000));
+    CHECK_EQUAL(0, uplink.run(1500000));
+    CHECK_EQUAL(1, sent[7]);
+
+    // Full queue
+    for (intptr_t i = 0; i < UPLINK_MAX_PENDING; i++) {
+        CHECK(uplink.submit(&count_send, (void *)(i + 1), false, 1600000));
+    }
+    CHECK(!uplink.submit(&count_send, (void *)17, false, 1600000));
+    CHECK(!uplink.submit(NULL, NULL, false, 1600000));
+    CHECK_EQUAL(2, uplink.stats().dropped);
+    CHECK(uplink.submit(&count_send, (void *)3, false, 1600000));
+    CHECK_EQUAL(UPLINK_MAX_PENDING, uplink.pending());
+
+    // A send function queueing again gets another run
+    uplink.configure(immediate, nbiotRadio, 0);
+    while (0 < uplink.pending()) {
+        uplink.run(0);
+    }
+    memset(sent, 0, sizeof(sent));
+    resubmitTo = &uplink;
+    CHECK(uplink.submit(&resubmit, (void *)8, false, 0));
+    CHECK_EQUAL(1, uplink.run(0));
+    CHECK_EQUAL(1, uplink.pending());
+    CHECK_EQUAL(0, uplink.run(1));
+    CHECK_EQUAL(1, sent[8]);
+}
+
+static void test_estimate()
+{
+    UplinkScheduler uplink;
+    UplinkWindow window = { 900000, 30000 };
+
+    // Across the wrap of the millisecond clock
+    uint32_t start = UINT32_MAX - 10000;
+    uplink.configure(window, nbiotRadio, start);
+    uplink.activity(start, 3);
+    CHECK_EQUAL(1, uplink.stats().wakeups);
+    CHECK_EQUAL(2000 + 3 * 200 + 20000, uplink.stats().radio_on_ms);
+
+    // Within the tail: no wake-up, the connection is extended
+    uplink.activity(start + 15000, 1);
+    CHECK_EQUAL(1, uplink.stats().wakeups);
+    CHECK_EQUAL(15000 + 200 + 20000, uplink.stats().radio_on_ms);
+    CHECK(uplink.awake(start + 35199));
+    CHECK(!uplink.awake(start + 35200));
+
+    // After it: a new wake-up
+    uplink.activity(start + 100000, 0);
+    CHECK_EQUAL(2, uplink.stats().wakeups);
+    CHECK_EQUAL(15000 + 200 + 20000 + 2000 + 20000, uplink.stats().radio_on_ms);
+    CHECK_EQUAL(4, uplink.stats().messages);
+
+    CHECK_EQUAL(0, uplink.radio_on_per_day(start));
+    CHECK_EQUAL((uint32_t)(57200ULL * 86400000ULL / 3600000), uplink.radio_on_per_day(start + 3600000));
+
+    // The window follows configure(), across the wrap
+    CHECK(uplink.awake(start + 900000 + 29999));
+    CHECK(!uplink.awake(start + 900000 + 30000));
+}
+
+struct Profile {
+    const char *name;
+    RadioProfile radio;
+    SimulatedModemProfile modem;
+};
+
+static const Profile profiles[] = {
+    { "NB-IoT", { 2000, 200, 20000 }, { 2000, 3000, 200, 20000, 60000, 20480, 100 } },
+    { "Cat.M1", { 500, 50, 10000 }, { 500, 1000, 50, 10000, 60000, 10240, 50 } },
+};
+
+struct Day;
+
+/** A notification source: a meter resource or the button. */
+struct Source {
+    Day *day;
+    bool pending;
+    bool urgent;
+    uint32_t submitted_ms;
+};
+
+struct Day {
+    UplinkScheduler uplink;
+    SimulatedModem modem;
+    Source sources[METERS + 1];
+    uint32_t now;
+    uint32_t burst;
+
+    uint32_t submitted;
+    uint32_t delivered;
+    uint32_t twice;
+    uint32_t late;
+    uint32_t urgent_late;
+    uint32_t asleep;
+
+    explicit Day(const SimulatedModemProfile &profile)
+        : modem(profile), now(0), burst(0), submitted(0), delivered(0), twice(0), late(0), urgent_late(0), asleep(0)
+    {
+        memset(sources, 0, sizeof(sources));
+    }
+};
+
+static uint32_t maxLatency;
+
+static void publish(void *context)
+{
+    Source *source = static_cast<Source *>(context);
+    Day *day = source->day;
+    uint32_t latency = day->now - source->submitted_ms;
+
+    if (!source->pending) {
+        day->twice++;
+    }
+    if (source->urgent && (0 < latency)) {
+        day->urgent_late++;
+    }
+    if (latency > maxLatency) {
+        day->late++;
+    }
+    source->pending = false;
+    source->urgent = false;
+    day->delivered++;
+    day->burst++;
+}
+
+static uint32_t next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/** One simulated day, time in whole seconds. */
+static void simulate(Day &day, const Profile &profile, const UplinkWindow &window, Button button)
+{
+    static const uint32_t presses[] = { 8 * 3600 + 17, 19 * 3600 + 45 * 60 + 3 };
+    uint32_t seed = 2024;
+    uint32_t next_run = 0;
+
+    for (size_t i = 0; i <= METERS; i++) {
+        day.sources[i].day = &day;
+    }
+    day.uplink.configure(window, profile.radio, 0);
+    maxLatency = (0 == window.period_ms) ? 0 : window.period_ms;
+
+    // Past the end of the day until the last window has sent the rest
+    for (day.now = 0; day.now < DAY_MS + window.period_ms; day.now += 1000) {
+        bool submitted = false;
+        uint32_t second = day.now / 1000;
+
+        // Meters polled a few seconds apart within each interval
+        for (size_t m = 0; (m < METERS) && (day.now < DAY_MS); m++) {
+            if ((second % (POLL_INTERVAL_MS / 1000)) == 2 * m && (0 == next_random(seed) % 3)) {
+                Source &source = day.sources[m];
+                if (!source.pending) {
+                    source.pending = true;
+                    source.submitted_ms = day.now;
+                }
+                day.submitted++;
+                submitted |= day.uplink.submit(&publish, &source, false, day.now);
+            }
+        }
+        for (size_t p = 0; (BUTTON_PRESSES == button) && (p < sizeof(presses) / sizeof(presses[0])); p++) {
+            if (second == presses[p]) {
+                Source &source = day.sources[METERS];
+                source.pending = true;
+                source.urgent = true;
+                source.submitted_ms = day.now;
+                day.submitted++;
+                submitted |= day.uplink.submit(&publish, &source, true, day.now);
+            }
+        }
+        if ((BUTTON_TICKER == button) && (day.now < DAY_MS) && (0 == day.now % TICKER_INTERVAL_MS)) {
+            Source &source = day.sources[METERS];
+            if (!source.pending) {
+                source.pending = true;
+                source.submitted_ms = day.now;
+            }
+            day.submitted++;
+            submitted |= day.uplink.submit(&publish, &source, false, day.now);
+        }
+
+        // As uplinkTick() on the eventQueue: after a submit or when due
+        if (submitted || ((0 != next_run) && (0 <= (int32_t)(day.now - next_run)))) {
+            bool awake = day.uplink.awake(day.now);
+            bool urgent = day.sources[METERS].urgent;
+
+            day.burst = 0;
+            uint32_t wait = day.uplink.run(day.now);
+            next_run = (0 == wait) ? 0 : day.now + ((wait + 999) / 1000) * 1000;
+            if (0 < day.burst) {
+                day.modem.send(day.now, day.burst);
+                if (!awake && !urgent) {
+                    day.asleep++;
+                }
+            }
+        }
+    }
+    day.modem.advance(day.now);
+}
+
+struct Result {
+    uint64_t estimate_ms;
+    uint64_t simulated_ms;
+    uint32_t connections;
+    uint32_t messages;
+};
+
+static Result check_day(const Profile &profile, const UplinkWindow &window, Button button)
+{
+    Day day(profile.modem);
+    simulate(day, profile, window, button);
+    const UplinkStats &stats = day.uplink.stats();
+
+    // Every notification once, at the latest at the next window, never waking the radio unless urgent
+    uint32_t delivered = day.delivered;
+    uint32_t coalesced = stats.coalesced;
+    CHECK_EQUAL(day.submitted, delivered + coalesced);
+    CHECK_EQUAL(0, day.twice);
+    CHECK_EQUAL(0, day.late);
+    CHECK_EQUAL(0, day.urgent_late);
+    CHECK_EQUAL(0, day.asleep);
+    CHECK_EQUAL(0, stats.dropped);
+    CHECK_EQUAL(0, day.uplink.pending());
+    CHECK_EQUAL(stats.messages, day.modem.messages());
+    CHECK(stats.urgent <= ((BUTTON_PRESSES == button) ? 2 : 0));
+
+    // The estimate knows no paging and no PSM resume: below the modem, but not by much
+    CHECK(stats.radio_on_ms <= day.modem.radio_on_ms());
+    CHECK(day.modem.radio_on_ms() * 100 <= stats.radio_on_ms * 125);
+    CHECK(day.modem.connections() <= stats.wakeups);
+
+    Result result = { stats.radio_on_ms, day.modem.radio_on_ms(), day.modem.connections(), stats.messages };
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        UplinkWindow window;
+    } windows[] = {
+        { "immediate", { 0, 0 } },
+        { "5 min / 30 s", { 300000, 30000 } },
+        { "15 min / 30 s", { 900000, 30000 } },
+    };
+    Result results[BUTTON_COUNT][2][3];
+
+    test_rules();
+    test_estimate();
+
+    for (size_t b = 0; b < BUTTON_COUNT; b++) {
+        for (size_t p = 0; p < 2; p++) {
+            for (size_t w = 0; w < 3; w++) {
+                results[b][p][w] = check_day(profiles[p], windows[w].window, (Button)b);
+            }
+            if (BUTTON_TICKER == b) {
+                // Never a gap long enough for the radio to sleep, whatever the window
+                CHECK(results[b][p][2].connections <= 2);
+                CHECK(DAY_MS <= results[b][p][2].simulated_ms);
+                continue;
+            }
+            // Windows cut the radio-on time of the day to under a third, each step down
+            CHECK(results[b][p][1].simulated_ms < results[b][p][0].simulated_ms);
+            CHECK(results[b][p][2].simulated_ms * 3 < results[b][p][0].simulated_ms);
+            // One connection per window, a press may add its own and one after it
+            CHECK(results[b][p][2].connections <= 96 + 2 + ((BUTTON_PRESSES == b) ? 2 : 0));
+        }
+    }
+
+    if (0 < host_test_arg(argc, argv, "bench", 0, 1)) {
+        printf("%-36s %10s %10s %12s %9s\n", "profile, window, button", "estimate", "simulated", "connections",
+               "messages");
+        for (size_t b = 0; b < BUTTON_COUNT; b++) {
+            for (size_t p = 0; p < 2; p++) {
+                for (size_t w = 0; w < 3; w++) {
+                    char name[60];
+                    snprintf(name, sizeof(name), "%s, %s, %s", profiles[p].name, windows[w].name, buttonNames[b]);
+                    printf("%-36s %8lu s %8lu s %12lu %9lu\n", name,
+                           (unsigned long)(results[b][p][w].estimate_ms / 1000),
+                           (unsigned long)(results[b][p][w].simulated_ms / 1000),
+                           (unsigned long)results[b][p][w].connections, (unsigned long)results[b][p][w].messages);
+                }
+            }
+        }
+    }
+
+    return host_test_done("uplink_test");
+}
@@ -23,12 +23,31 @@
 #include "FATFileSystem.h"
 #include "LittleFileSystem.h"
 
-#include "platform/CircularBuffer.h"
+#include "MeterProtocol.h"
+#include "SeoulFrameDecoder.h"
+#include "PstecFrameDecoder.h"
+#include "PstecTransactionQueue.h"
+#include "ModbusMaster.h"
+#include "PowerAggregator.h"
+#include "MeterPort.h"
+#include "StaticArena.h"
+#include "MeterReading.h"
+#include "ReadingStore.h"
+#include "UnstampedReadings.h"
+#include "Sntp.h"
+#include "ForwardQueue.h"
+#include "SenmlBatch.h"
+#include "ReportPolicy.h"
+#include "HistoryCodec.h"
+#include "UplinkScheduler.h"
+#include "PollScheduler.h"
+#include "PortCounters.h"
 
 
 #define UART1_BUF_SIZE    512
 #define UART2_BUF_SIZE    512
-#define UART3_BUF_SIZE    512
+#define UART3_BUF_SIZE    256
+#define UART_TX_BUF_SIZE  64
 
 
 // Default network interface object. Don't forget to change the WiFi SSID/password in mbed_app.json if you're using WiFi.
@@ -60,46 +79,203 @@ MbedCloudClientResource *led_res;
 MbedCloudClientResource *post_res;
 
 MbedCloudClientResource *power_meter_res;
+MbedCloudClientResource *power_demand_res;
 MbedCloudClientResource *seoul_water_meter_res;
 MbedCloudClientResource *water_meter_res;
 MbedCloudClientResource *hot_water_meter_res;
 MbedCloudClientResource *gas_meter_res;
 MbedCloudClientResource *heat_meter_res;
+MbedCloudClientResource *backlog_res;
+MbedCloudClientResource *senml_res;
+MbedCloudClientResource *report_policy_res;
+MbedCloudClientResource *history_res;
+MbedCloudClientResource *port_counters_res;
 
 // An event queue is a very useful structure to debounce information between contexts (e.g. ISR and normal threads)
 // This is great because things such as network operations are illegal in ISR, so updating a resource in a button's fall() function is not allowed
 EventQueue eventQueue;
 
 #if 1
-Thread threadSeoulWaterMeter;
-Thread threadPowerMeter;
-Thread threadOtherMeters;
-
-EventFlags uart1_Flags;
-EventFlags uart2_Flags;
-EventFlags uart3_Flags;
+// Meter UARTs, each with its buffers, decoder and parser thread
+typedef MeterPort<SeoulProtocol, UART1_BUF_SIZE, UART_TX_BUF_SIZE, MBED_CONF_APP_METER_PORT_STACK_SIZE> SeoulPort;
+typedef MeterPort<PstecProtocol, UART2_BUF_SIZE, UART_TX_BUF_SIZE, MBED_CONF_APP_METER_PORT_STACK_SIZE> PstecPort;
+typedef MeterPort<ModbusProtocol, UART3_BUF_SIZE, UART_TX_BUF_SIZE, MBED_CONF_APP_METER_PORT_STACK_SIZE> ModbusPort;
+
+// In this order in the arena and in the Port-Counters dump
+enum {
+    UART_PORT_SEOUL = 0,    // uart1, 1200 BPS
+    UART_PORT_PSTEC,        // uart2, 4800 BPS
+    UART_PORT_MODBUS,       // uart3, 9600 BPS
+    UART_PORT_COUNT
+};
 
-CircularBuffer<char, UART1_BUF_SIZE> bufUart1;
-CircularBuffer<char, UART2_BUF_SIZE> bufUart2;
-CircularBuffer<char, UART3_BUF_SIZE> bufUart3;
+// All port state in one block, sized by the compiler. It is the symbol
+// meterPorts in the map file.
+static StaticArena<SeoulPort, PstecPort, ModbusPort> meterPorts;
 
+static_assert(decltype(meterPorts)::size <= MBED_CONF_APP_METER_PORT_RAM,
+              "meter ports exceed meter-port-ram in mbed_app.json");
 
+static SeoulPort *seoulPort = NULL;
+static PstecPort *pstecPort = NULL;
+static ModbusPort *modbusPort = NULL;
+static MeterPortBase *ports[UART_PORT_COUNT];
 
-RawSerial uart1SeoulWaterMater(PC_1, PC_0);    // 1200 BPS
-RawSerial uart2OtherMater(PA_2, PA_3);         // 4800 BPS
-RawSerial uart3PowerMeter(PC_4, PC_5);         // 9600 BPS
+// Request-to-set_value latency of the Seoul water meter
+Timer seoulRequestTimer;
 #endif
 
+// A telegram with the longest L field is 261 characters, 2.4 s at 1200 BPS,
+// so the first polls wait for that much before the latency is known
+#define SEOUL_READ_TIMEOUT_MS       3000
+#define SEOUL_READ_DEADLINE_MS      4000
 
-static int button_press_count = 0;
 
-void request_OtherMeters(uint8_t meterType);
+void sendOtherMetersRequest(void *context, const uint8_t *data, size_t size);
 void request_SeoulWaterMeter();
 
-void request_WaterMeter();
-void request_HotWaterMeter();
-void request_GasMeter();
-void request_HeatMeter();
+// Bus indexes of the poll scheduler
+enum {
+    POLL_BUS_SEOUL = 0,     // seoulPort, uart1
+    POLL_BUS_PSTEC = 1,     // pstecPort, uart2
+    POLL_BUS_MODBUS = 2     // modbusPort, uart3
+};
+
+// Meters in the poll table
+enum {
+    POLL_SEOUL_WATER_METER = 0,
+    POLL_WATER_METER,
+    POLL_HOT_WATER_METER,
+    POLL_GAS_METER,
+    POLL_HEAT_METER,
+    POLL_METER_COUNT
+};
+
+// Owns uart1 and uart2 request timing, runs on the eventQueue thread only
+static PollScheduler pollScheduler;
+static int pollHandles[POLL_METER_COUNT];
+static int pollTickEvent = 0;
+
+static const char *meterNames[POLL_METER_COUNT] = { "Seoul-Water", "Water", "Hot-Water", "Gas", "Heat" };
+
+// Where fs is mounted; the host build maps it to a local directory
+#ifndef FS_MOUNT_POINT
+#define FS_MOUNT_POINT              "/fs"
+#endif
+
+// History of all readings on the LittleFS partition, eventQueue thread only
+static ReadingStore readingStore(FS_MOUNT_POINT "/ts");
+static bool readingStoreReady = false;
+
+// An RTC that lost power starts at 1970; anything before this is not a real time
+#define CLOCK_VALID_AFTER           1546300800UL    // 2019-01-01
+#define NTP_TIMEOUT_MS              5000
+#define NTP_ATTEMPTS                3
+
+// Readings wait here, eventQueue thread only, until the clock is set
+static UnstampedReadings unstampedReadings;
+static volatile bool clockValid = false;
+
+// Largest compressed history block sent at once, about 250 readings
+#define HISTORY_EXPORT_SIZE         512
+
+// Readings not yet delivered to Pelion, kept across outages and reboots
+#define FORWARD_QUEUE_ENTRIES       1024
+#define FORWARD_BATCH_SIZE          8
+#define FORWARD_INTERVAL_MS         2000    // between two batches at least
+#define FORWARD_ACK_TIMEOUT_MS      30000
+#define FORWARD_MAX_ATTEMPTS        8       // then the batch is only in the history
+
+static bool sendForwardBatch(void *context, const ForwardEntry *entries, size_t count);
+
+static ForwardQueue forwardQueue(FS_MOUNT_POINT "/fwd", FORWARD_QUEUE_ENTRIES, &sendForwardBatch, NULL);
+static bool forwardQueueReady = false;
+static int forwardTickEvent = 0;
+
+/**
+ * Where the latest reported reading of a meter is on the live path, the
+ * meter resources or the SenML pack. One replaced or published while the
+ * client is not registered, or whose notification failed, goes to the
+ * forward queue; the others are never queued. eventQueue thread only.
+ */
+enum LiveState {
+    LIVE_NONE = 0,
+    LIVE_WAITING,       // waiting for the wake window, or for the SenML batch
+    LIVE_PACKED,        // in the SenML pack waiting to be published
+    LIVE_SENT           // published, delivery status to come if observed
+};
+
+struct LiveReading {
+    MeterReading reading;
+    uint32_t timestamp;
+    LiveState state;
+};
+
+static LiveReading liveReadings[POLL_METER_COUNT];
+
+// One SenML-CBOR notification per polling cycle instead of one per meter
+#define SENML_PACK_SIZE             256
+
+static SenmlBatch senmlBatch(MBED_CONF_APP_SENML_FLUSH_WINDOW, POLL_METER_COUNT);
+
+// Decides which readings are worth sending, the reading store keeps all of them
+static ReportPolicy reportPolicies[POLL_METER_COUNT];
+
+// Notifications wait for the modem's wake window unless urgent
+static UplinkScheduler uplink;
+static int uplinkTickEvent = 0;
+
+// Reconnects the network after an outage and sets the clock, DNS needs the larger stack
+Thread networkThread(osPriorityBelowNormal, 3072);
+static SimpleMbedCloudClient *cloudClient = NULL;
+static volatile bool cloudRegistered = false;
+
+void onCloudLink(bool up);
+void forwardTick();
+void flushSenmlBatch();
+
+// PSTEC requests are queued back to back and answered by meter ID.
+// One on the wire at a time: the bus is half-duplex RS-485.
+// The timeout is where each meter starts; it then follows its latency.
+#define PSTEC_TRANSACTION_TIMEOUT_MS    500
+#define PSTEC_TURNAROUND_GUARD_MS       10
+
+static PstecTransactionQueue pstecTransactions(&sendOtherMetersRequest, NULL, 1, PSTEC_TURNAROUND_GUARD_MS);
+
+// Modbus RTU bus on uart3. The master reads the registers of each slave
+// in as few requests as it can and sends one request at a time, with at
+// least 3.5 quiet characters before each.
+#define MODBUS_BAUD                     9600
+#define MODBUS_GUARD_MS                 (modbus_t35_us(MODBUS_BAUD) / 1000 + 1)
+
+static void sendModbusRequest(void *context, const uint8_t *data, size_t size);
+
+static ModbusMaster modbus(&sendModbusRequest, NULL, MODBUS_GUARD_MS);
+
+// Response frame handed from the uart3 thread to the eventQueue thread
+struct ModbusResponse {
+    uint8_t frame[MODBUS_MAX_RESPONSE_LENGTH];
+    uint8_t length;
+};
+
+// The power meter is a Modbus slave sampled every second or so, and only
+// the aggregates of each interval are published. It is polled by the
+// scheduler but is not in the poll table: its samples are not readings.
+#define POWER_METER_POWER_EXPONENT      -1      // 0.1 W
+#define POWER_METER_ENERGY_EXPONENT     -3      // Wh, of a kWh register
+#define POWER_METER_TIMEOUT_MS          200
+#define POWER_METER_DEADLINE_MS         500
+
+static PowerAggregator powerAggregator;
+static int powerPollHandle = -1;
+static int powerPoint = -1;                 // Modbus point handles
+static int energyPoint = -1;
+static uint32_t powerIntervalStart = 0;     // timestamp of the open interval
+
+// Response frame handed from the uart2 thread to the eventQueue thread
+struct PstecResponse {
+    uint8_t frame[PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT];
+};
 
 // When the device is registered, this variable will be used to access various useful information, like device ID etc.
 static const ConnectorClientEndpointInfo* endpointInfo;
@@ -114,6 +290,60 @@ void put_callback(MbedCloudClientResource *resource, m2m::String newValue) {
     led = atoi(newValue.c_str());
 }
 
+/**
+ * Shows the policies in force on the Report-Policy resource, one line per
+ * meter as a PUT takes them. Runs on the eventQueue thread
+ */
+static void showReportPolicy() {
+    static char text[POLL_METER_COUNT * REPORT_POLICY_TEXT_SIZE];
+    char line[REPORT_POLICY_TEXT_SIZE];
+    size_t length = 0;
+
+    if (NULL == report_policy_res) {
+        return;
+    }
+    text[0] = '\0';
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        if (0 < report_policy_format(i, reportPolicies[i].config(), line, sizeof(line))) {
+            length += snprintf(text + length, sizeof(text) - length, "%s%s", (0 < length) ? "\n" : "", line);
+        }
+    }
+    report_policy_res->set_value(text);
+}
+
+/**
+ * Applies a reporting policy, runs on the eventQueue thread
+ * @param meter Meter number, or -1 for all meters
+ * @param config The new policy
+ */
+static void applyReportPolicy(int meter, ReportPolicyConfig config) {
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        if ((meter < 0) || (meter == i)) {
+            reportPolicies[i].configure(config);
+        }
+    }
+    showReportPolicy();
+}
+
+/**
+ * PUT handler - sets the reporting policy of one or all meters
+ * @param resource The resource that triggered the callback
+ * @param newValue "meter,abs,rel,min,max", meter "*" for all meters
+ */
+void report_policy_put_callback(MbedCloudClientResource *resource, m2m::String newValue) {
+    ReportPolicyConfig config;
+    int meter;
+
+    printf("PUT received. New report policy: %s\n", newValue.c_str());
+    if (!report_policy_parse(newValue.c_str(), meter, config) || (POLL_METER_COUNT <= meter)) {
+        printf("# Report policy rejected\n");
+        // The PUT overwrote the resource, put back the policies in force
+        eventQueue.call(&showReportPolicy);
+        return;
+    }
+    eventQueue.call(&applyReportPolicy, meter, config);
+}
+
 /**
  * POST handler - prints the content of the payload
  * @param resource The resource that triggered the callback
@@ -131,39 +361,194 @@ void post_callback(MbedCloudClientResource *resource, const uint8_t *buffer, uin
 
 /**
  * Button handler
- * This function will be triggered either by a physical button press or by a ticker every 5 seconds (see below)
+ * This function will be triggered by a physical button press (see below)
  */
-void button_press() {
+static void publishButton(void *context) {
     int v = button_res->get_value_int() + 1;
     button_res->set_value(v);
     printf("Button clicked %d times\n", v);
+}
 
-    if(0 == button_press_count) {
-        request_SeoulWaterMeter();
+static uint32_t nowMs() {
+    return (uint32_t)Kernel::get_ms_count();
+}
+
+/**
+ * Sends the queued notifications when the radio is up and re-arms for the
+ * next wake window
+ * Must be called on the eventQueue thread
+ */
+void uplinkTick() {
+    if (0 != uplinkTickEvent) {
+        eventQueue.cancel(uplinkTickEvent);
+        uplinkTickEvent = 0;
     }
-    else if(1 == button_press_count) {
-        request_WaterMeter();
+    uint32_t wait = uplink.run(nowMs());
+    if (0 < wait) {
+        uplinkTickEvent = eventQueue.call_in(wait, &uplinkTick);
     }
-     else if(2 == button_press_count) {
-        request_HotWaterMeter();
+}
+
+/**
+ * Queues a notification for the next burst
+ * Must be called on the eventQueue thread
+ * @param send Publishes the latest value when the burst goes out
+ * @param urgent Send now instead of waiting for the wake window
+ */
+static void submitUplink(UplinkSendFn send, void *context, bool urgent) {
+    if (!uplink.submit(send, context, urgent, nowMs())) {
+        printf("# Uplink queue full\n");
     }
-     else if(3 == button_press_count) {
-        request_GasMeter();
+    uplinkTick();
+}
+
+/**
+ * Button handler, runs on the eventQueue thread
+ * A button press is sent right away, outside the wake window
+ */
+void button_press() {
+    submitUplink(&publishButton, NULL, true);
+}
+
+/**
+ * Runs the poll scheduler and the PSTEC queue and re-arms them for the
+ * earlier of their next due times
+ * Must be called on the eventQueue thread
+ */
+void pollSchedulerTick() {
+    if (0 != pollTickEvent) {
+        eventQueue.cancel(pollTickEvent);
     }
-     else if(4 == button_press_count) {
-        request_HeatMeter();
+
+    uint32_t now = nowMs();
+    pstecTransactions.run(now);             // timeouts free scheduler slots
+    modbus.run(now);
+    uint32_t wait = pollScheduler.run(now);
+    uint32_t pstecWait = pstecTransactions.run(now);  // send what was just submitted
+    if ((0 < pstecWait) && (pstecWait < wait)) {
+        wait = pstecWait;
     }
-#if 0  
-    else if(5 == button_press_count) {
-        request_PowerMeter();
+    uint32_t modbusWait = modbus.run(now);
+    if ((0 < modbusWait) && (modbusWait < wait)) {
+        wait = modbusWait;
     }
-    button_press_count++;
-    button_press_count %= 6;
-#else
-    button_press_count++;
-    button_press_count %= 5;
-#endif
 
+    pollTickEvent = eventQueue.call_in(wait, &pollSchedulerTick);
+}
+
+/**
+ * A meter answered or its request failed: free its bus and start the next due request
+ * @param handle Poll scheduler handle of the meter
+ * @param answered false if the request failed
+ */
+void pollMeterDone(int handle, bool answered) {
+    if (pollScheduler.complete(handle, nowMs(), answered)) {
+        pollSchedulerTick();
+    }
+}
+
+/**
+ * Prints the schedule slip of every meter
+ */
+void printPollStats() {
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        const PollMeterStats *stats = pollScheduler.stats(pollHandles[i]);
+        if (NULL == stats) {
+            continue;
+        }
+        printf("# Poll %-11s: polls %lu, answered %lu, timeouts %lu, late %lu, skipped %lu, slip max %lu ms avg %lu ms\n",
+               meterNames[i], (unsigned long)stats->polls, (unsigned long)stats->responses, (unsigned long)stats->timeouts,
+               (unsigned long)stats->late, (unsigned long)stats->skipped, (unsigned long)stats->max_slip_ms,
+               (unsigned long)(stats->late ? (stats->total_slip_ms / stats->late) : 0));
+    }
+
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        const PollMeterStats *stats = pollScheduler.stats(pollHandles[i]);
+        const MeterHealth *health = pollScheduler.health(pollHandles[i]);
+        if ((NULL == stats) || (NULL == health)) {
+            continue;
+        }
+        const LatencyHistogram &latency = health->latency();
+        printf("# Health %-11s: %s, failures %u, retries %lu, timeout %lu ms, latency p50 %lu ms p99 %lu ms, buckets",
+               meterNames[i], meter_state_name(health->state()), (unsigned)health->failures(),
+               (unsigned long)stats->retries, (unsigned long)health->timeout_ms(),
+               (unsigned long)latency.percentile(500), (unsigned long)latency.percentile(990));
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+            printf(" %u", (unsigned)latency.count(b));
+        }
+        printf("\n");
+    }
+
+    const PollMeterStats *power = pollScheduler.stats(powerPollHandle);
+    if (NULL != power) {
+        printf("# Power meter : samples %lu, answered %lu, timeouts %lu, retries %lu, in interval %lu\n",
+               (unsigned long)power->polls, (unsigned long)power->responses, (unsigned long)power->timeouts,
+               (unsigned long)power->retries, (unsigned long)powerAggregator.samples());
+    }
+
+    const ModbusStats &bus = modbus.stats();
+    printf("# Modbus : %u blocks, polls %lu, rejected %lu, requests %lu, responses %lu, exceptions %lu, timeouts %lu, unmatched %lu\n",
+           (unsigned)modbus.blocks(), (unsigned long)bus.polls, (unsigned long)bus.rejected, (unsigned long)bus.requests,
+           (unsigned long)bus.responses, (unsigned long)bus.exceptions, (unsigned long)bus.timeouts,
+           (unsigned long)bus.unmatched);
+
+    const PstecTransactionStats &pstec = pstecTransactions.stats();
+    printf("# PSTEC queue : submitted %lu, rejected %lu, completed %lu, timeouts %lu, unmatched %lu\n",
+           (unsigned long)pstec.submitted, (unsigned long)pstec.rejected, (unsigned long)pstec.completed,
+           (unsigned long)pstec.timeouts, (unsigned long)pstec.unmatched);
+
+    const ForwardQueueStats &forward = forwardQueue.stats();
+    printf("# Forward queue : backlog %lu, queued %lu, batches %lu, delivered %lu, failures %lu, dropped %lu, "
+           "abandoned %lu, writes %lu\n",
+           (unsigned long)forwardQueue.backlog(), (unsigned long)forward.queued, (unsigned long)forward.batches,
+           (unsigned long)forward.delivered, (unsigned long)forward.failures, (unsigned long)forward.dropped,
+           (unsigned long)forward.abandoned, (unsigned long)forward.writes);
+
+    const UplinkStats &up = uplink.stats();
+    printf("# Uplink : queued %lu, coalesced %lu, bursts %lu, urgent %lu, messages %lu, wakeups %lu, radio on ~%lu s/day\n",
+           (unsigned long)up.queued, (unsigned long)up.coalesced, (unsigned long)up.bursts, (unsigned long)up.urgent,
+           (unsigned long)up.messages, (unsigned long)up.wakeups, (unsigned long)(uplink.radio_on_per_day(nowMs()) / 1000));
+
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        printf("# Report %-11s: suppressed %lu\n", meterNames[i], (unsigned long)reportPolicies[i].suppressed());
+    }
+
+    for (int i = 0; i < UART_PORT_COUNT; i++) {
+        PortCounterValues port;
+        ports[i]->counters().snapshot(port);
+        printf("# Port %s : rx %lu, overflows %lu, frames %lu, checksum %lu, length %lu, resets %lu, skipped %lu, "
+               "parse %lu runs %lu us max %lu us\n",
+               ports[i]->name(), (unsigned long)port.rx_bytes, (unsigned long)port.rx_overflows, (unsigned long)port.frames,
+               (unsigned long)port.checksum_errors, (unsigned long)port.length_errors, (unsigned long)port.resets,
+               (unsigned long)port.skipped, (unsigned long)port.parse_runs, (unsigned long)port.parse_us,
+               (unsigned long)port.parse_max_us);
+    }
+}
+
+/**
+ * Sets the Port-Counters resource to the counters of all ports, taken now
+ */
+static void publishPortCounters(void *context) {
+    PortCounterValues values[UART_PORT_COUNT];
+    uint8_t dump[3 + UART_PORT_COUNT * PORT_COUNTERS_FIELDS * 5];
+
+    if ((NULL == port_counters_res) || (NULL == port_counters_res->get_m2m_resource())) {
+        return;
+    }
+    for (int i = 0; i < UART_PORT_COUNT; i++) {
+        ports[i]->counters().snapshot(values[i]);
+    }
+    size_t length = port_counters_encode(values, UART_PORT_COUNT, dump, sizeof(dump));
+    if (0 < length) {
+        port_counters_res->get_m2m_resource()->set_value(dump, length);
+    }
+}
+
+/**
+ * Queues a Port-Counters update for the next wake window
+ */
+void reportPortCounters() {
+    submitUplink(&publishPortCounters, NULL, false);
 }
 
 /**
@@ -182,10 +567,67 @@ void button_callback(MbedCloudClientResource *resource, const NoticationDelivery
 void registered(const ConnectorClientEndpointInfo *endpoint) {
     printf("Registered to Pelion Device Management. Endpoint Name: %s\n", endpoint->internal_endpoint_name.c_str());
     endpointInfo = endpoint;
+    eventQueue.call(&onCloudLink, true);
+}
+
+void unregistered() {
+    printf("Unregistered from Pelion Device Management\n");
+    eventQueue.call(&onCloudLink, false);
+}
+
+static void onForwardDelivered(bool ok);
+static void onForwardAcknowledged(uint32_t seq);
+static void onLiveStatus(int meter, bool delivered);
+
+/**
+ * Passes the delivery status of a live reading to the eventQueue thread
+ * @param meter Meter number, or -1 for the SenML pack
+ */
+static void liveStatus(int meter, const NoticationDeliveryStatus status) {
+    if (NOTIFICATION_STATUS_DELIVERED == status) {
+        eventQueue.call(&onLiveStatus, meter, true);
+    }
+    else if ((NOTIFICATION_STATUS_SEND_FAILED == status) || (NOTIFICATION_STATUS_BUILD_ERROR == status) ||
+             (NOTIFICATION_STATUS_RESEND_QUEUE_FULL == status)) {
+        eventQueue.call(&onLiveStatus, meter, false);
+    }
+}
+
+/**
+ * PUT handler - the server acknowledges the backlog up to a sequence number,
+ * for servers that read the resource instead of observing it
+ * @param resource The resource that triggered the callback
+ * @param newValue Highest sequence number received
+ */
+void backlog_put_callback(MbedCloudClientResource *resource, m2m::String newValue) {
+    char *end;
+    unsigned long seq = strtoul(newValue.c_str(), &end, 10);
+
+    if ((end == newValue.c_str()) || ('\0' != *end)) {
+        printf("# Backlog acknowledgement rejected: %s\n", newValue.c_str());
+        return;
+    }
+    eventQueue.call(&onForwardAcknowledged, (uint32_t)seq);
+}
+
+/**
+ * Delivery of a backlog batch, acknowledges it in the forward queue
+ */
+void backlog_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
+    printf("Reading-Backlog notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+
+    if (NOTIFICATION_STATUS_DELIVERED == status) {
+        eventQueue.call(&onForwardDelivered, true);
+    }
+    else if ((NOTIFICATION_STATUS_SEND_FAILED == status) || (NOTIFICATION_STATUS_BUILD_ERROR == status) ||
+             (NOTIFICATION_STATUS_RESEND_QUEUE_FULL == status)) {
+        eventQueue.call(&onForwardDelivered, false);
+    }
 }
 
 void seoul_water_meter_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
     printf("Seoul-Water-Meter notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+    liveStatus(POLL_SEOUL_WATER_METER, status);
 }
 
 void power_meter_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
@@ -194,122 +636,43 @@ void power_meter_callback(MbedCloudClientResource *resource, const NoticationDel
 
 void gas_meter_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
     printf("Gas-Meter notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+    liveStatus(POLL_GAS_METER, status);
 }
 
 void water_meter_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
     printf("Water-Meter notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+    liveStatus(POLL_WATER_METER, status);
 }
 void hot_water_meter_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
     printf("Hot-Water-Meter notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+    liveStatus(POLL_HOT_WATER_METER, status);
 }
 
 void heat_meter_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
     printf("Heat-Water-Meter notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+    liveStatus(POLL_HEAT_METER, status);
 }
 
+void senml_callback(MbedCloudClientResource *resource, const NoticationDeliveryStatus status) {
+    printf("Readings-SenML notification, status %s (%d)\n", MbedCloudClientResource::delivery_status_to_string(status), status);
+    liveStatus(-1, status);
+}
 
-#if 1
-
-enum
-{
-   PSTEC_REQUEST_STX                                                     = 0xC0,
-   PSTEC_REQUEST_ETX                                                     = 0xD0,
-   PSTEC_RESPONSE_STX                                                    = PSTEC_REQUEST_STX,
-   PSTEC_RESPONSE_ETX                                                    = PSTEC_REQUEST_ETX,
-//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_WATER                              = 0x02,
-//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HOT_WATER                          = 0x03,
-//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_GAS                                = 0x04,
-//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HEAT                               = 0x05,
-   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER                          = 0xF2,
-   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER                      = 0xF3,
-   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS                            = 0xF4,
-   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT                           = 0xF5,
-   PSTEC_MAGIC_CODE_1ST_BYTE                                             = 0x22,
-   PSTEC_MAGIC_CODE_2ND_BYTE                                             = 0x69,
-   PSTEC_MAGIC_CODE_3RD_BYTE                                             = 0x6E,
-   PSTEC_MAGIC_CODE_4TH_BYTE                                             = 0x73,
-   PSTEC_REQUEST_PACKET_LENGTH                                           = 0x04,  // 4 bytes
-//@   PSTEC_RESPONSE_PACKET_LENGTH_NORMAL_ACCUM                             = 0x0B,  // 11 bytes
-   PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT                    = 0x0E,  // 14 bytes
-//@   PSTEC_RESPONSE_PACKET_APDU_LENGTH_NORMAL_ACCUM                        = 0x03,  //  3 bytes
-   PSTEC_RESPONSE_PACKET_APDU_LENGTH_PRECISE_ACCUM_INSTANT               = 0x0A,  // 10 bytes
-
-   SEOUL_REQUEST_STX           = 0x10,
-   SEOUL_REQUEST_ETX           = 0x16,
-   SEOUL_RESPONSE_STX          = 0x68,
-   SEOUL_RESPONSE_ETX          = SEOUL_REQUEST_ETX,
-   SEOUL_REQUEST_PACKET_LENGTH = 0x05  // 4 bytes
-};
-
-typedef enum
-{
-	INVALID_PACKET_STATE = 0,
-
-	PSTEC_PACKET_TX_STX = 90,
-	PSTEC_PACKET_TX_ID,
-	PSTEC_PACKET_TX_BCC,
-	PSTEC_PACKET_TX_ETX,
-	PSTEC_PACKET_RX_STX,
-	PSTEC_PACKET_RX_MAGIC_CODE_1ST_BYTE,
-	PSTEC_PACKET_RX_MAGIC_CODE_2ND_BYTE,
-	PSTEC_PACKET_RX_MAGIC_CODE_3RD_BYTE,
-	PSTEC_PACKET_RX_MAGIC_CODE_4TH_BYTE,
-	PSTEC_PACKET_RX_ID,
-	PSTEC_PACKET_RX_DATA,
-	PSTEC_PACKET_RX_BCC,
-	PSTEC_PACKET_RX_ETX,
-
-	SEOUL_PACKET_TX_STX = 120,
-	SEOUL_PACKET_TX_C_FIELD,
-	SEOUL_PACKET_TX_A_FIELD,
-	SEOUL_PACKET_TX_CHECKSUM,
-	SEOUL_PACKET_TX_ETX,
-	SEOUL_PACKET_RX_1ST_STX,
-	SEOUL_PACKET_RX_1ST_L_FIELD,
-	SEOUL_PACKET_RX_2ND_L_FIELD,
-	SEOUL_PACKET_RX_2ND_STX,
-	SEOUL_PACKET_RX_C_FIELD,
-	SEOUL_PACKET_RX_A_FIELD,
-	SEOUL_PACKET_RX_CI_FIELD,
-	SEOUL_PACKET_RX_DATA,
-	SEOUL_PACKET_RX_CHECKSUM,
-	SEOUL_PACKET_RX_ETX
-} PacketState;
-
-enum
-{
-   OTHER_DEVICE      = 0x00,
-
-   ELECTRICITY_METER = 0x02,
-   GAS_METER         = 0x03,
-   HEAT_METER        = 0x04,
-   STEAM_METER       = 0x05,
-   WARM_WATER_METER  = 0x06,
-   WATER_METER       = 0x07,
-   HOT_WATER_METER   = 0x15,
-   COLD_WATER_METER  = 0x16,
-   UNKNOWN_DEVICE    = 0x0F,
-
-   LED_LIGHTING      = 0x40,
-   LINK_TEST         = 0xFF
-};
-
-static PacketState  dplcPacketState = INVALID_PACKET_STATE;
-static PacketState seoulPacketState = INVALID_PACKET_STATE;
 
-static char dplcPacketMeterType    = 0;
-static char dplcPacketApduLength   = 0;
-static char dplcPacketRcvdBytes    = 0;
-static char dplcPacketChecksum     = 0;
+#if 1
 
-static char seoulPacketLFieldValue = 0;
-static char seoulPacketUserDataLen = 0;
-static char seoulPacketRcvdBytes   = 0;
-static char seoulPacketChecksum    = 0;
+static void onSeoulWaterMeterFrame(void *context, const uint8_t *frame, size_t length);
+static void onOtherMetersFrame(void *context, const uint8_t *frame, size_t length);
+static void pollPowerMeter(void *context);
 
+// Latency is measured from the moment the request left
+static void onSeoulRequestSent(void *context) {
+    seoulRequestTimer.reset();
+    seoulRequestTimer.start();
+}
 
 void request_SeoulWaterMeter() {
-    uint8_t bufRequestCommand[6];
+    uint8_t bufRequestCommand[5];
     uint8_t cmdLen = 0;
 
     bufRequestCommand[cmdLen++] = SEOUL_REQUEST_STX;
@@ -317,235 +680,480 @@ void request_SeoulWaterMeter() {
     bufRequestCommand[cmdLen++] = 0x01;
     bufRequestCommand[cmdLen++] = (uint8_t)(bufRequestCommand[1] + bufRequestCommand[2]);   // checksum
     bufRequestCommand[cmdLen++] = SEOUL_REQUEST_ETX;
-    bufRequestCommand[cmdLen]   = 0x00;
 
-    while (true) {
-        if (uart1SeoulWaterMater.writeable()) {
-            uart1SeoulWaterMater.printf((const char*)bufRequestCommand);
-            break;
-        }
+    if (!seoulPort->write(bufRequestCommand, cmdLen, &onSeoulRequestSent)) {
+        printf("# thUart1- TX queue full, request dropped\n");
     }
 }
 
-// 56 34 12 00
-void makeBcdToInt(int &nValue, char *pBuffer, int nCount) {
-    if ((NULL == pBuffer) || (nCount <= 0)) {
-        nValue = 0;
+static MbedCloudClientResource *meterResource(int meter) {
+    switch (meter) {
+        case POLL_SEOUL_WATER_METER:    return seoul_water_meter_res;
+        case POLL_WATER_METER:          return water_meter_res;
+        case POLL_HOT_WATER_METER:      return hot_water_meter_res;
+        case POLL_GAS_METER:            return gas_meter_res;
+        case POLL_HEAT_METER:           return heat_meter_res;
+        default:                        return NULL;
+    }
+}
+
+static void forwardUplink(void *context) {
+    forwardTick();
+}
+
+/**
+ * Queues a reading the live path missed, sent once the link allows
+ */
+static void forwardReading(int meter, uint32_t timestamp, const MeterReading &reading) {
+    // Taken before the clock was set: the history gets it, with its time, once it is
+    if (!forwardQueueReady || (0 == timestamp)) {
         return;
     }
+    int result = forwardQueue.push((uint8_t)meter, timestamp, reading);
+    if (0 != result) {
+        printf("# Forward queue write failed (%d)\n", result);
+    }
+    submitUplink(&forwardUplink, NULL, false);
+}
 
-    int index = nCount - 1;
-    nValue = 0;
-    do {
-        char ch = *(pBuffer + index);
+static void liveMissed(int meter) {
+    LiveReading &live = liveReadings[meter];
 
-        nValue *= 10;
-        nValue += ((ch & 0xF0) >> 4);
-        nValue *= 10;
-        nValue += (ch & 0x0F);
+    if (LIVE_NONE != live.state) {
+        forwardReading(meter, live.timestamp, live.reading);
+        live.state = LIVE_NONE;
+    }
+}
 
-        index--;
+/**
+ * A live reading reached the client: it is sent if registered, missed otherwise
+ */
+static void livePublished(int meter, LiveState from) {
+    LiveReading &live = liveReadings[meter];
+
+    if (from != live.state) {
+        return;
+    }
+    if (cloudRegistered) {
+        live.state = LIVE_SENT;
+    } else {
+        liveMissed(meter);
+    }
+}
+
+/**
+ * Delivery status of a live notification, runs on the eventQueue thread.
+ * Without an observer no status comes and the reading counts as sent.
+ * @param meter Meter number, or -1 for the readings of the SenML pack
+ */
+static void onLiveStatus(int meter, bool delivered) {
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        if (((meter < 0) || (meter == i)) && (LIVE_SENT == liveReadings[i].state)) {
+            if (delivered) {
+                liveReadings[i].state = LIVE_NONE;
+            } else {
+                liveMissed(i);
+            }
+        }
     }
-    while(0 <= index);
 }
 
-void makeReverseBcdToInt(int &nValue, char *pBuffer, int nCount) {
-    if ((NULL == pBuffer) || (nCount <= 0)) {
-        nValue = 0;
+// Latest reported value of every meter, published with the next burst
+static char meterText[POLL_METER_COUNT][METER_READING_TEXT_SIZE];
+
+static void publishMeter(void *context) {
+    int meter = (int)(intptr_t)context;
+    MbedCloudClientResource *resource = meterResource(meter);
+
+    if (NULL != resource) {
+        resource->set_value(meterText[meter]);
+        livePublished(meter, LIVE_WAITING);
+    }
+}
+
+/**
+ * Adds a reading to the history, runs on the eventQueue thread
+ */
+static void storeReading(void *context, uint8_t meter, uint32_t timestamp, const MeterReading &reading) {
+    int result = readingStore.append(meter, timestamp, reading);
+    if (-EINVAL == result) {
+        printf("# Reading store: %lu is before the last stored time, reading dropped\n", (unsigned long)timestamp);
+    } else if (0 != result) {
+        printf("# Reading store write failed (%d)\n", result);
+    }
+}
+
+/**
+ * Stores a reading and hands it to its LwM2M resource, the only place it
+ * becomes text. Runs on the eventQueue thread.
+ * @param meter Index in the poll table
+ */
+static void onMeterReading(int meter, MeterReading reading) {
+    char text[METER_READING_TEXT_SIZE];
+    MbedCloudClientResource *resource = meterResource(meter);
+    // SenML reads a time of 0 as "now" until the clock is set
+    uint32_t timestamp = clockValid ? (uint32_t)time(NULL) : 0;
+
+    if ((NULL == resource) || (0 == meter_reading_format(reading, text, sizeof(text)))) {
         return;
     }
+    printf("# Meter %s : %s %s\n", meterNames[meter], text, meter_unit_name(reading.unit));
 
-    int index = 0;
-    nValue = 0;
-    do {
-        char ch = *(pBuffer + index);
-
-        nValue *= 10;
-        nValue += ((ch & 0xF0) >> 4);
-        nValue *= 10;
-        nValue += (ch & 0x0F);
-
-        index++;
-    }
-    while(index < nCount);
-}
-
-void resetDplcResponseState(void)
-{
-	dplcPacketState      = PSTEC_PACKET_TX_STX;
-	dplcPacketMeterType  = UNKNOWN_DEVICE;
-	dplcPacketApduLength = 0;
-	dplcPacketRcvdBytes  = 0;
-	dplcPacketChecksum   = 0;
-}
-
-void resetSeoulResponseState(void) {
-	seoulPacketState       = SEOUL_PACKET_RX_1ST_STX;
-	seoulPacketLFieldValue = 0;
-	seoulPacketUserDataLen = 0;
-	seoulPacketRcvdBytes   = 0;
-	seoulPacketChecksum    = 0;
-}
-
-void threadUart1_SeoulWaterMeter() {
-	char buffer[22];
-
-    printf("### threadUart1 - 1\n");
-
-    while(true) {
-        //printf("### threadUart1 - 4\n");
-
-        int nCount = bufUart1.size();
-         //printf("# thUart1- Buffer Count : %d\n", nCount);
-
-        if (21 <= (nCount + seoulPacketRcvdBytes)) {
-            printf("# thUart1- Buffer Count : %d\n", nCount);
-            char ch = 0;
-			for (uint8_t i = 0; i < nCount; i++) {
-				bufUart1.pop(ch);
-
-				switch (seoulPacketState)
-				{
-					case SEOUL_PACKET_RX_1ST_STX:
-                        //printf("# thUart1- 1. SEOUL_RESPONSE_STX 0\n");
-						if (ch == SEOUL_RESPONSE_STX) {
-							seoulPacketState = SEOUL_PACKET_RX_1ST_L_FIELD;
-							buffer[seoulPacketRcvdBytes++] = ch;
-                             //printf("# thUart1- 1. SEOUL_RESPONSE_STX 1\n");
-						}
-						break;
-
-					case SEOUL_PACKET_RX_1ST_L_FIELD:
-                        //printf("# thUart1- 2. SEOUL_PACKET_RX_1ST_L_FIELD 0\n");
-						seoulPacketState       = SEOUL_PACKET_RX_2ND_L_FIELD;
-						seoulPacketLFieldValue = ch;
-						buffer[seoulPacketRcvdBytes++] = ch;
-						break;
-
-					case SEOUL_PACKET_RX_2ND_L_FIELD:
-                        //printf("# thUart1- 3. SEOUL_PACKET_RX_2ND_L_FIELD 0\n");
-						if (ch == seoulPacketLFieldValue) {
-							seoulPacketState = SEOUL_PACKET_RX_2ND_STX;
-							buffer[seoulPacketRcvdBytes++] = ch;
-                            //printf("# thUart1- 3. SEOUL_PACKET_RX_2ND_L_FIELD 1\n");
-						}
-						else {
-							resetSeoulResponseState();
-                            printf("# thUart1- 3. SEOUL_PACKET_RX_2ND_L_FIELD resetSeoulResponseState\n");
-						}
-						break;
-
-					case SEOUL_PACKET_RX_2ND_STX:
-                        //printf("# thUart1- 4. SEOUL_PACKET_RX_2ND_STX 0\n");
-						if (ch == SEOUL_RESPONSE_STX) {
-							seoulPacketState = SEOUL_PACKET_RX_C_FIELD;
-							buffer[seoulPacketRcvdBytes++] = ch;
-                            //printf("# thUart1- 4. SEOUL_PACKET_RX_2ND_STX 1\n");
-						}
-						break;
-
-					case SEOUL_PACKET_RX_C_FIELD:
-                        //printf("# thUart1- 5. SEOUL_PACKET_RX_C_FIELD 0\n");
-						if (ch < 0x80) {
-							seoulPacketState    = SEOUL_PACKET_RX_A_FIELD;
-							seoulPacketChecksum = ch;
-							buffer[seoulPacketRcvdBytes++] = ch;
-                            //printf("# thUart1- 5. SEOUL_PACKET_RX_C_FIELD 1\n");
-						}
-						else {
-							resetSeoulResponseState();
-                            printf("# thUart1- 5. SEOUL_PACKET_RX_C_FIELD resetSeoulResponseState\n");
-						}
-						break;
-
-					case SEOUL_PACKET_RX_A_FIELD:
-                        //printf("# thUart1- 6. SEOUL_PACKET_RX_A_FIELD 0\n");
-						seoulPacketState     = SEOUL_PACKET_RX_CI_FIELD;
-						seoulPacketChecksum += ch;
-						buffer[seoulPacketRcvdBytes++] = ch;
-						break;
-
-					case SEOUL_PACKET_RX_CI_FIELD:
-                        //printf("# thUart1- 7. SEOUL_PACKET_RX_CI_FIELD 0\n");
-						seoulPacketState     = SEOUL_PACKET_RX_DATA;
-						seoulPacketChecksum += ch;
-						buffer[seoulPacketRcvdBytes++] = ch;
-						break;
-
-					case SEOUL_PACKET_RX_DATA:
-                        //printf("# thUart1- 8. SEOUL_PACKET_RX_DATA 0\n");
-						seoulPacketUserDataLen++;
-						seoulPacketChecksum += ch;
-						buffer[seoulPacketRcvdBytes++] = ch;
-                        // 3 = C (1 byte) + A (1 byte) + CI (1 byte)
-						if ((seoulPacketUserDataLen + 3) > seoulPacketLFieldValue) {
-							resetSeoulResponseState();
-                            printf("# thUart1- 8. SEOUL_PACKET_RX_DATA resetSeoulResponseState\n");
-						}
-						else if ((seoulPacketUserDataLen + 3) == seoulPacketLFieldValue) {
-							seoulPacketState = SEOUL_PACKET_RX_CHECKSUM;
-                            //printf("# thUart1- 8. SEOUL_PACKET_RX_DATA 1\n");
-						}
-						break;
-
-					case SEOUL_PACKET_RX_CHECKSUM:
-                        //printf("# thUart1- 9. SEOUL_PACKET_RX_CHECKSUM 0\n");
-						//if (ch == seoulPacketChecksum) {
-                        if (true) {     // Ignore checksum fail
-							seoulPacketState = SEOUL_PACKET_RX_ETX;
-							buffer[seoulPacketRcvdBytes++] = ch;
-                            //printf("# thUart1- 9. SEOUL_PACKET_RX_CHECKSUM 1\n");
-						}
-						else {
-							resetSeoulResponseState();
-                            printf("# thUart1- 9. SEOUL_PACKET_RX_CHECKSUM resetSeoulResponseState ch=%02x CheckSum=%02x\n", ch, seoulPacketChecksum);
-#if 0
-                            int nValue = 0;
-                            makeBcdToInt(nValue, (buffer+15), 4);
-                            printf("# thUart1- nValue : %d\n", nValue);
-                            float fValue = (float)nValue / 1000;
-                            seoul_water_meter_res->set_value(fValue);
-                            //power_meter_res->set_value(fValue);
-                            printf("# thUart1- Seoul Water Meter : %02x %02x %02x %02x\n", 
-                                    buffer[15], buffer[16], buffer[17], buffer[18]);
-                            printf("# thUart1- Seoul Water Meter : %.3f\n", fValue);
+    if (!readingStoreReady) {
+        // Nothing to keep
+    } else if (clockValid) {
+        storeReading(NULL, (uint8_t)meter, timestamp, reading);
+    } else {
+        unstampedReadings.add((uint8_t)meter, nowMs(), reading);
+    }
+
+    if (!reportPolicies[meter].evaluate(reading, nowMs())) {
+        return;
+    }
+
+    // The resource still shows the latest value once the client registers
+    if (cloudRegistered) {
+        LiveReading &live = liveReadings[meter];
+        // Replaced before it went out; one in the SenML pack may still go too
+        if ((LIVE_WAITING == live.state) || (LIVE_PACKED == live.state)) {
+            liveMissed(meter);
+        }
+        live.reading = reading;
+        live.timestamp = timestamp;
+        live.state = LIVE_WAITING;
+    } else {
+        forwardReading(meter, timestamp, reading);
+    }
+
+#if MBED_CONF_APP_SENML_BATCHING == 1
+    if (senmlBatch.add(meterNames[meter], reading, timestamp, nowMs())) {
+        eventQueue.call_in(senmlBatch.window(), &flushSenmlBatch);
+    }
+    flushSenmlBatch();
+#else
+    memcpy(meterText[meter], text, sizeof(text));
+    submitUplink(&publishMeter, (void *)(intptr_t)meter, false);
 #endif
-						}
-						break;
-
-					case SEOUL_PACKET_RX_ETX:
-                        //printf("# thUart1- 10. SEOUL_PACKET_RX_ETX 0\n");
-						if (ch == SEOUL_RESPONSE_ETX) {
-							buffer[seoulPacketRcvdBytes++] = ch;
-
-                            int nValue = 0;
-                            makeBcdToInt(nValue, (buffer+15), 4);
-                            float fValue = (float)nValue / 1000;
-                            seoul_water_meter_res->set_value(fValue);
-                            printf("# thUart1- Seoul Water Meter : %.3f\n", fValue);
-                        }
-
-						resetSeoulResponseState();
-						break;
-
-					default:
-                        printf("# thUart1- 11. default %d\n", seoulPacketState);
-						break;
-				}
-			}
+}
+
+// Latest SenML pack, published with the next burst
+static uint8_t senmlPack[SENML_PACK_SIZE];
+static size_t senmlPackLength = 0;
+
+static void publishSenml(void *context) {
+    if ((0 < senmlPackLength) && (NULL != senml_res) && (NULL != senml_res->get_m2m_resource())) {
+        senml_res->get_m2m_resource()->set_value(senmlPack, senmlPackLength);
+        for (int i = 0; i < POLL_METER_COUNT; i++) {
+            livePublished(i, LIVE_PACKED);
+        }
+    }
+}
+
+/**
+ * Queues the readings of a polling cycle as one SenML-CBOR pack once the
+ * batch is complete or its flush window has passed
+ */
+void flushSenmlBatch() {
+    if (!senmlBatch.due(nowMs())) {
+        return;
+    }
+
+    size_t count = senmlBatch.count();
+    size_t length = senmlBatch.flush(NULL, senmlPack, sizeof(senmlPack));
+
+    // The pack not published yet is replaced, its readings with it
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        if ((LIVE_PACKED == liveReadings[i].state) || ((0 == length) && (LIVE_WAITING == liveReadings[i].state))) {
+            liveMissed(i);
+        }
+        if (LIVE_WAITING == liveReadings[i].state) {
+            liveReadings[i].state = LIVE_PACKED;
+        }
+    }
+    if (0 == length) {
+        return;
+    }
+    senmlPackLength = length;
+    printf("# SenML pack : %u readings, %u bytes\n", (unsigned)count, (unsigned)length);
+    submitUplink(&publishSenml, NULL, false);
+}
+
+/**
+ * Sends the next backlog batch when due and re-arms for the next one
+ * Must be called on the eventQueue thread
+ */
+void forwardTick() {
+    if (0 != forwardTickEvent) {
+        eventQueue.cancel(forwardTickEvent);
+        forwardTickEvent = 0;
+    }
+    // The backlog waits for the next wake window like any notification
+    if (!uplink.awake(nowMs())) {
+        if (0 < forwardQueue.backlog()) {
+            submitUplink(&forwardUplink, NULL, false);
+        }
+        return;
+    }
+    uint32_t wait = forwardQueue.run(nowMs());
+    if (0 < wait) {
+        forwardTickEvent = eventQueue.call_in(wait, &forwardTick);
+    }
+}
+
+/**
+ * Puts a batch on the backlog resource, one "seq,meter,timestamp,value" line per reading.
+ * The sequence numbers let the server drop batches it has seen. A batch is
+ * acknowledged by its delivery status when the resource is observed, or by
+ * a PUT of the last number the server has; one not acknowledged in time is
+ * sent again, FORWARD_MAX_ATTEMPTS times at most.
+ */
+static bool sendForwardBatch(void *context, const ForwardEntry *entries, size_t count) {
+    static char text[FORWARD_BATCH_SIZE * 64];
+    size_t length = 0;
+
+    if (NULL == backlog_res) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        MeterReading reading = { entries[i].reading.value, entries[i].reading.exponent, entries[i].reading.unit };
+        char value[METER_READING_TEXT_SIZE];
+
+        meter_reading_format(reading, value, sizeof(value));
+        length += snprintf(text + length, sizeof(text) - length, "%lu,%u,%lu,%s\n",
+                           (unsigned long)entries[i].seq, (unsigned)entries[i].reading.meter,
+                           (unsigned long)entries[i].reading.timestamp, value);
+        if (sizeof(text) <= length) {
+            return false;
+        }
+    }
+
+    backlog_res->set_value(text);
+    uplink.activity(nowMs(), 1);
+    return true;
+}
+
+static void onForwardDelivered(bool ok) {
+    forwardQueue.delivered(ok, nowMs());
+    forwardTick();
+}
+
+static void onForwardAcknowledged(uint32_t seq) {
+    if (!forwardQueue.acknowledge(seq)) {
+        printf("# Backlog acknowledgement %lu is ahead of the queue\n", (unsigned long)seq);
+    }
+    forwardTick();
+}
+
+/**
+ * Registration state of the Pelion client, runs on the eventQueue thread
+ */
+void onCloudLink(bool up) {
+    cloudRegistered = up;
+    forwardQueue.set_link(up, nowMs());
+    if (up) {
+        // Registration kept the radio up, queued notifications can follow
+        uplink.activity(nowMs(), 0);
+        uplinkTick();
+    } else {
+        // A status still to come is lost with the registration, take the reading as sent
+        for (int i = 0; i < POLL_METER_COUNT; i++) {
+            if (LIVE_SENT == liveReadings[i].state) {
+                liveReadings[i].state = LIVE_NONE;
+            }
         }
-        //printf("### threadUart1 - 6\n");
-        //uart1_Flags.clear();
-        //    printf("### threadUart1 - 7\n");
-        Thread::wait(1000.0);
     }
+    forwardTick();
+}
+
+/**
+ * Sets the clock and stores the readings held until then, runs on the
+ * eventQueue thread. A clock set back in time makes the store refuse the
+ * readings that would go before the ones it has.
+ * @param utc Server time in seconds
+ * @param atMs nowMs() when it arrived
+ */
+static void onClockSet(uint32_t utc, uint32_t atMs) {
+    uint32_t now = utc + (nowMs() - atMs) / 1000;
+    int32_t step = (int32_t)(now - (uint32_t)time(NULL));
+
+    set_time(now);
+    clockValid = true;
+
+    size_t stored = 0;
+    if (readingStoreReady) {
+        stored = unstampedReadings.stamp(now, nowMs(), &storeReading, NULL);
+    }
+    printf("# Clock set to %lu (%+ld s), %u held readings stored, %lu dropped\n",
+           (unsigned long)now, (long)step, (unsigned)stored, (unsigned long)unstampedReadings.dropped());
+}
+
+/**
+ * Asks the NTP server for the time, runs on the network thread
+ * @return true if the clock is being set
+ */
+static bool syncClock() {
+    static uint32_t requests = 0;
+    SocketAddress server;
+    UDPSocket socket;
+    uint8_t packet[SNTP_PACKET_SIZE];
+
+    nsapi_error_t status = net->gethostbyname(MBED_CONF_APP_NTP_SERVER, &server);
+    if (NSAPI_ERROR_OK != status) {
+        printf("NTP server %s not found (%d)\n", MBED_CONF_APP_NTP_SERVER, status);
+        return false;
+    }
+    server.set_port(SNTP_PORT);
+
+    status = socket.open(net);
+    if (NSAPI_ERROR_OK != status) {
+        printf("NTP socket failed (%d)\n", status);
+        return false;
+    }
+    socket.set_timeout(NTP_TIMEOUT_MS);
+
+    bool synced = false;
+    for (int attempt = 0; (attempt < NTP_ATTEMPTS) && !synced; attempt++) {
+        uint32_t nonce = nowMs() ^ (++requests << 20);
+        size_t length = sntp_request(nonce, packet, sizeof(packet));
+        if (0 > socket.sendto(server, packet, length)) {
+            continue;
+        }
+        // Late answers to an earlier attempt fail the nonce and are skipped
+        int received = socket.recvfrom(NULL, packet, sizeof(packet));
+        uint32_t utc;
+        if ((0 < received) && sntp_parse(packet, received, nonce, utc)) {
+            eventQueue.call(&onClockSet, utc, nowMs());
+            synced = true;
+        }
+    }
+    socket.close();
+
+    if (!synced) {
+        printf("No answer from NTP server %s\n", MBED_CONF_APP_NTP_SERVER);
+    }
+    return synced;
+}
+
+/**
+ * Brings the network back after an outage and registers again, and keeps
+ * the clock set. Runs on its own thread, connect() blocks for a long time
+ * on cellular.
+ */
+void threadNetwork() {
+    uint32_t syncedMs = 0;
+    bool synced = false;
+
+    while (true) {
+        if (NSAPI_STATUS_DISCONNECTED == net->get_connection_status()) {
+            printf("Network down, reconnecting...\n");
+            nsapi_error_t net_status = net->connect();
+            if (NSAPI_ERROR_OK != net_status) {
+                printf("Unable to connect to network (%d)\n", net_status);
+                Thread::wait(30 * 1000);
+                continue;
+            }
+            printf("Reconnected to the network. IP address: %s\n", net->get_ip_address());
+
+            if (!cloudRegistered && (NULL != cloudClient)) {
+                cloudClient->register_and_connect();
+            }
+        }
+
+        if (!synced || (MBED_CONF_APP_NTP_SYNC_HOURS * 3600000UL <= nowMs() - syncedMs)) {
+            synced = syncClock();
+            syncedMs = nowMs();
+        }
+
+        Thread::wait(30 * 1000);
+    }
+}
+
+/**
+ * Drops stored readings past the retention time
+ */
+void expireReadings() {
+    uint32_t now = (uint32_t)time(NULL);
+    uint32_t retention = MBED_CONF_APP_READING_RETENTION_HOURS * 3600UL;
+
+    if (readingStoreReady && clockValid && (now > retention)) {
+        readingStore.expire(now - retention);
+    }
+}
+
+/**
+ * Adds a stored reading to the history block
+ * @param context The HistoryEncoder
+ * @return false once the block is full
+ */
+static bool encodeHistoryReading(void *context, const StoredReading &stored) {
+    MeterReading reading = { stored.value, stored.exponent, stored.unit };
+    return static_cast<HistoryEncoder *>(context)->add(stored.timestamp, reading);
+}
+
+/**
+ * Publishes the stored readings of one meter as a compressed history block,
+ * runs on the eventQueue thread. A full block ends early; the next request
+ * starts after its last timestamp.
+ * @param meter Meter number
+ * @param from First timestamp included
+ * @param to Last timestamp included
+ */
+static void exportHistory(int meter, uint32_t from, uint32_t to) {
+    static uint8_t block[HISTORY_EXPORT_SIZE];
+    HistoryEncoder encoder(block, sizeof(block));
+
+    if (!readingStoreReady || (NULL == history_res) || (NULL == history_res->get_m2m_resource())) {
+        return;
+    }
+    readingStore.query((uint8_t)meter, from, to, &encodeHistoryReading, &encoder);
+    printf("# History %s: %u readings in %u bytes\n", meterNames[meter], (unsigned)encoder.count(), (unsigned)encoder.length());
+    history_res->get_m2m_resource()->set_value(block, encoder.length());
+    // Answers a request, so the connection is up already
+    uplink.activity(nowMs(), 1);
+}
+
+/**
+ * POST handler - requests the history of one meter
+ * @param resource The resource that triggered the callback
+ * @param buffer "meter,from,to", times in seconds
+ * @param size Size of the body
+ */
+void history_post_callback(MbedCloudClientResource *resource, const uint8_t *buffer, uint16_t size) {
+    char text[48];
+    int meter;
+    unsigned long from, to;
+
+    size = (size < sizeof(text)) ? size : (sizeof(text) - 1);
+    memcpy(text, buffer, size);
+    text[size] = '\0';
+
+    if ((3 != sscanf(text, "%d,%lu,%lu", &meter, &from, &to)) || (meter < 0) || (POLL_METER_COUNT <= meter)) {
+        printf("# History request rejected: %s\n", text);
+        return;
+    }
+    eventQueue.call(&exportHistory, meter, (uint32_t)from, (uint32_t)to);
 }
 
+/**
+ * Seoul water meter frame handler
+ * @param frame Complete M-Bus long frame, starting with the first 0x68
+ * @param length Number of bytes in the frame
+ */
+static void onSeoulWaterMeterFrame(void *context, const uint8_t *frame, size_t length) {
+    MeterReading reading;
+
+    if (!seoul_decode_reading(frame, length, reading)) {
+        printf("# thUart1- Seoul Water Meter : bad frame (%u bytes)\n", (unsigned)length);
+        // Fail the request now, so it is retried instead of holding the bus until the deadline
+        eventQueue.call(&pollMeterDone, pollHandles[POLL_SEOUL_WATER_METER], false);
+        return;
+    }
 
-void rxCallback_SeoulWaterMeter() {
-    char ch = uart1SeoulWaterMater.getc();
-    bufUart1.push(ch);
-    led2 = !led2;
+    printf("# thUart1- latency %d ms\n", seoulRequestTimer.read_ms());
+
+    eventQueue.call(&onMeterReading, (int)POLL_SEOUL_WATER_METER, reading);
+    eventQueue.call(&pollMeterDone, pollHandles[POLL_SEOUL_WATER_METER], true);
 }
 
 //meterType = PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_WATER;
@@ -553,303 +1161,264 @@ void rxCallback_SeoulWaterMeter() {
 //meterType = PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_GAS;
 //meterType = PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HEAT;
 
-void request_OtherMeters(uint8_t meterType) {
-    uint8_t bufRequestCommand[6];
-    uint8_t cmdLen = 0;
+/**
+ * PSTEC queue send function, writes one request frame to pstecPort
+ * @param data STX, meter type, BCC and ETX
+ */
+void sendOtherMetersRequest(void *context, const uint8_t *data, size_t size) {
+    // A dropped request ends in the transaction timeout
+    if (!pstecPort->write(data, size)) {
+        printf("# thUart2- TX queue full, request dropped\n");
+    }
+}
 
-	dplcPacketMeterType = meterType;
+static void onPstecDone(const PstecTransaction &transaction, const uint8_t *frame, size_t length);
 
-	bufRequestCommand[cmdLen++] = PSTEC_REQUEST_STX;
-	bufRequestCommand[cmdLen++] = dplcPacketMeterType;
-	bufRequestCommand[cmdLen++] = (bufRequestCommand[0] + bufRequestCommand[1]) & 0x7F;	// BCC
-	bufRequestCommand[cmdLen++] = PSTEC_REQUEST_ETX;
+/**
+ * Poll table index of a PSTEC meter
+ * @param meterType Meter type of the request and response
+ */
+static int meterOfPstecType(uint8_t meterType) {
+    switch (meterType) {
+        case PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER:      return POLL_WATER_METER;
+        case PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER:  return POLL_HOT_WATER_METER;
+        case PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS:        return POLL_GAS_METER;
+        case PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT:       return POLL_HEAT_METER;
+        default:                                                return -1;
+    }
+}
 
-    while (true) {
-        if (uart2OtherMater.writeable()) {
-            uart2OtherMater.printf((const char*)bufRequestCommand);
-            break;
-        }
+// Poll scheduler request functions
+static void pollSeoulWaterMeter(void *context) {
+    request_SeoulWaterMeter();
+}
+
+static void pollOtherMeter(void *context) {
+    uint8_t meterType = (uint8_t)(uintptr_t)context;
+    int handle = pollHandles[meterOfPstecType(meterType)];
+
+    if (!pstecTransactions.submit(meterType, pollScheduler.timeout_ms(handle), &onPstecDone, (void *)(intptr_t)handle, nowMs())) {
+        // Not from inside pollScheduler.run()
+        eventQueue.call(&pollMeterDone, handle, false);
     }
 }
 
-void request_WaterMeter() {
-//@    request_OtherMeters(PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_WATER);
-    request_OtherMeters(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER);
+/**
+ * Registers all meters with the poll scheduler
+ */
+void setupPollScheduler() {
+    // bus, priority, interval, initial timeout, timeout ceiling, request, context
+    static const PollMeterConfig meters[POLL_METER_COUNT] = {
+        { POLL_BUS_SEOUL, 1, MBED_CONF_APP_SEOUL_WATER_METER_POLL_INTERVAL, SEOUL_READ_TIMEOUT_MS, SEOUL_READ_DEADLINE_MS, &pollSeoulWaterMeter, NULL },
+        { POLL_BUS_PSTEC, 1, MBED_CONF_APP_WATER_METER_POLL_INTERVAL,       PSTEC_TRANSACTION_TIMEOUT_MS, 2000, &pollOtherMeter, (void *)PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER },
+        { POLL_BUS_PSTEC, 1, MBED_CONF_APP_HOT_WATER_METER_POLL_INTERVAL,   PSTEC_TRANSACTION_TIMEOUT_MS, 2000, &pollOtherMeter, (void *)PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER },
+        { POLL_BUS_PSTEC, 1, MBED_CONF_APP_GAS_METER_POLL_INTERVAL,         PSTEC_TRANSACTION_TIMEOUT_MS, 2000, &pollOtherMeter, (void *)PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS },
+        { POLL_BUS_PSTEC, 1, MBED_CONF_APP_HEAT_METER_POLL_INTERVAL,        PSTEC_TRANSACTION_TIMEOUT_MS, 2000, &pollOtherMeter, (void *)PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT },
+    };
+
+    // The PSTEC queue sequences its own requests and applies each meter's
+    // timeout, so every due meter is handed to it at once.
+    pollScheduler.set_bus_depth(POLL_BUS_PSTEC, PSTEC_MAX_TRANSACTIONS);
+
+    uint32_t now = nowMs();
+    for (int i = 0; i < POLL_METER_COUNT; i++) {
+        pollHandles[i] = pollScheduler.add_meter(meters[i], now);
+    }
+
+    // Registers of the Modbus slaves, merged into block reads
+    powerPoint = modbus.add_point(MBED_CONF_APP_POWER_METER_ADDRESS, MODBUS_READ_INPUT_REGISTERS,
+                                  MBED_CONF_APP_POWER_METER_POWER_REGISTER, MODBUS_FLOAT_REGISTERS);
+    energyPoint = modbus.add_point(MBED_CONF_APP_POWER_METER_ADDRESS, MODBUS_READ_INPUT_REGISTERS,
+                                   MBED_CONF_APP_POWER_METER_ENERGY_REGISTER, MODBUS_FLOAT_REGISTERS);
+    printf("Modbus: %u points in %u requests\n", 2, (unsigned)modbus.plan(MBED_CONF_APP_MODBUS_MERGE_GAP));
+
+    // Like the PSTEC queue, the master sequences the requests of the bus
+    pollScheduler.set_bus_depth(POLL_BUS_MODBUS, MODBUS_MAX_POLLS);
+
+    // Its deadline ends well before the next sample is due
+    static const PollMeterConfig powerMeter = {
+        POLL_BUS_MODBUS, 1, MBED_CONF_APP_POWER_METER_SAMPLE_INTERVAL, POWER_METER_TIMEOUT_MS, POWER_METER_DEADLINE_MS,
+        &pollPowerMeter, NULL
+    };
+    powerPollHandle = pollScheduler.add_meter(powerMeter, now);
 }
 
-void request_HotWaterMeter() {
-//@    request_OtherMeters(PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HOT_WATER);
-    request_OtherMeters(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER);
+/**
+ * PSTEC transaction completion, runs on the eventQueue thread
+ * @param transaction The finished request
+ * @param frame STX, meter type, 10 data bytes, BCC and ETX, or NULL on timeout
+ * @param length Number of bytes in the frame
+ */
+static void onPstecDone(const PstecTransaction &transaction, const uint8_t *frame, size_t length) {
+    MeterReading reading;
+    uint8_t meterType = transaction.meter_type;
+    int handle = (int)(intptr_t)transaction.context;
+    uint32_t now = nowMs();
+
+    if (NULL == frame) {
+        printf("# thUart2- Meter 0x%02X timeout\n", meterType);
+        pollScheduler.complete(handle, now, false);
+        return;
+    }
+
+    if (!pstec_decode_reading(frame, length, reading)) {
+        printf("# thUart2- Meter 0x%02X : bad digits\n", meterType);
+        pollScheduler.complete(handle, now, false);
+        return;
+    }
+
+    onMeterReading(meterOfPstecType(meterType), reading);
+    printf("# thUart2- latency %lu ms, queued %lu ms\n",
+           (unsigned long)(now - transaction.sent_ms), (unsigned long)(transaction.sent_ms - transaction.submitted_ms));
+
+    // The caller runs the scheduler right after this. Time in the queue is
+    // not the meter's latency.
+    pollScheduler.complete(handle, now, true, now - transaction.sent_ms);
 }
 
-void request_GasMeter() {
-//@    request_OtherMeters(PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_GAS);
-    request_OtherMeters(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS);
+/**
+ * Hands a PSTEC response to its transaction, runs on the eventQueue thread
+ */
+static void onPstecResponse(PstecResponse response) {
+    if (pstecTransactions.on_frame(response.frame, sizeof(response.frame), nowMs())) {
+        pollSchedulerTick();
+    }
 }
 
-void request_HeatMeter() {
-//@    request_OtherMeters(PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HEAT);
-    request_OtherMeters(PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT);
+/**
+ * PSTEC frame handler, runs on the uart2 thread
+ * @param frame Request echo (4 bytes) or response (14 bytes)
+ * @param length Number of bytes in the frame
+ */
+static void onOtherMetersFrame(void *context, const uint8_t *frame, size_t length) {
+    PstecResponse response;
+
+    if (sizeof(response.frame) != length) {
+        return;     // our own request, echoed back by the line
+    }
+
+    memcpy(response.frame, frame, length);
+    eventQueue.call(&onPstecResponse, response);
 }
 
-void threadUart2_OtherMeters() {
-	char buffer[22];
+/**
+ * Modbus master send function, writes one request frame to modbusPort
+ */
+static void sendModbusRequest(void *context, const uint8_t *data, size_t size) {
+    // A dropped request ends in the request timeout
+    if (!modbusPort->write(data, size)) {
+        printf("# thUart3- TX queue full, request dropped\n");
+    }
+}
 
-    printf("### threadUart2 - 1\n");
+/**
+ * Power meter poll completion, runs on the eventQueue thread
+ * Whatever was read goes into the aggregator, even if a block failed.
+ */
+static void onPowerMeterDone(const ModbusPoll &poll, bool ok) {
+    const uint16_t *power = modbus.registers(powerPoint);
+    const uint16_t *energy = modbus.registers(energyPoint);
+    MeterReading reading;
+    uint32_t now = nowMs();
+
+    if ((NULL != power) && modbus_decode_float(power, POWER_METER_POWER_EXPONENT, METER_UNIT_WATT, reading)) {
+        powerAggregator.add_power(reading);
+    }
+    if ((NULL != energy) && modbus_decode_float(energy, POWER_METER_ENERGY_EXPONENT, METER_UNIT_KILOWATT_HOUR, reading)) {
+        powerAggregator.add_energy(reading);
+    }
+    if (!ok) {
+        printf("# thUart3- Power meter %u : no answer\n", (unsigned)poll.slave);
+    }
 
-    while(true) {
-        //printf("### threadUart2 - 4\n");
+    // The caller runs the scheduler right after this
+    pollScheduler.complete(powerPollHandle, now, ok, now - poll.sent_ms);
+}
 
-        int nCount = bufUart2.size();
-        //printf("# thUart2- Buffer Count : %d\n", nCount);
+// Poll scheduler request function of the power meter
+static void pollPowerMeter(void *context) {
+    if (!modbus.submit(MBED_CONF_APP_POWER_METER_ADDRESS, pollScheduler.timeout_ms(powerPollHandle), &onPowerMeterDone,
+                       NULL, nowMs())) {
+        // Not from inside pollScheduler.run()
+        eventQueue.call(&pollMeterDone, powerPollHandle, false);
+    }
+}
 
-        if (PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT <= (nCount + dplcPacketRcvdBytes)) {
-            //printf("# thUart2- Buffer Count : %d\n", nCount);
-            char ch = 0;
-			for (int i = 0; i < nCount; i++) {
-				bufUart2.pop(ch);
+/**
+ * Hands a Modbus frame to the master, runs on the eventQueue thread
+ */
+static void onModbusResponse(ModbusResponse response) {
+    if (modbus.on_frame(response.frame, response.length, nowMs())) {
+        pollSchedulerTick();
+    }
+}
+
+/**
+ * Modbus frame handler, runs on the uart3 thread
+ * @param frame Response or exception frame with a valid CRC
+ */
+static void onModbusFrame(void *context, const uint8_t *frame, size_t length) {
+    ModbusResponse response;
 
-				switch (dplcPacketState) {
-					case PSTEC_PACKET_TX_STX:
-						if (ch == PSTEC_REQUEST_STX) {
-							dplcPacketState    = PSTEC_PACKET_TX_ID;
-							dplcPacketChecksum = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						break;
-
-					case PSTEC_PACKET_TX_ID:
-						if (ch == dplcPacketMeterType) {
-							dplcPacketState     = PSTEC_PACKET_TX_BCC;
-							dplcPacketChecksum += ch;
+    memcpy(response.frame, frame, length);
+    response.length = (uint8_t)length;
+    eventQueue.call(&onModbusResponse, response);
+}
+
+// Aggregates of the last closed interval, published with the next burst:
+// "start,seconds,samples,min,max,mean,delta" with power in W, energy in kWh
+static char powerDemandText[7 * METER_READING_TEXT_SIZE];
+static char powerEnergyText[METER_READING_TEXT_SIZE];
 
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_TX_BCC:
-						dplcPacketChecksum &= 0x7F;	// trim to 7-bit BCC
-
-						if (ch == dplcPacketChecksum) {
-							dplcPacketState = PSTEC_PACKET_TX_ETX;
-							dplcPacketRcvdBytes++;
-						}
-						else						{
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_TX_ETX:
-						if (ch == PSTEC_REQUEST_ETX) {
-							dplcPacketRcvdBytes++;
-
-							if (dplcPacketRcvdBytes == PSTEC_REQUEST_PACKET_LENGTH)	{
-								dplcPacketState = PSTEC_PACKET_RX_STX;
-							}
-							else {
-								resetDplcResponseState();
-							}
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-                    case PSTEC_PACKET_RX_STX:
-                        if (ch == PSTEC_RESPONSE_STX) {
-        //@                     dplcPacketState    = PSTEC_PACKET_RX_MAGIC_CODE_1ST_BYTE;
-                            dplcPacketState    = PSTEC_PACKET_RX_ID;
-                            dplcPacketChecksum = ch;
-
-                            buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-                            dplcPacketRcvdBytes++;
-                        }
-                        else {
-                            resetDplcResponseState();
-                        }
-                        break;
-
-					case PSTEC_PACKET_RX_MAGIC_CODE_1ST_BYTE:
-						if (ch == PSTEC_MAGIC_CODE_1ST_BYTE) {
-							dplcPacketState     = PSTEC_PACKET_RX_MAGIC_CODE_2ND_BYTE;
-							dplcPacketChecksum += ch;
-
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_RX_MAGIC_CODE_2ND_BYTE:
-						if (ch == PSTEC_MAGIC_CODE_2ND_BYTE) {
-							dplcPacketState     = PSTEC_PACKET_RX_MAGIC_CODE_3RD_BYTE;
-							dplcPacketChecksum += ch;
-
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_RX_MAGIC_CODE_3RD_BYTE:
-						if (ch == PSTEC_MAGIC_CODE_3RD_BYTE) {
-							dplcPacketState     = PSTEC_PACKET_RX_MAGIC_CODE_4TH_BYTE;
-							dplcPacketChecksum += ch;
-
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_RX_MAGIC_CODE_4TH_BYTE:
-						if (ch == PSTEC_MAGIC_CODE_4TH_BYTE) {
-							dplcPacketState     = PSTEC_PACKET_RX_ID;
-							dplcPacketChecksum += ch;
-
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_RX_ID:
-						if (ch == dplcPacketMeterType) {
-							dplcPacketState     = PSTEC_PACKET_RX_DATA;
-							dplcPacketChecksum += ch;
-
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_RX_DATA:
-						dplcPacketApduLength++;
-						dplcPacketChecksum += ch;
-
-						buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-						dplcPacketRcvdBytes++;
-
-						if (dplcPacketApduLength > PSTEC_RESPONSE_PACKET_APDU_LENGTH_PRECISE_ACCUM_INSTANT) {
-							resetDplcResponseState();
-						}
-						else if (dplcPacketApduLength == PSTEC_RESPONSE_PACKET_APDU_LENGTH_PRECISE_ACCUM_INSTANT) {
-							dplcPacketState = PSTEC_PACKET_RX_BCC;
-						}
-						break;
-
-					case PSTEC_PACKET_RX_BCC:
-						dplcPacketChecksum &= 0x7F;	// trim to 7-bit BCC
-
-						if (ch == dplcPacketChecksum) {
-							dplcPacketState = PSTEC_PACKET_RX_ETX;
-
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-						}
-						else {
-							resetDplcResponseState();
-						}
-						break;
-
-					case PSTEC_PACKET_RX_ETX:
-						if (ch == PSTEC_RESPONSE_ETX) {
-							buffer[dplcPacketRcvdBytes-PSTEC_REQUEST_PACKET_LENGTH] = ch;
-
-							dplcPacketRcvdBytes++;
-
-//@							if ((PSTEC_REQUEST_PACKET_LENGTH + PSTEC_RESPONSE_PACKET_LENGTH_NORMAL_ACCUM) == dplcPacketRcvdBytes) {
-//@			//					dplcPacket.length = PSTEC_RESPONSE_PACKET_LENGTH_NORMAL_ACCUM;
-							if ((PSTEC_REQUEST_PACKET_LENGTH + PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT) == dplcPacketRcvdBytes) {
-			//					dplcPacket.length = PSTEC_RESPONSE_PACKET_LENGPSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANTH_NORMAL_ACCUM;
-			//
-			//					ret = TRUE;
-                                float fValue = 0.0f;
-//@                                int nValue = 0;
-                                int nValue1 = 0;
-                                int nValue2 = 0;
-//@                                makeReverseBcdToInt(nValue, (buffer+6), 3);
-                                makeReverseBcdToInt(nValue1, (buffer+2), 3);
-                                makeReverseBcdToInt(nValue2, (buffer+5), 2);
-//@                                printf("# thUart2- nValue : %d\n", nValue);
-//@                                printf("# thUart2- Other Meters : %02x %02x %02x\n", buffer[6], buffer[7], buffer[8]);
-                                //printf("# thUart2- nValue1 : %d, nValue2 : %d\n", nValue1, nValue2);
-                                //printf("# thUart2- Other Meters : %02x %02x %02x %02x %02x\n", buffer[2], buffer[3], buffer[4], buffer[5], buffer[6]);
-
-                                fValue = (float)nValue1 + (float)nValue2 / 10000.0;
-
-//@                                if (PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_WATER == dplcPacketMeterType) {
-                                if (PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER == dplcPacketMeterType) {
-//@                                    fValue = (float)nValue / 10;
-                                    water_meter_res->set_value(fValue);
-//@                                    printf("# thUart2- Water Meter : %.1f\n", fValue);
-                                    printf("# thUart2- Water Meter : %.4f\n", fValue);
-                                }
-//@                                else if (PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HOT_WATER == dplcPacketMeterType) {
-                                else if (PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER == dplcPacketMeterType) {
-//@                                    fValue = (float)nValue / 10;
-                                    hot_water_meter_res->set_value(fValue);
-//@                                    printf("# thUart2- Hot Water Meter : %.1f\n", fValue);
-                                    printf("# thUart2- Hot Water Meter : %.4f\n", fValue);
-                                }
-//@                                else if (PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_GAS == dplcPacketMeterType) {
-                                else if (PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS == dplcPacketMeterType) {
-//@                                    fValue = (float)nValue / 10;
-                                    gas_meter_res->set_value(fValue);
-//@                                    printf("# thUart2- Gas Meter : %.1f\n", fValue);
-                                    printf("# thUart2- Gas Meter : %.4f\n", fValue);
-                                }
-//@                                else if (PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HEAT == dplcPacketMeterType) {
-                                else if (PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT == dplcPacketMeterType) {
-//@                                    fValue = (float)nValue / 100;
-                                    heat_meter_res->set_value(fValue);
-//@                                    printf("# thUart2- Heat Meter : %.2f\n", fValue);
-                                    printf("# thUart2- Heat Meter : %.4f\n", fValue);
-                                }
-							}
-						}
-
-						resetDplcResponseState();
-						break;
-
-					default:
-                        printf("# thUart2- 11. default %d\n", dplcPacketState);
-						break;
-				}
-			}
-		}
-        //printf("### threadUart2 - 6\n");
-        Thread::wait(1000.0);
-    }
-}
-
-void rxCallback_OtherMeters() {
-    char ch = uart2OtherMater.getc();
-    bufUart2.push(ch);
-    led2 = !led2;
+static void publishPowerDemand(void *context) {
+    if (NULL != power_demand_res) {
+        power_demand_res->set_value(powerDemandText);
+    }
+    if ((NULL != power_meter_res) && ('\0' != powerEnergyText[0])) {
+        power_meter_res->set_value(powerEnergyText);
+    }
+}
+
+/**
+ * Closes the aggregation interval of the power meter and queues its
+ * aggregates for the next burst. Intervals end on multiples of their
+ * length in wall-clock time, like the demand periods of a utility; a first
+ * interval that would be shorter than half of that runs on to the next end.
+ * Runs on the eventQueue thread.
+ */
+void powerIntervalTick() {
+    uint32_t interval = MBED_CONF_APP_POWER_METER_AGGREGATE_INTERVAL;
+    uint32_t now = (uint32_t)time(NULL);
+    PowerAggregate aggregate;
+
+    if (powerAggregator.close(aggregate)) {
+        char min[METER_READING_TEXT_SIZE] = "";
+        char max[METER_READING_TEXT_SIZE] = "";
+        char mean[METER_READING_TEXT_SIZE] = "";
+        char delta[METER_READING_TEXT_SIZE] = "";
+
+        if (0 < aggregate.samples) {
+            meter_reading_format(aggregate.min, min, sizeof(min));
+            meter_reading_format(aggregate.max, max, sizeof(max));
+            meter_reading_format(aggregate.mean, mean, sizeof(mean));
+        }
+        if (aggregate.has_delta) {
+            meter_reading_format(aggregate.energy_delta, delta, sizeof(delta));
+        }
+        if (aggregate.has_energy) {
+            meter_reading_format(aggregate.energy, powerEnergyText, sizeof(powerEnergyText));
+        }
+
+        snprintf(powerDemandText, sizeof(powerDemandText), "%lu,%lu,%lu,%s,%s,%s,%s",
+                 (unsigned long)powerIntervalStart, (unsigned long)(now - powerIntervalStart),
+                 (unsigned long)aggregate.samples, min, max, mean, delta);
+        printf("# Power : %s\n", powerDemandText);
+        submitUplink(&publishPowerDemand, NULL, false);
+    }
+
+    powerIntervalStart = now;
+    uint32_t next = ((now + interval / 2) / interval + 1) * interval;
+    eventQueue.call_in((next - now) * 1000, &powerIntervalTick);
 }
 
 #endif
@@ -919,13 +1488,13 @@ int main(void) {
         }
     }
 
+    // Keep metering without the network, readings wait in the forward queue
     if (net_status != NSAPI_ERROR_OK) {
-        printf("ERROR: Connecting to the network failed (%d)!\n", net_status);
-        return -1;
+        printf("ERROR: Connecting to the network failed (%d)! Retrying in the background.\n", net_status);
+    } else {
+        printf("Connected to the network successfully. IP address: %s\n", net->get_ip_address());
     }
 
-    printf("Connected to the network successfully. IP address: %s\n", net->get_ip_address());
-
     printf("Initializing Pelion Device Management Client...\n");
 
     // SimpleMbedCloudClient handles registering over LwM2M to Pelion Device Management
@@ -959,6 +1528,12 @@ int main(void) {
     power_meter_res->observable(true);
     power_meter_res->attach_notification_callback(power_meter_callback);
 
+    power_demand_res = client.create_resource("4100/0/5755", "Power-Demand");
+    power_demand_res->set_value("");
+    power_demand_res->methods(M2MMethod::GET);
+    power_demand_res->observable(true);
+    power_demand_res->attach_notification_callback(power_meter_callback);
+
     seoul_water_meter_res = client.create_resource("4110/0/5700", "Seoul-Water-Meter");
     seoul_water_meter_res->set_value(0);
     seoul_water_meter_res->methods(M2MMethod::GET);
@@ -988,47 +1563,109 @@ int main(void) {
     heat_meter_res->methods(M2MMethod::GET);
     heat_meter_res->observable(true);
     heat_meter_res->attach_notification_callback(heat_meter_callback);
+
+    backlog_res = client.create_resource("4100/0/5750", "Reading-Backlog");
+    backlog_res->set_value("");
+    backlog_res->methods(M2MMethod::GET | M2MMethod::PUT);
+    backlog_res->observable(true);
+    backlog_res->attach_notification_callback(backlog_callback);
+    backlog_res->attach_put_callback(backlog_put_callback);
+
+    senml_res = client.create_resource("4100/0/5751", "Readings-SenML");
+    senml_res->set_value("");
+    senml_res->methods(M2MMethod::GET);
+    senml_res->observable(true);
+    senml_res->attach_notification_callback(senml_callback);
+
+    report_policy_res = client.create_resource("4100/0/5752", "Report-Policy");
+    report_policy_res->set_value("");
+    report_policy_res->methods(M2MMethod::GET | M2MMethod::PUT);
+    report_policy_res->attach_put_callback(report_policy_put_callback);
+
+    history_res = client.create_resource("4100/0/5753", "Reading-History");
+    history_res->set_value("");
+    history_res->methods(M2MMethod::GET | M2MMethod::POST);
+    history_res->observable(true);
+    history_res->attach_post_callback(history_post_callback);
+
+    port_counters_res = client.create_resource("4100/0/5754", "Port-Counters");
+    port_counters_res->set_value("");
+    port_counters_res->methods(M2MMethod::GET);
+    port_counters_res->observable(true);
 #endif
 
     printf("Initialized Pelion Device Management Client. Registering...\n");
 
     // Callback that fires when registering is complete
     client.on_registered(&registered);
+    client.on_unregistered(&unregistered);
+    cloudClient = &client;
 
-    // Register with Pelion DM
-    client.register_and_connect();
+    if (net_status == NSAPI_ERROR_OK) {
+        // Register with Pelion DM
+        client.register_and_connect();
 
-    int i = 600; // wait up 60 seconds before attaching sensors and button events
-    while (i-- > 0 && !client.is_client_registered()) {
-        wait_ms(100);
+        int i = 600; // wait up 60 seconds before attaching sensors and button events
+        while (i-- > 0 && !client.is_client_registered()) {
+            wait_ms(100);
+        }
     }
 
-
-#if 1
-    resetSeoulResponseState();
-    bufUart1.reset();
-    uart1SeoulWaterMater.baud(1200);
-
-    printf("### MainThread - 1\n");
-    threadSeoulWaterMeter.start(threadUart1_SeoulWaterMeter);
-    printf("### MainThread - 2\n");
-    uart1SeoulWaterMater.attach(&rxCallback_SeoulWaterMeter, Serial::RxIrq);
-    printf("### MainThread - 3\n");
-
-
-    resetDplcResponseState();
-    bufUart2.reset();
-    uart2OtherMater.baud(4800);
-
-    printf("### MainThread - 4\n");
-    threadOtherMeters.start(threadUart2_OtherMeters);
-    printf("### MainThread - 5\n");
-    uart2OtherMater.attach(&rxCallback_OtherMeters, Serial::RxIrq);
-    printf("### MainThread - 6\n"); 
+    // The RTC keeps running across a reset, not across a power loss
+    clockValid = (CLOCK_VALID_AFTER <= (uint32_t)time(NULL));
+    if (!clockValid) {
+        printf("Clock not set, readings are held until the NTP server answers\n");
+    }
+    networkThread.start(threadNetwork);
 
 
-    //bufUart3.reset();
-    //uart3PowerMeter.baud(9600);
+#if 1
+    seoulPort = &meterPorts.create<UART_PORT_SEOUL>("uart1", PC_1, PC_0, 1200, &onSeoulWaterMeterFrame, (void *)NULL,
+                                                    eventQueue, &led2);
+    pstecPort = &meterPorts.create<UART_PORT_PSTEC>("uart2", PA_2, PA_3, 4800, &onOtherMetersFrame, (void *)NULL,
+                                                    eventQueue, &led2);
+    modbusPort = &meterPorts.create<UART_PORT_MODBUS>("uart3", PC_4, PC_5, MODBUS_BAUD, &onModbusFrame, (void *)NULL,
+                                                      eventQueue, &led2);
+    ports[UART_PORT_SEOUL] = seoulPort;
+    ports[UART_PORT_PSTEC] = pstecPort;
+    ports[UART_PORT_MODBUS] = modbusPort;
+    printf("Meter ports: %u bytes (uart1 %u, uart2 %u, uart3 %u)\n", (unsigned)decltype(meterPorts)::size,
+           (unsigned)sizeof(SeoulPort), (unsigned)sizeof(PstecPort), (unsigned)sizeof(ModbusPort));
+
+    seoulPort->start();
+    pstecPort->start();
+    modbusPort->start();
+
+    // Readings are kept on the file system; a missing store only costs the history
+    int store_status = readingStore.open();
+    readingStoreReady = (0 == store_status);
+    printf("Reading store: %lu readings in %u segments (%d)\n",
+           (unsigned long)readingStore.records(), (unsigned)readingStore.segments(), store_status);
+    eventQueue.call_every(60 * 60 * 1000, &expireReadings);
+
+    forwardQueue.configure(FORWARD_BATCH_SIZE, FORWARD_INTERVAL_MS, FORWARD_ACK_TIMEOUT_MS, FORWARD_MAX_ATTEMPTS);
+    int forward_status = forwardQueue.open();
+    forwardQueueReady = (0 == forward_status);
+    printf("Forward queue: %lu readings waiting (%d)\n", (unsigned long)forwardQueue.backlog(), forward_status);
+
+    ReportPolicyConfig reportPolicy = {
+        { 0, 0, METER_UNIT_NONE }, { 0, 0, METER_UNIT_NONE },
+        MBED_CONF_APP_REPORT_MIN_INTERVAL, MBED_CONF_APP_REPORT_MAX_INTERVAL
+    };
+    applyReportPolicy(-1, reportPolicy);
+
+    UplinkWindow uplinkWindow = { MBED_CONF_APP_UPLINK_WINDOW_PERIOD * 1000UL, MBED_CONF_APP_UPLINK_WINDOW_LENGTH * 1000UL };
+    RadioProfile radioProfile = { MBED_CONF_APP_RADIO_WAKE_TIME, MBED_CONF_APP_RADIO_MESSAGE_TIME, MBED_CONF_APP_RADIO_TAIL_TIME };
+    uplink.configure(uplinkWindow, radioProfile, nowMs());
+
+    // Meters are polled on their own intervals from the eventQueue thread
+    setupPollScheduler();
+    eventQueue.call(&pollSchedulerTick);
+    eventQueue.call(&powerIntervalTick);
+    eventQueue.call_every(10 * 60 * 1000, &printPollStats);
+    if (0 < MBED_CONF_APP_PORT_COUNTERS_INTERVAL) {
+        eventQueue.call_every(MBED_CONF_APP_PORT_COUNTERS_INTERVAL * 1000, &reportPortCounters);
+    }
 
 #endif
 
@@ -1036,11 +1673,6 @@ int main(void) {
     // The button fires on an interrupt context, but debounces it to the eventqueue, so it's safe to do network operations
     button.fall(eventQueue.event(&button_press));
     printf("Press the user button to increment the LwM2M resource value...\n");
-#else
-    // The timer fires on an interrupt context, but debounces it to the eventqueue, so it's safe to do network operations
-    Ticker timer;
-    timer.attach(eventQueue.event(&button_press), 5.0);
-    printf("Simulating button press every 5 seconds...\n");
 #endif /* USE_BUTTON */
 
 
@@ -0,0 +1,77 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "Bcd.h"
+
+// Value of every byte, built at compile time. Invalid entries have bit 7
+// set, so OR-ing the entries of a number flags any bad digit at once.
+struct BcdTable {
+    uint8_t value[256];
+
+    constexpr BcdTable() : value()
+    {
+        for (unsigned i = 0; i < 256; i++) {
+            unsigned high = i >> 4;
+            unsigned low = i & 0x0F;
+            value[i] = ((high < 10) && (low < 10)) ? (uint8_t)(high * 10 + low) : (uint8_t)BCD_INVALID;
+        }
+    }
+};
+
+static constexpr BcdTable bcdTable;
+
+static_assert(99 == bcdTable.value[0x99], "BCD table");
+static_assert(BCD_INVALID == bcdTable.value[0x1A], "BCD table");
+
+uint8_t bcd_byte(uint8_t data)
+{
+    return bcdTable.value[data];
+}
+
+bool bcd_decode_msb_first(const uint8_t *data, size_t count, uint64_t &value)
+{
+    uint8_t invalid = 0;
+    uint64_t result = 0;
+
+    if (BCD_MAX_BYTES < count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint8_t digits = bcdTable.value[data[i]];
+        invalid |= digits;
+        result = result * 100 + digits;
+    }
+
+    value = result;
+    return 0 == (invalid & 0x80);
+}
+
+bool bcd_decode_lsb_first(const uint8_t *data, size_t count, uint64_t &value)
+{
+    uint8_t invalid = 0;
+    uint64_t result = 0;
+
+    if (BCD_MAX_BYTES < count) {
+        return false;
+    }
+    for (size_t i = count; 0 < i; i--) {
+        uint8_t digits = bcdTable.value[data[i - 1]];
+        invalid |= digits;
+        result = result * 100 + digits;
+    }
+
+    value = result;
+    return 0 == (invalid & 0x80);
+}
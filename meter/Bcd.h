@@ -0,0 +1,48 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef BCD_H
+#define BCD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bcd_byte() result for a byte with a nibble above 9
+#define BCD_INVALID         0xFF
+
+// Digits that always fit the 64-bit result
+#define BCD_MAX_BYTES       9
+
+/**
+ * Two-digit value of one packed BCD byte.
+ * @return 0 to 99, or BCD_INVALID
+ */
+uint8_t bcd_byte(uint8_t data);
+
+/**
+ * Decode packed BCD stored most significant byte first (12 34 56 = 123456).
+ * @param count Number of bytes, at most BCD_MAX_BYTES
+ * @return false if a nibble is not a decimal digit or @p count is too large
+ */
+bool bcd_decode_msb_first(const uint8_t *data, size_t count, uint64_t &value);
+
+/**
+ * Decode packed BCD stored least significant byte first (56 34 12 = 123456).
+ * @param count Number of bytes, at most BCD_MAX_BYTES
+ * @return false if a nibble is not a decimal digit or @p count is too large
+ */
+bool bcd_decode_lsb_first(const uint8_t *data, size_t count, uint64_t &value);
+
+#endif /* BCD_H */
@@ -0,0 +1,32 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Start value of a Modbus CRC
+#define CRC16_MODBUS_INIT   0xFFFF
+
+/**
+ * CRC-16/MODBUS (polynomial 0x8005, reflected) of @p size bytes, one table
+ * lookup per byte. It goes on the wire low byte first.
+ * @param crc Result for the bytes before @p data, to compute in pieces
+ */
+uint16_t crc16_modbus(const uint8_t *data, size_t size, uint16_t crc = CRC16_MODBUS_INIT);
+
+#endif /* CRC16_H */
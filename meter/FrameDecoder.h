@@ -0,0 +1,257 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FrameFormat.h"
+
+/**
+ * Receives every complete frame found by a decoder.
+ *
+ * @param context User pointer given to the decoder constructor
+ * @param frame   First byte of the frame. Only valid during the call.
+ * @param length  Number of bytes in the frame
+ */
+typedef void (*MeterFrameHandler)(void *context, const uint8_t *frame, size_t length);
+
+/** Counters of a frame decoder. */
+struct DecoderStats {
+    uint32_t frames;            // frames passed to the handler
+    uint32_t checksum_errors;   // frames with a wrong checksum
+    uint32_t length_errors;     // length field or end byte not where expected
+    uint32_t resets;            // partial frames dropped
+    uint32_t skipped;           // bytes dropped while looking for a frame start
+};
+
+/**
+ * Decoder for the frames described by one or more FrameFormat types that
+ * share a start byte.
+ *
+ * The decoder scans for the start byte instead of stepping through a state
+ * machine. A frame is only accepted when every field of its format checks
+ * out, and a candidate that turns out to be wrong only costs its first
+ * byte: scanning goes on from the byte after it, so a real frame hidden
+ * behind line noise is still found.
+ *
+ * A frame that lies entirely inside the span passed to feed() is checked
+ * and handed over in place. Only a frame that straddles two feed() calls
+ * is collected in the internal window, which holds the longest frame.
+ *
+ * One instance holds the whole parse state of one port, so bytes can be
+ * fed in arbitrary chunks as they come off the UART.
+ */
+template <typename... Formats>
+class FrameDecoder {
+    typedef FrameFormatSet<Formats...> Set;
+
+public:
+    /** Longest frame of all formats. */
+    static const size_t max_length = Set::max_length;
+
+    /**
+     * @param handler Called for every complete frame
+     * @param context Passed back to @p handler
+     */
+    FrameDecoder(MeterFrameHandler handler, void *context)
+        : _handler(handler), _context(context), _window_length(0), _need(0)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    /** Drop any partial frame and wait for the next start byte. */
+    void reset()
+    {
+        _window_length = 0;
+    }
+
+    /**
+     * Scan a span of received bytes.
+     * @param data Received bytes
+     * @param size Number of bytes in @p data
+     * @return Number of frames passed to the handler
+     */
+    size_t feed(const uint8_t *data, size_t size)
+    {
+        size_t frames = 0;
+        size_t i = 0;
+
+        while (i < size) {
+            // A frame is pending from an earlier span: complete it in the window
+            if (0 < _window_length) {
+                size_t want = _need - _window_length;
+                if (want > size - i) {
+                    want = size - i;
+                }
+                if (1 == want) {
+                    _window[_window_length] = data[i];
+                }
+                else {
+                    memcpy(_window + _window_length, data + i, want);
+                }
+                _window_length += want;
+                i += want;
+                // Until then the frame can be neither accepted nor rejected
+                if (_window_length == _need) {
+                    frames += scan_window();
+                }
+                continue;
+            }
+
+            const uint8_t *p = (const uint8_t *)memchr(data + i, Set::start, size - i);
+            if (NULL == p) {
+                _stats.skipped += size - i;
+                break;
+            }
+            _stats.skipped += p - (data + i);
+            i = p - data;
+
+            // Fast path: check the frame where it lies
+            size_t total = 0;
+            int result = check(p, size - i, total);
+            if (0 < result) {
+                _stats.frames++;
+                _handler(_context, p, total);
+                frames++;
+                i += total;
+            }
+            else if (0 == result) {
+                memcpy(_window, p, size - i);
+                _window_length = size - i;
+                _need = total;
+                i = size;
+            }
+            else {
+                _stats.resets++;
+                _stats.skipped++;
+                i++;
+            }
+        }
+
+        return frames;
+    }
+
+    /**
+     * The line went quiet, so the partial frame will not complete. Scan the
+     * bytes held after its first byte for frames, instead of dropping them.
+     * @return Number of frames passed to the handler
+     */
+    size_t resync()
+    {
+        size_t frames = 0;
+
+        if (0 < _window_length) {
+            _stats.resets++;
+        }
+        while (0 < _window_length) {
+            _stats.skipped++;
+            drop(1);
+            frames += scan_window();
+        }
+
+        return frames;
+    }
+
+    /** Bytes of a partial frame held, 0 between frames. */
+    size_t pending() const
+    {
+        return _window_length;
+    }
+
+    const DecoderStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    /**
+     * Check a candidate frame.
+     * @param total Set to the frame length if valid, to the bytes needed if undecided
+     * @return 1 if valid, 0 if more bytes are needed, -1 if not a frame
+     */
+    int check(const uint8_t *p, size_t length, size_t &total)
+    {
+        FrameMatch match;
+        int result = Set::check(p, length, match);
+
+        if (0 <= result) {
+            total = match.length;
+        }
+        else if (FRAME_CHECK_LENGTH_ERROR == match.error) {
+            _stats.length_errors++;
+        }
+        else if (FRAME_CHECK_CHECKSUM_ERROR == match.error) {
+            _stats.checksum_errors++;
+        }
+        return result;
+    }
+
+    /** Hand over the frames in the window and drop what cannot start one. */
+    size_t scan_window()
+    {
+        size_t frames = 0;
+
+        while (0 < _window_length) {
+            if (Set::start != _window[0]) {
+                const uint8_t *next = (const uint8_t *)memchr(_window, Set::start, _window_length);
+                size_t skip = (NULL != next) ? (size_t)(next - _window) : _window_length;
+                _stats.skipped += skip;
+                drop(skip);
+                continue;
+            }
+
+            size_t total = 0;
+            int result = check(_window, _window_length, total);
+            if (0 == result) {
+                _need = total;
+                break;
+            }
+            if (0 < result) {
+                _stats.frames++;
+                _handler(_context, _window, total);
+                frames++;
+                drop(total);
+            }
+            else {
+                _stats.resets++;
+                _stats.skipped++;
+                drop(1);
+            }
+        }
+
+        return frames;
+    }
+
+    void drop(size_t count)
+    {
+        _window_length -= count;
+        memmove(_window, _window + count, _window_length);
+    }
+
+    MeterFrameHandler _handler;
+    void *_context;
+
+    uint8_t _window[max_length];
+    size_t _window_length;
+    size_t _need;               // window length at which the next field of the pending frame can be checked
+
+    DecoderStats _stats;
+};
+
+#endif /* FRAME_DECODER_H */
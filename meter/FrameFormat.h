@@ -0,0 +1,502 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef FRAME_FORMAT_H
+#define FRAME_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Crc16.h"
+
+/*
+ * Compile-time description of a meter frame.
+ *
+ * A frame format is the list of its fields, in wire order:
+ *
+ *   typedef FrameFormat<
+ *       FrameByte<0x68>,                // start byte
+ *       FrameLength<3>,                 // L, at least 3
+ *       FrameLengthCopy,                // L again
+ *       FrameByte<0x68>,
+ *       FrameAny<3>,                    // C, A, CI, counted by L
+ *       FrameLengthData<3>,             // L - 3 bytes of user data
+ *       FrameChecksum<FRAME_SUM8, 4>,   // sum of the bytes from offset 4 on
+ *       FrameByte<0x16>                 // end byte
+ *   > MbusLongFrame;
+ *
+ * The format's check() is generated from the list: every field becomes a
+ * few inlined compares at an offset known to the compiler, so there is no
+ * state machine and no table to walk at run time. FrameDecoder scans a byte
+ * stream for frames of one or more formats.
+ *
+ * Rules, checked by static_assert: the first field is a fixed byte, the
+ * frame has at most one FrameLengthData field, and a FrameLength field
+ * comes before it.
+ */
+
+// The field checks are meant to collapse into straight-line code, also at -Os
+#if defined(__GNUC__)
+#define FRAME_INLINE inline __attribute__((always_inline))
+#else
+#define FRAME_INLINE inline
+#endif
+
+/** How a FrameChecksum is computed over its bytes. */
+enum FrameChecksumKind {
+    FRAME_SUM8 = 0,     // arithmetic sum modulo 256 (M-Bus)
+    FRAME_BCC7,         // arithmetic sum, low 7 bits (PSTEC)
+    FRAME_CRC16         // CRC-16/MODBUS, two bytes, low byte first (Modbus RTU)
+};
+
+/** Result of checking the bytes of a frame, or of one of its fields. */
+enum FrameCheck {
+    FRAME_CHECK_OK = 0,
+    FRAME_CHECK_MORE,               // not all bytes are there yet
+    FRAME_CHECK_MISMATCH,           // not a frame of this format
+    FRAME_CHECK_LENGTH_ERROR,       // length field or end byte not as expected
+    FRAME_CHECK_CHECKSUM_ERROR
+};
+
+/** What the check of one candidate frame found. */
+struct FrameMatch {
+    size_t length;          // frame length if valid, else bytes needed before the answer can change
+    size_t reached;         // offset of the field that failed
+    FrameCheck error;       // why it failed
+};
+
+/** Run-time state of checking one candidate frame. */
+struct FrameScan {
+    size_t length;          // value of the length field
+    bool body;              // past the data, a wrong fixed byte is a length error
+    size_t end;             // frame length once every field was checked, else bytes needed
+    size_t reached;
+};
+
+/** Defaults of the compile-time properties of a field. */
+struct FrameField {
+    static const int start = -1;            // value of a leading fixed byte
+    static const size_t fixed = 0;          // bytes, apart from FrameLengthData
+    static const bool variable = false;     // sized by the length field
+    static const bool length = false;       // is the length field
+    static const unsigned length_min = 0;
+    static const unsigned length_max = 0;
+    static const size_t before = 0;         // fixed bytes counted by the length field
+    static const bool body = false;
+    static const bool checks = false;       // check() can reject the frame
+
+    static FRAME_INLINE bool verify(const uint8_t *, size_t)
+    {
+        return true;
+    }
+};
+
+/** Fixed bytes: start and end bytes, magic codes. */
+template <uint8_t First, uint8_t... Rest>
+struct FrameBytes : FrameField {
+    static const int start = First;
+    static const size_t fixed = 1 + sizeof...(Rest);
+    static const bool checks = true;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return fixed;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *field, FrameScan &scan)
+    {
+        static const uint8_t bytes[fixed] = { First, Rest... };
+
+        for (size_t i = 0; i < fixed; i++) {
+            if (bytes[i] != field[i]) {
+                return scan.body ? FRAME_CHECK_LENGTH_ERROR : FRAME_CHECK_MISMATCH;
+            }
+        }
+        return FRAME_CHECK_OK;
+    }
+};
+
+template <uint8_t Byte>
+struct FrameBytes<Byte> : FrameField {
+    static const int start = Byte;
+    static const size_t fixed = 1;
+    static const bool checks = true;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return 1;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *field, FrameScan &scan)
+    {
+        if (Byte != *field) {
+            return scan.body ? FRAME_CHECK_LENGTH_ERROR : FRAME_CHECK_MISMATCH;
+        }
+        return FRAME_CHECK_OK;
+    }
+};
+
+template <uint8_t Byte>
+using FrameByte = FrameBytes<Byte>;
+
+/** @p Count bytes of any value: addresses, meter types, fixed-size data. */
+template <size_t Count = 1>
+struct FrameAny : FrameField {
+    static const size_t fixed = Count;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return Count;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *, FrameScan &)
+    {
+        return FRAME_CHECK_OK;
+    }
+};
+
+/** Data of a fixed size, which ends the header part of a frame. */
+template <size_t Count>
+struct FrameData : FrameAny<Count> {
+    static const bool body = true;
+};
+
+/** One byte from @p Min to @p Max, to reject false starts early. */
+template <uint8_t Min, uint8_t Max>
+struct FrameRange : FrameField {
+    static const size_t fixed = 1;
+    static const bool checks = true;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return 1;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *field, FrameScan &)
+    {
+        return ((Min <= *field) && (*field <= Max)) ? FRAME_CHECK_OK : FRAME_CHECK_MISMATCH;
+    }
+};
+
+/** One-byte length field: the size of FrameLengthData plus its Before bytes. */
+template <uint8_t Min = 0, uint8_t Max = 0xFF>
+struct FrameLength : FrameField {
+    static const size_t fixed = 1;
+    static const bool length = true;
+    static const bool checks = true;
+    static const unsigned length_min = Min;
+    static const unsigned length_max = Max;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return 1;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *field, FrameScan &scan)
+    {
+        if ((*field < Min) || (Max < *field)) {
+            return FRAME_CHECK_LENGTH_ERROR;
+        }
+        scan.length = *field;
+        return FRAME_CHECK_OK;
+    }
+};
+
+/** Repeat of the length field. */
+struct FrameLengthCopy : FrameField {
+    static const size_t fixed = 1;
+    static const bool checks = true;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return 1;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *field, FrameScan &scan)
+    {
+        return (scan.length == *field) ? FRAME_CHECK_OK : FRAME_CHECK_LENGTH_ERROR;
+    }
+};
+
+/**
+ * Data sized by the length field. @p Before is the number of bytes of the
+ * fields between the length field and this one that the length includes.
+ */
+template <size_t Before = 0>
+struct FrameLengthData : FrameField {
+    static const bool variable = true;
+    static const size_t before = Before;
+    static const bool body = true;
+
+    static FRAME_INLINE size_t size(const FrameScan &scan)
+    {
+        return scan.length - Before;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *, FrameScan &)
+    {
+        return FRAME_CHECK_OK;
+    }
+};
+
+/** Checksum over the bytes from offset @p From up to it. */
+template <FrameChecksumKind Kind, size_t From = 0>
+struct FrameChecksum : FrameField {
+    static const size_t fixed = (FRAME_CRC16 == Kind) ? 2 : 1;
+    static const bool body = true;
+
+    static FRAME_INLINE size_t size(const FrameScan &)
+    {
+        return fixed;
+    }
+
+    static FRAME_INLINE FrameCheck check(const uint8_t *, FrameScan &)
+    {
+        return FRAME_CHECK_OK;
+    }
+
+    static FRAME_INLINE bool verify(const uint8_t *frame, size_t offset)
+    {
+        const uint8_t *data = frame + From;
+        size_t count = offset - From;
+
+        if (FRAME_CRC16 == Kind) {
+            uint16_t crc = crc16_modbus(data, count);
+            return ((uint8_t)crc == frame[offset]) && ((uint8_t)(crc >> 8) == frame[offset + 1]);
+        }
+
+        uint32_t sum = 0;
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            sum += data[i] + data[i + 1] + data[i + 2] + data[i + 3];
+        }
+        for (; i < count; i++) {
+            sum += data[i];
+        }
+
+        if (FRAME_BCC7 == Kind) {
+            sum &= 0x7F;
+        }
+        return (uint8_t)sum == frame[offset];
+    }
+};
+
+// Walks the fields of a format: compile-time sums and the generated checks
+template <typename... Fields>
+struct FrameFields {
+    static const int start_byte = -1;
+    static const size_t fixed = 0;
+    static const size_t variables = 0;
+    static const bool has_length = false;
+    static const size_t length_offset = 0;
+    static const size_t variable_offset = 0;
+    static const unsigned length_min = 0;
+    static const unsigned length_max = 0;
+    static const size_t before = 0;
+
+    template <bool Whole>
+    static FRAME_INLINE FrameCheck check(const uint8_t *, size_t, size_t offset, FrameScan &scan)
+    {
+        scan.end = offset;
+        return FRAME_CHECK_OK;
+    }
+
+    static FRAME_INLINE bool verify(const uint8_t *, size_t, FrameScan &)
+    {
+        return true;
+    }
+
+    static FRAME_INLINE size_t need(size_t offset, const FrameScan &)
+    {
+        return offset;
+    }
+
+    static FRAME_INLINE size_t need_run(size_t offset, const FrameScan &)
+    {
+        return offset;
+    }
+};
+
+template <typename F, typename... Rest>
+struct FrameFields<F, Rest...> {
+    typedef FrameFields<Rest...> Next;
+
+    static const int start_byte = F::start;
+    static const size_t fixed = F::fixed + Next::fixed;
+    static const size_t variables = (F::variable ? 1 : 0) + Next::variables;
+    static const bool has_length = F::length || Next::has_length;
+    static const size_t length_offset = F::length ? 0 : (F::fixed + Next::length_offset);
+    static const size_t variable_offset = F::variable ? 0 : (F::fixed + Next::variable_offset);
+    static const unsigned length_min = F::length ? F::length_min : Next::length_min;
+    static const unsigned length_max = F::length ? F::length_max : Next::length_max;
+    static const size_t before = F::before + Next::before;
+
+    // Pass 1: the cheap byte compares of every field, as far as bytes are there.
+    // Whole: the longest frame fits in the available bytes, no need to ask.
+    template <bool Whole>
+    static FRAME_INLINE FrameCheck check(const uint8_t *p, size_t available, size_t offset, FrameScan &scan)
+    {
+        size_t size = F::size(scan);
+        if (!Whole && (offset + size > available)) {
+            scan.end = need(offset, scan);
+            return FRAME_CHECK_MORE;
+        }
+
+        FrameCheck result = F::check(p + offset, scan);
+        if (FRAME_CHECK_OK != result) {
+            scan.reached = offset;
+            return result;
+        }
+        scan.body |= F::body;
+        return Next::template check<Whole>(p, available, offset + size, scan);
+    }
+
+    // Bytes needed before the fields from @p offset on can reject the frame:
+    // up to the next run of checked fields, such as a header, all of it.
+    // Checksums are verified once the whole frame is there.
+    static FRAME_INLINE size_t need(size_t offset, const FrameScan &scan)
+    {
+        return F::checks ? Next::need_run(offset + F::size(scan), scan) : Next::need(offset + F::size(scan), scan);
+    }
+
+    static FRAME_INLINE size_t need_run(size_t offset, const FrameScan &scan)
+    {
+        return F::checks ? Next::need_run(offset + F::size(scan), scan) : offset;
+    }
+
+    // Pass 2: the checksums, once the whole frame is there
+    static FRAME_INLINE bool verify(const uint8_t *p, size_t offset, FrameScan &scan)
+    {
+        if (!F::verify(p, offset)) {
+            scan.reached = offset;
+            return false;
+        }
+        return Next::verify(p, offset + F::size(scan), scan);
+    }
+};
+
+/** A frame format, see the top of this file. */
+template <typename... Fields>
+struct FrameFormat {
+    typedef FrameFields<Fields...> List;
+
+    static const bool variable = (0 < List::variables);
+
+    /** First byte of every frame. */
+    static const int start = List::start_byte;
+
+    static const size_t min_length = List::fixed + (variable ? List::length_min - List::before : 0);
+    static const size_t max_length = List::fixed + (variable ? List::length_max - List::before : 0);
+
+    static_assert(0 <= start, "a frame format must begin with a fixed byte");
+    static_assert(List::variables <= 1, "a frame format can have one FrameLengthData field at most");
+    static_assert(!variable || (List::has_length && (List::length_offset < List::variable_offset)),
+                  "FrameLengthData needs a FrameLength field before it");
+    static_assert(!variable || (List::before <= List::length_min),
+                  "the smallest length must cover the bytes counted before FrameLengthData");
+
+    /**
+     * Check the candidate frame at @p p.
+     * @param available Bytes from @p p on
+     * @return 1 if it is a valid frame, 0 if more bytes are needed, -1 if not
+     */
+    static FRAME_INLINE int check(const uint8_t *p, size_t available, FrameMatch &match)
+    {
+        FrameScan scan;
+        scan.length       = 0;
+        scan.body         = false;
+        scan.end          = 0;
+        scan.reached      = 0;
+
+        FrameCheck result = (max_length <= available) ? List::template check<true>(p, available, 0, scan)
+                                                      : List::template check<false>(p, available, 0, scan);
+        if (FRAME_CHECK_MORE == result) {
+            match.length = scan.end;
+            return 0;
+        }
+        if ((FRAME_CHECK_OK == result) && !List::verify(p, 0, scan)) {
+            result = FRAME_CHECK_CHECKSUM_ERROR;
+        }
+        if (FRAME_CHECK_OK != result) {
+            match.reached = scan.reached;
+            match.error   = result;
+            return -1;
+        }
+
+        match.length = scan.end;
+        return 1;
+    }
+};
+
+/**
+ * Several formats sharing a start byte, such as a response and the echo of
+ * a request. A candidate is valid if any format accepts it and undecided
+ * while any format needs more bytes. When all reject it, the error is the
+ * one of the format that got furthest.
+ */
+template <typename... Formats>
+struct FrameFormatSet;
+
+template <typename Format>
+struct FrameFormatSet<Format> {
+    static const int start = Format::start;
+    static const size_t max_length = Format::max_length;
+
+    static FRAME_INLINE int check(const uint8_t *p, size_t available, FrameMatch &match)
+    {
+        return Format::check(p, available, match);
+    }
+};
+
+template <typename Format, typename... Rest>
+struct FrameFormatSet<Format, Rest...> {
+    typedef FrameFormatSet<Rest...> Next;
+
+    static const int start = Format::start;
+    static const size_t max_length = (Format::max_length > Next::max_length) ? Format::max_length : Next::max_length;
+
+    static_assert(Format::start == Next::start, "the formats of a set must share their start byte");
+
+    static FRAME_INLINE int check(const uint8_t *p, size_t available, FrameMatch &match)
+    {
+        int result = Format::check(p, available, match);
+        if (0 < result) {
+            return 1;
+        }
+
+        FrameMatch other;
+        int next = Next::check(p, available, other);
+        if (0 < next) {
+            match = other;
+            return 1;
+        }
+        if (0 == next) {
+            if ((0 != result) || (other.length < match.length)) {
+                match = other;
+            }
+            return 0;
+        }
+        if (0 == result) {
+            return 0;
+        }
+        if (other.reached > match.reached) {
+            match = other;
+        }
+        return -1;
+    }
+};
+
+#endif /* FRAME_FORMAT_H */
@@ -0,0 +1,154 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "HistoryCodec.h"
+
+// Small magnitudes of either sign become small unsigned numbers
+static inline uint64_t zigzag_encode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static size_t varint_put(uint8_t *p, uint64_t value)
+{
+    size_t n = 0;
+
+    while (0x80 <= value) {
+        p[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (uint8_t)value;
+    return n;
+}
+
+// @return Bytes read, 0 if the varint is cut off or too long
+static size_t varint_get(const uint8_t *p, size_t size, uint64_t &value)
+{
+    value = 0;
+    for (size_t n = 0; (n < size) && (n < 10); n++) {
+        value |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+        if (0 == (p[n] & 0x80)) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+HistoryEncoder::HistoryEncoder(uint8_t *buffer, size_t size)
+    : _buffer(buffer), _size(size)
+{
+    reset();
+}
+
+void HistoryEncoder::reset()
+{
+    _length     = 0;
+    _count      = 0;
+    _last_ts    = 0;
+    _last_delta = 0;
+    _last.value    = 0;
+    _last.exponent = 0;
+    _last.unit     = METER_UNIT_NONE;
+}
+
+bool HistoryEncoder::add(uint32_t timestamp, const MeterReading &reading)
+{
+    uint8_t sample[HISTORY_CODEC_HEADER_SIZE + HISTORY_CODEC_MAX_SAMPLE];
+    size_t n = 0;
+    int64_t delta = 0;
+
+    if (0 == _count) {
+        sample[n++] = (uint8_t)reading.exponent;
+        sample[n++] = reading.unit;
+        n += varint_put(sample + n, timestamp);
+        n += varint_put(sample + n, zigzag_encode(reading.value));
+    }
+    else {
+        if ((reading.exponent != _last.exponent) || (reading.unit != _last.unit)) {
+            return false;
+        }
+        delta = (int64_t)timestamp - (int64_t)_last_ts;
+        n += varint_put(sample + n, zigzag_encode(delta - _last_delta));
+        // Wrapping difference, so any pair of values round-trips
+        n += varint_put(sample + n, zigzag_encode((int64_t)((uint64_t)reading.value - (uint64_t)_last.value)));
+    }
+
+    if (n > (_size - _length)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        _buffer[_length + i] = sample[i];
+    }
+    _length += n;
+    _count++;
+
+    _last       = reading;
+    _last_ts    = timestamp;
+    _last_delta = delta;
+    return true;
+}
+
+HistoryDecoder::HistoryDecoder(const uint8_t *data, size_t length)
+    : _data(data), _length(length), _offset(0), _count(0), _last_ts(0), _last_delta(0)
+{
+    _last.value    = 0;
+    _last.exponent = 0;
+    _last.unit     = METER_UNIT_NONE;
+}
+
+bool HistoryDecoder::next(uint32_t &timestamp, MeterReading &reading)
+{
+    uint64_t ts;
+    uint64_t value;
+    size_t n;
+
+    if (0 == _count) {
+        if (HISTORY_CODEC_HEADER_SIZE > _length) {
+            return false;
+        }
+        _last.exponent = (int8_t)_data[0];
+        _last.unit     = _data[1];
+        _offset = HISTORY_CODEC_HEADER_SIZE;
+    }
+
+    if ((_offset >= _length) || (0 == (n = varint_get(_data + _offset, _length - _offset, ts)))) {
+        return false;
+    }
+    _offset += n;
+    if (0 == (n = varint_get(_data + _offset, _length - _offset, value))) {
+        return false;
+    }
+    _offset += n;
+
+    if (0 == _count) {
+        _last_ts    = (uint32_t)ts;
+        _last.value = zigzag_decode(value);
+    }
+    else {
+        _last_delta += zigzag_decode(ts);
+        _last_ts     = (uint32_t)((int64_t)_last_ts + _last_delta);
+        _last.value  = (int64_t)((uint64_t)_last.value + (uint64_t)zigzag_decode(value));
+    }
+    _count++;
+
+    timestamp = _last_ts;
+    reading   = _last;
+    return true;
+}
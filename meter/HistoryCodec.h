@@ -0,0 +1,102 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+// Block header (exponent, unit) and the largest possible first sample
+#define HISTORY_CODEC_HEADER_SIZE   2
+#define HISTORY_CODEC_MAX_SAMPLE    15
+
+/**
+ * Compresses the readings of one meter into a block of bytes.
+ *
+ * Timestamps are stored as the change of their delta (delta-of-delta), so
+ * a steady poll interval costs one byte per sample. Values are stored as
+ * the difference to the previous value. Both are zigzag mapped and written
+ * as base-128 varints, so a register that did not move costs one more byte.
+ * The first sample holds the full timestamp and value.
+ *
+ * A block has one exponent and unit, taken from its first reading; a
+ * reading with another scale does not fit and needs a new block. Samples
+ * are written whole or not at all, so the block stays decodable when it
+ * runs full. The encoder does not allocate and keeps only the last sample.
+ */
+class HistoryEncoder {
+public:
+    HistoryEncoder(uint8_t *buffer, size_t size);
+
+    /** Start a new block in the same buffer. */
+    void reset();
+
+    /**
+     * Append a reading.
+     * @return false if the buffer is full or the reading has another exponent or unit
+     */
+    bool add(uint32_t timestamp, const MeterReading &reading);
+
+    /** Bytes written so far. */
+    size_t length() const
+    {
+        return _length;
+    }
+
+    /** Readings in the block. */
+    size_t count() const
+    {
+        return _count;
+    }
+
+private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length;
+    size_t _count;
+
+    MeterReading _last;
+    uint32_t _last_ts;
+    int64_t _last_delta;
+};
+
+/**
+ * Reads the readings back from a block, oldest first. Does not allocate.
+ */
+class HistoryDecoder {
+public:
+    HistoryDecoder(const uint8_t *data, size_t length);
+
+    /**
+     * Read the next reading.
+     * @return false at the end of the block or if it is corrupt
+     */
+    bool next(uint32_t &timestamp, MeterReading &reading);
+
+private:
+    const uint8_t *_data;
+    size_t _length;
+    size_t _offset;
+    size_t _count;
+
+    MeterReading _last;
+    uint32_t _last_ts;
+    int64_t _last_delta;
+};
+
+#endif /* HISTORY_CODEC_H */
@@ -0,0 +1,706 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <math.h>
+#include <string.h>
+
+#include "MbusRecords.h"
+#include "Bcd.h"
+
+// Special DIFs
+#define MBUS_DIF_MANUFACTURER       0x0F    // manufacturer data up to the end
+#define MBUS_DIF_MORE_FOLLOWS       0x1F    // the same, more records in the next telegram
+#define MBUS_DIF_IDLE_FILLER        0x2F
+
+// VIFs that are not a unit
+#define MBUS_VIF_TABLE_FB           0xFB    // true VIF in the first extension table
+#define MBUS_VIF_TABLE_FD           0xFD    // true VIF in the second extension table
+#define MBUS_VIF_TABLE_EF           0xEF    // reserved extension table
+#define MBUS_VIF_PLAIN_TEXT         0x7C
+#define MBUS_VIF_ANY                0x7E
+#define MBUS_VIF_MANUFACTURER       0x7F
+
+// Combinable VIFEs
+#define MBUS_VIFE_ERROR_LAST        0x1F    // 0x00-0x1F: record error codes
+#define MBUS_VIFE_FACTOR            0x70    // 0x70-0x77: times 10^(nnn-6)
+#define MBUS_VIFE_FACTOR_1000       0x7D
+#define MBUS_VIFE_MANUFACTURER      0x7F    // the VIFEs after it are manufacturer specific
+
+// Time units of the nn and pp fields
+static const uint8_t durationUnits[4] = { MBUS_UNIT_SECOND, MBUS_UNIT_MINUTE, MBUS_UNIT_HOUR, MBUS_UNIT_DAY };
+static const uint8_t longDurationUnits[4] = { MBUS_UNIT_HOUR, MBUS_UNIT_DAY, MBUS_UNIT_MONTH, MBUS_UNIT_YEAR };
+
+static void set(MbusRecord &record, uint8_t quantity, uint8_t unit, int exponent)
+{
+    record.quantity = quantity;
+    record.unit     = unit;
+    record.exponent = (int8_t)exponent;
+}
+
+// Primary VIF table, 0x00-0x7A
+static void describe_primary(MbusRecord &record, uint8_t vif)
+{
+    uint8_t n = vif & 0x07;
+    uint8_t nn = vif & 0x03;
+
+    switch (vif >> 3) {
+        case 0x00:  set(record, MBUS_QUANTITY_ENERGY, MBUS_UNIT_WATT_HOUR, n - 3); return;
+        case 0x01:  set(record, MBUS_QUANTITY_ENERGY, MBUS_UNIT_JOULE, n); return;
+        case 0x02:  set(record, MBUS_QUANTITY_VOLUME, MBUS_UNIT_CUBIC_METRE, n - 6); return;
+        case 0x03:  set(record, MBUS_QUANTITY_MASS, MBUS_UNIT_KILOGRAM, n - 3); return;
+        case 0x04:
+            set(record, (vif & 0x04) ? MBUS_QUANTITY_OPERATING_TIME : MBUS_QUANTITY_ON_TIME, durationUnits[nn], 0);
+            return;
+        case 0x05:  set(record, MBUS_QUANTITY_POWER, MBUS_UNIT_WATT, n - 3); return;
+        case 0x06:  set(record, MBUS_QUANTITY_POWER, MBUS_UNIT_JOULE_PER_HOUR, n); return;
+        case 0x07:  set(record, MBUS_QUANTITY_VOLUME_FLOW, MBUS_UNIT_CUBIC_METRE_PER_HOUR, n - 6); return;
+        case 0x08:  set(record, MBUS_QUANTITY_VOLUME_FLOW, MBUS_UNIT_CUBIC_METRE_PER_MINUTE, n - 7); return;
+        case 0x09:  set(record, MBUS_QUANTITY_VOLUME_FLOW, MBUS_UNIT_CUBIC_METRE_PER_SECOND, n - 9); return;
+        case 0x0A:  set(record, MBUS_QUANTITY_MASS_FLOW, MBUS_UNIT_KILOGRAM_PER_HOUR, n - 3); return;
+        case 0x0B:
+            set(record, (vif & 0x04) ? MBUS_QUANTITY_RETURN_TEMPERATURE : MBUS_QUANTITY_FLOW_TEMPERATURE,
+                MBUS_UNIT_CELSIUS, nn - 3);
+            return;
+        case 0x0C:
+            if (vif & 0x04) {
+                set(record, MBUS_QUANTITY_EXTERNAL_TEMPERATURE, MBUS_UNIT_CELSIUS, nn - 3);
+            }
+            else {
+                set(record, MBUS_QUANTITY_TEMPERATURE_DIFFERENCE, MBUS_UNIT_KELVIN, nn - 3);
+            }
+            return;
+        case 0x0D:
+            if (0 == (vif & 0x04)) {
+                set(record, MBUS_QUANTITY_PRESSURE, MBUS_UNIT_BAR, nn - 3);
+            }
+            else if (0x6C == vif) {
+                set(record, MBUS_QUANTITY_DATE, MBUS_UNIT_NONE, 0);
+            }
+            else if (0x6D == vif) {
+                set(record, MBUS_QUANTITY_DATE_TIME, MBUS_UNIT_NONE, 0);
+            }
+            else if (0x6E == vif) {
+                set(record, MBUS_QUANTITY_HCA_UNITS, MBUS_UNIT_NONE, 0);
+            }
+            return;
+        case 0x0E:
+            set(record, (vif & 0x04) ? MBUS_QUANTITY_ACTUALITY_DURATION : MBUS_QUANTITY_AVERAGING_DURATION,
+                durationUnits[nn], 0);
+            return;
+        default:
+            if (0x78 == vif) {
+                set(record, MBUS_QUANTITY_FABRICATION_NUMBER, MBUS_UNIT_NONE, 0);
+            }
+            else if (0x79 == vif) {
+                set(record, MBUS_QUANTITY_ENHANCED_ID, MBUS_UNIT_NONE, 0);
+            }
+            else if (0x7A == vif) {
+                set(record, MBUS_QUANTITY_BUS_ADDRESS, MBUS_UNIT_NONE, 0);
+            }
+            return;
+    }
+}
+
+// First extension table, after VIF 0xFB. Multiples are folded into the exponent.
+static void describe_fb(MbusRecord &record, uint8_t vif)
+{
+    uint8_t n = vif & 0x01;
+    uint8_t nn = vif & 0x03;
+
+    if (vif <= 0x01) {
+        set(record, MBUS_QUANTITY_ENERGY, MBUS_UNIT_WATT_HOUR, n - 1 + 6);              // MWh
+    }
+    else if ((0x08 <= vif) && (vif <= 0x09)) {
+        set(record, MBUS_QUANTITY_ENERGY, MBUS_UNIT_JOULE, n - 1 + 9);                  // GJ
+    }
+    else if ((0x10 <= vif) && (vif <= 0x11)) {
+        set(record, MBUS_QUANTITY_VOLUME, MBUS_UNIT_CUBIC_METRE, n + 2);
+    }
+    else if ((0x18 <= vif) && (vif <= 0x19)) {
+        set(record, MBUS_QUANTITY_MASS, MBUS_UNIT_KILOGRAM, n + 2 + 3);                 // t
+    }
+    else if (0x21 == vif) {
+        set(record, MBUS_QUANTITY_VOLUME, MBUS_UNIT_CUBIC_FEET, -1);
+    }
+    else if ((0x22 <= vif) && (vif <= 0x23)) {
+        set(record, MBUS_QUANTITY_VOLUME, MBUS_UNIT_US_GALLON, n - 1);
+    }
+    else if (0x24 == vif) {
+        set(record, MBUS_QUANTITY_VOLUME_FLOW, MBUS_UNIT_US_GALLON_PER_MINUTE, -3);
+    }
+    else if (0x25 == vif) {
+        set(record, MBUS_QUANTITY_VOLUME_FLOW, MBUS_UNIT_US_GALLON_PER_MINUTE, 0);
+    }
+    else if (0x26 == vif) {
+        set(record, MBUS_QUANTITY_VOLUME_FLOW, MBUS_UNIT_US_GALLON_PER_HOUR, 0);
+    }
+    else if ((0x28 <= vif) && (vif <= 0x29)) {
+        set(record, MBUS_QUANTITY_POWER, MBUS_UNIT_WATT, n - 1 + 6);                    // MW
+    }
+    else if ((0x30 <= vif) && (vif <= 0x31)) {
+        set(record, MBUS_QUANTITY_POWER, MBUS_UNIT_JOULE_PER_HOUR, n - 1 + 9);          // GJ/h
+    }
+    else if ((0x58 <= vif) && (vif <= 0x5B)) {
+        set(record, MBUS_QUANTITY_FLOW_TEMPERATURE, MBUS_UNIT_FAHRENHEIT, nn - 3);
+    }
+    else if ((0x5C <= vif) && (vif <= 0x5F)) {
+        set(record, MBUS_QUANTITY_RETURN_TEMPERATURE, MBUS_UNIT_FAHRENHEIT, nn - 3);
+    }
+    else if ((0x60 <= vif) && (vif <= 0x63)) {
+        set(record, MBUS_QUANTITY_TEMPERATURE_DIFFERENCE, MBUS_UNIT_FAHRENHEIT, nn - 3);
+    }
+    else if ((0x64 <= vif) && (vif <= 0x67)) {
+        set(record, MBUS_QUANTITY_EXTERNAL_TEMPERATURE, MBUS_UNIT_FAHRENHEIT, nn - 3);
+    }
+    else if ((0x70 <= vif) && (vif <= 0x73)) {
+        set(record, MBUS_QUANTITY_TEMPERATURE_LIMIT, MBUS_UNIT_FAHRENHEIT, nn - 3);
+    }
+    else if ((0x74 <= vif) && (vif <= 0x77)) {
+        set(record, MBUS_QUANTITY_TEMPERATURE_LIMIT, MBUS_UNIT_CELSIUS, nn - 3);
+    }
+    else if (0x78 <= vif) {
+        set(record, MBUS_QUANTITY_MAX_POWER_COUNT, MBUS_UNIT_WATT, (vif & 0x07) - 3);
+    }
+}
+
+// Second extension table, after VIF 0xFD
+static void describe_fd(MbusRecord &record, uint8_t vif)
+{
+    // Codes without unit or scale, 0x08-0x1E
+    static const uint8_t plain[] = {
+        MBUS_QUANTITY_ACCESS_NUMBER, MBUS_QUANTITY_MEDIUM, MBUS_QUANTITY_MANUFACTURER,
+        MBUS_QUANTITY_PARAMETER_SET, MBUS_QUANTITY_MODEL_VERSION, MBUS_QUANTITY_HARDWARE_VERSION,
+        MBUS_QUANTITY_FIRMWARE_VERSION, MBUS_QUANTITY_SOFTWARE_VERSION, MBUS_QUANTITY_CUSTOMER_LOCATION,
+        MBUS_QUANTITY_CUSTOMER, MBUS_QUANTITY_ACCESS_CODE, MBUS_QUANTITY_ACCESS_CODE, MBUS_QUANTITY_ACCESS_CODE,
+        MBUS_QUANTITY_ACCESS_CODE, MBUS_QUANTITY_PASSWORD, MBUS_QUANTITY_ERROR_FLAGS, MBUS_QUANTITY_ERROR_MASK,
+        MBUS_QUANTITY_UNKNOWN, MBUS_QUANTITY_DIGITAL_OUTPUT, MBUS_QUANTITY_DIGITAL_INPUT, MBUS_QUANTITY_BAUD_RATE,
+        MBUS_QUANTITY_RESPONSE_DELAY, MBUS_QUANTITY_RETRY
+    };
+    // Codes 0x60-0x67
+    static const uint8_t counters[] = {
+        MBUS_QUANTITY_RESET_COUNTER, MBUS_QUANTITY_CUMULATION_COUNTER, MBUS_QUANTITY_CONTROL_SIGNAL,
+        MBUS_QUANTITY_DAY_OF_WEEK, MBUS_QUANTITY_WEEK_NUMBER, MBUS_QUANTITY_DAY_CHANGE,
+        MBUS_QUANTITY_PARAMETER_ACTIVATION, MBUS_QUANTITY_SUPPLIER_INFORMATION
+    };
+    uint8_t nn = vif & 0x03;
+
+    if (vif <= 0x03) {
+        set(record, MBUS_QUANTITY_CREDIT, MBUS_UNIT_CURRENCY, nn - 3);
+    }
+    else if (vif <= 0x07) {
+        set(record, MBUS_QUANTITY_DEBIT, MBUS_UNIT_CURRENCY, nn - 3);
+    }
+    else if (vif <= 0x1E) {
+        set(record, plain[vif - 0x08], MBUS_UNIT_NONE, 0);
+        if (0x1C == vif) {
+            record.unit = MBUS_UNIT_BAUD;
+        }
+        else if (0x1D == vif) {
+            record.unit = MBUS_UNIT_BIT_TIMES;
+        }
+    }
+    else if (0x20 == vif) {
+        set(record, MBUS_QUANTITY_FIRST_STORAGE, MBUS_UNIT_NONE, 0);
+    }
+    else if (0x21 == vif) {
+        set(record, MBUS_QUANTITY_LAST_STORAGE, MBUS_UNIT_NONE, 0);
+    }
+    else if (0x22 == vif) {
+        set(record, MBUS_QUANTITY_STORAGE_BLOCK_SIZE, MBUS_UNIT_NONE, 0);
+    }
+    else if ((0x24 <= vif) && (vif <= 0x27)) {
+        set(record, MBUS_QUANTITY_STORAGE_INTERVAL, durationUnits[nn], 0);
+    }
+    else if ((0x28 == vif) || (0x29 == vif)) {
+        set(record, MBUS_QUANTITY_STORAGE_INTERVAL, (0x28 == vif) ? MBUS_UNIT_MONTH : MBUS_UNIT_YEAR, 0);
+    }
+    else if ((0x2C <= vif) && (vif <= 0x2F)) {
+        set(record, MBUS_QUANTITY_SINCE_LAST_READOUT, durationUnits[nn], 0);
+    }
+    else if (0x30 == vif) {
+        set(record, MBUS_QUANTITY_TARIFF_START, MBUS_UNIT_NONE, 0);
+    }
+    else if ((0x31 <= vif) && (vif <= 0x33)) {
+        set(record, MBUS_QUANTITY_TARIFF_DURATION, durationUnits[nn], 0);
+    }
+    else if ((0x34 <= vif) && (vif <= 0x37)) {
+        set(record, MBUS_QUANTITY_TARIFF_PERIOD, durationUnits[nn], 0);
+    }
+    else if ((0x38 == vif) || (0x39 == vif)) {
+        set(record, MBUS_QUANTITY_TARIFF_PERIOD, (0x38 == vif) ? MBUS_UNIT_MONTH : MBUS_UNIT_YEAR, 0);
+    }
+    else if (0x3A == vif) {
+        set(record, MBUS_QUANTITY_DIMENSIONLESS, MBUS_UNIT_NONE, 0);
+    }
+    else if ((0x40 <= vif) && (vif <= 0x4F)) {
+        set(record, MBUS_QUANTITY_VOLTAGE, MBUS_UNIT_VOLT, (vif & 0x0F) - 9);
+    }
+    else if ((0x50 <= vif) && (vif <= 0x5F)) {
+        set(record, MBUS_QUANTITY_CURRENT, MBUS_UNIT_AMPERE, (vif & 0x0F) - 12);
+    }
+    else if ((0x60 <= vif) && (vif <= 0x67)) {
+        set(record, counters[vif - 0x60], MBUS_UNIT_NONE, 0);
+    }
+    else if ((0x68 <= vif) && (vif <= 0x6B)) {
+        set(record, MBUS_QUANTITY_SINCE_LAST_CUMULATION, longDurationUnits[nn], 0);
+    }
+    else if ((0x6C <= vif) && (vif <= 0x6F)) {
+        set(record, MBUS_QUANTITY_BATTERY_OPERATING_TIME, longDurationUnits[nn], 0);
+    }
+    else if (0x70 == vif) {
+        set(record, MBUS_QUANTITY_BATTERY_CHANGE, MBUS_UNIT_NONE, 0);
+    }
+}
+
+MbusRecordIterator::MbusRecordIterator(const uint8_t *frame, size_t length)
+    : _p(NULL), _end(NULL), _error(MBUS_RECORD_OK), _more_follows(false)
+{
+    memset(&_header, 0, sizeof(_header));
+
+    // 0x68 L L 0x68 C A CI ... CS 0x16
+    if ((MBUS_LONG_FRAME_USER_DATA + 2 > length) || (0x68 != frame[0]) || (frame[1] != frame[2]) ||
+        (0x68 != frame[3]) || ((size_t)frame[1] + 6 != length)) {
+        fail(MBUS_RECORD_NOT_LONG_FRAME);
+        return;
+    }
+
+    const uint8_t *p = frame + MBUS_LONG_FRAME_USER_DATA;
+    _end = frame + length - 2;
+    _header.ci = frame[MBUS_LONG_FRAME_USER_DATA - 1];
+
+    if (MBUS_CI_RESPONSE_LONG_HEADER == _header.ci) {
+        if (_end - p < MBUS_LONG_HEADER_LENGTH) {
+            fail(MBUS_RECORD_TRUNCATED);
+            return;
+        }
+        _header.id = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        _header.manufacturer = (uint16_t)(p[4] | (p[5] << 8));
+        _header.version = p[6];
+        _header.medium = p[7];
+        p += 8;
+    }
+    else if (MBUS_CI_RESPONSE_SHORT_HEADER == _header.ci) {
+        if (_end - p < MBUS_SHORT_HEADER_LENGTH) {
+            fail(MBUS_RECORD_TRUNCATED);
+            return;
+        }
+    }
+    else if (MBUS_CI_RESPONSE_NO_HEADER != _header.ci) {
+        fail(MBUS_RECORD_UNKNOWN_CI);
+        return;
+    }
+
+    // Both headers end in access number, status and signature
+    if (MBUS_CI_RESPONSE_NO_HEADER != _header.ci) {
+        _header.access = p[0];
+        _header.status = p[1];
+        _header.signature = (uint16_t)(p[2] | (p[3] << 8));
+        p += 4;
+    }
+    _p = p;
+}
+
+bool MbusRecordIterator::fail(uint8_t error)
+{
+    _error = error;
+    _p = _end;
+    return false;
+}
+
+bool MbusRecordIterator::next(MbusRecord &record)
+{
+    // Fillers may stand between records and at the end
+    while ((_p < _end) && (MBUS_DIF_IDLE_FILLER == *_p)) {
+        _p++;
+    }
+    if (_p >= _end) {
+        return false;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.dif = _p;
+
+    const uint8_t *p = _p;
+    uint8_t dif = *p++;
+
+    if ((MBUS_DIF_MANUFACTURER == dif) || (MBUS_DIF_MORE_FOLLOWS == dif)) {
+        record.coding = MBUS_CODING_MANUFACTURER;
+        record.data = p;
+        record.length = (uint8_t)(_end - p);
+        _more_follows = (MBUS_DIF_MORE_FOLLOWS == dif);
+        _p = _end;
+        return true;
+    }
+    if (0x0F == (dif & 0x0F)) {
+        return fail(MBUS_RECORD_RESERVED_DIF);
+    }
+
+    // Storage number, tariff and subunit: one bit in the DIF, then more in every DIFE
+    record.function = (dif >> 4) & 0x03;
+    record.storage = (dif >> 6) & 0x01;
+    uint8_t extension = dif;
+    for (unsigned n = 0; extension & 0x80; n++) {
+        if (MBUS_MAX_DIFE == n) {
+            return fail(MBUS_RECORD_TOO_MANY_DIFE);
+        }
+        if (p >= _end) {
+            return fail(MBUS_RECORD_TRUNCATED);
+        }
+        extension = *p++;
+        record.storage |= (uint64_t)(extension & 0x0F) << (1 + 4 * n);
+        record.tariff |= (uint32_t)((extension >> 4) & 0x03) << (2 * n);
+        record.subunit |= (uint16_t)(((extension >> 6) & 0x01) << n);
+    }
+
+    // VIF, or an extension table and the true VIF
+    if (p >= _end) {
+        return fail(MBUS_RECORD_TRUNCATED);
+    }
+    extension = *p++;
+    if ((MBUS_VIF_TABLE_FB == extension) || (MBUS_VIF_TABLE_FD == extension) || (MBUS_VIF_TABLE_EF == extension)) {
+        if (p >= _end) {
+            return fail(MBUS_RECORD_TRUNCATED);
+        }
+        record.vif_table = extension;
+        extension = *p++;
+    }
+    record.vif = extension & 0x7F;
+    if ((0 == record.vif_table) && ((MBUS_VIF_PLAIN_TEXT == record.vif) || (MBUS_VIF_MANUFACTURER == record.vif))) {
+        record.vif_table = record.vif;
+    }
+
+    record.vife = p;
+    while (extension & 0x80) {
+        if (MBUS_MAX_VIFE == record.vife_count) {
+            return fail(MBUS_RECORD_TOO_MANY_VIFE);
+        }
+        if (p >= _end) {
+            return fail(MBUS_RECORD_TRUNCATED);
+        }
+        extension = *p++;
+        record.vife_count++;
+    }
+
+    // A plain text unit follows the VIF and its VIFEs
+    if (MBUS_VIF_PLAIN_TEXT == record.vif_table) {
+        if ((p >= _end) || (*p > _end - p - 1)) {
+            return fail(MBUS_RECORD_TRUNCATED);
+        }
+        record.unit_text_length = *p++;
+        record.unit_text = p;
+        p += record.unit_text_length;
+    }
+
+    // Data field: none, 1-4 byte integer, real, 6 and 8 byte integer,
+    // selection, BCD of 2-8 digits, variable length, 12 digit BCD
+    static const uint8_t codings[15] = {
+        MBUS_CODING_NONE, MBUS_CODING_INTEGER, MBUS_CODING_INTEGER, MBUS_CODING_INTEGER, MBUS_CODING_INTEGER,
+        MBUS_CODING_REAL, MBUS_CODING_INTEGER, MBUS_CODING_INTEGER, MBUS_CODING_NONE, MBUS_CODING_BCD,
+        MBUS_CODING_BCD, MBUS_CODING_BCD, MBUS_CODING_BCD, MBUS_CODING_NONE, MBUS_CODING_BCD
+    };
+    static const uint8_t lengths[15] = { 0, 1, 2, 3, 4, 4, 6, 8, 0, 1, 2, 3, 4, 0, 6 };
+    uint8_t field = dif & 0x0F;
+    size_t length = lengths[field];
+    record.coding = codings[field];
+
+    if (0x0D == field) {
+        if (p >= _end) {
+            return fail(MBUS_RECORD_TRUNCATED);
+        }
+        uint8_t lvar = *p++;
+        if (lvar < 0xC0) {
+            record.coding = MBUS_CODING_TEXT;
+            length = lvar;
+        }
+        else if (lvar <= 0xC9) {
+            record.coding = MBUS_CODING_BCD;
+            length = lvar - 0xC0;
+        }
+        else if ((0xD0 <= lvar) && (lvar <= 0xD9)) {
+            record.coding = MBUS_CODING_NEGATIVE_BCD;
+            length = lvar - 0xD0;
+        }
+        else if ((0xE0 <= lvar) && (lvar <= 0xEF)) {
+            record.coding = MBUS_CODING_INTEGER;
+            length = lvar - 0xE0;
+        }
+        else if ((0xF0 <= lvar) && (lvar <= 0xF4)) {
+            record.coding = MBUS_CODING_INTEGER;
+            length = 4 * (lvar - 0xEC);
+        }
+        else if ((0xF5 == lvar) || (0xF6 == lvar)) {
+            record.coding = MBUS_CODING_INTEGER;
+            length = (0xF5 == lvar) ? 48 : 64;
+        }
+        else {
+            return fail(MBUS_RECORD_RESERVED_LVAR);
+        }
+    }
+
+    if ((size_t)(_end - p) < length) {
+        return fail(MBUS_RECORD_TRUNCATED);
+    }
+    record.data = p;
+    record.length = (uint8_t)length;
+    _p = p + length;
+
+    describe(record);
+    return true;
+}
+
+// Quantity, unit and exponent from the VIF and the combinable VIFEs
+void MbusRecordIterator::describe(MbusRecord &record) const
+{
+    switch (record.vif_table) {
+        case 0:
+            if (MBUS_VIF_ANY == record.vif) {
+                record.quantity = MBUS_QUANTITY_ANY;
+            }
+            else {
+                describe_primary(record, record.vif);
+            }
+            break;
+        case MBUS_VIF_TABLE_FB:
+            describe_fb(record, record.vif);
+            break;
+        case MBUS_VIF_TABLE_FD:
+            describe_fd(record, record.vif);
+            break;
+        case MBUS_VIF_PLAIN_TEXT:
+            record.quantity = MBUS_QUANTITY_PLAIN_TEXT;
+            break;
+        default:
+            // Manufacturer VIF or reserved table: the VIFEs cannot be told apart
+            return;
+    }
+
+    int exponent = record.exponent;
+    for (uint8_t i = 0; i < record.vife_count; i++) {
+        uint8_t vife = record.vife[i] & 0x7F;
+
+        if (MBUS_VIFE_MANUFACTURER == vife) {
+            break;
+        }
+        if ((vife <= MBUS_VIFE_ERROR_LAST) && (0 == record.error)) {
+            record.error = vife;
+        }
+        else if ((MBUS_VIFE_FACTOR <= vife) && (vife <= MBUS_VIFE_FACTOR + 7)) {
+            exponent += (vife & 0x07) - 6;
+        }
+        else if (MBUS_VIFE_FACTOR_1000 == vife) {
+            exponent += 3;
+        }
+    }
+    record.exponent = (int8_t)exponent;
+}
+
+// Signed value of a type A number, least significant byte first
+static bool decode_bcd(const uint8_t *data, size_t length, bool negative, int64_t &value)
+{
+    uint64_t magnitude = 0;
+
+    if (BCD_MAX_BYTES < length) {
+        return false;
+    }
+    for (size_t i = length; 0 < i; i--) {
+        uint8_t high = data[i - 1] >> 4;
+        uint8_t low = data[i - 1] & 0x0F;
+
+        // A minus in place of the top digit
+        if ((i == length) && (0x0F == high)) {
+            negative = true;
+            high = 0;
+        }
+        if ((9 < high) || (9 < low)) {
+            return false;
+        }
+        magnitude = magnitude * 100 + high * 10 + low;
+    }
+    value = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+    return true;
+}
+
+bool mbus_record_value(const MbusRecord &record, MeterReading &reading)
+{
+    int64_t value = 0;
+    int exponent = record.exponent;
+
+    switch (record.coding) {
+        case MBUS_CODING_INTEGER: {
+            if ((0 == record.length) || (8 < record.length)) {
+                return false;
+            }
+            uint64_t bits = 0;
+            for (size_t i = record.length; 0 < i; i--) {
+                bits = (bits << 8) | record.data[i - 1];
+            }
+            // Sign extension from the top bit sent
+            unsigned shift = 64 - 8 * record.length;
+            value = (int64_t)(bits << shift) >> shift;
+            break;
+        }
+        case MBUS_CODING_BCD:
+        case MBUS_CODING_NEGATIVE_BCD:
+            if ((0 == record.length) ||
+                !decode_bcd(record.data, record.length, MBUS_CODING_NEGATIVE_BCD == record.coding, value)) {
+                return false;
+            }
+            break;
+        case MBUS_CODING_REAL: {
+            uint32_t bits = (uint32_t)record.data[0] | ((uint32_t)record.data[1] << 8) |
+                            ((uint32_t)record.data[2] << 16) | ((uint32_t)record.data[3] << 24);
+            float real;
+            memcpy(&real, &bits, sizeof(real));
+            if (!isfinite(real)) {
+                return false;
+            }
+            // Seven significant digits, all a single has
+            if (0.0f != real) {
+                int shift = (int)floor(log10(fabs((double)real))) - 6;
+                value = (int64_t)llround((double)real * pow(10.0, -shift));
+                exponent += shift;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+
+    reading.value = value;
+    reading.exponent = (int8_t)exponent;
+    switch (record.unit) {
+        case MBUS_UNIT_WATT_HOUR:
+            reading.unit = METER_UNIT_KILOWATT_HOUR;
+            reading.exponent = (int8_t)(exponent - 3);
+            break;
+        case MBUS_UNIT_CUBIC_METRE:
+            reading.unit = METER_UNIT_CUBIC_METRE;
+            break;
+        case MBUS_UNIT_WATT:
+            reading.unit = METER_UNIT_WATT;
+            break;
+        default:
+            reading.unit = METER_UNIT_NONE;
+            break;
+    }
+    return true;
+}
+
+// Years of two digits count from 1981, as the standard suggests
+static uint16_t full_year(uint8_t year, uint8_t century)
+{
+    if (0 != century) {
+        return (uint16_t)(1900 + 100 * century + year);
+    }
+    return (uint16_t)((year < 81) ? 2000 + year : 1900 + year);
+}
+
+bool mbus_record_date(const MbusRecord &record, MbusDateTime &date)
+{
+    const uint8_t *d = record.data;
+
+    if (MBUS_CODING_INTEGER != record.coding) {
+        return false;
+    }
+    memset(&date, 0, sizeof(date));
+    date.valid = true;
+
+    switch (record.length) {
+        case 2:     // type G, date
+            date.day = d[0] & 0x1F;
+            date.month = d[1] & 0x0F;
+            date.year = full_year((uint8_t)(((d[0] & 0xE0) >> 5) | ((d[1] & 0xF0) >> 1)), 0);
+            date.valid = (1 <= date.month) && (date.month <= 12) && (1 <= date.day);
+            return true;
+        case 3:     // type J, time of day
+            date.second = d[0] & 0x3F;
+            date.minute = d[1] & 0x3F;
+            date.hour = d[2] & 0x1F;
+            return true;
+        case 4:     // type F, date and time to the minute
+            date.minute = d[0] & 0x3F;
+            date.valid = (0 == (d[0] & 0x80));
+            date.hour = d[1] & 0x1F;
+            date.summer_time = (0 != (d[1] & 0x80));
+            date.day = d[2] & 0x1F;
+            date.month = d[3] & 0x0F;
+            date.year = full_year((uint8_t)(((d[2] & 0xE0) >> 5) | ((d[3] & 0xF0) >> 1)), (d[1] >> 5) & 0x03);
+            return true;
+        case 6:     // type I, date and time to the second
+            date.second = d[0] & 0x3F;
+            date.minute = d[1] & 0x3F;
+            date.valid = (0 == (d[1] & 0x40));
+            date.summer_time = (0 != (d[1] & 0x80));
+            date.hour = d[2] & 0x1F;
+            date.day = d[3] & 0x1F;
+            date.month = d[4] & 0x0F;
+            date.year = full_year((uint8_t)(((d[3] & 0xE0) >> 5) | ((d[4] & 0xF0) >> 1)), 0);
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t mbus_record_text(const MbusRecord &record, char *text, size_t size)
+{
+    if ((MBUS_CODING_TEXT != record.coding) || (size <= record.length)) {
+        return 0;
+    }
+    for (size_t i = 0; i < record.length; i++) {
+        text[i] = (char)record.data[record.length - 1 - i];
+    }
+    text[record.length] = '\0';
+    return record.length;
+}
+
+void mbus_manufacturer_code(uint16_t manufacturer, char *code)
+{
+    code[0] = (char)('@' + ((manufacturer >> 10) & 0x1F));
+    code[1] = (char)('@' + ((manufacturer >> 5) & 0x1F));
+    code[2] = (char)('@' + (manufacturer & 0x1F));
+    code[3] = '\0';
+}
+
+const char *mbus_quantity_name(uint8_t quantity)
+{
+    static const char *const names[] = {
+        "unknown", "plain text", "any", "energy", "volume", "mass", "on time", "operating time", "power",
+        "volume flow", "mass flow", "flow temperature", "return temperature", "temperature difference",
+        "external temperature", "pressure", "date", "date and time", "HCA units", "averaging duration",
+        "actuality duration", "fabrication number", "enhanced id", "bus address", "temperature limit",
+        "max power count", "credit", "debit", "access number", "medium", "manufacturer", "parameter set",
+        "model version", "hardware version", "firmware version", "software version", "customer location",
+        "customer", "access code", "password", "error flags", "error mask", "digital output", "digital input",
+        "baud rate", "response delay", "retry", "first storage", "last storage", "storage block size",
+        "storage interval", "since last readout", "tariff start", "tariff duration", "tariff period",
+        "dimensionless", "voltage", "current", "reset counter", "cumulation counter", "control signal",
+        "day of week", "week number", "day change", "parameter activation", "supplier information",
+        "since last cumulation", "battery operating time", "battery change"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == MBUS_QUANTITY_COUNT, "a quantity has no name");
+
+    return (quantity < MBUS_QUANTITY_COUNT) ? names[quantity] : "unknown";
+}
+
+const char *mbus_unit_name(uint8_t unit)
+{
+    static const char *const names[] = {
+        "", "Wh", "J", "m3", "kg", "s", "min", "h", "d", "month", "year", "W", "J/h", "m3/h", "m3/min", "m3/s",
+        "kg/h", "C", "K", "F", "bar", "ft3", "gal", "gal/min", "gal/h", "V", "A", "currency", "Bd", "bit times"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == MBUS_UNIT_COUNT, "a unit has no name");
+
+    return (unit < MBUS_UNIT_COUNT) ? names[unit] : "";
+}
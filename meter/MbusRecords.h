@@ -0,0 +1,318 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef MBUS_RECORDS_H
+#define MBUS_RECORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+// Application layer of an M-Bus long frame, EN 13757-3
+#define MBUS_CI_RESPONSE_LONG_HEADER    0x72    // 12 byte header, then records
+#define MBUS_CI_RESPONSE_NO_HEADER      0x78
+#define MBUS_CI_RESPONSE_SHORT_HEADER   0x7A    // 4 byte header
+
+#define MBUS_LONG_FRAME_USER_DATA       7       // offset of the first byte after CI
+#define MBUS_LONG_HEADER_LENGTH         12
+#define MBUS_SHORT_HEADER_LENGTH        4
+
+// Extension bytes a record may have, as the standard allows
+#define MBUS_MAX_DIFE                   10
+#define MBUS_MAX_VIFE                   10
+
+/** Function field of the DIF. */
+enum MbusFunction {
+    MBUS_FUNCTION_INSTANTANEOUS = 0,
+    MBUS_FUNCTION_MAXIMUM,
+    MBUS_FUNCTION_MINIMUM,
+    MBUS_FUNCTION_ERROR         // value during error state
+};
+
+/** How the data of a record is coded. */
+enum MbusCoding {
+    MBUS_CODING_NONE = 0,       // no data, or selection for readout
+    MBUS_CODING_INTEGER,        // type B, signed, least significant byte first
+    MBUS_CODING_BCD,            // type A, least significant byte first, F in the top digit for negative
+    MBUS_CODING_NEGATIVE_BCD,   // variable length BCD with a minus sign
+    MBUS_CODING_REAL,           // type H, IEEE 754 single
+    MBUS_CODING_TEXT,           // variable length ASCII, last character first
+    MBUS_CODING_MANUFACTURER    // manufacturer data up to the end of the telegram
+};
+
+/** What a record measures, from its VIF or the first VIFE of an extension table. */
+enum MbusQuantity {
+    MBUS_QUANTITY_UNKNOWN = 0,  // reserved or manufacturer specific VIF
+    MBUS_QUANTITY_PLAIN_TEXT,   // unit given as text, see MbusRecord::unit_text
+    MBUS_QUANTITY_ANY,          // any VIF, readout selection
+    MBUS_QUANTITY_ENERGY,
+    MBUS_QUANTITY_VOLUME,
+    MBUS_QUANTITY_MASS,
+    MBUS_QUANTITY_ON_TIME,
+    MBUS_QUANTITY_OPERATING_TIME,
+    MBUS_QUANTITY_POWER,
+    MBUS_QUANTITY_VOLUME_FLOW,
+    MBUS_QUANTITY_MASS_FLOW,
+    MBUS_QUANTITY_FLOW_TEMPERATURE,
+    MBUS_QUANTITY_RETURN_TEMPERATURE,
+    MBUS_QUANTITY_TEMPERATURE_DIFFERENCE,
+    MBUS_QUANTITY_EXTERNAL_TEMPERATURE,
+    MBUS_QUANTITY_PRESSURE,
+    MBUS_QUANTITY_DATE,         // type G
+    MBUS_QUANTITY_DATE_TIME,    // type F, I or J by the data length
+    MBUS_QUANTITY_HCA_UNITS,    // heat cost allocator
+    MBUS_QUANTITY_AVERAGING_DURATION,
+    MBUS_QUANTITY_ACTUALITY_DURATION,
+    MBUS_QUANTITY_FABRICATION_NUMBER,
+    MBUS_QUANTITY_ENHANCED_ID,
+    MBUS_QUANTITY_BUS_ADDRESS,
+    MBUS_QUANTITY_TEMPERATURE_LIMIT,
+    MBUS_QUANTITY_MAX_POWER_COUNT,  // cumulative count of maximum power
+    MBUS_QUANTITY_CREDIT,
+    MBUS_QUANTITY_DEBIT,
+    MBUS_QUANTITY_ACCESS_NUMBER,
+    MBUS_QUANTITY_MEDIUM,
+    MBUS_QUANTITY_MANUFACTURER,
+    MBUS_QUANTITY_PARAMETER_SET,
+    MBUS_QUANTITY_MODEL_VERSION,
+    MBUS_QUANTITY_HARDWARE_VERSION,
+    MBUS_QUANTITY_FIRMWARE_VERSION,
+    MBUS_QUANTITY_SOFTWARE_VERSION,
+    MBUS_QUANTITY_CUSTOMER_LOCATION,
+    MBUS_QUANTITY_CUSTOMER,
+    MBUS_QUANTITY_ACCESS_CODE,
+    MBUS_QUANTITY_PASSWORD,
+    MBUS_QUANTITY_ERROR_FLAGS,
+    MBUS_QUANTITY_ERROR_MASK,
+    MBUS_QUANTITY_DIGITAL_OUTPUT,
+    MBUS_QUANTITY_DIGITAL_INPUT,
+    MBUS_QUANTITY_BAUD_RATE,
+    MBUS_QUANTITY_RESPONSE_DELAY,
+    MBUS_QUANTITY_RETRY,
+    MBUS_QUANTITY_FIRST_STORAGE,
+    MBUS_QUANTITY_LAST_STORAGE,
+    MBUS_QUANTITY_STORAGE_BLOCK_SIZE,
+    MBUS_QUANTITY_STORAGE_INTERVAL,
+    MBUS_QUANTITY_SINCE_LAST_READOUT,
+    MBUS_QUANTITY_TARIFF_START,
+    MBUS_QUANTITY_TARIFF_DURATION,
+    MBUS_QUANTITY_TARIFF_PERIOD,
+    MBUS_QUANTITY_DIMENSIONLESS,
+    MBUS_QUANTITY_VOLTAGE,
+    MBUS_QUANTITY_CURRENT,
+    MBUS_QUANTITY_RESET_COUNTER,
+    MBUS_QUANTITY_CUMULATION_COUNTER,
+    MBUS_QUANTITY_CONTROL_SIGNAL,
+    MBUS_QUANTITY_DAY_OF_WEEK,
+    MBUS_QUANTITY_WEEK_NUMBER,
+    MBUS_QUANTITY_DAY_CHANGE,
+    MBUS_QUANTITY_PARAMETER_ACTIVATION,
+    MBUS_QUANTITY_SUPPLIER_INFORMATION,
+    MBUS_QUANTITY_SINCE_LAST_CUMULATION,
+    MBUS_QUANTITY_BATTERY_OPERATING_TIME,
+    MBUS_QUANTITY_BATTERY_CHANGE,
+    MBUS_QUANTITY_COUNT
+};
+
+/** Unit of a record. Multiples such as MWh or t are folded into the exponent. */
+enum MbusUnit {
+    MBUS_UNIT_NONE = 0,
+    MBUS_UNIT_WATT_HOUR,
+    MBUS_UNIT_JOULE,
+    MBUS_UNIT_CUBIC_METRE,
+    MBUS_UNIT_KILOGRAM,
+    MBUS_UNIT_SECOND,
+    MBUS_UNIT_MINUTE,
+    MBUS_UNIT_HOUR,
+    MBUS_UNIT_DAY,
+    MBUS_UNIT_MONTH,
+    MBUS_UNIT_YEAR,
+    MBUS_UNIT_WATT,
+    MBUS_UNIT_JOULE_PER_HOUR,
+    MBUS_UNIT_CUBIC_METRE_PER_HOUR,
+    MBUS_UNIT_CUBIC_METRE_PER_MINUTE,
+    MBUS_UNIT_CUBIC_METRE_PER_SECOND,
+    MBUS_UNIT_KILOGRAM_PER_HOUR,
+    MBUS_UNIT_CELSIUS,
+    MBUS_UNIT_KELVIN,
+    MBUS_UNIT_FAHRENHEIT,
+    MBUS_UNIT_BAR,
+    MBUS_UNIT_CUBIC_FEET,
+    MBUS_UNIT_US_GALLON,
+    MBUS_UNIT_US_GALLON_PER_MINUTE,
+    MBUS_UNIT_US_GALLON_PER_HOUR,
+    MBUS_UNIT_VOLT,
+    MBUS_UNIT_AMPERE,
+    MBUS_UNIT_CURRENCY,         // of the local legal currency
+    MBUS_UNIT_BAUD,
+    MBUS_UNIT_BIT_TIMES,
+    MBUS_UNIT_COUNT
+};
+
+/** Parse errors of MbusRecordIterator. */
+enum MbusRecordError {
+    MBUS_RECORD_OK = 0,
+    MBUS_RECORD_NOT_LONG_FRAME,     // too short or not 0x68 L L 0x68
+    MBUS_RECORD_UNKNOWN_CI,         // not a variable data response this decoder knows
+    MBUS_RECORD_TRUNCATED,          // a record runs past the end of the user data
+    MBUS_RECORD_TOO_MANY_DIFE,
+    MBUS_RECORD_TOO_MANY_VIFE,
+    MBUS_RECORD_RESERVED_DIF,
+    MBUS_RECORD_RESERVED_LVAR       // variable length coding this decoder does not know
+};
+
+/** Header of a variable data response; fields absent from the CI's header are 0. */
+struct MbusHeader {
+    uint8_t ci;
+    uint32_t id;                // identification number, BCD as sent
+    uint16_t manufacturer;      // three letters, see mbus_manufacturer_code()
+    uint8_t version;
+    uint8_t medium;
+    uint8_t access;             // access number
+    uint8_t status;
+    uint16_t signature;
+};
+
+/**
+ * One data record. All pointers point into the frame given to the
+ * iterator and are only valid as long as the frame is.
+ */
+struct MbusRecord {
+    const uint8_t *dif;         // first byte of the record
+    const uint8_t *data;        // value bytes as sent, after a variable length byte
+    uint8_t length;             // number of bytes at @p data
+    uint8_t coding;             // MbusCoding
+    uint8_t function;           // MbusFunction
+    uint16_t subunit;           // device unit
+    uint32_t tariff;
+    uint64_t storage;           // storage number, 0 for the current value
+    uint8_t vif;                // VIF, or the byte after an 0xFB or 0xFD VIF, without extension bit
+    uint8_t vif_table;          // 0, 0xFB, 0xFD, 0xEF, 0x7C for plain text or 0x7F for manufacturer
+    const uint8_t *vife;        // combinable VIFEs that follow the (true) VIF
+    uint8_t vife_count;
+    const uint8_t *unit_text;   // plain text unit, last character first; NULL for none
+    uint8_t unit_text_length;
+    uint8_t quantity;           // MbusQuantity
+    uint8_t unit;               // MbusUnit
+    int8_t exponent;            // value * 10^exponent unit, with VIFE correction factors
+    uint8_t error;              // record error code of a VIFE 0x00-0x1F, 0 for none
+};
+
+/** Date and time of a record of type F, G, I or J; fields not sent are 0. */
+struct MbusDateTime {
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    bool valid;                 // the IV flag is clear
+    bool summer_time;
+};
+
+/**
+ * Walks the data records of an M-Bus variable data response (EN 13757-3):
+ * DIF and up to 10 DIFEs, VIF and up to 10 VIFEs, then the data, record
+ * after record. The iterator only keeps a position in the caller's frame;
+ * nothing is copied or allocated, so it can run on a port thread against
+ * the frame the decoder hands over.
+ *
+ * Every record is described by MbusRecord: its storage number, tariff and
+ * subunit, what it measures, the unit and the decimal exponent, including
+ * the 0xFB and 0xFD extension tables and VIFE correction factors. The
+ * value itself is decoded on demand with mbus_record_value(),
+ * mbus_record_date() or mbus_record_text().
+ *
+ * Idle fillers (DIF 0x2F) are skipped. Manufacturer specific data (DIF
+ * 0x0F or 0x1F) ends the records and is returned as one last record.
+ * Only CI 0x72, 0x78 and 0x7A are known; byte order is always least
+ * significant first.
+ */
+class MbusRecordIterator {
+public:
+    /**
+     * @param frame Complete long frame, 0x68 L L 0x68 C A CI ... CS 0x16
+     * @param length Number of bytes in @p frame
+     */
+    MbusRecordIterator(const uint8_t *frame, size_t length);
+
+    /** Header fields of the response, valid if error() was not set by the constructor. */
+    const MbusHeader &header() const
+    {
+        return _header;
+    }
+
+    /**
+     * Parse the next record.
+     * @return false at the end of the records or on an error
+     */
+    bool next(MbusRecord &record);
+
+    /** Why next() returned false, MBUS_RECORD_OK at the regular end. */
+    uint8_t error() const
+    {
+        return _error;
+    }
+
+    /** The meter signalled more records in the next telegram (DIF 0x1F). */
+    bool more_follows() const
+    {
+        return _more_follows;
+    }
+
+private:
+    bool fail(uint8_t error);
+    void describe(MbusRecord &record) const;
+
+    const uint8_t *_p;          // next byte to parse
+    const uint8_t *_end;        // first byte after the user data
+    MbusHeader _header;
+    uint8_t _error;
+    bool _more_follows;
+};
+
+/**
+ * Value of a numeric record in fixed point, with the record's exponent.
+ * Reals keep 7 significant digits. The MeterUnit is set for the units the
+ * gateway reports (energy as kWh, volume, power), METER_UNIT_NONE otherwise.
+ * @return false for dates, text, no data or digits that are not BCD
+ */
+bool mbus_record_value(const MbusRecord &record, MeterReading &reading);
+
+/**
+ * Date or time in the data of a record, for DATE and DATE_TIME records or
+ * those with a time point VIFE. The type follows from the data length.
+ * @return false if the data is not an integer of type G (2 bytes), J (3), F (4) or I (6)
+ */
+bool mbus_record_date(const MbusRecord &record, MbusDateTime &date);
+
+/**
+ * Text of a variable length ASCII record in reading order.
+ * @param size Size of @p text including the terminator
+ * @return Length of the text, 0 if it is not text or did not fit
+ */
+size_t mbus_record_text(const MbusRecord &record, char *text, size_t size);
+
+/** Three letters of a manufacturer field, e.g. "KAM". @p code must hold 4 bytes. */
+void mbus_manufacturer_code(uint16_t manufacturer, char *code);
+
+/** Short name of an MbusQuantity, e.g. "volume". */
+const char *mbus_quantity_name(uint8_t quantity);
+
+/** Short name of an MbusUnit, e.g. "m3". */
+const char *mbus_unit_name(uint8_t unit);
+
+#endif /* MBUS_RECORDS_H */
@@ -0,0 +1,138 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "MeterHealth.h"
+
+// Upper bucket edges in ms, the last bucket takes everything above
+static const uint16_t latencyEdges[LATENCY_BUCKETS - 1] = {
+    25, 50, 75, 100, 150, 200, 300, 400, 600, 800, 1200, 1600, 2400, 3200, 5000
+};
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::clear()
+{
+    memset(_counts, 0, sizeof(_counts));
+    _samples = 0;
+}
+
+void LatencyHistogram::add(uint32_t ms)
+{
+    size_t bucket = 0;
+    while ((bucket < LATENCY_BUCKETS - 1) && (ms > latencyEdges[bucket])) {
+        bucket++;
+    }
+
+    if (LATENCY_HISTORY <= _samples) {
+        _samples = 0;
+        for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+            _counts[i] /= 2;
+            _samples += _counts[i];
+        }
+    }
+
+    _counts[bucket]++;
+    _samples++;
+}
+
+uint32_t LatencyHistogram::edge(size_t bucket)
+{
+    return (bucket < LATENCY_BUCKETS - 1) ? latencyEdges[bucket] : UINT32_MAX;
+}
+
+uint32_t LatencyHistogram::percentile(uint16_t permille) const
+{
+    if (0 == _samples) {
+        return 0;
+    }
+
+    // Smallest bucket with at least that many samples at or below it
+    uint32_t rank = ((uint32_t)_samples * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += _counts[i];
+        if ((0 < seen) && (seen >= rank)) {
+            return edge(i);
+        }
+    }
+    return UINT32_MAX;
+}
+
+MeterHealth::MeterHealth()
+    : _policy(NULL), _initial_timeout_ms(0), _max_timeout_ms(0), _failures(0), _retry(0)
+{
+}
+
+void MeterHealth::configure(const MeterHealthPolicy *policy, uint32_t initialTimeoutMs, uint32_t maxTimeoutMs)
+{
+    _policy = policy;
+    _initial_timeout_ms = initialTimeoutMs;
+    _max_timeout_ms = maxTimeoutMs;
+}
+
+uint32_t MeterHealth::timeout_ms() const
+{
+    if ((NULL == _policy) || (METER_HEALTH_MIN_SAMPLES > _latency.samples())) {
+        return _initial_timeout_ms;
+    }
+
+    uint32_t p99 = _latency.percentile(990);
+    uint32_t timeout = (p99 < _max_timeout_ms / _policy->timeout_factor) ? p99 * _policy->timeout_factor : _max_timeout_ms;
+    return (timeout < _policy->min_timeout_ms) ? _policy->min_timeout_ms : timeout;
+}
+
+void MeterHealth::on_response(uint32_t latencyMs)
+{
+    _latency.add(latencyMs);
+    _failures = 0;
+    _retry = 0;
+}
+
+uint32_t MeterHealth::on_failure()
+{
+    if (UINT16_MAX > _failures) {
+        _failures++;
+    }
+
+    if ((NULL == _policy) || (METER_ONLINE != state()) || (_retry >= _policy->retries)) {
+        _retry = 0;
+        return 0;
+    }
+
+    return _policy->backoff_ms << _retry++;
+}
+
+MeterState MeterHealth::state() const
+{
+    if ((NULL == _policy) || (_failures < _policy->degraded_after)) {
+        return METER_ONLINE;
+    }
+    return (_failures < _policy->offline_after) ? METER_DEGRADED : METER_OFFLINE;
+}
+
+const char *meter_state_name(MeterState state)
+{
+    switch (state) {
+        case METER_ONLINE:      return "online";
+        case METER_DEGRADED:    return "degraded";
+        case METER_OFFLINE:     return "offline";
+        default:                return "?";
+    }
+}
@@ -0,0 +1,159 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef METER_HEALTH_H
+#define METER_HEALTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LATENCY_BUCKETS             16
+
+// Samples kept at full weight: beyond that, older ones fade out by halving
+#define LATENCY_HISTORY             1024
+
+// Samples needed before the timeout follows the measured latency
+#define METER_HEALTH_MIN_SAMPLES    8
+
+/**
+ * Response times in fixed buckets, 2 bytes per bucket.
+ *
+ * The bucket edges are roughly logarithmic from 25 ms to 5 s, so one
+ * layout fits a 9600 baud meter answering in 30 ms as well as a slow
+ * 1200 baud one. Whenever LATENCY_HISTORY samples have been counted, all
+ * counts are halved, so the histogram follows a meter that changes.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void clear();
+
+    void add(uint32_t ms);
+
+    /** Samples currently counted. */
+    uint32_t samples() const
+    {
+        return _samples;
+    }
+
+    uint16_t count(size_t bucket) const
+    {
+        return (bucket < LATENCY_BUCKETS) ? _counts[bucket] : 0;
+    }
+
+    /** Upper edge of a bucket in ms; UINT32_MAX for the last one. */
+    static uint32_t edge(size_t bucket);
+
+    /**
+     * Upper edge of the bucket holding the given share of the samples.
+     * @param permille 500 for the median, 990 for the 99th percentile
+     * @return 0 if there are no samples
+     */
+    uint32_t percentile(uint16_t permille) const;
+
+private:
+    uint16_t _counts[LATENCY_BUCKETS];
+    uint16_t _samples;
+};
+
+typedef enum {
+    METER_ONLINE = 0,
+    METER_DEGRADED,     // failing: one request per poll, no retries
+    METER_OFFLINE       // dead: only probed now and then
+} MeterState;
+
+/** How failures of a meter are handled; the same for all meters. */
+struct MeterHealthPolicy {
+    uint32_t min_timeout_ms;        // floor of the adaptive timeout
+    uint8_t timeout_factor;         // timeout = 99th percentile x factor
+    uint8_t retries;                // extra requests per poll while online
+    uint32_t backoff_ms;            // first retry delay, doubled per retry
+    uint8_t degraded_after;         // consecutive failures
+    uint8_t offline_after;          // consecutive failures
+    uint32_t probe_interval_ms;     // time between polls of an offline meter
+};
+
+// Defaults of MeterHealthPolicy
+#define METER_HEALTH_MIN_TIMEOUT_MS     100
+#define METER_HEALTH_TIMEOUT_FACTOR     2
+#define METER_HEALTH_RETRIES            2
+#define METER_HEALTH_BACKOFF_MS         500
+#define METER_HEALTH_DEGRADED_AFTER     3
+#define METER_HEALTH_OFFLINE_AFTER      6
+#define METER_HEALTH_PROBE_INTERVAL_MS  (15 * 60 * 1000)
+
+/**
+ * Response time and failure record of one meter.
+ *
+ * The response timeout follows the meter's own latency: the 99th
+ * percentile of its histogram times the policy factor, between the policy
+ * floor and the meter's maximum. Until enough samples are in, the
+ * configured initial timeout applies.
+ *
+ * A failed request is retried with exponential backoff while the meter is
+ * online. After degraded_after failures in a row the meter gets no more
+ * retries, after offline_after it is only probed every probe_interval_ms.
+ * The first answer brings it back online.
+ */
+class MeterHealth {
+public:
+    MeterHealth();
+
+    /**
+     * @param policy Shared policy, must outlive this object
+     * @param initialTimeoutMs Timeout until the latency is known
+     * @param maxTimeoutMs Ceiling of the adaptive timeout
+     */
+    void configure(const MeterHealthPolicy *policy, uint32_t initialTimeoutMs, uint32_t maxTimeoutMs);
+
+    /** Time the meter gets to answer its next request. */
+    uint32_t timeout_ms() const;
+
+    void on_response(uint32_t latencyMs);
+
+    /**
+     * Record a failed request.
+     * @return Milliseconds until the retry, 0 if there is none
+     */
+    uint32_t on_failure();
+
+    MeterState state() const;
+
+    /** Failures since the last answer. */
+    uint16_t failures() const
+    {
+        return _failures;
+    }
+
+    const LatencyHistogram &latency() const
+    {
+        return _latency;
+    }
+
+private:
+    const MeterHealthPolicy *_policy;
+    uint32_t _initial_timeout_ms;
+    uint32_t _max_timeout_ms;
+
+    LatencyHistogram _latency;
+    uint16_t _failures;
+    uint8_t _retry;             // retries used by the current poll
+};
+
+/** Printable name of a meter state. */
+const char *meter_state_name(MeterState state);
+
+#endif /* METER_HEALTH_H */
@@ -0,0 +1,97 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef METER_PROTOCOL_H
+#define METER_PROTOCOL_H
+
+/*
+ * Wire constants of the meter buses handled by the gateway.
+ *
+ * This header (and everything else under meter/) must not depend on Mbed OS,
+ * so the protocol code can be built and measured on a plain Linux host.
+ */
+
+enum
+{
+   PSTEC_REQUEST_STX                                                     = 0xC0,
+   PSTEC_REQUEST_ETX                                                     = 0xD0,
+   PSTEC_RESPONSE_STX                                                    = PSTEC_REQUEST_STX,
+   PSTEC_RESPONSE_ETX                                                    = PSTEC_REQUEST_ETX,
+//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_WATER                              = 0x02,
+//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HOT_WATER                          = 0x03,
+//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_GAS                                = 0x04,
+//@   PSTEC_NORMAL_ACCUM_ONLY_METER_TYPE_HEAT                               = 0x05,
+   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_WATER                          = 0xF2,
+   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HOT_WATER                      = 0xF3,
+   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_GAS                            = 0xF4,
+   PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT                           = 0xF5,
+   PSTEC_MAGIC_CODE_1ST_BYTE                                             = 0x22,
+   PSTEC_MAGIC_CODE_2ND_BYTE                                             = 0x69,
+   PSTEC_MAGIC_CODE_3RD_BYTE                                             = 0x6E,
+   PSTEC_MAGIC_CODE_4TH_BYTE                                             = 0x73,
+   PSTEC_REQUEST_PACKET_LENGTH                                           = 0x04,  // 4 bytes
+//@   PSTEC_RESPONSE_PACKET_LENGTH_NORMAL_ACCUM                             = 0x0B,  // 11 bytes
+   PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT                    = 0x0E,  // 14 bytes
+//@   PSTEC_RESPONSE_PACKET_APDU_LENGTH_NORMAL_ACCUM                        = 0x03,  //  3 bytes
+   PSTEC_RESPONSE_PACKET_APDU_LENGTH_PRECISE_ACCUM_INSTANT               = 0x0A,  // 10 bytes
+
+   SEOUL_REQUEST_STX           = 0x10,
+   SEOUL_REQUEST_ETX           = 0x16,
+   SEOUL_RESPONSE_STX          = 0x68,
+   SEOUL_RESPONSE_ETX          = SEOUL_REQUEST_ETX,
+   SEOUL_REQUEST_PACKET_LENGTH = 0x05, // 4 bytes
+
+   // 0x68 L L 0x68 + L bytes (C, A, CI, user data) + checksum + 0x16
+   SEOUL_RESPONSE_HEADER_LENGTH = 4,
+   SEOUL_RESPONSE_MIN_L_FIELD   = 3,     // C, A and CI fields
+   SEOUL_RESPONSE_MAX_L_FIELD   = 0xFF,
+   SEOUL_RESPONSE_MAX_LENGTH    = SEOUL_RESPONSE_HEADER_LENGTH + SEOUL_RESPONSE_MAX_L_FIELD + 2,
+
+   // Modbus RTU
+   MODBUS_READ_HOLDING_REGISTERS = 0x03,
+   MODBUS_READ_INPUT_REGISTERS   = 0x04,
+   MODBUS_WRITE_SINGLE_COIL      = 0x05,
+   MODBUS_WRITE_SINGLE_REGISTER  = 0x06,
+   MODBUS_WRITE_MULTIPLE_COILS   = 0x0F,
+   MODBUS_WRITE_MULTIPLE_REGISTERS = 0x10,
+   MODBUS_EXCEPTION              = 0x80,  // set in the function code of an error response
+   MODBUS_READ_REQUEST_LENGTH    = 8,     // slave, function, register, count, CRC
+   MODBUS_WRITE_RESPONSE_LENGTH  = 8,     // slave, function, register, value or count, CRC
+   MODBUS_EXCEPTION_LENGTH       = 5,     // slave, function | 0x80, code, CRC
+   MODBUS_READ_RESPONSE_OVERHEAD = 5,     // slave, function, byte count, CRC
+   MODBUS_MAX_READ_REGISTERS     = 125,
+   MODBUS_MAX_FRAME_LENGTH       = 256,
+   MODBUS_FLOAT_REGISTERS        = 2      // IEEE 754 float, high word first
+};
+
+enum
+{
+   OTHER_DEVICE      = 0x00,
+
+   ELECTRICITY_METER = 0x02,
+   GAS_METER         = 0x03,
+   HEAT_METER        = 0x04,
+   STEAM_METER       = 0x05,
+   WARM_WATER_METER  = 0x06,
+   WATER_METER       = 0x07,
+   HOT_WATER_METER   = 0x15,
+   COLD_WATER_METER  = 0x16,
+   UNKNOWN_DEVICE    = 0x0F,
+
+   LED_LIGHTING      = 0x40,
+   LINK_TEST         = 0xFF
+};
+
+#endif /* METER_PROTOCOL_H */
@@ -0,0 +1,155 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "MeterReading.h"
+
+size_t meter_reading_format(const MeterReading &reading, char *text, size_t size)
+{
+    // Digits are written backwards, least significant first
+    char digits[METER_READING_TEXT_SIZE];
+    size_t count = 0;
+    uint64_t magnitude = (reading.value < 0) ? (0 - (uint64_t)reading.value) : (uint64_t)reading.value;
+    int fraction = (reading.exponent < 0) ? -reading.exponent : 0;
+
+    for (int i = 0; i < reading.exponent; i++) {
+        if (sizeof(digits) <= count) {
+            return 0;
+        }
+        digits[count++] = '0';
+    }
+    do {
+        if (sizeof(digits) <= count) {
+            return 0;
+        }
+        digits[count++] = (char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while ((0 < magnitude) || ((int)count <= fraction));
+
+    size_t length = count + ((0 < fraction) ? 1 : 0) + ((reading.value < 0) ? 1 : 0);
+    if (size <= length) {
+        return 0;
+    }
+
+    char *p = text;
+    if (reading.value < 0) {
+        *p++ = '-';
+    }
+    while (0 < count) {
+        if ((int)count == fraction) {
+            *p++ = '.';
+        }
+        *p++ = digits[--count];
+    }
+    *p = '\0';
+
+    return length;
+}
+
+const char *meter_unit_name(uint8_t unit)
+{
+    switch (unit) {
+        case METER_UNIT_CUBIC_METRE:    return "m3";
+        case METER_UNIT_KILOWATT_HOUR:  return "kWh";
+        case METER_UNIT_WATT:           return "W";
+        default:                        return "";
+    }
+}
+
+bool meter_reading_parse(const char *text, MeterReading &reading)
+{
+    const char *p = text;
+    bool negative = ('-' == *p);
+    bool point = false;
+    int digits = 0;
+    int64_t value = 0;
+    int exponent = 0;
+
+    if (negative || ('+' == *p)) {
+        p++;
+    }
+    for (; '\0' != *p; p++) {
+        if (('.' == *p) && !point) {
+            point = true;
+        }
+        else if (('0' <= *p) && (*p <= '9')) {
+            // 18 digits always fit
+            if (18 < ++digits) {
+                return false;
+            }
+            value = value * 10 + (*p - '0');
+            exponent -= point ? 1 : 0;
+        }
+        else {
+            return false;
+        }
+    }
+    if (0 == digits) {
+        return false;
+    }
+
+    reading.value = negative ? -value : value;
+    reading.exponent = (int8_t)exponent;
+    reading.unit = METER_UNIT_NONE;
+    return true;
+}
+
+// value * 10^shift, false on overflow
+static bool scale_up(int64_t value, int shift, int64_t &result)
+{
+    const int64_t limit = INT64_MAX / 10;
+
+    for (; 0 < shift; shift--) {
+        if ((value > limit) || (value < -limit)) {
+            return false;
+        }
+        value *= 10;
+    }
+    result = value;
+    return true;
+}
+
+int meter_reading_compare(const MeterReading &a, const MeterReading &b)
+{
+    int64_t va = a.value;
+    int64_t vb = b.value;
+
+    // Bring both to the smaller exponent; one that overflows is the larger magnitude
+    if ((a.exponent > b.exponent) && !scale_up(a.value, a.exponent - b.exponent, va)) {
+        return (a.value < 0) ? -1 : 1;
+    }
+    if ((b.exponent > a.exponent) && !scale_up(b.value, b.exponent - a.exponent, vb)) {
+        return (b.value < 0) ? 1 : -1;
+    }
+    return (va < vb) ? -1 : ((va > vb) ? 1 : 0);
+}
+
+bool meter_reading_subtract(const MeterReading &a, const MeterReading &b, MeterReading &result)
+{
+    int8_t exponent = (a.exponent < b.exponent) ? a.exponent : b.exponent;
+    int64_t va;
+    int64_t vb;
+
+    if (!scale_up(a.value, a.exponent - exponent, va) || !scale_up(b.value, b.exponent - exponent, vb)) {
+        return false;
+    }
+    if (((vb < 0) && (va > INT64_MAX + vb)) || ((vb > 0) && (va < INT64_MIN + vb))) {
+        return false;
+    }
+
+    result.value = va - vb;
+    result.exponent = exponent;
+    result.unit = a.unit;
+    return true;
+}
@@ -0,0 +1,72 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef METER_READING_H
+#define METER_READING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest text meter_reading_format() produces, with the terminator
+#define METER_READING_TEXT_SIZE 32
+
+enum MeterUnit {
+    METER_UNIT_NONE = 0,        // not known for this meter model
+    METER_UNIT_CUBIC_METRE,
+    METER_UNIT_KILOWATT_HOUR,
+    METER_UNIT_WATT
+};
+
+/**
+ * One meter value in fixed point: value * 10^exponent unit.
+ *
+ * Readings stay exact from the frame to the server. They are converted to
+ * text only when handed to LwM2M.
+ */
+struct MeterReading {
+    int64_t value;
+    int8_t exponent;
+    uint8_t unit;       // MeterUnit
+};
+
+/**
+ * Decimal text of a reading without the unit, e.g. "123456.7890".
+ * @param size Size of @p text, METER_READING_TEXT_SIZE is always enough
+ * @return Length of the text, 0 if it did not fit
+ */
+size_t meter_reading_format(const MeterReading &reading, char *text, size_t size);
+
+/**
+ * Parse decimal text such as "12.5" or "-0.001" into a reading without unit.
+ * @return false if the text is not a decimal number or has too many digits
+ */
+bool meter_reading_parse(const char *text, MeterReading &reading);
+
+/**
+ * Compare two readings by value, whatever their exponents.
+ * @return Negative, zero or positive as @p a is below, equal to or above @p b
+ */
+int meter_reading_compare(const MeterReading &a, const MeterReading &b);
+
+/**
+ * Difference a - b at the smaller of the two exponents.
+ * @return false if the result does not fit
+ */
+bool meter_reading_subtract(const MeterReading &a, const MeterReading &b, MeterReading &result);
+
+/** Short name of a MeterUnit, e.g. "m3". */
+const char *meter_unit_name(uint8_t unit);
+
+#endif /* METER_READING_H */
@@ -0,0 +1,290 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <math.h>
+#include <string.h>
+
+#include "ModbusMaster.h"
+#include "Crc16.h"
+
+// Largest decoded value kept, well inside int64_t and exact in a double
+#define MODBUS_MAX_DECODED_VALUE    1e15
+
+ModbusMaster::ModbusMaster(ModbusSendFn send, void *context, uint32_t guardMs)
+    : _send(send), _send_context(context), _guard_ms(guardMs), _point_count(0), _block_count(0),
+      _count(0), _block(0), _last_block(0), _started(false), _in_flight(false), _ok(false),
+      _request_ms(0), _last_activity_ms(0)
+{
+    memset(_points, 0, sizeof(_points));
+    memset(_blocks, 0, sizeof(_blocks));
+    memset(_registers, 0, sizeof(_registers));
+    memset(_polls, 0, sizeof(_polls));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int ModbusMaster::add_point(uint8_t slave, uint8_t function, uint16_t reg, uint8_t count)
+{
+    if ((MODBUS_MAX_POINTS <= _point_count) || (0 < _block_count) || (0 == slave) || (247 < slave) ||
+        ((MODBUS_READ_HOLDING_REGISTERS != function) && (MODBUS_READ_INPUT_REGISTERS != function)) ||
+        (0 == count) || (MODBUS_MAX_BLOCK_REGISTERS < count) || (0x10000 < (uint32_t)reg + count)) {
+        return -1;
+    }
+
+    Point &point = _points[_point_count];
+    point.slave    = slave;
+    point.function = function;
+    point.reg      = reg;
+    point.count    = count;
+    point.block    = 0;
+    return (int)_point_count++;
+}
+
+size_t ModbusMaster::plan(uint16_t maxGap)
+{
+    uint8_t order[MODBUS_MAX_POINTS];
+
+    // Points by slave, function and register
+    for (size_t i = 0; i < _point_count; i++) {
+        size_t j = i;
+        for (; 0 < j; j--) {
+            const Point &a = _points[order[j - 1]];
+            const Point &b = _points[i];
+            if ((a.slave < b.slave) || ((a.slave == b.slave) && ((a.function < b.function) ||
+                ((a.function == b.function) && (a.reg <= b.reg))))) {
+                break;
+            }
+            order[j] = order[j - 1];
+        }
+        order[j] = (uint8_t)i;
+    }
+
+    _block_count = 0;
+    for (size_t i = 0; i < _point_count; i++) {
+        Point &point = _points[order[i]];
+        uint32_t end = (uint32_t)point.reg + point.count;
+        Block *block = (0 < _block_count) ? &_blocks[_block_count - 1] : NULL;
+
+        if ((NULL != block) && (block->slave == point.slave) && (block->function == point.function) &&
+            (point.reg <= (uint32_t)block->reg + block->count + maxGap) &&
+            (end - block->reg <= MODBUS_MAX_BLOCK_REGISTERS)) {
+            if (end > (uint32_t)block->reg + block->count) {
+                block->count = (uint8_t)(end - block->reg);
+            }
+        }
+        else {
+            if (MODBUS_MAX_BLOCKS <= _block_count) {
+                _block_count = 0;
+                return 0;
+            }
+            block = &_blocks[_block_count++];
+            block->slave    = point.slave;
+            block->function = point.function;
+            block->reg      = point.reg;
+            block->count    = point.count;
+            block->valid    = false;
+        }
+        point.block = (uint8_t)(_block_count - 1);
+    }
+
+    size_t cache = 0;
+    for (size_t i = 0; i < _block_count; i++) {
+        _blocks[i].cache = (uint16_t)cache;
+        cache += _blocks[i].count;
+    }
+    if (MODBUS_MAX_REGISTERS < cache) {
+        _block_count = 0;
+        return 0;
+    }
+
+    return _block_count;
+}
+
+bool ModbusMaster::submit(uint8_t slave, uint32_t timeoutMs, ModbusDoneFn done, void *context, uint32_t nowMs)
+{
+    bool known = false;
+    for (size_t i = 0; i < _block_count; i++) {
+        known |= (slave == _blocks[i].slave);
+    }
+    bool duplicate = false;
+    for (size_t i = 0; i < _count; i++) {
+        duplicate |= (slave == _polls[i].slave);
+    }
+
+    if (!known || duplicate || (MODBUS_MAX_POLLS <= _count) || (NULL == done)) {
+        _stats.rejected++;
+        return false;
+    }
+
+    ModbusPoll &poll = _polls[_count++];
+    poll.slave        = slave;
+    poll.submitted_ms = nowMs;
+    poll.sent_ms      = 0;
+    poll.timeout_ms   = timeoutMs;
+    poll.done         = done;
+    poll.context      = context;
+
+    _stats.polls++;
+    return true;
+}
+
+void ModbusMaster::send(uint32_t nowMs)
+{
+    ModbusPoll &poll = _polls[0];
+
+    if (!_started) {
+        // Blocks of a slave are next to each other, see plan()
+        _block = 0;
+        while (_blocks[_block].slave != poll.slave) {
+            _block++;
+        }
+        for (_last_block = _block; (_last_block < _block_count) && (_blocks[_last_block].slave == poll.slave); _last_block++) {
+            _blocks[_last_block].valid = false;
+        }
+        _started = true;
+        _ok = true;
+        poll.sent_ms = nowMs;
+    }
+
+    const Block &block = _blocks[_block];
+    uint8_t request[MODBUS_READ_REQUEST_LENGTH];
+    request[0] = block.slave;
+    request[1] = block.function;
+    request[2] = (uint8_t)(block.reg >> 8);
+    request[3] = (uint8_t)block.reg;
+    request[4] = 0;
+    request[5] = block.count;
+    uint16_t crc = crc16_modbus(request, 6);
+    request[6] = (uint8_t)crc;
+    request[7] = (uint8_t)(crc >> 8);
+
+    _in_flight = true;
+    _request_ms = nowMs;
+    _last_activity_ms = nowMs;
+    _stats.requests++;
+
+    _send(_send_context, request, sizeof(request));
+}
+
+void ModbusMaster::finish(bool ok)
+{
+    // Copy out first: the callback may submit the next poll
+    ModbusPoll poll = _polls[0];
+
+    memmove(&_polls[0], &_polls[1], (_count - 1) * sizeof(ModbusPoll));
+    _count--;
+    _started = false;
+    _in_flight = false;
+
+    poll.done(poll, ok);
+}
+
+void ModbusMaster::next_block(bool answered, uint32_t nowMs)
+{
+    _in_flight = false;
+    _ok &= answered;
+    _last_activity_ms = nowMs;
+
+    if (++_block >= _last_block) {
+        finish(_ok);
+    }
+}
+
+bool ModbusMaster::on_frame(const uint8_t *frame, size_t length, uint32_t nowMs)
+{
+    if (!_in_flight || (length < MODBUS_EXCEPTION_LENGTH) || (frame[0] != _blocks[_block].slave)) {
+        _stats.unmatched++;
+        return false;
+    }
+
+    Block &block = _blocks[_block];
+
+    if (((block.function | MODBUS_EXCEPTION) == frame[1]) && (MODBUS_EXCEPTION_LENGTH == length)) {
+        _stats.exceptions++;
+        next_block(false, nowMs);
+        return true;
+    }
+
+    if ((block.function != frame[1]) || (2 * block.count != frame[2]) ||
+        ((size_t)(MODBUS_READ_RESPONSE_OVERHEAD + 2 * block.count) != length)) {
+        _stats.unmatched++;
+        return false;
+    }
+
+    const uint8_t *data = frame + 3;
+    for (size_t i = 0; i < block.count; i++) {
+        _registers[block.cache + i] = (uint16_t)((data[2 * i] << 8) | data[2 * i + 1]);
+    }
+    block.valid = true;
+    _stats.responses++;
+
+    next_block(true, nowMs);
+    return true;
+}
+
+uint32_t ModbusMaster::run(uint32_t nowMs)
+{
+    if (_in_flight) {
+        uint32_t age = nowMs - _request_ms;
+        if (age < _polls[0].timeout_ms) {
+            // One request on the bus at a time
+            return _polls[0].timeout_ms - age;
+        }
+
+        // A slave that misses one request is not asked for its other blocks
+        _stats.timeouts++;
+        _last_activity_ms = nowMs;
+        finish(false);
+    }
+
+    if (0 == _count) {
+        return 0;
+    }
+
+    uint32_t quiet = nowMs - _last_activity_ms;
+    if (quiet < _guard_ms) {
+        return _guard_ms - quiet;
+    }
+
+    send(nowMs);
+    return _polls[0].timeout_ms;
+}
+
+const uint16_t *ModbusMaster::registers(int point) const
+{
+    if ((point < 0) || ((size_t)point >= _point_count) || (0 == _block_count)) {
+        return NULL;
+    }
+
+    const Point &p = _points[point];
+    const Block &block = _blocks[p.block];
+    return block.valid ? &_registers[block.cache + (p.reg - block.reg)] : NULL;
+}
+
+bool modbus_decode_float(const uint16_t *registers, int8_t exponent, uint8_t unit, MeterReading &reading)
+{
+    uint32_t bits = ((uint32_t)registers[0] << 16) | registers[1];
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+
+    double scaled = (double)value * pow(10.0, -exponent);
+    if (!(fabs(scaled) < MODBUS_MAX_DECODED_VALUE)) {
+        return false;   // also NaN and infinity
+    }
+
+    reading.value    = (int64_t)llround(scaled);
+    reading.exponent = exponent;
+    reading.unit     = unit;
+    return true;
+}
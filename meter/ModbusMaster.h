@@ -0,0 +1,209 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef MODBUS_MASTER_H
+#define MODBUS_MASTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterProtocol.h"
+#include "MeterReading.h"
+
+#define MODBUS_MAX_POINTS           32
+#define MODBUS_MAX_BLOCKS           16
+#define MODBUS_MAX_POLLS            8       // slaves waiting for their turn
+#define MODBUS_MAX_REGISTERS        256     // register cache of all blocks together
+
+// Registers per request at most. Well below the protocol limit of 125, so
+// a response fits in MODBUS_MAX_RESPONSE_LENGTH and one lost byte costs
+// little airtime.
+#define MODBUS_MAX_BLOCK_REGISTERS  32
+#define MODBUS_MAX_RESPONSE_LENGTH  (MODBUS_READ_RESPONSE_OVERHEAD + 2 * MODBUS_MAX_BLOCK_REGISTERS)
+
+struct ModbusPoll;
+
+/**
+ * End of a poll.
+ * @param poll The finished poll
+ * @param ok true if every block of the slave was read
+ */
+typedef void (*ModbusDoneFn)(const ModbusPoll &poll, bool ok);
+
+/**
+ * Puts a request frame on the bus.
+ * @param context User pointer given to the master constructor
+ */
+typedef void (*ModbusSendFn)(void *context, const uint8_t *data, size_t size);
+
+/** One read of all blocks of one slave. */
+struct ModbusPoll {
+    uint8_t slave;
+    uint32_t submitted_ms;
+    uint32_t sent_ms;       // first request of the poll
+    uint32_t timeout_ms;    // per request, from sending to the response
+    ModbusDoneFn done;
+    void *context;
+};
+
+/** Counters of the master. */
+struct ModbusStats {
+    uint32_t polls;
+    uint32_t rejected;      // queue full, slave already queued or nothing to read
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t exceptions;    // requests the slave refused
+    uint32_t timeouts;
+    uint32_t unmatched;     // frames that answer no open request
+};
+
+/**
+ * Modbus RTU master of one bus.
+ *
+ * The values wanted from the slaves are registered as points. plan()
+ * merges the points of a slave that lie close together into blocks, each
+ * read by one function 0x03 or 0x04 request: reading a few unused
+ * registers costs less airtime than another request, with its CRC,
+ * turnaround and two silences. A poll reads every block of one slave;
+ * polls of many slaves queue up and run one request at a time, and the
+ * next request goes out only after the line was quiet for the guard time,
+ * at least 3.5 characters.
+ *
+ * A block's registers stay readable through registers() until the next
+ * poll of its slave starts.
+ *
+ * Not thread safe: all calls must come from the same thread.
+ */
+class ModbusMaster {
+public:
+    /**
+     * @param send Writes a request frame to the bus
+     * @param context Passed back to @p send
+     * @param guardMs Quiet time between a response and the next request
+     */
+    ModbusMaster(ModbusSendFn send, void *context, uint32_t guardMs);
+
+    /**
+     * Register a value to read. Only before plan().
+     * @param function MODBUS_READ_HOLDING_REGISTERS or MODBUS_READ_INPUT_REGISTERS
+     * @param count Registers, 1 to MODBUS_MAX_BLOCK_REGISTERS
+     * @return Point handle, or -1 if the table is full or the point invalid
+     */
+    int add_point(uint8_t slave, uint8_t function, uint16_t reg, uint8_t count);
+
+    /**
+     * Merge the points into blocks. Points of the same slave and function
+     * share a block if at most @p maxGap registers lie between them and the
+     * block stays within MODBUS_MAX_BLOCK_REGISTERS.
+     * @return Number of blocks, 0 if they do not fit the tables
+     */
+    size_t plan(uint16_t maxGap);
+
+    /**
+     * Queue a poll of every block of @p slave.
+     * @return false if the queue is full, the slave is queued already or has no blocks
+     */
+    bool submit(uint8_t slave, uint32_t timeoutMs, ModbusDoneFn done, void *context, uint32_t nowMs);
+
+    /**
+     * Handle a frame from the decoder.
+     * @return true if it answered the open request
+     */
+    bool on_frame(const uint8_t *frame, size_t length, uint32_t nowMs);
+
+    /**
+     * Time out the open request and send the next one.
+     * @return Milliseconds until run() needs to be called again, 0 if idle
+     */
+    uint32_t run(uint32_t nowMs);
+
+    /**
+     * Registers of a point from the last poll of its slave, as sent.
+     * @return NULL if that poll did not read them
+     */
+    const uint16_t *registers(int point) const;
+
+    size_t blocks() const
+    {
+        return _block_count;
+    }
+
+    /** Number of queued polls. */
+    size_t pending() const
+    {
+        return _count;
+    }
+
+    const ModbusStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    struct Point {
+        uint8_t slave;
+        uint8_t function;
+        uint16_t reg;
+        uint8_t count;
+        uint8_t block;
+    };
+
+    struct Block {
+        uint8_t slave;
+        uint8_t function;
+        uint16_t reg;
+        uint8_t count;
+        uint16_t cache;     // first register in _registers
+        bool valid;
+    };
+
+    void send(uint32_t nowMs);
+    void next_block(bool answered, uint32_t nowMs);
+    void finish(bool ok);
+
+    ModbusSendFn _send;
+    void *_send_context;
+    uint32_t _guard_ms;
+
+    Point _points[MODBUS_MAX_POINTS];
+    size_t _point_count;
+    Block _blocks[MODBUS_MAX_BLOCKS];   // grouped by slave
+    size_t _block_count;
+    uint16_t _registers[MODBUS_MAX_REGISTERS];
+
+    // FIFO in submission order, the first one is on the bus
+    ModbusPoll _polls[MODBUS_MAX_POLLS];
+    size_t _count;
+    size_t _block;              // block of the first poll read next or now
+    size_t _last_block;         // end of the blocks of that slave
+    bool _started;              // the first poll sent its first request
+    bool _in_flight;            // a request waits for its response
+    bool _ok;                   // every block of the poll answered so far
+    uint32_t _request_ms;
+    uint32_t _last_activity_ms;
+
+    ModbusStats _stats;
+};
+
+/**
+ * Decode an IEEE 754 float held in two registers, high word first, into
+ * fixed point rounded to 10^exponent.
+ * @param exponent Resolution of the result, e.g. -3 for Wh out of a kWh register
+ * @param unit MeterUnit of the value
+ * @return false if the value is not a number or does not fit
+ */
+bool modbus_decode_float(const uint16_t *registers, int8_t exponent, uint8_t unit, MeterReading &reading);
+
+#endif /* MODBUS_MASTER_H */
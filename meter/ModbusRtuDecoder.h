@@ -0,0 +1,200 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef MODBUS_RTU_DECODER_H
+#define MODBUS_RTU_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "MeterProtocol.h"
+#include "FrameDecoder.h"
+#include "Crc16.h"
+
+// Above 19200 baud the inter-frame silence is fixed
+#define MODBUS_T35_FIXED_US     1750
+
+/**
+ * Silence that ends a Modbus RTU frame: 3.5 characters of 11 bits.
+ */
+inline uint32_t modbus_t35_us(uint32_t baud)
+{
+    return (19200 < baud) ? MODBUS_T35_FIXED_US : (uint32_t)((35UL * 11 * 100000) / baud);
+}
+
+/**
+ * Modbus RTU frames as a master receives them.
+ *
+ * RTU frames have neither start nor end byte: a frame is what comes
+ * between two silences of 3.5 characters, which the port's idle timeout
+ * reports through resync(). The length of every frame a master receives
+ * follows from its first bytes, so a frame is checked and handed over as
+ * soon as its last byte is in, without waiting for the silence. After a
+ * frame with a wrong CRC or an unknown function code, everything up to
+ * the next silence is dropped, as the standard asks.
+ *
+ * The interface is the one of FrameDecoder, so a MeterPort can host it.
+ *
+ * @tparam MaxLength Longest frame accepted, up to MODBUS_MAX_FRAME_LENGTH
+ */
+template <size_t MaxLength = MODBUS_MAX_FRAME_LENGTH>
+class ModbusRtuDecoder {
+public:
+    /** Longest frame accepted. */
+    static const size_t max_length = MaxLength;
+
+    /**
+     * @param handler Called for every frame with a valid CRC
+     * @param context Passed back to @p handler
+     */
+    ModbusRtuDecoder(MeterFrameHandler handler, void *context)
+        : _handler(handler), _context(context), _length(0), _need(2), _discard(false)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    /** Drop any partial frame. */
+    void reset()
+    {
+        _length = 0;
+        _need = 2;
+        _discard = false;
+    }
+
+    /**
+     * Take received bytes.
+     * @return Number of frames passed to the handler
+     */
+    size_t feed(const uint8_t *data, size_t size)
+    {
+        size_t frames = 0;
+        size_t i = 0;
+
+        while (i < size) {
+            if (_discard) {
+                _stats.skipped += size - i;
+                break;
+            }
+
+            size_t want = _need - _length;
+            if (want > size - i) {
+                want = size - i;
+            }
+            memcpy(_frame + _length, data + i, want);
+            _length += want;
+            i += want;
+            if (_length < _need) {
+                break;
+            }
+
+            size_t need = expected();
+            if ((0 == need) || (MaxLength < need)) {
+                _stats.length_errors++;
+                spoil();
+                continue;
+            }
+            if (_length < need) {
+                _need = need;
+                continue;
+            }
+
+            uint16_t crc = crc16_modbus(_frame, _length - 2);
+            if (((uint8_t)crc != _frame[_length - 2]) || ((uint8_t)(crc >> 8) != _frame[_length - 1])) {
+                _stats.checksum_errors++;
+                spoil();
+                continue;
+            }
+
+            _stats.frames++;
+            _handler(_context, _frame, _length);
+            frames++;
+            reset();
+        }
+
+        return frames;
+    }
+
+    /**
+     * The line went quiet: the frame in progress is over, complete or not.
+     * @return Always 0, a frame is handed over as soon as it is complete
+     */
+    size_t resync()
+    {
+        if ((0 < _length) && !_discard) {
+            _stats.resets++;
+            _stats.skipped += _length;
+        }
+        reset();
+        return 0;
+    }
+
+    /** Bytes of a partial or spoilt frame held, 0 between frames. */
+    size_t pending() const
+    {
+        return _length;
+    }
+
+    const DecoderStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    /**
+     * Frame length from the bytes so far.
+     * @return Length, more than _length if a byte count is still missing, 0 if unknown
+     */
+    size_t expected() const
+    {
+        uint8_t function = _frame[1];
+
+        if (function & MODBUS_EXCEPTION) {
+            return MODBUS_EXCEPTION_LENGTH;
+        }
+        switch (function) {
+            case MODBUS_READ_HOLDING_REGISTERS:
+            case MODBUS_READ_INPUT_REGISTERS:
+                return (_length < 3) ? 3 : (MODBUS_READ_RESPONSE_OVERHEAD + _frame[2]);
+            case MODBUS_WRITE_SINGLE_COIL:
+            case MODBUS_WRITE_SINGLE_REGISTER:
+            case MODBUS_WRITE_MULTIPLE_COILS:
+            case MODBUS_WRITE_MULTIPLE_REGISTERS:
+                return MODBUS_WRITE_RESPONSE_LENGTH;
+            default:
+                return 0;
+        }
+    }
+
+    // Drop the frame and what follows it up to the next silence
+    void spoil()
+    {
+        _stats.resets++;
+        _stats.skipped += _length;
+        _discard = true;
+    }
+
+    MeterFrameHandler _handler;
+    void *_context;
+
+    uint8_t _frame[MaxLength];
+    size_t _length;
+    size_t _need;       // bytes before the next look at the frame
+    bool _discard;      // spoilt, wait for the silence
+
+    DecoderStats _stats;
+};
+
+#endif /* MODBUS_RTU_DECODER_H */
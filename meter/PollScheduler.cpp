@@ -0,0 +1,276 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "PollScheduler.h"
+
+// true if time a is at or after time b, across wrap-around
+static inline bool time_reached(uint32_t a, uint32_t b)
+{
+    return 0 <= (int32_t)(a - b);
+}
+
+PollScheduler::PollScheduler() : _count(0)
+{
+    for (size_t i = 0; i < POLL_SCHEDULER_MAX_BUSES; i++) {
+        _in_flight[i] = 0;
+        _depth[i] = 1;
+    }
+
+    _policy.min_timeout_ms    = METER_HEALTH_MIN_TIMEOUT_MS;
+    _policy.timeout_factor    = METER_HEALTH_TIMEOUT_FACTOR;
+    _policy.retries           = METER_HEALTH_RETRIES;
+    _policy.backoff_ms        = METER_HEALTH_BACKOFF_MS;
+    _policy.degraded_after    = METER_HEALTH_DEGRADED_AFTER;
+    _policy.offline_after     = METER_HEALTH_OFFLINE_AFTER;
+    _policy.probe_interval_ms = METER_HEALTH_PROBE_INTERVAL_MS;
+}
+
+int PollScheduler::add_meter(const PollMeterConfig &config, uint32_t nowMs)
+{
+    if ((POLL_SCHEDULER_MAX_METERS <= _count) || (POLL_SCHEDULER_MAX_BUSES <= config.bus) ||
+        (NULL == config.request) || (0 == config.interval_ms) || (0 == config.deadline_ms)) {
+        return -1;
+    }
+
+    Meter &meter = _meters[_count];
+    meter = Meter();
+    meter.config = config;
+    meter.due_ms = nowMs;
+    meter.health.configure(&_policy, config.timeout_ms ? config.timeout_ms : config.deadline_ms, config.deadline_ms);
+
+    return (int)_count++;
+}
+
+void PollScheduler::set_interval(int handle, uint32_t intervalMs)
+{
+    if ((0 <= handle) && ((size_t)handle < _count) && (0 < intervalMs)) {
+        _meters[handle].config.interval_ms = intervalMs;
+    }
+}
+
+void PollScheduler::set_bus_depth(uint8_t bus, uint8_t depth)
+{
+    if ((bus < POLL_SCHEDULER_MAX_BUSES) && (0 < depth)) {
+        _depth[bus] = depth;
+    }
+}
+
+void PollScheduler::set_health_policy(const MeterHealthPolicy &policy)
+{
+    _policy = policy;
+    if (0 == _policy.timeout_factor) {
+        _policy.timeout_factor = 1;
+    }
+}
+
+// Earlier of the regular poll and a pending retry
+uint32_t PollScheduler::due(const Meter &meter)
+{
+    if (meter.retry && ((int32_t)(meter.retry_ms - meter.due_ms) < 0)) {
+        return meter.retry_ms;
+    }
+    return meter.due_ms;
+}
+
+int PollScheduler::select(uint8_t bus, uint32_t nowMs) const
+{
+    int best = -1;
+
+    for (size_t i = 0; i < _count; i++) {
+        const Meter &meter = _meters[i];
+
+        if ((bus != meter.config.bus) || meter.active || !time_reached(nowMs, due(meter))) {
+            continue;
+        }
+        if (best < 0) {
+            best = (int)i;
+            continue;
+        }
+
+        const Meter &other = _meters[best];
+        if (meter.config.priority != other.config.priority) {
+            if (meter.config.priority > other.config.priority) {
+                best = (int)i;
+            }
+        }
+        else if (meter.health.state() != other.health.state()) {
+            if (meter.health.state() < other.health.state()) {
+                best = (int)i;
+            }
+        }
+        else if ((int32_t)(due(meter) - due(other)) < 0) {
+            best = (int)i;
+        }
+    }
+
+    return best;
+}
+
+void PollScheduler::start(int handle, uint32_t nowMs)
+{
+    Meter &meter = _meters[handle];
+
+    if (meter.retry && !time_reached(nowMs, meter.due_ms)) {
+        // A retry between two regular polls leaves their phase alone
+        meter.stats.retries++;
+    }
+    else {
+        uint32_t slip = nowMs - meter.due_ms;
+
+        meter.stats.polls++;
+        if (0 < slip) {
+            meter.stats.late++;
+            meter.stats.total_slip_ms += slip;
+            if (slip > meter.stats.max_slip_ms) {
+                meter.stats.max_slip_ms = slip;
+            }
+        }
+
+        // Keep the phase, but do not catch up on polls that are already lost
+        meter.due_ms += meter.config.interval_ms;
+        if (time_reached(nowMs, meter.due_ms)) {
+            meter.stats.skipped++;
+            meter.due_ms = nowMs + meter.config.interval_ms;
+        }
+    }
+
+    meter.retry = false;
+    meter.started_ms = nowMs;
+    uint8_t depth = _depth[meter.config.bus];
+    meter.expiry_ms = nowMs + ((1 < depth) ? (depth * meter.config.deadline_ms) : meter.health.timeout_ms());
+    meter.active = true;
+    _in_flight[meter.config.bus]++;
+
+    meter.config.request(meter.config.context);
+}
+
+void PollScheduler::fail(Meter &meter, uint32_t nowMs)
+{
+    meter.stats.timeouts++;
+
+    uint32_t backoff = meter.health.on_failure();
+    if (0 < backoff) {
+        meter.retry = true;
+        meter.retry_ms = nowMs + backoff;
+    }
+    else if (METER_OFFLINE == meter.health.state()) {
+        uint32_t probe = nowMs + _policy.probe_interval_ms;
+        if ((int32_t)(probe - meter.due_ms) > 0) {
+            meter.due_ms = probe;
+        }
+    }
+}
+
+uint32_t PollScheduler::run(uint32_t nowMs)
+{
+    uint32_t wait = POLL_SCHEDULER_IDLE_WAIT_MS;
+
+    // Expire transactions past their deadline
+    for (size_t i = 0; i < _count; i++) {
+        Meter &meter = _meters[i];
+
+        if (!meter.active) {
+            continue;
+        }
+
+        if (time_reached(nowMs, meter.expiry_ms)) {
+            meter.active = false;
+            _in_flight[meter.config.bus]--;
+            fail(meter, nowMs);
+        }
+        else if ((meter.expiry_ms - nowMs) < wait) {
+            wait = meter.expiry_ms - nowMs;
+        }
+    }
+
+    // Fill every bus up to its depth
+    for (uint8_t bus = 0; bus < POLL_SCHEDULER_MAX_BUSES; bus++) {
+        while (_in_flight[bus] < _depth[bus]) {
+            int handle = select(bus, nowMs);
+            if (handle < 0) {
+                break;
+            }
+            start(handle, nowMs);
+            if ((_meters[handle].expiry_ms - nowMs) < wait) {
+                wait = _meters[handle].expiry_ms - nowMs;
+            }
+        }
+    }
+
+    // Next due time of any idle meter whose bus has room
+    for (size_t i = 0; i < _count; i++) {
+        const Meter &meter = _meters[i];
+
+        if (meter.active || (_in_flight[meter.config.bus] >= _depth[meter.config.bus])) {
+            continue;
+        }
+        uint32_t until = time_reached(nowMs, due(meter)) ? 0 : (due(meter) - nowMs);
+        if (until < wait) {
+            wait = until;
+        }
+    }
+
+    return wait;
+}
+
+bool PollScheduler::complete(int handle, uint32_t nowMs, bool answered, uint32_t latencyMs)
+{
+    if ((handle < 0) || ((size_t)handle >= _count) || !_meters[handle].active) {
+        return false;
+    }
+
+    Meter &meter = _meters[handle];
+
+    meter.active = false;
+    _in_flight[meter.config.bus]--;
+
+    if (answered) {
+        meter.stats.responses++;
+        meter.health.on_response((POLL_LATENCY_FROM_START == latencyMs) ? (nowMs - meter.started_ms) : latencyMs);
+    }
+    else {
+        fail(meter, nowMs);
+    }
+    return true;
+}
+
+uint32_t PollScheduler::timeout_ms(int handle) const
+{
+    if ((handle < 0) || ((size_t)handle >= _count)) {
+        return 0;
+    }
+    return _meters[handle].health.timeout_ms();
+}
+
+uint8_t PollScheduler::busy(uint8_t bus) const
+{
+    return (bus < POLL_SCHEDULER_MAX_BUSES) ? _in_flight[bus] : 0;
+}
+
+const PollMeterStats *PollScheduler::stats(int handle) const
+{
+    if ((handle < 0) || ((size_t)handle >= _count)) {
+        return NULL;
+    }
+    return &_meters[handle].stats;
+}
+
+const MeterHealth *PollScheduler::health(int handle) const
+{
+    if ((handle < 0) || ((size_t)handle >= _count)) {
+        return NULL;
+    }
+    return &_meters[handle].health;
+}
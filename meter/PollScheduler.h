@@ -0,0 +1,159 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterHealth.h"
+
+#define POLL_SCHEDULER_MAX_METERS   8
+#define POLL_SCHEDULER_MAX_BUSES    4
+
+// run() result when nothing is scheduled at all
+#define POLL_SCHEDULER_IDLE_WAIT_MS 1000
+
+// complete() latency argument: measure from the start of the transaction
+#define POLL_LATENCY_FROM_START     UINT32_MAX
+
+/**
+ * Sends the poll request of one meter.
+ * @param context User pointer from PollMeterConfig
+ */
+typedef void (*PollRequestFn)(void *context);
+
+/** How and how often one meter is polled. */
+struct PollMeterConfig {
+    uint8_t bus;            // bus index, one transaction per bus at a time
+    uint8_t priority;       // higher value wins when several meters are due
+    uint32_t interval_ms;   // time between polls
+    uint32_t timeout_ms;    // time the meter has to answer until its latency is known
+    uint32_t deadline_ms;   // ceiling of the adaptive timeout
+    PollRequestFn request;
+    void *context;
+};
+
+/** Counters kept per meter. */
+struct PollMeterStats {
+    uint32_t polls;         // requests sent
+    uint32_t responses;     // complete() calls in time
+    uint32_t timeouts;      // deadlines missed
+    uint32_t retries;       // requests repeated after a failure
+    uint32_t skipped;       // polls dropped because the meter fell a full interval behind
+    uint32_t late;          // polls sent after their due time
+    uint32_t max_slip_ms;   // worst delay between due time and request
+    uint32_t total_slip_ms; // sum of all delays, for the mean
+};
+
+/**
+ * Polls the meters on their own intervals.
+ *
+ * Every bus carries one transaction at a time unless set_bus_depth() allows
+ * more, for buses with their own request queue. A transaction starts when a
+ * meter on the bus is due and ends on complete() or when the meter's
+ * deadline passes.
+ * When several meters of a bus are due, the highest priority goes first,
+ * then the healthier one, then the one that has waited longest. The delay
+ * between a meter's due time and its request is recorded as schedule slip.
+ *
+ * Every meter has a MeterHealth record. The time a meter gets to answer
+ * follows its measured latency, a failed request is retried with backoff
+ * without moving the regular poll times, and a meter that keeps failing is
+ * first denied retries, then only probed, so it stops holding up the bus.
+ * On a bus with its own request queue (depth > 1) the queue applies
+ * timeout_ms() itself. The scheduler then only expires a transaction as a
+ * backstop, after depth x deadline_ms: the time the queue takes if every
+ * request ahead of it times out.
+ *
+ * Time is passed in by the caller and may wrap; the scheduler never blocks.
+ */
+class PollScheduler {
+public:
+    PollScheduler();
+
+    /**
+     * Register a meter. The first poll is due right away.
+     * @return Meter handle, or -1 if the table is full or the config invalid
+     */
+    int add_meter(const PollMeterConfig &config, uint32_t nowMs);
+
+    /** Change the poll interval of a meter, from its next poll on. */
+    void set_interval(int handle, uint32_t intervalMs);
+
+    /** Allow @p depth transactions at the same time on @p bus (default 1). */
+    void set_bus_depth(uint8_t bus, uint8_t depth);
+
+    /** Replace the retry and timeout policy of all meters. */
+    void set_health_policy(const MeterHealthPolicy &policy);
+
+    /**
+     * Expire overdue transactions and start the due ones on idle buses.
+     * @return Milliseconds until run() needs to be called again
+     */
+    uint32_t run(uint32_t nowMs);
+
+    /**
+     * Report the end of a meter's transaction, which frees its bus.
+     * Call run() afterwards to use the bus right away.
+     * @param answered false if the transaction failed before the deadline
+     * @param latencyMs Response time of the meter, if the caller knows it
+     *        better than the scheduler (the request waited in a queue)
+     * @return false if no transaction of this meter was open
+     */
+    bool complete(int handle, uint32_t nowMs, bool answered = true, uint32_t latencyMs = POLL_LATENCY_FROM_START);
+
+    /** Time the meter gets to answer its current or next request. */
+    uint32_t timeout_ms(int handle) const;
+
+    /** Number of open transactions on @p bus. */
+    uint8_t busy(uint8_t bus) const;
+
+    const PollMeterStats *stats(int handle) const;
+
+    const MeterHealth *health(int handle) const;
+
+    size_t meters() const
+    {
+        return _count;
+    }
+
+private:
+    struct Meter {
+        PollMeterConfig config;
+        PollMeterStats stats;
+        MeterHealth health;
+        uint32_t due_ms;        // next regular poll
+        uint32_t retry_ms;      // next retry, if retry is set
+        uint32_t started_ms;
+        uint32_t expiry_ms;     // transaction deadline
+        bool retry;
+        bool active;
+    };
+
+    static uint32_t due(const Meter &meter);
+    int select(uint8_t bus, uint32_t nowMs) const;
+    void start(int handle, uint32_t nowMs);
+    void fail(Meter &meter, uint32_t nowMs);
+
+    Meter _meters[POLL_SCHEDULER_MAX_METERS];
+    size_t _count;
+    uint8_t _in_flight[POLL_SCHEDULER_MAX_BUSES];
+    uint8_t _depth[POLL_SCHEDULER_MAX_BUSES];
+    MeterHealthPolicy _policy;
+};
+
+#endif /* POLL_SCHEDULER_H */
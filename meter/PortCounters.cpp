@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "PortCounters.h"
+
+PortCounters::PortCounters()
+    : _rx_bytes(0), _rx_overflows(0), _frames(0), _checksum_errors(0), _length_errors(0), _resets(0),
+      _skipped(0), _parse_runs(0), _parse_us(0), _parse_max_us(0)
+{
+}
+
+void PortCounters::snapshot(PortCounterValues &values) const
+{
+    values.rx_bytes        = _rx_bytes.load(std::memory_order_relaxed);
+    values.rx_overflows    = _rx_overflows.load(std::memory_order_relaxed);
+    values.frames          = _frames.load(std::memory_order_relaxed);
+    values.checksum_errors = _checksum_errors.load(std::memory_order_relaxed);
+    values.length_errors   = _length_errors.load(std::memory_order_relaxed);
+    values.resets          = _resets.load(std::memory_order_relaxed);
+    values.skipped         = _skipped.load(std::memory_order_relaxed);
+    values.parse_runs      = _parse_runs.load(std::memory_order_relaxed);
+    values.parse_us        = _parse_us.load(std::memory_order_relaxed);
+    values.parse_max_us    = _parse_max_us.load(std::memory_order_relaxed);
+}
+
+// Unsigned LEB128
+// @return Bytes written, 0 if they do not fit
+static size_t varint_put(uint8_t *p, size_t size, uint32_t value)
+{
+    size_t n = 0;
+    do {
+        if (n >= size) {
+            return 0;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        p[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return n;
+}
+
+size_t port_counters_encode(const PortCounterValues *ports, size_t count, uint8_t *buffer, size_t size)
+{
+    if ((3 > size) || (255 < count)) {
+        return 0;
+    }
+
+    size_t length = 0;
+    buffer[length++] = PORT_COUNTERS_VERSION;
+    buffer[length++] = (uint8_t)count;
+    buffer[length++] = (uint8_t)PORT_COUNTERS_FIELDS;
+
+    for (size_t i = 0; i < count; i++) {
+        const PortCounterValues &port = ports[i];
+        const uint32_t fields[PORT_COUNTERS_FIELDS] = {
+            port.rx_bytes, port.rx_overflows, port.frames, port.checksum_errors, port.length_errors,
+            port.resets, port.skipped, port.parse_runs, port.parse_us, port.parse_max_us
+        };
+
+        for (size_t f = 0; f < PORT_COUNTERS_FIELDS; f++) {
+            size_t n = varint_put(buffer + length, size - length, fields[f]);
+            if (0 == n) {
+                return 0;
+            }
+            length += n;
+        }
+    }
+
+    return length;
+}
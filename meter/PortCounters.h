@@ -0,0 +1,121 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef PORT_COUNTERS_H
+#define PORT_COUNTERS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FrameDecoder.h"
+
+// First byte of an encoded dump
+#define PORT_COUNTERS_VERSION   1
+
+/** Counters of one port at one moment. */
+struct PortCounterValues {
+    uint32_t rx_bytes;          // bytes taken from the UART
+    uint32_t rx_overflows;      // bytes lost because the receive ring was full
+    uint32_t frames;            // frames found by the decoder, request echoes included
+    uint32_t checksum_errors;
+    uint32_t length_errors;
+    uint32_t resets;            // partial frames dropped, on a decoder error or an inter-byte gap
+    uint32_t skipped;           // bytes outside any frame
+    uint32_t parse_runs;        // decoder runs
+    uint32_t parse_us;          // time spent in the decoder
+    uint32_t parse_max_us;      // longest decoder run
+};
+
+// Counters per port in an encoded dump
+#define PORT_COUNTERS_FIELDS    10
+
+/**
+ * Receive path counters of one UART.
+ *
+ * Every counter has a single writer: the receive interrupt for the rx
+ * counters, the port's thread for the others. A writer does a relaxed load
+ * and store rather than a read-modify-write, which is a plain load and
+ * store on Cortex-M, so counting costs a few cycles and never takes a lock.
+ * Any thread may take a snapshot() at any time. Each counter in it is
+ * consistent, the set as a whole is not.
+ */
+class PortCounters {
+public:
+    PortCounters();
+
+    /** Interrupt side: @p received bytes came in, @p dropped of them did not fit. */
+    void count_rx(size_t received, size_t dropped)
+    {
+        bump(_rx_bytes, (uint32_t)received);
+        if (0 < dropped) {
+            bump(_rx_overflows, (uint32_t)dropped);
+        }
+    }
+
+    /** Thread side: one decoder run took @p us microseconds. */
+    void count_parse(uint32_t us)
+    {
+        bump(_parse_runs, 1);
+        bump(_parse_us, us);
+        if (us > _parse_max_us.load(std::memory_order_relaxed)) {
+            _parse_max_us.store(us, std::memory_order_relaxed);
+        }
+    }
+
+    /** Thread side: take over the counters the decoder keeps itself. */
+    void update(const DecoderStats &stats)
+    {
+        _frames.store(stats.frames, std::memory_order_relaxed);
+        _checksum_errors.store(stats.checksum_errors, std::memory_order_relaxed);
+        _length_errors.store(stats.length_errors, std::memory_order_relaxed);
+        _resets.store(stats.resets, std::memory_order_relaxed);
+        _skipped.store(stats.skipped, std::memory_order_relaxed);
+    }
+
+    void snapshot(PortCounterValues &values) const;
+
+private:
+    static void bump(std::atomic<uint32_t> &counter, uint32_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Written by the receive interrupt
+    std::atomic<uint32_t> _rx_bytes;
+    std::atomic<uint32_t> _rx_overflows;
+
+    // Written by the port's thread
+    std::atomic<uint32_t> _frames;
+    std::atomic<uint32_t> _checksum_errors;
+    std::atomic<uint32_t> _length_errors;
+    std::atomic<uint32_t> _resets;
+    std::atomic<uint32_t> _skipped;
+    std::atomic<uint32_t> _parse_runs;
+    std::atomic<uint32_t> _parse_us;
+    std::atomic<uint32_t> _parse_max_us;
+};
+
+/**
+ * Encode the counters of several ports as a compact binary dump: a version
+ * byte, the number of ports, the number of counters per port, then every
+ * counter of every port in the order of PortCounterValues, each as an
+ * unsigned LEB128 varint. Readers skip counters beyond the ones they know,
+ * so new counters can be appended.
+ * @return Number of bytes written, 0 if @p size is too small
+ */
+size_t port_counters_encode(const PortCounterValues *ports, size_t count, uint8_t *buffer, size_t size);
+
+#endif /* PORT_COUNTERS_H */
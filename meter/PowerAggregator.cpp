@@ -0,0 +1,91 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "PowerAggregator.h"
+
+PowerAggregator::PowerAggregator()
+    : _count(0), _min(0), _max(0), _sum(0), _exponent(0), _unit(METER_UNIT_NONE), _has_base(false), _has_energy(false)
+{
+    memset(&_base, 0, sizeof(_base));
+    memset(&_energy, 0, sizeof(_energy));
+}
+
+bool PowerAggregator::add_power(const MeterReading &power)
+{
+    if (0 == _count) {
+        _min = _max = _sum = power.value;
+        _exponent = power.exponent;
+        _unit = power.unit;
+        _count = 1;
+        return true;
+    }
+
+    if ((power.exponent != _exponent) || (power.unit != _unit)) {
+        return false;
+    }
+    if (power.value < _min) {
+        _min = power.value;
+    }
+    if (power.value > _max) {
+        _max = power.value;
+    }
+    _sum += power.value;
+    _count++;
+    return true;
+}
+
+void PowerAggregator::add_energy(const MeterReading &energy)
+{
+    if (!_has_base) {
+        _base = energy;
+        _has_base = true;
+    }
+    _energy = energy;
+    _has_energy = true;
+}
+
+bool PowerAggregator::close(PowerAggregate &aggregate)
+{
+    if ((0 == _count) && !_has_energy) {
+        return false;
+    }
+
+    memset(&aggregate, 0, sizeof(aggregate));
+    aggregate.samples = _count;
+    if (0 < _count) {
+        // Rounded half away from zero
+        int64_t half = (int64_t)(_count / 2);
+        int64_t mean = (0 <= _sum) ? ((_sum + half) / (int64_t)_count) : ((_sum - half) / (int64_t)_count);
+
+        aggregate.min  = MeterReading { _min, _exponent, _unit };
+        aggregate.max  = MeterReading { _max, _exponent, _unit };
+        aggregate.mean = MeterReading { mean, _exponent, _unit };
+    }
+
+    aggregate.has_energy = _has_energy;
+    if (_has_energy) {
+        aggregate.energy = _energy;
+        // A register that went backwards was reset or replaced: no delta
+        aggregate.has_delta = meter_reading_subtract(_energy, _base, aggregate.energy_delta) &&
+                              (0 <= aggregate.energy_delta.value);
+        _base = _energy;
+    }
+
+    _count = 0;
+    _has_energy = false;
+    return true;
+}
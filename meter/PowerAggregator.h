@@ -0,0 +1,87 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef POWER_AGGREGATOR_H
+#define POWER_AGGREGATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+/** What the power meter did during one interval. */
+struct PowerAggregate {
+    uint32_t samples;           // power samples taken
+    MeterReading min;           // power
+    MeterReading max;
+    MeterReading mean;          // of the samples, rounded to their resolution
+    bool has_energy;            // an energy reading came in during the interval
+    MeterReading energy;        // energy register, last reading of the interval
+    bool has_delta;             // energy has a reference and did not go backwards
+    MeterReading energy_delta;  // energy since the last reading of an earlier interval
+};
+
+/**
+ * Streaming min/max/mean of the power samples and the energy used, per
+ * interval.
+ *
+ * Samples are folded in as they arrive, so an interval of any length costs
+ * a few words. The caller decides where intervals end and calls close().
+ * The energy delta of an interval starts at the last energy reading of the
+ * interval before, so no energy falls between two intervals; the first
+ * interval starts at its own first reading.
+ */
+class PowerAggregator {
+public:
+    PowerAggregator();
+
+    /**
+     * Add a power sample. All samples of an interval must have the
+     * exponent and unit of its first one.
+     * @return false if the sample was dropped for that reason
+     */
+    bool add_power(const MeterReading &power);
+
+    /** Add a reading of the energy register. */
+    void add_energy(const MeterReading &energy);
+
+    /**
+     * End the interval and start the next one.
+     * @return false if the interval had no sample at all; @p aggregate is then left alone
+     */
+    bool close(PowerAggregate &aggregate);
+
+    /** Power samples of the current interval so far. */
+    uint32_t samples() const
+    {
+        return _count;
+    }
+
+private:
+    uint32_t _count;
+    int64_t _min;
+    int64_t _max;
+    int64_t _sum;
+    int8_t _exponent;
+    uint8_t _unit;
+
+    // Energy register: the reference of the delta and the latest reading
+    bool _has_base;
+    MeterReading _base;
+    bool _has_energy;
+    MeterReading _energy;
+};
+
+#endif /* POWER_AGGREGATOR_H */
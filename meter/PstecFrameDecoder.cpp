@@ -0,0 +1,33 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "PstecFrameDecoder.h"
+#include "Bcd.h"
+
+bool pstec_decode_reading(const uint8_t *frame, size_t length, MeterReading &reading)
+{
+    uint64_t value;
+
+    // Integer and fraction bytes are adjacent, so one pass reads both
+    if ((PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT != length) || !bcd_decode_msb_first(frame + 2, 5, value)) {
+        return false;
+    }
+
+    reading.value    = (int64_t)value;
+    reading.exponent = -4;
+    // Heat meters report in a unit that depends on the model
+    reading.unit     = (PSTEC_PRECISE_ACCUM_INSTANT_METER_TYPE_HEAT == frame[1]) ? METER_UNIT_NONE : METER_UNIT_CUBIC_METRE;
+    return true;
+}
@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef PSTEC_FRAME_DECODER_H
+#define PSTEC_FRAME_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterProtocol.h"
+#include "FrameDecoder.h"
+#include "MeterReading.h"
+
+/*
+ * Frames of the PSTEC meter bus.
+ *
+ * The bus is half duplex, so every 4-byte request (STX type BCC ETX) is read
+ * back as an echo, and 14-byte responses (STX type data[10] BCC ETX) follow.
+ * Both are passed to the handler; the length tells them apart.
+ *
+ * The decoder does not need to know which request was sent: a frame whose
+ * third byte is the BCC of the first two and whose fourth byte is ETX is an
+ * echo. Response data is BCD, so ETX (0xD0) cannot appear there. Matching
+ * responses to requests is left to the caller, by the ID field.
+ */
+typedef FrameFormat<
+    FrameByte<PSTEC_REQUEST_STX>,
+    FrameAny<1>,                                                // meter type
+    FrameChecksum<FRAME_BCC7>,
+    FrameByte<PSTEC_REQUEST_ETX>
+> PstecEchoFrame;
+
+typedef FrameFormat<
+    FrameByte<PSTEC_RESPONSE_STX>,
+    FrameAny<1>,                                                // meter type
+    FrameData<PSTEC_RESPONSE_PACKET_APDU_LENGTH_PRECISE_ACCUM_INSTANT>,
+    FrameChecksum<FRAME_BCC7>,
+    FrameByte<PSTEC_RESPONSE_ETX>
+> PstecResponseFrame;
+
+typedef FrameDecoder<PstecEchoFrame, PstecResponseFrame> PstecFrameDecoder;
+
+/**
+ * Accumulated reading of a PSTEC response: 3 BCD bytes of integer part and
+ * 2 of fraction, most significant first, so 10 digits with 4 decimals.
+ * @return false if @p frame is not a response or the digits are not BCD
+ */
+bool pstec_decode_reading(const uint8_t *frame, size_t length, MeterReading &reading);
+
+#endif /* PSTEC_FRAME_DECODER_H */
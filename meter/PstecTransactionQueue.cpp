@@ -0,0 +1,143 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "PstecTransactionQueue.h"
+
+PstecTransactionQueue::PstecTransactionQueue(PstecSendFn send, void *context, uint8_t maxInFlight, uint32_t guardMs)
+    : _send(send), _send_context(context), _max_in_flight(maxInFlight ? maxInFlight : 1), _guard_ms(guardMs),
+      _count(0), _in_flight(0), _last_activity_ms(0)
+{
+    memset(_slots, 0, sizeof(_slots));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool PstecTransactionQueue::submit(uint8_t meterType, uint32_t timeoutMs, PstecDoneFn done, void *context, uint32_t nowMs)
+{
+    bool duplicate = false;
+    for (size_t i = 0; i < _count; i++) {
+        duplicate |= (meterType == _slots[i].transaction.meter_type);
+    }
+
+    if (duplicate || (PSTEC_MAX_TRANSACTIONS <= _count) || (NULL == done)) {
+        _stats.rejected++;
+        return false;
+    }
+
+    Slot &slot = _slots[_count++];
+    slot.transaction.meter_type   = meterType;
+    slot.transaction.submitted_ms = nowMs;
+    slot.transaction.sent_ms      = 0;
+    slot.transaction.timeout_ms   = timeoutMs;
+    slot.transaction.done         = done;
+    slot.transaction.context      = context;
+    slot.sent = false;
+
+    _stats.submitted++;
+    return true;
+}
+
+void PstecTransactionQueue::finish(size_t index, const uint8_t *frame, size_t length)
+{
+    // Copy out first: the callback may submit the next transaction
+    PstecTransaction transaction = _slots[index].transaction;
+
+    memmove(&_slots[index], &_slots[index + 1], (_count - index - 1) * sizeof(Slot));
+    _count--;
+    _in_flight--;
+
+    transaction.done(transaction, frame, length);
+}
+
+bool PstecTransactionQueue::on_frame(const uint8_t *frame, size_t length, uint32_t nowMs)
+{
+    if (PSTEC_RESPONSE_PACKET_LENGTH_PRECISE_ACCUM_INSTANT != length) {
+        return false;
+    }
+
+    _last_activity_ms = nowMs;
+
+    for (size_t i = 0; i < _count; i++) {
+        if (_slots[i].sent && (frame[1] == _slots[i].transaction.meter_type)) {
+            _stats.completed++;
+            finish(i, frame, length);
+            return true;
+        }
+    }
+
+    _stats.unmatched++;
+    return false;
+}
+
+uint32_t PstecTransactionQueue::run(uint32_t nowMs)
+{
+    uint32_t wait = 0;
+
+    // Expire open transactions
+    for (size_t i = 0; i < _count; ) {
+        const PstecTransaction &transaction = _slots[i].transaction;
+        uint32_t age = nowMs - transaction.sent_ms;
+
+        if (!_slots[i].sent) {
+            i++;
+        }
+        else if (age >= transaction.timeout_ms) {
+            _stats.timeouts++;
+            finish(i, NULL, 0);
+        }
+        else {
+            if ((0 == wait) || ((transaction.timeout_ms - age) < wait)) {
+                wait = transaction.timeout_ms - age;
+            }
+            i++;
+        }
+    }
+
+    // Start queued ones while there is room on the wire
+    for (size_t i = 0; (i < _count) && (_in_flight < _max_in_flight); i++) {
+        Slot &slot = _slots[i];
+        if (slot.sent) {
+            continue;
+        }
+
+        uint32_t quiet = nowMs - _last_activity_ms;
+        if (quiet < _guard_ms) {
+            if ((0 == wait) || ((_guard_ms - quiet) < wait)) {
+                wait = _guard_ms - quiet;
+            }
+            break;
+        }
+
+        uint8_t request[PSTEC_REQUEST_PACKET_LENGTH];
+        request[0] = PSTEC_REQUEST_STX;
+        request[1] = slot.transaction.meter_type;
+        request[2] = (request[0] + request[1]) & 0x7F;    // BCC
+        request[3] = PSTEC_REQUEST_ETX;
+
+        slot.sent = true;
+        slot.transaction.sent_ms = nowMs;
+        _in_flight++;
+        _last_activity_ms = nowMs;
+
+        _send(_send_context, request, sizeof(request));
+
+        if ((0 == wait) || (slot.transaction.timeout_ms < wait)) {
+            wait = slot.transaction.timeout_ms;
+        }
+    }
+
+    return wait;
+}
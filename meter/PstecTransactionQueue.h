@@ -0,0 +1,135 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef PSTEC_TRANSACTION_QUEUE_H
+#define PSTEC_TRANSACTION_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterProtocol.h"
+
+#define PSTEC_MAX_TRANSACTIONS  8
+
+struct PstecTransaction;
+
+/**
+ * Completion of a transaction.
+ * @param transaction The finished transaction
+ * @param frame Response frame (STX type data[10] BCC ETX), NULL on timeout
+ * @param length Number of bytes in @p frame
+ */
+typedef void (*PstecDoneFn)(const PstecTransaction &transaction, const uint8_t *frame, size_t length);
+
+/**
+ * Puts a request frame on the bus.
+ * @param context User pointer given to the queue constructor
+ */
+typedef void (*PstecSendFn)(void *context, const uint8_t *data, size_t size);
+
+/** One request/response exchange with one meter. */
+struct PstecTransaction {
+    uint8_t meter_type;     // request type, matched against the response ID
+    uint32_t submitted_ms;
+    uint32_t sent_ms;
+    uint32_t timeout_ms;    // from sending to the response
+    PstecDoneFn done;
+    void *context;
+};
+
+/** Counters of the queue. */
+struct PstecTransactionStats {
+    uint32_t submitted;
+    uint32_t rejected;      // queue full or same meter already pending
+    uint32_t completed;
+    uint32_t timeouts;
+    uint32_t unmatched;     // responses with no open transaction of their ID
+};
+
+/**
+ * Request queue of the PSTEC bus.
+ *
+ * Each transaction carries its own meter type, callback and context, so
+ * nothing about the request in progress is kept in globals. Responses are
+ * matched to the open transactions by their ID field. The next queued
+ * request goes out as soon as a slot frees up and the bus has been quiet for
+ * the turnaround guard time, instead of waiting for the next poll.
+ *
+ * Not thread safe: submit(), on_frame() and run() must all be called from
+ * the same thread.
+ */
+class PstecTransactionQueue {
+public:
+    /**
+     * @param send Writes a request frame to the bus
+     * @param context Passed back to @p send
+     * @param maxInFlight Requests on the wire at the same time. Keep 1 unless
+     *        every meter on the bus holds its answer until the line is free.
+     * @param guardMs Quiet time between a response and the next request
+     */
+    PstecTransactionQueue(PstecSendFn send, void *context, uint8_t maxInFlight, uint32_t guardMs);
+
+    /**
+     * Queue a request.
+     * @return false if the queue is full or the meter already has one pending
+     */
+    bool submit(uint8_t meterType, uint32_t timeoutMs, PstecDoneFn done, void *context, uint32_t nowMs);
+
+    /**
+     * Handle a response frame from the decoder.
+     * @return true if it completed an open transaction
+     */
+    bool on_frame(const uint8_t *frame, size_t length, uint32_t nowMs);
+
+    /**
+     * Time out overdue transactions and send queued ones.
+     * @return Milliseconds until run() needs to be called again, 0 if idle
+     */
+    uint32_t run(uint32_t nowMs);
+
+    /** Number of queued and open transactions. */
+    size_t pending() const
+    {
+        return _count;
+    }
+
+    const PstecTransactionStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    struct Slot {
+        PstecTransaction transaction;
+        bool sent;
+    };
+
+    void finish(size_t index, const uint8_t *frame, size_t length);
+
+    PstecSendFn _send;
+    void *_send_context;
+    uint8_t _max_in_flight;
+    uint32_t _guard_ms;
+
+    // FIFO in submission order, the sent ones first
+    Slot _slots[PSTEC_MAX_TRANSACTIONS];
+    size_t _count;
+    uint8_t _in_flight;
+    uint32_t _last_activity_ms;
+
+    PstecTransactionStats _stats;
+};
+
+#endif /* PSTEC_TRANSACTION_QUEUE_H */
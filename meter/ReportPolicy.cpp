@@ -0,0 +1,175 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ReportPolicy.h"
+
+ReportPolicy::ReportPolicy() : _reported(false), _last_ms(0), _suppressed(0)
+{
+    memset(&_config, 0, sizeof(_config));
+    memset(&_last, 0, sizeof(_last));
+}
+
+void ReportPolicy::configure(const ReportPolicyConfig &config)
+{
+    _config = config;
+}
+
+bool ReportPolicy::changed(const MeterReading &reading) const
+{
+    MeterReading delta;
+    bool absOn = (0 != _config.abs_deadband.value);
+    bool relOn = (0 != _config.rel_deadband.value);
+
+    if (!meter_reading_subtract(reading, _last, delta)) {
+        return true;
+    }
+    if (delta.value < 0) {
+        delta.value = -delta.value;
+    }
+
+    if (!absOn && !relOn) {
+        return 0 != delta.value;
+    }
+    if (absOn && (0 <= meter_reading_compare(delta, _config.abs_deadband))) {
+        return true;
+    }
+    if (relOn) {
+        // delta * 100 >= rel * |last|
+        MeterReading lhs = delta;
+        MeterReading rhs = _last;
+        int64_t last = (rhs.value < 0) ? -rhs.value : rhs.value;
+
+        if ((0 < last) && ((INT64_MAX / last) < _config.rel_deadband.value)) {
+            return false;
+        }
+        lhs.exponent += 2;
+        rhs.value = last * _config.rel_deadband.value;
+        rhs.exponent += _config.rel_deadband.exponent;
+        return 0 <= meter_reading_compare(lhs, rhs);
+    }
+    return false;
+}
+
+bool ReportPolicy::evaluate(const MeterReading &reading, uint32_t nowMs)
+{
+    bool report;
+
+    if (!_reported) {
+        report = true;
+    }
+    else {
+        uint32_t elapsedS = (nowMs - _last_ms) / 1000;
+
+        if (elapsedS < _config.min_interval_s) {
+            report = false;
+        }
+        else {
+            report = changed(reading) || ((0 < _config.max_interval_s) && (_config.max_interval_s <= elapsedS));
+        }
+    }
+
+    if (report) {
+        _reported = true;
+        _last = reading;
+        _last_ms = nowMs;
+    }
+    else {
+        _suppressed++;
+    }
+    return report;
+}
+
+// Next comma separated field of text, copied into field
+static const char *next_field(const char *text, char *field, size_t size)
+{
+    size_t length = strcspn(text, ",");
+
+    if ((0 == length) || (size <= length)) {
+        return NULL;
+    }
+    memcpy(field, text, length);
+    field[length] = '\0';
+    return ('\0' == text[length]) ? (text + length) : (text + length + 1);
+}
+
+static bool parse_seconds(const char *field, uint32_t &seconds)
+{
+    char *end;
+    unsigned long value = strtoul(field, &end, 10);
+
+    seconds = (uint32_t)value;
+    return ('\0' == *end) && ('-' != field[0]);
+}
+
+bool report_policy_parse(const char *text, int &meter, ReportPolicyConfig &config)
+{
+    char field[24];
+    ReportPolicyConfig parsed;
+
+    if (NULL == (text = next_field(text, field, sizeof(field)))) {
+        return false;
+    }
+    if (0 == strcmp(field, "*")) {
+        meter = -1;
+    }
+    else {
+        char *end;
+        meter = (int)strtol(field, &end, 10);
+        if (('\0' != *end) || (meter < 0)) {
+            return false;
+        }
+    }
+
+    if ((NULL == (text = next_field(text, field, sizeof(field)))) || !meter_reading_parse(field, parsed.abs_deadband) ||
+        (NULL == (text = next_field(text, field, sizeof(field)))) || !meter_reading_parse(field, parsed.rel_deadband) ||
+        (NULL == (text = next_field(text, field, sizeof(field)))) || !parse_seconds(field, parsed.min_interval_s) ||
+        (NULL == (text = next_field(text, field, sizeof(field)))) || !parse_seconds(field, parsed.max_interval_s) ||
+        ('\0' != *text)) {
+        return false;
+    }
+    if ((parsed.abs_deadband.value < 0) || (parsed.rel_deadband.value < 0)) {
+        return false;
+    }
+
+    config = parsed;
+    return true;
+}
+
+size_t report_policy_format(int meter, const ReportPolicyConfig &config, char *text, size_t size)
+{
+    char abs[METER_READING_TEXT_SIZE];
+    char rel[METER_READING_TEXT_SIZE];
+    char number[12];
+    int length;
+
+    if ((0 == meter_reading_format(config.abs_deadband, abs, sizeof(abs))) ||
+        (0 == meter_reading_format(config.rel_deadband, rel, sizeof(rel)))) {
+        return 0;
+    }
+    if (meter < 0) {
+        strcpy(number, "*");
+    }
+    else {
+        snprintf(number, sizeof(number), "%d", meter);
+    }
+
+    length = snprintf(text, size, "%s,%s,%s,%lu,%lu", number, abs, rel,
+                      (unsigned long)config.min_interval_s, (unsigned long)config.max_interval_s);
+    return ((length < 0) || (size <= (size_t)length)) ? 0 : (size_t)length;
+}
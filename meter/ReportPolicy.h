@@ -0,0 +1,95 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef REPORT_POLICY_H
+#define REPORT_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+// Longest text report_policy_format() produces, with the terminator
+#define REPORT_POLICY_TEXT_SIZE 100
+
+/** When a meter resource is worth updating. */
+struct ReportPolicyConfig {
+    MeterReading abs_deadband;      // change in meter units that triggers a report, 0 = off
+    MeterReading rel_deadband;      // change in percent of the last report, 0 = off
+    uint32_t min_interval_s;        // reports at least this far apart
+    uint32_t max_interval_s;        // report unchanged values after this long, 0 = never
+};
+
+/**
+ * Reporting policy of one meter resource.
+ *
+ * A reading is reported when it moved past the absolute or the relative
+ * deadband since the last report. With both deadbands off, any change
+ * counts. Nothing is reported within the minimum interval of the last
+ * report; a change held back that way goes out with the first reading
+ * after it. Once the maximum interval has passed, the next reading is
+ * reported even if unchanged, as a heartbeat.
+ */
+class ReportPolicy {
+public:
+    ReportPolicy();
+
+    void configure(const ReportPolicyConfig &config);
+
+    const ReportPolicyConfig &config() const
+    {
+        return _config;
+    }
+
+    /**
+     * Decide on a new reading. If it is to be reported, it becomes the
+     * reference for the next decisions.
+     * @return true if the reading should be reported
+     */
+    bool evaluate(const MeterReading &reading, uint32_t nowMs);
+
+    /** Readings held back so far. */
+    uint32_t suppressed() const
+    {
+        return _suppressed;
+    }
+
+private:
+    bool changed(const MeterReading &reading) const;
+
+    ReportPolicyConfig _config;
+    bool _reported;
+    MeterReading _last;
+    uint32_t _last_ms;
+    uint32_t _suppressed;
+};
+
+/**
+ * Parse a policy update: "meter,abs,rel,min,max", e.g. "2,0.01,0.5,60,3600".
+ * abs is in meter units, rel in percent, min and max in seconds.
+ * @param meter Set to the meter number, or -1 for "*" (all meters)
+ * @return false if the text is malformed
+ */
+bool report_policy_parse(const char *text, int &meter, ReportPolicyConfig &config);
+
+/**
+ * Text of a policy as report_policy_parse() reads it.
+ * @param meter Meter number, or -1 for "*"
+ * @param size Size of @p text, REPORT_POLICY_TEXT_SIZE is always enough
+ * @return Length of the text, 0 if it did not fit
+ */
+size_t report_policy_format(int meter, const ReportPolicyConfig &config, char *text, size_t size);
+
+#endif /* REPORT_POLICY_H */
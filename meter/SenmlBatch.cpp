@@ -0,0 +1,68 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "SenmlBatch.h"
+
+SenmlBatch::SenmlBatch(uint32_t windowMs, size_t expected)
+    : _window_ms(windowMs), _expected(expected), _count(0), _opened_ms(0)
+{
+    if ((0 == _expected) || (SENML_BATCH_MAX_RECORDS < _expected)) {
+        _expected = SENML_BATCH_MAX_RECORDS;
+    }
+}
+
+bool SenmlBatch::add(const char *name, const MeterReading &reading, uint32_t time, uint32_t nowMs)
+{
+    bool opened = (0 == _count);
+    size_t i = 0;
+
+    while ((i < _count) && (0 != strcmp(name, _records[i].name))) {
+        i++;
+    }
+    if (SENML_BATCH_MAX_RECORDS <= i) {
+        return false;
+    }
+    if (i == _count) {
+        _count++;
+    }
+
+    _records[i].name = name;
+    _records[i].reading = reading;
+    _records[i].time = time;
+
+    if (opened) {
+        _opened_ms = nowMs;
+    }
+    return opened;
+}
+
+bool SenmlBatch::due(uint32_t nowMs) const
+{
+    return (0 < _count) && ((_expected <= _count) || ((nowMs - _opened_ms) >= _window_ms));
+}
+
+size_t SenmlBatch::flush(const char *baseName, uint8_t *buffer, size_t size)
+{
+    size_t length = 0;
+
+    if (0 < _count) {
+        length = senml_cbor_encode(_records, _count, baseName, buffer, size);
+    }
+
+    _count = 0;
+    return length;
+}
@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SENML_BATCH_H
+#define SENML_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SenmlCbor.h"
+
+#define SENML_BATCH_MAX_RECORDS 8
+
+/**
+ * Collects the readings of one polling cycle into a single SenML pack.
+ *
+ * The first reading opens a flush window. The batch is due when the window
+ * has passed or when it holds a reading of every expected meter, whichever
+ * comes first. A second reading of the same meter within one batch replaces
+ * the first, so every meter appears at most once per pack.
+ *
+ * Names are not copied and must stay valid. Not thread safe.
+ */
+class SenmlBatch {
+public:
+    /**
+     * @param windowMs Time from the first reading to the flush at the latest
+     * @param expected Readings that complete a batch, at most SENML_BATCH_MAX_RECORDS
+     */
+    SenmlBatch(uint32_t windowMs, size_t expected);
+
+    /**
+     * Add a reading.
+     * @return true if it opened a new window
+     */
+    bool add(const char *name, const MeterReading &reading, uint32_t time, uint32_t nowMs);
+
+    /** true if the batch should be flushed now. */
+    bool due(uint32_t nowMs) const;
+
+    /**
+     * Encode the batch as SenML-CBOR and empty it.
+     * @return Number of bytes written, 0 if empty or @p size is too small
+     */
+    size_t flush(const char *baseName, uint8_t *buffer, size_t size);
+
+    size_t count() const
+    {
+        return _count;
+    }
+
+    uint32_t window() const
+    {
+        return _window_ms;
+    }
+
+private:
+    uint32_t _window_ms;
+    size_t _expected;
+
+    SenmlRecord _records[SENML_BATCH_MAX_RECORDS];
+    size_t _count;
+    uint32_t _opened_ms;
+};
+
+#endif /* SENML_BATCH_H */
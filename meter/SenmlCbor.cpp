@@ -0,0 +1,163 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "SenmlCbor.h"
+
+// CBOR major types
+#define CBOR_UNSIGNED   0
+#define CBOR_NEGATIVE   1
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_TAG        6
+
+#define CBOR_TAG_DECIMAL_FRACTION   4
+
+// SenML labels
+#define SENML_BASE_NAME -2
+#define SENML_BASE_TIME -3
+#define SENML_NAME      0
+#define SENML_UNIT      1
+#define SENML_VALUE     2
+#define SENML_TIME      6
+
+// Appends CBOR items, remembers an overflow instead of checking every call
+class CborWriter {
+public:
+    CborWriter(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _length(0), _overflow(false) {}
+
+    void head(uint8_t major, uint64_t value)
+    {
+        uint8_t bytes[9];
+        size_t count;
+
+        if (value < 24) {
+            bytes[0] = (uint8_t)((major << 5) | value);
+            count = 1;
+        }
+        else if (value <= 0xFF) {
+            bytes[0] = (uint8_t)((major << 5) | 24);
+            count = 2;
+        }
+        else if (value <= 0xFFFF) {
+            bytes[0] = (uint8_t)((major << 5) | 25);
+            count = 3;
+        }
+        else if (value <= 0xFFFFFFFFUL) {
+            bytes[0] = (uint8_t)((major << 5) | 26);
+            count = 5;
+        }
+        else {
+            bytes[0] = (uint8_t)((major << 5) | 27);
+            count = 9;
+        }
+        for (size_t i = 1; i < count; i++) {
+            bytes[i] = (uint8_t)(value >> (8 * (count - 1 - i)));
+        }
+        put(bytes, count);
+    }
+
+    void integer(int64_t value)
+    {
+        if (value < 0) {
+            head(CBOR_NEGATIVE, (uint64_t)(-1 - value));
+        }
+        else {
+            head(CBOR_UNSIGNED, (uint64_t)value);
+        }
+    }
+
+    void text(const char *value)
+    {
+        size_t length = strlen(value);
+        head(CBOR_TEXT, length);
+        put((const uint8_t *)value, length);
+    }
+
+    size_t length() const
+    {
+        return _overflow ? 0 : _length;
+    }
+
+private:
+    void put(const uint8_t *data, size_t size)
+    {
+        if (_size - _length < size) {
+            _overflow = true;
+            return;
+        }
+        memcpy(_buffer + _length, data, size);
+        _length += size;
+    }
+
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length;
+    bool _overflow;
+};
+
+size_t senml_cbor_encode(const SenmlRecord *records, size_t count, const char *baseName,
+                         uint8_t *buffer, size_t size)
+{
+    CborWriter cbor(buffer, size);
+
+    cbor.head(CBOR_ARRAY, count);
+
+    for (size_t i = 0; i < count; i++) {
+        const SenmlRecord &record = records[i];
+        const char *unit = meter_unit_name(record.reading.unit);
+        bool first = (0 == i);
+        bool hasBaseName = first && (NULL != baseName);
+        int32_t time = (int32_t)(record.time - records[0].time);
+
+        cbor.head(CBOR_MAP, 2 + (hasBaseName ? 1 : 0) + (first ? 1 : 0) + (('\0' != *unit) ? 1 : 0) + ((0 != time) ? 1 : 0));
+
+        if (hasBaseName) {
+            cbor.integer(SENML_BASE_NAME);
+            cbor.text(baseName);
+        }
+        if (first) {
+            cbor.integer(SENML_BASE_TIME);
+            cbor.integer(record.time);
+        }
+        cbor.integer(SENML_NAME);
+        cbor.text(record.name);
+        if ('\0' != *unit) {
+            cbor.integer(SENML_UNIT);
+            cbor.text(unit);
+        }
+
+        cbor.integer(SENML_VALUE);
+        if (0 == record.reading.exponent) {
+            cbor.integer(record.reading.value);
+        }
+        else {
+            // [exponent, mantissa]
+            cbor.head(CBOR_TAG, CBOR_TAG_DECIMAL_FRACTION);
+            cbor.head(CBOR_ARRAY, 2);
+            cbor.integer(record.reading.exponent);
+            cbor.integer(record.reading.value);
+        }
+
+        if (0 != time) {
+            cbor.integer(SENML_TIME);
+            cbor.integer(time);
+        }
+    }
+
+    return cbor.length();
+}
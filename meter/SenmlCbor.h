@@ -0,0 +1,45 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SENML_CBOR_H
+#define SENML_CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+/** One SenML record: a named reading at a time. */
+struct SenmlRecord {
+    const char *name;
+    MeterReading reading;
+    uint32_t time;          // seconds
+};
+
+/**
+ * Encode records as a SenML-CBOR pack (RFC 8428).
+ *
+ * The first record carries the base name, if any, and the base time; the
+ * others carry their time relative to it. Values keep their exponent as a
+ * CBOR decimal fraction (tag 4), so they stay exact; integral values are
+ * plain integers.
+ *
+ * @param baseName Prefix of every name, NULL for none
+ * @return Number of bytes written, 0 if @p size is too small
+ */
+size_t senml_cbor_encode(const SenmlRecord *records, size_t count, const char *baseName,
+                         uint8_t *buffer, size_t size);
+
+#endif /* SENML_CBOR_H */
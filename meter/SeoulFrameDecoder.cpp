@@ -0,0 +1,33 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "SeoulFrameDecoder.h"
+#include "MbusRecords.h"
+
+bool seoul_decode_reading(const uint8_t *frame, size_t length, MeterReading &reading)
+{
+    MbusRecordIterator records(frame, length);
+    MbusRecord record;
+
+    while (records.next(record)) {
+        if ((MBUS_QUANTITY_VOLUME != record.quantity) || (MBUS_FUNCTION_INSTANTANEOUS != record.function) ||
+            (0 != record.storage) || (0 != record.tariff) || (0 != record.subunit) || (0 != record.error)) {
+            continue;
+        }
+        // Gallons and cubic feet are not what the gateway reports
+        return mbus_record_value(record, reading) && (METER_UNIT_CUBIC_METRE == reading.unit);
+    }
+    return false;
+}
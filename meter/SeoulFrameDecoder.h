@@ -0,0 +1,54 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SEOUL_FRAME_DECODER_H
+#define SEOUL_FRAME_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterProtocol.h"
+#include "FrameDecoder.h"
+#include "MeterReading.h"
+
+/**
+ * M-Bus long frame returned by the Seoul water meter, of any L field length:
+ * 0x68 L L 0x68 C A CI data... CS 0x16. The checksum is the sum of C, A, CI
+ * and the user data. A C field with the top bit set cannot come from a
+ * meter, which rejects most false starts on the fifth byte.
+ */
+typedef FrameFormat<
+    FrameByte<SEOUL_RESPONSE_STX>,
+    FrameLength<SEOUL_RESPONSE_MIN_L_FIELD, SEOUL_RESPONSE_MAX_L_FIELD>,
+    FrameLengthCopy,
+    FrameByte<SEOUL_RESPONSE_STX>,
+    FrameRange<0x00, 0x7F>,                                     // C
+    FrameAny<2>,                                                // A, CI
+    FrameLengthData<SEOUL_RESPONSE_MIN_L_FIELD>,
+    FrameChecksum<FRAME_SUM8, SEOUL_RESPONSE_HEADER_LENGTH>,
+    FrameByte<SEOUL_RESPONSE_ETX>
+> SeoulResponseFrame;
+
+typedef FrameDecoder<SeoulResponseFrame> SeoulFrameDecoder;
+
+/**
+ * Volume reading of a Seoul water meter frame: the first record of the
+ * current volume in m3 (instantaneous, storage 0, no tariff or subunit),
+ * wherever it is in the telegram and in whatever coding and scale.
+ * @return false if the frame has no such record or its value is not valid
+ */
+bool seoul_decode_reading(const uint8_t *frame, size_t length, MeterReading &reading);
+
+#endif /* SEOUL_FRAME_DECODER_H */
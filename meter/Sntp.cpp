@@ -0,0 +1,80 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "Sntp.h"
+
+// First byte: leap indicator, version, mode
+#define SNTP_VERSION            4
+#define SNTP_MODE_CLIENT        3
+#define SNTP_MODE_SERVER        4
+#define SNTP_LEAP_UNSYNCED      3
+
+#define SNTP_ORIGINATE_OFFSET   24
+#define SNTP_TRANSMIT_OFFSET    40
+
+// Seconds from 1900, the NTP epoch, to 1970
+#define SNTP_UNIX_OFFSET        2208988800UL
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void write_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+size_t sntp_request(uint32_t nonce, uint8_t *packet, size_t size)
+{
+    if (SNTP_PACKET_SIZE > size) {
+        return 0;
+    }
+    memset(packet, 0, SNTP_PACKET_SIZE);
+    packet[0] = (SNTP_VERSION << 3) | SNTP_MODE_CLIENT;
+    // Only the fraction, a server reads nothing into it
+    write_u32(packet + SNTP_TRANSMIT_OFFSET + 4, nonce);
+    return SNTP_PACKET_SIZE;
+}
+
+bool sntp_parse(const uint8_t *packet, size_t length, uint32_t nonce, uint32_t &utc)
+{
+    if (SNTP_PACKET_SIZE > length) {
+        return false;
+    }
+
+    uint8_t leap = packet[0] >> 6;
+    uint8_t mode = packet[0] & 0x07;
+    uint8_t stratum = packet[1];
+    if ((SNTP_MODE_SERVER != mode) || (SNTP_LEAP_UNSYNCED == leap) || (0 == stratum) || (15 < stratum)) {
+        return false;
+    }
+    if ((0 != read_u32(packet + SNTP_ORIGINATE_OFFSET)) || (nonce != read_u32(packet + SNTP_ORIGINATE_OFFSET + 4))) {
+        return false;
+    }
+
+    uint32_t seconds = read_u32(packet + SNTP_TRANSMIT_OFFSET);
+    if (0 == seconds) {
+        return false;
+    }
+    // Wraps into era 1 in 2036 like the NTP time itself
+    utc = seconds - SNTP_UNIX_OFFSET;
+    return true;
+}
@@ -0,0 +1,40 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SNTP_H
+#define SNTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNTP_PORT           123
+#define SNTP_PACKET_SIZE    48
+
+/**
+ * Build an SNTP client request (RFC 4330).
+ * @param nonce Sent as the transmit time; the server echoes it, which ties the answer to this request
+ * @return SNTP_PACKET_SIZE, or 0 if @p size is too small
+ */
+size_t sntp_request(uint32_t nonce, uint8_t *packet, size_t size);
+
+/**
+ * Time of an SNTP server answer.
+ * @param nonce The one given to sntp_request()
+ * @param utc Set to the server's transmit time, in seconds since 1970
+ * @return false if it is not a synchronised server's answer to that request
+ */
+bool sntp_parse(const uint8_t *packet, size_t length, uint32_t nonce, uint32_t &utc);
+
+#endif /* SNTP_H */
@@ -0,0 +1,171 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef SPSC_BYTE_RING_H
+#define SPSC_BYTE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+/**
+ * Single-producer/single-consumer byte ring for handing received bytes
+ * from an interrupt to a thread.
+ *
+ * Neither side takes a lock. The producer only writes the head index and
+ * the consumer only writes the tail index, both free running and published
+ * with release/acquire ordering. When the ring is full, new bytes are
+ * dropped and counted. Bytes already queued are never overwritten.
+ *
+ * @tparam Size Capacity in bytes, a power of two
+ */
+template <size_t Size>
+class SpscByteRing {
+    static_assert((0 < Size) && (0 == (Size & (Size - 1))), "SpscByteRing size must be a power of two");
+    static_assert(Size <= 0x80000000UL, "SpscByteRing size must fit the 32-bit indices");
+
+public:
+    SpscByteRing() : _head(0), _tail(0), _overflows(0) {}
+
+    /**
+     * Drop everything queued and clear the overflow count.
+     * Neither side may be active while this runs.
+     */
+    void reset()
+    {
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+        _overflows.store(0, std::memory_order_relaxed);
+    }
+
+    /** Producer: queue one byte. @return false if it was dropped */
+    bool push(uint8_t data)
+    {
+        return 1 == push(&data, 1);
+    }
+
+    /**
+     * Producer: queue a block of bytes.
+     * @return Number of bytes queued, the rest were dropped and counted
+     */
+    size_t push(const uint8_t *data, size_t size)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        size_t space = Size - (uint32_t)(head - tail);
+
+        if (size > space) {
+            _overflows.store(_overflows.load(std::memory_order_relaxed) + (uint32_t)(size - space), std::memory_order_relaxed);
+            size = space;
+        }
+
+        size_t offset = head & (Size - 1);
+        size_t first = Size - offset;
+        if (first > size) {
+            first = size;
+        }
+        memcpy(_data + offset, data, first);
+        memcpy(_data, data + first, size - first);
+
+        _head.store(head + (uint32_t)size, std::memory_order_release);
+        return size;
+    }
+
+    /**
+     * Consumer: look at the queued bytes without removing them.
+     * They are returned as up to two contiguous regions because the data
+     * may wrap around the end of the storage.
+     * @return Total number of bytes in both regions
+     */
+    size_t peek(const uint8_t *&first, size_t &firstSize, const uint8_t *&second, size_t &secondSize) const
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t head = _head.load(std::memory_order_acquire);
+        size_t used = (uint32_t)(head - tail);
+        size_t offset = tail & (Size - 1);
+
+        first = _data + offset;
+        firstSize = Size - offset;
+        if (firstSize > used) {
+            firstSize = used;
+        }
+        second = _data;
+        secondSize = used - firstSize;
+
+        return used;
+    }
+
+    /** Consumer: remove @p size bytes previously returned by peek(). */
+    void commit(size_t size)
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + (uint32_t)size, std::memory_order_release);
+    }
+
+    /**
+     * Consumer: copy out and remove up to @p size bytes.
+     * @return Number of bytes copied
+     */
+    size_t pop(uint8_t *data, size_t size)
+    {
+        const uint8_t *first;
+        const uint8_t *second;
+        size_t firstSize;
+        size_t secondSize;
+
+        peek(first, firstSize, second, secondSize);
+        if (firstSize > size) {
+            firstSize = size;
+        }
+        if (secondSize > (size - firstSize)) {
+            secondSize = size - firstSize;
+        }
+        memcpy(data, first, firstSize);
+        memcpy(data + firstSize, second, secondSize);
+
+        commit(firstSize + secondSize);
+        return firstSize + secondSize;
+    }
+
+    /** Number of queued bytes, exact only when called from one of the sides. */
+    size_t size() const
+    {
+        return (uint32_t)(_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire));
+    }
+
+    bool empty() const
+    {
+        return 0 == size();
+    }
+
+    /** Number of bytes dropped because the ring was full. */
+    uint32_t overflows() const
+    {
+        return _overflows.load(std::memory_order_relaxed);
+    }
+
+    static size_t capacity()
+    {
+        return Size;
+    }
+
+private:
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _overflows;
+    uint8_t _data[Size];
+};
+
+#endif /* SPSC_BYTE_RING_H */
@@ -0,0 +1,87 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef STATIC_ARENA_H
+#define STATIC_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <utility>
+
+// Offsets of a list of types placed one after the other, each aligned
+template <size_t Offset, typename... Types>
+struct StaticArenaLayout {
+    static constexpr size_t end = Offset;
+};
+
+template <size_t Offset, typename T, typename... Rest>
+struct StaticArenaLayout<Offset, T, Rest...> {
+    typedef T type;
+    typedef StaticArenaLayout<((Offset + alignof(T) - 1) / alignof(T)) * alignof(T) + sizeof(T), Rest...> next;
+
+    static constexpr size_t offset = ((Offset + alignof(T) - 1) / alignof(T)) * alignof(T);
+    static constexpr size_t end = next::end;
+};
+
+// Slot I of a layout
+template <size_t I, typename Layout>
+struct StaticArenaSlot : StaticArenaSlot<I - 1, typename Layout::next> {};
+
+template <typename Layout>
+struct StaticArenaSlot<0, Layout> {
+    typedef typename Layout::type type;
+    static constexpr size_t offset = Layout::offset;
+};
+
+/**
+ * One statically allocated block holding one object of each of @p Types.
+ *
+ * The layout is worked out by the compiler, so size is a compile-time
+ * constant that can be checked with static_assert, and the block shows up
+ * as a single symbol in the linker map. Objects are constructed in place by
+ * create() and live for the rest of the program; they are never destroyed.
+ *
+ * @tparam Types Object types, addressed by their index in this list
+ */
+template <typename... Types>
+class StaticArena {
+    typedef StaticArenaLayout<0, Types...> Layout;
+
+public:
+    /** Bytes taken by all objects, padding included. */
+    static constexpr size_t size = Layout::end;
+
+    template <size_t I>
+    using type = typename StaticArenaSlot<I, Layout>::type;
+
+    /** Construct object @p I from @p args. Call once per object, before get(). */
+    template <size_t I, typename... Args>
+    type<I> &create(Args &&... args)
+    {
+        return *new (_storage + StaticArenaSlot<I, Layout>::offset) type<I>(std::forward<Args>(args)...);
+    }
+
+    template <size_t I>
+    type<I> &get()
+    {
+        return *reinterpret_cast<type<I> *>(_storage + StaticArenaSlot<I, Layout>::offset);
+    }
+
+private:
+    alignas(8) uint8_t _storage[(0 < size) ? size : 1];
+};
+
+#endif /* STATIC_ARENA_H */
@@ -0,0 +1,129 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef UART_RX_CHUNKER_H
+#define UART_RX_CHUNKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Why a chunk was handed over. */
+typedef enum {
+    RX_CHUNK_FULL = 0,      // chunk storage filled up
+    RX_CHUNK_END_BYTE,      // protocol end byte received
+    RX_CHUNK_IDLE           // line quiet for the idle time, chunk may be empty
+} RxChunkReason;
+
+/**
+ * Receives the chunks collected by a UartRxChunker.
+ * Runs in interrupt context on target.
+ */
+typedef void (*RxChunkHandler)(void *context, const uint8_t *data, size_t size, RxChunkReason reason);
+
+/**
+ * Groups received bytes into chunks on the interrupt side of a UART.
+ *
+ * The receive interrupt hands over whatever the UART FIFO (or DMA buffer)
+ * holds, and one idle timer per burst detects the end of the line activity.
+ * The parser thread is then woken once per chunk instead of once per byte.
+ *
+ * Both receive() and poll() run in interrupt context and must not preempt
+ * each other; the caller takes care of that.
+ */
+template <size_t ChunkSize>
+class UartRxChunker {
+public:
+    /**
+     * @param handler Called with every chunk
+     * @param context Passed back to @p handler
+     * @param endByte Byte that closes a chunk immediately, or -1 for none
+     * @param idleUs Quiet time after which a burst is considered over
+     */
+    UartRxChunker(RxChunkHandler handler, void *context, int endByte, uint32_t idleUs)
+        : _handler(handler), _context(context), _end_byte(endByte), _idle_us(idleUs),
+          _last_rx_us(0), _timer_armed(false), _length(0)
+    {
+    }
+
+    uint32_t idle_time() const
+    {
+        return _idle_us;
+    }
+
+    /**
+     * Take bytes read from the UART.
+     * @param data Received bytes
+     * @param size Number of bytes in @p data
+     * @param nowUs Current time in microseconds
+     * @return true if the idle timer has to be started for idle_time()
+     */
+    bool receive(const uint8_t *data, size_t size, uint32_t nowUs)
+    {
+        _last_rx_us = nowUs;
+
+        for (size_t i = 0; i < size; i++) {
+            _chunk[_length++] = data[i];
+            if ((int)data[i] == _end_byte) {
+                flush(RX_CHUNK_END_BYTE);
+            }
+            else if (ChunkSize == _length) {
+                flush(RX_CHUNK_FULL);
+            }
+        }
+
+        if (_timer_armed) {
+            return false;
+        }
+        _timer_armed = true;
+        return true;
+    }
+
+    /**
+     * Idle timer expiry.
+     * @param nowUs Current time in microseconds
+     * @return Microseconds until the timer has to fire again, 0 to stop it
+     */
+    uint32_t poll(uint32_t nowUs)
+    {
+        uint32_t quiet = nowUs - _last_rx_us;
+
+        if (quiet < _idle_us) {
+            return _idle_us - quiet;
+        }
+
+        _timer_armed = false;
+        flush(RX_CHUNK_IDLE);
+        return 0;
+    }
+
+private:
+    void flush(RxChunkReason reason)
+    {
+        _handler(_context, _chunk, _length, reason);
+        _length = 0;
+    }
+
+    RxChunkHandler _handler;
+    void *_context;
+    int _end_byte;
+    uint32_t _idle_us;
+
+    uint32_t _last_rx_us;
+    bool _timer_armed;
+    size_t _length;
+    uint8_t _chunk[ChunkSize];
+};
+
+#endif /* UART_RX_CHUNKER_H */
@@ -0,0 +1,162 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef UART_TX_QUEUE_H
+#define UART_TX_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "SpscByteRing.h"
+
+/**
+ * Completion of a frame written to a UartTxQueue.
+ * @param context User pointer given to write()
+ */
+typedef void (*UartTxDoneFn)(void *context);
+
+/** Completion to run once the last byte of a frame was taken. */
+struct UartTxCompletion {
+    UartTxDoneFn done;      // NULL if the byte did not end a frame
+    void *context;
+};
+
+/**
+ * Transmit queue of one UART, filled by a thread and emptied by the TX
+ * interrupt.
+ *
+ * Frames are written whole and binary, so 0x00 bytes go out like any other.
+ * write() never waits: it queues the frame or fails at once. The interrupt
+ * takes the bytes one at a time with next(), which also hands back the
+ * frame's completion when its last byte is taken. The caller decides where
+ * the completion runs, normally by posting it to a thread.
+ *
+ * Single producer and single consumer, no locks, like SpscByteRing.
+ *
+ * @tparam Size Capacity in bytes, a power of two
+ * @tparam MaxFrames Frames queued at the same time, a power of two
+ */
+template <size_t Size, size_t MaxFrames = 8>
+class UartTxQueue {
+    static_assert((0 < MaxFrames) && (0 == (MaxFrames & (MaxFrames - 1))), "UartTxQueue frame count must be a power of two");
+
+public:
+    UartTxQueue() : _frame_head(0), _frame_tail(0), _remaining(0), _rejected(0)
+    {
+        _current.done = NULL;
+        _current.context = NULL;
+    }
+
+    /**
+     * Drop everything queued.
+     * Neither side may be active while this runs.
+     */
+    void reset()
+    {
+        _bytes.reset();
+        _frame_head.store(0, std::memory_order_relaxed);
+        _frame_tail.store(0, std::memory_order_relaxed);
+        _remaining = 0;
+        _rejected = 0;
+    }
+
+    /**
+     * Producer: queue one frame.
+     * @param done Called with @p context once the frame was handed to the UART, may be NULL
+     * @return false if there is no room for the whole frame, nothing is queued then
+     */
+    bool write(const uint8_t *data, size_t size, UartTxDoneFn done = NULL, void *context = NULL)
+    {
+        uint32_t head = _frame_head.load(std::memory_order_relaxed);
+        uint32_t tail = _frame_tail.load(std::memory_order_acquire);
+
+        if ((0 == size) || (MaxFrames <= (uint32_t)(head - tail)) || ((Size - _bytes.size()) < size)) {
+            _rejected++;
+            return false;
+        }
+
+        _bytes.push(data, size);
+
+        // Published after the bytes, so the consumer never sees a frame without them
+        Frame &frame = _frames[head & (MaxFrames - 1)];
+        frame.size = size;
+        frame.completion.done = done;
+        frame.completion.context = context;
+        _frame_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Consumer: take the next byte to send.
+     * @param completion Set to the frame's completion if @p ch ends it, else done is NULL
+     * @return false if nothing is queued
+     */
+    bool next(uint8_t &ch, UartTxCompletion &completion)
+    {
+        completion.done = NULL;
+
+        if (0 == _remaining) {
+            uint32_t tail = _frame_tail.load(std::memory_order_relaxed);
+            if (tail == _frame_head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            const Frame &frame = _frames[tail & (MaxFrames - 1)];
+            _remaining = frame.size;
+            _current = frame.completion;
+            _frame_tail.store(tail + 1, std::memory_order_release);
+        }
+
+        _bytes.pop(&ch, 1);
+        if (0 == --_remaining) {
+            completion = _current;
+        }
+        return true;
+    }
+
+    /** true if no frame is queued or being sent. */
+    bool idle() const
+    {
+        return _bytes.empty();
+    }
+
+    /** Number of frames write() refused. */
+    uint32_t rejected() const
+    {
+        return _rejected;
+    }
+
+private:
+    struct Frame {
+        size_t size;
+        UartTxCompletion completion;
+    };
+
+    SpscByteRing<Size> _bytes;
+
+    Frame _frames[MaxFrames];
+    std::atomic<uint32_t> _frame_head;
+    std::atomic<uint32_t> _frame_tail;
+
+    // Consumer side only
+    size_t _remaining;
+    UartTxCompletion _current;
+
+    // Producer side only
+    uint32_t _rejected;
+};
+
+#endif /* UART_TX_QUEUE_H */
@@ -0,0 +1,144 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <string.h>
+
+#include "UplinkScheduler.h"
+
+// true if time a is at or after time b, across wrap-around
+static inline bool time_reached(uint32_t a, uint32_t b)
+{
+    return 0 <= (int32_t)(a - b);
+}
+
+UplinkScheduler::UplinkScheduler()
+    : _started_ms(0), _count(0), _urgent(false), _radio_used(false), _radio_off_ms(0)
+{
+    memset(&_window, 0, sizeof(_window));
+    memset(&_radio, 0, sizeof(_radio));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void UplinkScheduler::configure(const UplinkWindow &window, const RadioProfile &radio, uint32_t nowMs)
+{
+    _window = window;
+    _radio = radio;
+    _started_ms = nowMs;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool UplinkScheduler::in_window(uint32_t nowMs) const
+{
+    if (0 == _window.period_ms) {
+        return true;
+    }
+    return ((nowMs - _started_ms) % _window.period_ms) < _window.length_ms;
+}
+
+uint32_t UplinkScheduler::until_window(uint32_t nowMs) const
+{
+    if (in_window(nowMs)) {
+        return 0;
+    }
+    return _window.period_ms - ((nowMs - _started_ms) % _window.period_ms);
+}
+
+bool UplinkScheduler::awake(uint32_t nowMs) const
+{
+    return in_window(nowMs) || (_radio_used && !time_reached(nowMs, _radio_off_ms));
+}
+
+bool UplinkScheduler::submit(UplinkSendFn send, void *context, bool urgent, uint32_t nowMs)
+{
+    (void)nowMs;
+
+    for (size_t i = 0; i < _count; i++) {
+        if ((send == _entries[i].send) && (context == _entries[i].context)) {
+            _stats.coalesced++;
+            _urgent |= urgent;
+            return true;
+        }
+    }
+
+    if ((UPLINK_MAX_PENDING <= _count) || (NULL == send)) {
+        _stats.dropped++;
+        return false;
+    }
+
+    _entries[_count].send = send;
+    _entries[_count].context = context;
+    _count++;
+    _urgent |= urgent;
+    _stats.queued++;
+    return true;
+}
+
+uint32_t UplinkScheduler::run(uint32_t nowMs)
+{
+    if (0 == _count) {
+        return 0;
+    }
+
+    if (!_urgent && !awake(nowMs)) {
+        return until_window(nowMs);
+    }
+
+    _stats.bursts++;
+    if (!in_window(nowMs) && _urgent) {
+        _stats.urgent++;
+    }
+
+    // Copy out first: a send function may submit again
+    Entry burst[UPLINK_MAX_PENDING];
+    size_t count = _count;
+    memcpy(burst, _entries, count * sizeof(Entry));
+    _count = 0;
+    _urgent = false;
+
+    activity(nowMs, (uint32_t)count);
+    for (size_t i = 0; i < count; i++) {
+        burst[i].send(burst[i].context);
+    }
+
+    return (0 < _count) ? 1 : 0;
+}
+
+void UplinkScheduler::activity(uint32_t nowMs, uint32_t messages)
+{
+    bool connected = _radio_used && !time_reached(nowMs, _radio_off_ms);
+    uint32_t off = nowMs + (connected ? 0 : _radio.wake_ms) + (messages * _radio.message_ms) + _radio.tail_ms;
+
+    _stats.messages += messages;
+    if (!connected) {
+        _stats.wakeups++;
+        _stats.radio_on_ms += off - nowMs;
+        _radio_off_ms = off;
+    }
+    else if (time_reached(off, _radio_off_ms)) {
+        _stats.radio_on_ms += off - _radio_off_ms;
+        _radio_off_ms = off;
+    }
+    _radio_used = true;
+}
+
+uint32_t UplinkScheduler::radio_on_per_day(uint32_t nowMs) const
+{
+    uint32_t elapsed = nowMs - _started_ms;
+
+    if (0 == elapsed) {
+        return 0;
+    }
+    return (uint32_t)((_stats.radio_on_ms * 86400000ULL) / elapsed);
+}
@@ -0,0 +1,136 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef UPLINK_SCHEDULER_H
+#define UPLINK_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UPLINK_MAX_PENDING  16
+
+/**
+ * Sends one queued notification, e.g. by setting a resource value.
+ * @param context User pointer given to submit()
+ */
+typedef void (*UplinkSendFn)(void *context);
+
+/** When the radio is expected to be up anyway. */
+struct UplinkWindow {
+    uint32_t period_ms;     // distance between wake windows, 0 = send right away
+    uint32_t length_ms;     // how long each window stays open
+};
+
+/** Cost of a transmission, for the radio-on estimate. */
+struct RadioProfile {
+    uint32_t wake_ms;       // connection setup from idle
+    uint32_t message_ms;    // airtime of one notification
+    uint32_t tail_ms;       // inactivity time before the network releases the connection
+};
+
+/** Counters of the scheduler. */
+struct UplinkStats {
+    uint32_t queued;        // submit() calls accepted
+    uint32_t coalesced;     // submits merged into one already pending
+    uint32_t dropped;       // submits refused, queue full
+    uint32_t bursts;        // times the queue was sent
+    uint32_t urgent;        // bursts started outside a window
+    uint32_t messages;      // notifications sent
+    uint32_t wakeups;       // transmissions that found the radio idle
+    uint64_t radio_on_ms;   // estimated connected time
+};
+
+/**
+ * Holds outgoing notifications until the radio is up and sends them in one
+ * burst.
+ *
+ * The queue is sent when a wake window opens, right away while the radio is
+ * still connected after an earlier transmission, or at once when an urgent
+ * notification is submitted. A notification submitted again while pending
+ * is sent once, so its send function should publish the latest value.
+ *
+ * Windows repeat every period_ms from configure(). The radio-on time is
+ * estimated from the RadioProfile: every transmission that finds the radio
+ * idle pays the wake time, and the connection is held for the tail time
+ * after the last message.
+ *
+ * Time is passed in by the caller and may wrap; the scheduler never blocks.
+ * Not thread safe.
+ */
+class UplinkScheduler {
+public:
+    UplinkScheduler();
+
+    void configure(const UplinkWindow &window, const RadioProfile &radio, uint32_t nowMs);
+
+    /**
+     * Queue a notification. Call run() afterwards.
+     * @param urgent Send without waiting for the window
+     * @return false if the queue is full
+     */
+    bool submit(UplinkSendFn send, void *context, bool urgent, uint32_t nowMs);
+
+    /**
+     * Send the queue if the radio is up or an urgent notification waits.
+     * @return Milliseconds until run() needs to be called again, 0 if idle
+     */
+    uint32_t run(uint32_t nowMs);
+
+    /**
+     * Record a transmission made outside the scheduler, so that it counts
+     * for the estimate and later notifications can use the connection.
+     */
+    void activity(uint32_t nowMs, uint32_t messages);
+
+    /** true if sending now costs no extra wake-up. */
+    bool awake(uint32_t nowMs) const;
+
+    /** Estimated radio-on milliseconds per day, from the time since configure(). */
+    uint32_t radio_on_per_day(uint32_t nowMs) const;
+
+    size_t pending() const
+    {
+        return _count;
+    }
+
+    const UplinkStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    struct Entry {
+        UplinkSendFn send;
+        void *context;
+    };
+
+    bool in_window(uint32_t nowMs) const;
+    uint32_t until_window(uint32_t nowMs) const;
+
+    UplinkWindow _window;
+    RadioProfile _radio;
+    uint32_t _started_ms;
+
+    Entry _entries[UPLINK_MAX_PENDING];
+    size_t _count;
+    bool _urgent;
+
+    bool _radio_used;
+    uint32_t _radio_off_ms;
+
+    UplinkStats _stats;
+};
+
+#endif /* UPLINK_SCHEDULER_H */
@@ -0,0 +1,489 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__MBED__)
+#include "platform/mbed_retarget.h"     // opendir() and mkdir() on the mbed file systems
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "ForwardQueue.h"
+
+static_assert(24 == sizeof(ForwardEntry), "ForwardEntry is the on-flash record layout");
+
+#define FORWARD_QUEUE_CURSOR_FILE   "acked.dat"
+
+// Segment file name: 8 hex digits of the segment number and this suffix
+#define FORWARD_QUEUE_SUFFIX        ".fwd"
+
+static int last_error()
+{
+    return (0 != errno) ? -errno : -EIO;
+}
+
+// FNV-1a over everything but the check field
+static uint32_t entry_check(const ForwardEntry &entry)
+{
+    const uint8_t *bytes = (const uint8_t *)&entry.reading;
+    uint32_t hash = 2166136261UL ^ entry.seq;
+
+    for (size_t i = 0; i < sizeof(entry.reading); i++) {
+        hash = (hash ^ bytes[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+ForwardQueue::ForwardQueue(const char *directory, uint32_t capacity, ForwardSendFn send, void *context)
+    : _send(send), _context(context),
+      _batch_size(8), _interval_ms(2000), _ack_timeout_ms(30000), _max_attempts(0),
+      _head(1), _acked(0), _saved(0), _first_segment(0), _in_flight(0), _batch_first(0), _attempts(0),
+      _sent_ms(0), _next_ms(0), _backoff_ms(2000), _link(false), _pending_count(0)
+{
+    strncpy(_directory, directory, sizeof(_directory) - 1);
+    _directory[sizeof(_directory) - 1] = '\0';
+    memset(&_stats, 0, sizeof(_stats));
+
+    // Two at least, the newest segment is kept when it is all acknowledged
+    _max_segments = (capacity + FORWARD_QUEUE_SEGMENT_ENTRIES - 1) / FORWARD_QUEUE_SEGMENT_ENTRIES;
+    if (2 > _max_segments) {
+        _max_segments = 2;
+    }
+    if (FORWARD_QUEUE_MAX_SEGMENTS < _max_segments) {
+        _max_segments = FORWARD_QUEUE_MAX_SEGMENTS;
+    }
+}
+
+void ForwardQueue::configure(size_t batchSize, uint32_t intervalMs, uint32_t ackTimeoutMs, uint32_t maxAttempts)
+{
+    _batch_size = ((0 < batchSize) && (batchSize <= FORWARD_QUEUE_MAX_BATCH)) ? batchSize : FORWARD_QUEUE_MAX_BATCH;
+    _interval_ms = intervalMs;
+    _ack_timeout_ms = ackTimeoutMs;
+    _max_attempts = maxAttempts;
+    _backoff_ms = intervalMs;
+}
+
+void ForwardQueue::file_path(const char *name, char *buffer, size_t size) const
+{
+    snprintf(buffer, size, "%s/%s", _directory, name);
+}
+
+void ForwardQueue::segment_path(uint32_t segment, char *buffer, size_t size) const
+{
+    snprintf(buffer, size, "%s/%08lx" FORWARD_QUEUE_SUFFIX, _directory, (unsigned long)segment);
+}
+
+int ForwardQueue::open()
+{
+    char name[FORWARD_QUEUE_PATH_SIZE + 16];
+
+    _head = 1;
+    _acked = 0;
+    _in_flight = 0;
+    _batch_first = 0;
+    _attempts = 0;
+    _pending_count = 0;
+
+    errno = 0;
+    if ((0 != mkdir(_directory, 0777)) && (EEXIST != errno)) {
+        return last_error();
+    }
+
+    // Acknowledged position: the value and its complement
+    uint32_t cursor[2];
+    file_path(FORWARD_QUEUE_CURSOR_FILE, name, sizeof(name));
+    FILE *file = fopen(name, "rb");
+    if (NULL != file) {
+        if ((1 == fread(cursor, sizeof(cursor), 1, file)) && (cursor[0] == (uint32_t)~cursor[1])) {
+            _acked = cursor[0];
+        }
+        fclose(file);
+    }
+
+    DIR *dir = opendir(_directory);
+    if (NULL == dir) {
+        return last_error();
+    }
+
+    bool found = false;
+    uint32_t oldest = 0;
+    uint32_t newest = 0;
+    struct dirent *entry;
+    while (NULL != (entry = readdir(dir))) {
+        char *end;
+        uint32_t segment = (uint32_t)strtoul(entry->d_name, &end, 16);
+
+        if ((end == (entry->d_name + 8)) && (0 == strcmp(end, FORWARD_QUEUE_SUFFIX))) {
+            oldest = (!found || (segment < oldest)) ? segment : oldest;
+            newest = (!found || (segment > newest)) ? segment : newest;
+            found = true;
+        }
+    }
+    closedir(dir);
+
+    _first_segment = found ? oldest : (_acked / FORWARD_QUEUE_SEGMENT_ENTRIES);
+    if (found) {
+        // The readings before the oldest file are gone whatever the cursor says
+        if (oldest * FORWARD_QUEUE_SEGMENT_ENTRIES > _acked) {
+            _acked = oldest * FORWARD_QUEUE_SEGMENT_ENTRIES;
+        }
+
+        // A record cut short by a power loss is not counted; flush() starts a new segment after it
+        long size = 0;
+        segment_path(newest, name, sizeof(name));
+        file = fopen(name, "rb");
+        if (NULL != file) {
+            fseek(file, 0, SEEK_END);
+            size = ftell(file);
+            fclose(file);
+        }
+        _head = newest * FORWARD_QUEUE_SEGMENT_ENTRIES + (uint32_t)(size / sizeof(ForwardEntry)) + 1;
+    }
+    if (_head <= _acked) {
+        _head = _acked + 1;
+    }
+    _saved = _acked;
+
+    // Delete what was acknowledged, and what no longer fits
+    uint32_t acked = _acked;
+    _acked = 0;
+    advance(acked);
+    while ((1 < _head) && (_max_segments < segment_of(_head - 1) - _first_segment + 1)) {
+        int result = drop_oldest();
+        if (0 != result) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int ForwardQueue::write_cursor()
+{
+    char name[FORWARD_QUEUE_PATH_SIZE + 16];
+    uint32_t cursor[2] = { _acked, (uint32_t)~_acked };
+
+    file_path(FORWARD_QUEUE_CURSOR_FILE, name, sizeof(name));
+    errno = 0;
+    FILE *file = fopen(name, "wb");
+    if (NULL == file) {
+        return last_error();
+    }
+    size_t written = fwrite(cursor, sizeof(cursor), 1, file);
+    int closed = fclose(file);
+    _stats.writes++;
+
+    if ((1 != written) || (0 != closed)) {
+        return last_error();
+    }
+    _saved = _acked;
+    return 0;
+}
+
+void ForwardQueue::advance(uint32_t seq)
+{
+    char name[FORWARD_QUEUE_PATH_SIZE + 16];
+
+    if ((int32_t)(seq - _acked) <= 0) {
+        return;
+    }
+    _acked = seq;
+
+    // Segments all acknowledged go, but the newest one tells open() where to carry on
+    uint32_t keep = segment_of(_acked + 1);
+    if ((1 < _head) && (segment_of(_head - 1) < keep)) {
+        keep = segment_of(_head - 1);
+    }
+    while (_first_segment < keep) {
+        segment_path(_first_segment++, name, sizeof(name));
+        remove(name);
+    }
+
+    if (FORWARD_QUEUE_CURSOR_INTERVAL <= _acked - _saved) {
+        write_cursor();
+    }
+}
+
+int ForwardQueue::drop_oldest()
+{
+    char name[FORWARD_QUEUE_PATH_SIZE + 16];
+    segment_path(_first_segment, name, sizeof(name));
+
+    errno = 0;
+    if ((0 != remove(name)) && (ENOENT != errno)) {
+        return last_error();
+    }
+
+    uint32_t end = (_first_segment + 1) * FORWARD_QUEUE_SEGMENT_ENTRIES;
+    _first_segment++;
+    if ((int32_t)(end - _acked) > 0) {
+        uint32_t written = ((int32_t)(end - (_head - 1)) > 0) ? (_head - 1) : end;
+        if ((int32_t)(written - _acked) > 0) {
+            _stats.dropped += written - _acked;
+        }
+        _acked = end;
+    }
+
+    // The batch in flight or being retried may have gone with it
+    if ((0 != _in_flight) && ((int32_t)(_in_flight - _acked) <= 0)) {
+        _in_flight = 0;
+    }
+    if ((int32_t)(_batch_first - _acked) <= 0) {
+        _batch_first = 0;
+        _attempts = 0;
+    }
+    return 0;
+}
+
+int ForwardQueue::push(uint8_t meter, uint32_t timestamp, const MeterReading &reading)
+{
+    if (FORWARD_QUEUE_WRITE_BUFFER == _pending_count) {
+        int result = flush();
+        if (0 != result) {
+            return result;
+        }
+    }
+
+    StoredReading &record = _pending[_pending_count++];
+    record.value = reading.value;
+    record.timestamp = timestamp;
+    record.meter = meter;
+    record.exponent = reading.exponent;
+    record.unit = reading.unit;
+    record.reserved = 0;
+    _stats.queued++;
+
+    return (FORWARD_QUEUE_WRITE_BUFFER == _pending_count) ? flush() : 0;
+}
+
+int ForwardQueue::flush()
+{
+    ForwardEntry block[FORWARD_QUEUE_WRITE_BUFFER];
+    char name[FORWARD_QUEUE_PATH_SIZE + 16];
+
+    while (0 < _pending_count) {
+        uint32_t segment = segment_of(_head);
+        uint32_t slot = (_head - 1) % FORWARD_QUEUE_SEGMENT_ENTRIES;
+
+        while (_max_segments < segment - _first_segment + 1) {
+            int result = drop_oldest();
+            if (0 != result) {
+                return result;
+            }
+        }
+
+        segment_path(segment, name, sizeof(name));
+        errno = 0;
+        FILE *file = fopen(name, "ab");
+        if (NULL == file) {
+            return last_error();
+        }
+
+        // Records are found by number, after a torn one the rest of the segment is skipped
+        fseek(file, 0, SEEK_END);
+        if ((long)(slot * sizeof(ForwardEntry)) != ftell(file)) {
+            fclose(file);
+            _head = (segment + 1) * FORWARD_QUEUE_SEGMENT_ENTRIES + 1;
+            continue;
+        }
+
+        size_t size = FORWARD_QUEUE_SEGMENT_ENTRIES - slot;
+        if (size > _pending_count) {
+            size = _pending_count;
+        }
+        for (size_t i = 0; i < size; i++) {
+            memset(&block[i], 0, sizeof(block[i]));
+            block[i].seq = _head + (uint32_t)i;
+            block[i].reading = _pending[i];
+            block[i].check = entry_check(block[i]);
+        }
+
+        size_t written = fwrite(block, sizeof(ForwardEntry), size, file);
+        int closed = fclose(file);
+        _stats.writes++;
+
+        if (0 < written) {
+            _head += (uint32_t)written;
+            _pending_count -= written;
+            memmove(&_pending[0], &_pending[written], _pending_count * sizeof(StoredReading));
+        }
+        if ((written != size) || (0 != closed)) {
+            return last_error();
+        }
+    }
+
+    return 0;
+}
+
+void ForwardQueue::set_link(bool up, uint32_t nowMs)
+{
+    if (up && !_link) {
+        _next_ms = nowMs;
+        _backoff_ms = _interval_ms;
+    }
+    _link = up;
+    _in_flight = 0;
+}
+
+void ForwardQueue::failed(uint32_t nowMs, uint32_t last)
+{
+    _in_flight = 0;
+    _stats.failures++;
+
+    // Given up; the readings are still in the history
+    if ((0 != last) && (0 != _max_attempts) && (_max_attempts <= _attempts)) {
+        if ((int32_t)(last - _acked) > 0) {
+            _stats.abandoned += last - _acked;
+        }
+        advance(last);
+        _batch_first = 0;
+        _attempts = 0;
+        _backoff_ms = _interval_ms;
+        _next_ms = nowMs + _interval_ms;
+        return;
+    }
+
+    _next_ms = nowMs + _backoff_ms;
+    _backoff_ms = (_backoff_ms < (FORWARD_QUEUE_MAX_BACKOFF_MS / 2)) ? (_backoff_ms * 2) : FORWARD_QUEUE_MAX_BACKOFF_MS;
+}
+
+uint32_t ForwardQueue::run(uint32_t nowMs)
+{
+    if (!_link || (0 == backlog())) {
+        return 0;
+    }
+
+    if (0 != _in_flight) {
+        uint32_t elapsed = nowMs - _sent_ms;
+        if (elapsed < _ack_timeout_ms) {
+            return _ack_timeout_ms - elapsed;
+        }
+        failed(nowMs, _in_flight);
+    }
+
+    if ((int32_t)(nowMs - _next_ms) < 0) {
+        return _next_ms - nowMs;
+    }
+
+    if (0 != flush()) {
+        failed(nowMs, 0);
+        return _next_ms - nowMs;
+    }
+
+    ForwardEntry batch[FORWARD_QUEUE_MAX_BATCH];
+    char name[FORWARD_QUEUE_PATH_SIZE + 16];
+    size_t count = 0;
+
+    // Consecutive readings of one segment, read in one go
+    while ((0 == count) && (0 < backlog())) {
+        uint32_t seq = _acked + 1;
+        uint32_t segment = segment_of(seq);
+        uint32_t last = (segment + 1) * FORWARD_QUEUE_SEGMENT_ENTRIES;
+        if ((int32_t)(last - (_head - 1)) > 0) {
+            last = _head - 1;
+        }
+        size_t wanted = last - seq + 1;
+        if (wanted > _batch_size) {
+            wanted = _batch_size;
+        }
+
+        segment_path(segment, name, sizeof(name));
+        errno = 0;
+        FILE *file = fopen(name, "rb");
+        if ((NULL == file) && (ENOENT != errno)) {
+            failed(nowMs, 0);
+            return _next_ms - nowMs;
+        }
+        size_t got = 0;
+        if (NULL != file) {
+            if (0 == fseek(file, (long)(((seq - 1) % FORWARD_QUEUE_SEGMENT_ENTRIES) * sizeof(ForwardEntry)), SEEK_SET)) {
+                got = fread(batch, sizeof(ForwardEntry), wanted, file);
+            }
+            fclose(file);
+        }
+
+        while ((count < got) && (seq + count == batch[count].seq) && (batch[count].check == entry_check(batch[count]))) {
+            count++;
+        }
+        if ((0 == count) && (0 < got)) {
+            // Torn by a power loss, skip it for good
+            _stats.dropped++;
+            advance(seq);
+        }
+        else if (0 == count) {
+            // Never written, flush() went on to the next segment after a torn record
+            advance(last);
+        }
+    }
+
+    if (0 == count) {
+        return 0;
+    }
+
+    if (batch[0].seq != _batch_first) {
+        _batch_first = batch[0].seq;
+        _attempts = 0;
+    }
+    _attempts++;
+
+    if (!_send(_context, batch, count)) {
+        failed(nowMs, batch[count - 1].seq);
+        return _next_ms - nowMs;
+    }
+
+    _stats.batches++;
+    _in_flight = batch[count - 1].seq;
+    _sent_ms = nowMs;
+    _next_ms = nowMs + _interval_ms;
+    return _ack_timeout_ms;
+}
+
+void ForwardQueue::delivered(bool ok, uint32_t nowMs)
+{
+    if (0 == _in_flight) {
+        return;
+    }
+
+    if (!ok) {
+        failed(nowMs, _in_flight);
+        return;
+    }
+    acknowledge(_in_flight);
+}
+
+bool ForwardQueue::acknowledge(uint32_t seq)
+{
+    if ((0 == seq) || ((int32_t)(seq - (_head - 1)) > 0)) {
+        return false;
+    }
+
+    // Readings dropped meanwhile may already be past it
+    if ((int32_t)(seq - _acked) > 0) {
+        _stats.delivered += seq - _acked;
+        advance(seq);
+    }
+    if ((0 != _in_flight) && ((int32_t)(_in_flight - seq) <= 0)) {
+        _in_flight = 0;
+        _batch_first = 0;
+        _attempts = 0;
+        _backoff_ms = _interval_ms;
+    }
+    return true;
+}
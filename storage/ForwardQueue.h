@@ -0,0 +1,199 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef FORWARD_QUEUE_H
+#define FORWARD_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+#include "ReadingStore.h"
+
+#define FORWARD_QUEUE_MAX_BATCH         16
+#define FORWARD_QUEUE_MAX_SEGMENTS      16
+#define FORWARD_QUEUE_SEGMENT_ENTRIES   128     // 3 KiB per segment file
+#define FORWARD_QUEUE_WRITE_BUFFER      8       // readings held in RAM before a write
+#define FORWARD_QUEUE_CURSOR_INTERVAL   32      // acknowledged readings between two cursor writes
+#define FORWARD_QUEUE_PATH_SIZE         READING_STORE_PATH_SIZE
+
+// Longest wait between retries after failed deliveries
+#define FORWARD_QUEUE_MAX_BACKOFF_MS    (5 * 60 * 1000)
+
+/** One queued reading. seq counts up across reboots and is never reused. */
+struct ForwardEntry {
+    uint32_t seq;
+    uint32_t check;         // detects records torn by a power loss
+    StoredReading reading;
+};
+
+/**
+ * Sends a batch of readings upstream.
+ * @param context User pointer given to the queue constructor
+ * @return false if the batch could not be handed to the link
+ */
+typedef bool (*ForwardSendFn)(void *context, const ForwardEntry *entries, size_t count);
+
+/** Counters of the queue. */
+struct ForwardQueueStats {
+    uint32_t queued;
+    uint32_t batches;       // batches handed to the link
+    uint32_t delivered;     // readings acknowledged
+    uint32_t failures;      // batches failed or not acknowledged in time
+    uint32_t dropped;       // unsent readings deleted while the queue was full, or torn
+    uint32_t abandoned;     // readings given up after the last attempt
+    uint32_t writes;        // file writes, segments and cursor
+};
+
+/**
+ * Store-and-forward queue of readings for a link that comes and goes.
+ *
+ * Readings are numbered and appended to segment files of
+ * FORWARD_QUEUE_SEGMENT_ENTRIES records; reading n is record
+ * (n - 1) % FORWARD_QUEUE_SEGMENT_ENTRIES of segment
+ * (n - 1) / FORWARD_QUEUE_SEGMENT_ENTRIES, so files are only ever appended
+ * to, in blocks of up to FORWARD_QUEUE_WRITE_BUFFER readings, and deleted
+ * whole. A segment whose readings are all acknowledged is deleted; when
+ * the queue is full, the oldest one goes with its unsent readings. The
+ * highest acknowledged number is also written to a cursor file, every
+ * FORWARD_QUEUE_CURSOR_INTERVAL readings, so a reboot sends that many
+ * readings again at most. open() carries on where
+ * the queue stopped; readings still in the write buffer are lost on a
+ * power loss, like those of ReadingStore.
+ *
+ * While the link is up, run() sends the backlog in batches of consecutive
+ * readings, at least the send interval apart. A batch is acknowledged by
+ * delivered(), which needs a notification status and so an observer, or
+ * by acknowledge(), which the receiver can call through the link with the
+ * highest number it has, without observing. A batch not acknowledged in
+ * time is sent again with an exponential backoff, and given up after the
+ * configured number of attempts so the queue always drains; the readings
+ * are still in the ReadingStore history. The numbers let the receiver drop
+ * the duplicates this can produce.
+ *
+ * RAM use is one batch and the write buffer. Not thread safe.
+ */
+class ForwardQueue {
+public:
+    /**
+     * @param directory Directory of the queue files, e.g. "/fs/fwd"
+     * @param capacity Readings kept, rounded up to whole segments and at
+     *        most FORWARD_QUEUE_MAX_SEGMENTS of them
+     * @param send Sends one batch
+     * @param context Passed back to @p send
+     */
+    ForwardQueue(const char *directory, uint32_t capacity, ForwardSendFn send, void *context);
+
+    /**
+     * @param batchSize Readings per batch, at most FORWARD_QUEUE_MAX_BATCH
+     * @param intervalMs Time between two batches at least
+     * @param ackTimeoutMs Time a batch has to be acknowledged
+     * @param maxAttempts Sends of a batch before it is given up, 0 for no limit
+     */
+    void configure(size_t batchSize, uint32_t intervalMs, uint32_t ackTimeoutMs, uint32_t maxAttempts);
+
+    /**
+     * Create the directory if needed and recover the queue state from the files.
+     * @return 0 on success, negative error code otherwise
+     */
+    int open();
+
+    /**
+     * Queue a reading. It reaches the file on flush(), when the write
+     * buffer is full or before the next batch is sent.
+     * @return 0 on success, negative error code if a write failed
+     */
+    int push(uint8_t meter, uint32_t timestamp, const MeterReading &reading);
+
+    /**
+     * Write the buffered readings.
+     * @return 0 on success, negative error code otherwise
+     */
+    int flush();
+
+    /** Report whether the link is up. Going down abandons the batch in flight. */
+    void set_link(bool up, uint32_t nowMs);
+
+    /**
+     * Send the next batch if the link, the rate limit and the backlog allow.
+     * @return Milliseconds until run() needs to be called again, 0 if idle
+     */
+    uint32_t run(uint32_t nowMs);
+
+    /**
+     * Delivery status of the batch in flight.
+     * @param ok false if the link reported a delivery failure
+     */
+    void delivered(bool ok, uint32_t nowMs);
+
+    /**
+     * Acknowledge every reading up to @p seq, as reported by the receiver.
+     * @return false if @p seq was not sent yet
+     */
+    bool acknowledge(uint32_t seq);
+
+    /** Readings not acknowledged yet, buffered ones included. */
+    uint32_t backlog() const
+    {
+        return _head - 1 - _acked + (uint32_t)_pending_count;
+    }
+
+    const ForwardQueueStats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    void file_path(const char *name, char *buffer, size_t size) const;
+    void segment_path(uint32_t segment, char *buffer, size_t size) const;
+    int write_cursor();
+    int drop_oldest();
+    void advance(uint32_t seq);
+    void failed(uint32_t nowMs, uint32_t last);
+
+    static uint32_t segment_of(uint32_t seq)
+    {
+        return (seq - 1) / FORWARD_QUEUE_SEGMENT_ENTRIES;
+    }
+
+    char _directory[FORWARD_QUEUE_PATH_SIZE];
+    uint32_t _max_segments;
+    ForwardSendFn _send;
+    void *_context;
+
+    size_t _batch_size;
+    uint32_t _interval_ms;
+    uint32_t _ack_timeout_ms;
+    uint32_t _max_attempts;
+
+    uint32_t _head;         // number of the next reading written
+    uint32_t _acked;        // highest acknowledged number
+    uint32_t _saved;        // acknowledged number in the cursor file
+    uint32_t _first_segment;    // oldest segment file
+    uint32_t _in_flight;    // last number of the batch in flight, 0 if none
+    uint32_t _batch_first;  // first number of the last batch sent, 0 if none
+    uint32_t _attempts;     // sends of that batch
+    uint32_t _sent_ms;
+    uint32_t _next_ms;      // earliest time of the next batch
+    uint32_t _backoff_ms;
+    bool _link;
+
+    StoredReading _pending[FORWARD_QUEUE_WRITE_BUFFER];
+    size_t _pending_count;
+
+    ForwardQueueStats _stats;
+};
+
+#endif /* FORWARD_QUEUE_H */
@@ -0,0 +1,358 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__MBED__)
+#include "platform/mbed_retarget.h"     // opendir() and mkdir() on the mbed file systems
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "ReadingStore.h"
+
+static_assert(16 == sizeof(StoredReading), "StoredReading is the on-flash record layout");
+
+// Records read per file access while scanning a segment
+#define READING_STORE_READ_BLOCK    16
+
+// Segment file name: 8 hex digits of the id and this suffix
+#define READING_STORE_SUFFIX        ".seg"
+
+static int last_error()
+{
+    return (0 != errno) ? -errno : -EIO;
+}
+
+ReadingStore::ReadingStore(const char *directory, size_t maxSegments)
+    : _max_segments(maxSegments), _count(0), _next_id(0), _last_ts(0), _appending(false), _pending_count(0)
+{
+    strncpy(_directory, directory, sizeof(_directory) - 1);
+    _directory[sizeof(_directory) - 1] = '\0';
+
+    if ((0 == _max_segments) || (READING_STORE_MAX_SEGMENTS < _max_segments)) {
+        _max_segments = READING_STORE_MAX_SEGMENTS;
+    }
+}
+
+void ReadingStore::path(uint32_t id, char *buffer, size_t size) const
+{
+    snprintf(buffer, size, "%s/%08lx" READING_STORE_SUFFIX, _directory, (unsigned long)id);
+}
+
+int ReadingStore::open()
+{
+    _count = 0;
+    _next_id = 0;
+    _last_ts = 0;
+    _appending = false;
+    _pending_count = 0;
+
+    errno = 0;
+    if ((0 != mkdir(_directory, 0777)) && (EEXIST != errno)) {
+        return last_error();
+    }
+
+    DIR *dir = opendir(_directory);
+    if (NULL == dir) {
+        return last_error();
+    }
+
+    int result = 0;
+    struct dirent *entry;
+    while ((0 == result) && (NULL != (entry = readdir(dir)))) {
+        char *end;
+        unsigned long id = strtoul(entry->d_name, &end, 16);
+
+        if ((end == (entry->d_name + 8)) && (0 == strcmp(end, READING_STORE_SUFFIX))) {
+            result = load((uint32_t)id);
+        }
+    }
+    closedir(dir);
+
+    if (0 < _count) {
+        _next_id = _segments[_count - 1].id + 1;
+        _last_ts = _segments[_count - 1].last_ts;
+    }
+
+    return result;
+}
+
+int ReadingStore::load(uint32_t id)
+{
+    char name[READING_STORE_PATH_SIZE + 16];
+    path(id, name, sizeof(name));
+
+    FILE *file = fopen(name, "rb");
+    if (NULL == file) {
+        return last_error();
+    }
+
+    Segment segment;
+    StoredReading first;
+    StoredReading last;
+
+    // A record cut short by a power loss is ignored
+    fseek(file, 0, SEEK_END);
+    segment.id = id;
+    segment.records = (uint32_t)(ftell(file) / sizeof(StoredReading));
+
+    bool valid = (0 < segment.records) &&
+                 (0 == fseek(file, 0, SEEK_SET)) && (1 == fread(&first, sizeof(first), 1, file)) &&
+                 (0 == fseek(file, (long)((segment.records - 1) * sizeof(last)), SEEK_SET)) &&
+                 (1 == fread(&last, sizeof(last), 1, file));
+    fclose(file);
+
+    if (!valid) {
+        remove(name);
+        return 0;
+    }
+    segment.first_ts = first.timestamp;
+    segment.last_ts = last.timestamp;
+
+    if (_count == _max_segments) {
+        if (id < _segments[0].id) {
+            remove(name);
+            return 0;
+        }
+        int result = remove_oldest();
+        if (0 != result) {
+            return result;
+        }
+    }
+
+    // Directory order is arbitrary, keep the table sorted by id
+    size_t i = _count;
+    while ((0 < i) && (_segments[i - 1].id > id)) {
+        _segments[i] = _segments[i - 1];
+        i--;
+    }
+    _segments[i] = segment;
+    _count++;
+
+    return 0;
+}
+
+int ReadingStore::remove_oldest()
+{
+    char name[READING_STORE_PATH_SIZE + 16];
+    path(_segments[0].id, name, sizeof(name));
+
+    errno = 0;
+    if ((0 != remove(name)) && (ENOENT != errno)) {
+        return last_error();
+    }
+
+    _count--;
+    memmove(&_segments[0], &_segments[1], _count * sizeof(Segment));
+    if (0 == _count) {
+        _appending = false;
+    }
+    return 0;
+}
+
+int ReadingStore::append(uint8_t meter, uint32_t timestamp, const MeterReading &reading)
+{
+    if ((int32_t)(timestamp - _last_ts) < 0) {
+        return -EINVAL;
+    }
+    // Still full after a failed write
+    if (READING_STORE_WRITE_BUFFER == _pending_count) {
+        int result = flush();
+        if (0 != result) {
+            return result;
+        }
+    }
+    _last_ts = timestamp;
+
+    StoredReading &record = _pending[_pending_count++];
+    record.value = reading.value;
+    record.timestamp = timestamp;
+    record.meter = meter;
+    record.exponent = reading.exponent;
+    record.unit = reading.unit;
+    record.reserved = 0;
+
+    return (READING_STORE_WRITE_BUFFER == _pending_count) ? flush() : 0;
+}
+
+int ReadingStore::flush()
+{
+    while (0 < _pending_count) {
+        // Segments found by open() are never appended to, their tail may be torn
+        if (!_appending || (READING_STORE_SEGMENT_RECORDS <= _segments[_count - 1].records)) {
+            if (_count == _max_segments) {
+                int result = remove_oldest();
+                if (0 != result) {
+                    return result;
+                }
+            }
+            Segment &segment = _segments[_count++];
+            segment.id = _next_id++;
+            segment.first_ts = _pending[0].timestamp;
+            segment.last_ts = _pending[0].timestamp;
+            segment.records = 0;
+            _appending = true;
+        }
+
+        Segment &segment = _segments[_count - 1];
+        size_t size = READING_STORE_SEGMENT_RECORDS - segment.records;
+        if (size > _pending_count) {
+            size = _pending_count;
+        }
+
+        char name[READING_STORE_PATH_SIZE + 16];
+        path(segment.id, name, sizeof(name));
+
+        errno = 0;
+        FILE *file = fopen(name, "ab");
+        if (NULL == file) {
+            int result = last_error();
+            if (0 == segment.records) {
+                // Forget the new segment, the next flush retries it
+                _count--;
+                _next_id--;
+                _appending = (0 < _count);
+            }
+            return result;
+        }
+        size_t written = fwrite(_pending, sizeof(StoredReading), size, file);
+        int closed = fclose(file);
+
+        if (0 < written) {
+            segment.records += (uint32_t)written;
+            segment.last_ts = _pending[written - 1].timestamp;
+            _pending_count -= written;
+            memmove(&_pending[0], &_pending[written], _pending_count * sizeof(StoredReading));
+        }
+        if ((written != size) || (0 != closed)) {
+            return last_error();
+        }
+    }
+
+    return 0;
+}
+
+size_t ReadingStore::find_segment(uint32_t from) const
+{
+    size_t low = 0;
+    size_t high = _count;
+
+    // First segment that ends at or after from
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (_segments[middle].last_ts < from) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+size_t ReadingStore::query_segment(const Segment &segment, uint8_t meter, uint32_t from, uint32_t to,
+                                   StoredReadingFn visit, void *context, bool &stop)
+{
+    char name[READING_STORE_PATH_SIZE + 16];
+    path(segment.id, name, sizeof(name));
+
+    FILE *file = fopen(name, "rb");
+    if (NULL == file) {
+        return 0;
+    }
+
+    // First record at or after from
+    size_t low = 0;
+    size_t high = segment.records;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        StoredReading record;
+
+        if ((0 != fseek(file, (long)(middle * sizeof(record)), SEEK_SET)) || (1 != fread(&record, sizeof(record), 1, file))) {
+            fclose(file);
+            return 0;
+        }
+        if (record.timestamp < from) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    size_t visited = 0;
+    StoredReading block[READING_STORE_READ_BLOCK];
+
+    fseek(file, (long)(low * sizeof(StoredReading)), SEEK_SET);
+    while (!stop && (low < segment.records)) {
+        size_t count = fread(block, sizeof(StoredReading), READING_STORE_READ_BLOCK, file);
+        if (0 == count) {
+            break;
+        }
+        low += count;
+
+        for (size_t i = 0; (i < count) && !stop; i++) {
+            if (block[i].timestamp > to) {
+                stop = true;
+            }
+            else if ((READING_STORE_ALL_METERS == meter) || (meter == block[i].meter)) {
+                visited++;
+                stop = !visit(context, block[i]);
+            }
+        }
+    }
+    fclose(file);
+
+    return visited;
+}
+
+size_t ReadingStore::query(uint8_t meter, uint32_t from, uint32_t to, StoredReadingFn visit, void *context)
+{
+    size_t visited = 0;
+    bool stop = false;
+
+    flush();
+
+    for (size_t i = find_segment(from); !stop && (i < _count) && (_segments[i].first_ts <= to); i++) {
+        visited += query_segment(_segments[i], meter, from, to, visit, context, stop);
+    }
+
+    return visited;
+}
+
+size_t ReadingStore::expire(uint32_t before)
+{
+    size_t removed = 0;
+
+    while ((0 < _count) && (_segments[0].last_ts < before) && (0 == remove_oldest())) {
+        removed++;
+    }
+    return removed;
+}
+
+uint32_t ReadingStore::records() const
+{
+    uint32_t total = (uint32_t)_pending_count;
+
+    for (size_t i = 0; i < _count; i++) {
+        total += _segments[i].records;
+    }
+    return total;
+}
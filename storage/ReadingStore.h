@@ -0,0 +1,149 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef READING_STORE_H
+#define READING_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+#define READING_STORE_MAX_SEGMENTS      64
+#define READING_STORE_SEGMENT_RECORDS   256     // 4 KiB per segment file
+#define READING_STORE_WRITE_BUFFER      8       // records held in RAM before a write
+#define READING_STORE_PATH_SIZE         48
+
+// query() meter filter that matches every meter
+#define READING_STORE_ALL_METERS        0xFF
+
+/** One reading as it is kept in the segment files. */
+struct StoredReading {
+    int64_t value;
+    uint32_t timestamp;     // seconds
+    uint8_t meter;
+    int8_t exponent;
+    uint8_t unit;
+    uint8_t reserved;
+};
+
+/**
+ * Receives the readings found by a query.
+ * @param context User pointer given to query()
+ * @return false to stop the query
+ */
+typedef bool (*StoredReadingFn)(void *context, const StoredReading &reading);
+
+/**
+ * Append-only time series of meter readings.
+ *
+ * Readings of all meters go into one stream of fixed-size records, split
+ * into segment files of READING_STORE_SEGMENT_RECORDS each. The time span
+ * of every segment is kept in RAM as a sparse index. A range query binary
+ * searches that index, then the records of the first segment, and reads on
+ * from there.
+ *
+ * When the segment limit is reached, the oldest segment is deleted;
+ * expire() drops segments past the retention time. RAM use is fixed by
+ * READING_STORE_MAX_SEGMENTS and READING_STORE_WRITE_BUFFER.
+ *
+ * Timestamps must not go backwards, the queries rely on a sorted stream.
+ * append() refuses an older one rather than storing it under a wrong time.
+ *
+ * Uses stdio only, so the same code runs on the device file system and on
+ * a host directory. Not thread safe.
+ */
+class ReadingStore {
+public:
+    /**
+     * @param directory Directory of the segment files, e.g. "/fs/ts"
+     * @param maxSegments Segment files kept, at most READING_STORE_MAX_SEGMENTS
+     */
+    ReadingStore(const char *directory, size_t maxSegments = READING_STORE_MAX_SEGMENTS);
+
+    /**
+     * Create the directory if needed and rebuild the index from the files.
+     * @return 0 on success, negative error code otherwise
+     */
+    int open();
+
+    /**
+     * Add a reading. It reaches the file on flush() or when the write
+     * buffer is full.
+     * @return 0 on success, -EINVAL if @p timestamp is older than the last
+     *         one, negative error code if a write failed
+     */
+    int append(uint8_t meter, uint32_t timestamp, const MeterReading &reading);
+
+    /**
+     * Write the buffered readings.
+     * @return 0 on success, negative error code otherwise
+     */
+    int flush();
+
+    /**
+     * Visit the readings of one meter, or all, between two times, oldest first.
+     * Flushes the write buffer first.
+     * @param meter Meter number, or READING_STORE_ALL_METERS
+     * @param from First timestamp included
+     * @param to Last timestamp included
+     * @return Number of readings visited
+     */
+    size_t query(uint8_t meter, uint32_t from, uint32_t to, StoredReadingFn visit, void *context);
+
+    /**
+     * Delete the segments whose readings are all older than @p before.
+     * @return Number of segments deleted
+     */
+    size_t expire(uint32_t before);
+
+    /** Number of stored readings, buffered ones included. */
+    uint32_t records() const;
+
+    size_t segments() const
+    {
+        return _count;
+    }
+
+private:
+    struct Segment {
+        uint32_t id;
+        uint32_t first_ts;
+        uint32_t last_ts;
+        uint32_t records;
+    };
+
+    void path(uint32_t id, char *buffer, size_t size) const;
+    int load(uint32_t id);
+    int remove_oldest();
+    size_t find_segment(uint32_t from) const;
+    size_t query_segment(const Segment &segment, uint8_t meter, uint32_t from, uint32_t to,
+                         StoredReadingFn visit, void *context, bool &stop);
+
+    char _directory[READING_STORE_PATH_SIZE];
+    size_t _max_segments;
+
+    // Sorted by id, which is also time order
+    Segment _segments[READING_STORE_MAX_SEGMENTS];
+    size_t _count;
+    uint32_t _next_id;
+    uint32_t _last_ts;
+    bool _appending;        // the last segment was created by this instance
+
+    StoredReading _pending[READING_STORE_WRITE_BUFFER];
+    size_t _pending_count;
+};
+
+#endif /* READING_STORE_H */
@@ -0,0 +1,51 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#include "UnstampedReadings.h"
+
+UnstampedReadings::UnstampedReadings()
+    : _first(0), _count(0), _dropped(0)
+{
+}
+
+void UnstampedReadings::add(uint8_t meter, uint32_t uptimeMs, const MeterReading &reading)
+{
+    if (UNSTAMPED_READINGS_SIZE == _count) {
+        _first = (_first + 1) % UNSTAMPED_READINGS_SIZE;
+        _count--;
+        _dropped++;
+    }
+
+    Held &held = _held[(_first + _count) % UNSTAMPED_READINGS_SIZE];
+    held.reading = reading;
+    held.uptimeMs = uptimeMs;
+    held.meter = meter;
+    _count++;
+}
+
+size_t UnstampedReadings::stamp(uint32_t utc, uint32_t uptimeMs, StampedReadingFn fn, void *context)
+{
+    size_t stamped = _count;
+
+    while (0 < _count) {
+        const Held &held = _held[_first];
+        uint32_t age = (uptimeMs - held.uptimeMs) / 1000;
+        fn(context, held.meter, utc - age, held.reading);
+        _first = (_first + 1) % UNSTAMPED_READINGS_SIZE;
+        _count--;
+    }
+    _first = 0;
+    return stamped;
+}
@@ -0,0 +1,80 @@
+// ----------------------------------------------------------------------------
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef UNSTAMPED_READINGS_H
+#define UNSTAMPED_READINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MeterReading.h"
+
+#define UNSTAMPED_READINGS_SIZE     32
+
+/**
+ * Receives a held reading with its wall-clock time.
+ * @param context User pointer given to stamp()
+ */
+typedef void (*StampedReadingFn)(void *context, uint8_t meter, uint32_t timestamp, const MeterReading &reading);
+
+/**
+ * Readings taken before the real-time clock was set. They keep the uptime
+ * they were taken at and get their wall-clock time once the clock is
+ * known, counted back from it. When full, the oldest reading is dropped.
+ */
+class UnstampedReadings {
+public:
+    UnstampedReadings();
+
+    /**
+     * Hold a reading.
+     * @param uptimeMs Milliseconds since boot when it was taken
+     */
+    void add(uint8_t meter, uint32_t uptimeMs, const MeterReading &reading);
+
+    /**
+     * Hand every held reading, oldest first, to @p fn and forget them.
+     * @param utc Wall-clock time now, in seconds
+     * @param uptimeMs Milliseconds since boot now
+     * @return Number of readings handed over
+     */
+    size_t stamp(uint32_t utc, uint32_t uptimeMs, StampedReadingFn fn, void *context);
+
+    /** Readings held. */
+    size_t count() const
+    {
+        return _count;
+    }
+
+    /** Readings dropped because the buffer was full. */
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+private:
+    struct Held {
+        MeterReading reading;
+        uint32_t uptimeMs;
+        uint8_t meter;
+    };
+
+    Held _held[UNSTAMPED_READINGS_SIZE];
+    size_t _first;
+    size_t _count;
+    uint32_t _dropped;
+};
+
+#endif /* UNSTAMPED_READINGS_H */